@@ -6,6 +6,10 @@
 
 #include "ev3api.h"
 #include "app.h"
+#include "lppb.h"
+#include "path_stream.h"
+#include "planner.h"
+#include "setpoint.h"
 #include "math.h"
 #include <unistd.h>
 #include <ctype.h>
@@ -42,31 +46,21 @@ n
 e
 */
 
-#define A4_WIDTH_MM (210.0)
-#define A4_HEIGHT_MM (297.0)
-
-#define Y0_MOTOR_PORT (EV3_PORT_A) // 右Lモーター
-#define Y1_MOTOR_PORT (EV3_PORT_B) // 左Lモーター
-#define X_MOTOR_PORT (EV3_PORT_C) // 左Mモーター
-#define PEN_MOTOR_PORT (EV3_PORT_D) // 右Mモーター
-
-#define PEN_BETWEEN_HALF_DEG (5474.0 * 0.5) // deg
-
 float x = 0, y = 0; // Current position(mm)
 
 //const float y_mm_to_deg = (2586.0 + 2096.0) / 275.5;
-const float y_mm_to_deg = (25.5 + 4624) / 274.5;
-const float x_mm_to_deg = (8620.0 + 17910.0) / 195.3;
+#define Y_MM_TO_DEG ((25.5 + 4624) / 274.5)
+#define X_MM_TO_DEG ((8620.0 + 17910.0) / 195.3)
+const float y_mm_to_deg = Y_MM_TO_DEG;
+const float x_mm_to_deg = X_MM_TO_DEG;
+// 制御周期ごとの計算用 (1/65536 単位)
+#define MM_TO_DEG_SHIFT (16)
+const int32_t y_mm_to_deg_fix = (int32_t)(Y_MM_TO_DEG * (1 << MM_TO_DEG_SHIFT) + 0.5);
+const int32_t x_mm_to_deg_fix = (int32_t)(X_MM_TO_DEG * (1 << MM_TO_DEG_SHIFT) + 0.5);
 
 const float y_adjust_speed_mm_per_sec = 10.0;
 const float x_adjust_speed_mm_per_sec = 10.0;
 
-typedef enum {
-	LEFT_PEN = -1,
-	RIGHT_PEN = 1,
-	CENTER = 0 // pen is not used
-} pen_mode_t;
-
 pen_mode_t pen_mode = CENTER;
 bool_t pen_is_down = false;
 
@@ -77,9 +71,23 @@ float my_max(float a, float b) {
 	return a > b ? a : b;
 }
 
-float diff_control(float target, int current) {
-	if((int)round(target) == current) return 0;
-	return target - current;
+// target, 戻り値: CNTL_DEG の単位、current: deg
+int32_t diff_control(int32_t target, int32_t current) {
+	if(((target + (1 << (CNTL_ERR_SHIFT - 1))) >> CNTL_ERR_SHIFT) == current) return 0;
+	return target - (current << CNTL_ERR_SHIFT);
+}
+
+int32_t abs_i32(int32_t v) {
+	return v < 0 ? -v : v;
+}
+
+// planner の位置 (mm, PLANNER_FIX_SHIFT) → 目標の角度 (CNTL_DEG の単位)
+int32_t mm_fix_to_deg(int32_t mm, int32_t mm_to_deg_fix) {
+	return (int32_t)(((int64_t)mm * mm_to_deg_fix) >> (PLANNER_FIX_SHIFT + MM_TO_DEG_SHIFT - CNTL_ERR_SHIFT));
+}
+
+float mm_from_fix(int32_t mm) {
+	return mm * (1.0f / (1 << PLANNER_FIX_SHIFT));
 }
 
 int to_valid_power(int power) {
@@ -91,14 +99,15 @@ int to_valid_power(int power) {
 void pen_move_to(float angle) {
 	cntl_t pen_cntl;
 	c_init_cntl_PD(&pen_cntl, 5.0, 10.0, 0);
-	const float pen_move_finish_err = 2.0; // deg
+	const int32_t target = CNTL_DEG(angle);
+	const int32_t pen_move_finish_err = CNTL_DEG(2); // deg
 	const int timeout = 5000; // ms
 	int time = 0;
 	ev3_motor_stop(PEN_MOTOR_PORT, false);
 	//ev3_motor_reset_counts(PEN_MOTOR_PORT);
 	while(1){
-		ev3_motor_set_power(PEN_MOTOR_PORT, to_valid_power(c_cntl_next(&pen_cntl, diff_control(angle, ev3_motor_get_counts(PEN_MOTOR_PORT)))));
-		if(fabs(diff_control(angle, ev3_motor_get_counts(PEN_MOTOR_PORT))) < pen_move_finish_err){
+		ev3_motor_set_power(PEN_MOTOR_PORT, to_valid_power(c_cntl_next(&pen_cntl, diff_control(target, ev3_motor_get_counts(PEN_MOTOR_PORT)))));
+		if(abs_i32(diff_control(target, ev3_motor_get_counts(PEN_MOTOR_PORT))) < pen_move_finish_err){
 			break;
 		}
 		tslp_tsk(10);
@@ -193,16 +202,19 @@ void pen_up() {
 	}
 }
 
+// ペンを下ろしたときのペンのモーターの角度
+float pen_down_angle() {
+	return pen_mode == LEFT_PEN ? -145.0 : 145.0;
+}
+
 void pen_down() {
 	if(pen_is_down) return;
 	pen_is_down = true;
 
 	if(pen_mode == CENTER) {
 		; // do nothing
-	} else if(pen_mode == LEFT_PEN) {
-		pen_move_to(-145.0);
-	} else if(pen_mode == RIGHT_PEN) {
-		pen_move_to(145.0);
+	} else {
+		pen_move_to(pen_down_angle());
 	}
 }
 
@@ -218,35 +230,37 @@ void goto_position(float target_x, float target_y) {
 	cntl_t y0_cntl, y1_cntl;
 	cntl_t y_cntl, y_diff_cntl;
 	cntl_t x_cntl;
-	float h, diff;
-	float pen_diff = -((int)pen_mode) * PEN_BETWEEN_HALF_DEG; // deg
+	int h, diff;
+	int32_t pen_diff = CNTL_DEG(-((int)pen_mode) * PEN_BETWEEN_HALF_DEG);
 
-	float y0_deg, y1_deg, x_deg;
+	int32_t y0_deg, y1_deg, x_deg, y_target, x_target;
 
 	//if(pen_is_down) return;
 
 	x = target_x;
 	y = target_y;
+	y_target = CNTL_DEG(y*y_mm_to_deg);
+	x_target = CNTL_DEG(x*x_mm_to_deg) + pen_diff;
 
 	c_init_cntl_PD(&y_cntl, 5.0, 15.0, 0);
 	c_init_cntl_PD(&y_diff_cntl, 3.0, 15.0, 0);
 	c_init_cntl_PD(&x_cntl, 6.0, 15.0, 0);
-	const float first_move_finish_err = 5.0; // deg
+	const int32_t first_move_finish_err = CNTL_DEG(5); // deg
 	const int max_h = 60; // power
 	while(1){
 		y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
 		y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
 		x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
-		h = c_cntl_next(&y_cntl, diff_control(y*y_mm_to_deg, (y0_deg + y1_deg)*0.5));
-		diff = c_cntl_next(&y_diff_cntl, diff_control(0.0, y0_deg - y1_deg));
+		h = c_cntl_next(&y_cntl, diff_control(y_target, (y0_deg + y1_deg) / 2));
+		diff = c_cntl_next(&y_diff_cntl, diff_control(0, y0_deg - y1_deg));
 		if(h > max_h) h = max_h;
 		if(h < -max_h) h = -max_h;
 		ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(h + diff));
 		ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(h - diff));
-		ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x*x_mm_to_deg + pen_diff, x_deg))));
-		if(fabs(diff_control(y*y_mm_to_deg, y0_deg)) < first_move_finish_err &&
-		   fabs(diff_control(y*y_mm_to_deg, y1_deg)) < first_move_finish_err &&
-		   fabs(diff_control(x*x_mm_to_deg + pen_diff, x_deg)) < first_move_finish_err){
+		ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x_target, x_deg))));
+		if(abs_i32(diff_control(y_target, y0_deg)) < first_move_finish_err &&
+		   abs_i32(diff_control(y_target, y1_deg)) < first_move_finish_err &&
+		   abs_i32(diff_control(x_target, x_deg)) < first_move_finish_err){
 			break;
 		}
 		pen_set_power_safe();
@@ -255,17 +269,17 @@ void goto_position(float target_x, float target_y) {
 	c_init_cntl_PD(&y0_cntl, 3.5, 15.0, 0);
 	c_init_cntl_PD(&y1_cntl, 3.5, 15.0, 0);
 	c_init_cntl_PID(&x_cntl, 4.5, 0.000015, 13.0, 0.99, 0);
-	const float fine_move_finish_err = 1.0; // deg
+	const int32_t fine_move_finish_err = CNTL_DEG(1); // deg
 	while(1){
 		y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
 		y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
 		x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
-		ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&y0_cntl, diff_control(y*y_mm_to_deg, y0_deg))));
-		ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&y1_cntl, diff_control(y*y_mm_to_deg, y1_deg))));
-		ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x*x_mm_to_deg + pen_diff, x_deg))));
-		if(fabs(diff_control(y*y_mm_to_deg, y0_deg)) < fine_move_finish_err &&
-		   fabs(diff_control(y*y_mm_to_deg, y1_deg)) < fine_move_finish_err &&
-		   fabs(diff_control(x*x_mm_to_deg + pen_diff, x_deg)) < fine_move_finish_err){
+		ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&y0_cntl, diff_control(y_target, y0_deg))));
+		ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&y1_cntl, diff_control(y_target, y1_deg))));
+		ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x_target, x_deg))));
+		if(abs_i32(diff_control(y_target, y0_deg)) < fine_move_finish_err &&
+		   abs_i32(diff_control(y_target, y1_deg)) < fine_move_finish_err &&
+		   abs_i32(diff_control(x_target, x_deg)) < fine_move_finish_err){
 			break;
 		}
 		pen_set_power_safe();
@@ -277,25 +291,382 @@ void goto_position(float target_x, float target_y) {
 	ev3_motor_stop(X_MOTOR_PORT, true);
 }
 
+/*
+ *  制御タスク
+ *  CONTROL_CYC に CONTROL_PERIOD_MS ごとに起こされて、setpoints の目標に台を合わせる
+ *  目標は main_task が planner を先に進めて時刻つきで入れておき、起こされた時刻 (get_tim) で補間する
+ *  (前は tslp_tsk(4) で間隔を作っていたので、計算にかかった時間の分だけ周期が延び、目標も遅れていた)
+ */
+
+#define SETPOINT_PERIOD_MS (4) // planner を進めて目標を入れる間隔 (ms)
+#define SETPOINT_CAPACITY (16) // 先に計算しておく目標の数 (2のべき乗)
+
+typedef enum {
+	CONTROL_IDLE = 0, // 何もしない (goto_position などは main_task が直接モーターを動かす)
+	CONTROL_TRACK     // setpoints の目標に台を合わせる
+} control_mode_t;
+
+// 制御タスクと main_task で共有する。cntl_t は mode が CONTROL_IDLE のときだけ main_task が初期化する
+typedef struct {
+	volatile control_mode_t mode;
+	cntl_t y0_cntl, y1_cntl, x_cntl, pen_cntl;
+	volatile bool_t pen_active;  // pen_target にペンを合わせる (でなければ pen_set_power_safe)
+	volatile int32_t pen_target; // CNTL_DEG の単位
+	volatile int32_t err;        // 台の偏差の最大 (CNTL_DEG の単位)
+	volatile int32_t pen_err;
+	volatile bool_t reached;     // 最後の目標の時刻を過ぎた
+} control_t;
+
+// 目標を作る側 (main_task)
+typedef struct {
+	planner_t planner;
+	int32_t x_fix, y_fix; // planner の今の位置 (mm, PLANNER_FIX_SHIFT)
+	int32_t pen_diff;     // CNTL_DEG の単位
+	SYSTIM next_time;     // 次に入れる目標の時刻
+} motion_t;
+
+static control_t control;
+static motion_t motion;
+static setpoint_t setpoint_buffer[SETPOINT_CAPACITY];
+static setpoint_queue_t setpoints;
+
+// EV3_CRE_CYC のハンドラ。モーターは制御タスクで動かす
+void control_cyc(intptr_t unused) {
+	act_tsk(CONTROL_TASK);
+}
+
+void control_task(intptr_t unused) {
+	SYSTIM now;
+	int32_t x_target, y_target, y0_deg, y1_deg, x_deg, pen_deg, err;
+	int result;
+
+	if(control.mode != CONTROL_TRACK) return;
+	get_tim(&now);
+	result = setpoint_queue_sample(&setpoints, (uint32_t)now, &x_target, &y_target);
+	if(result < 0) return;
+
+	y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
+	y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
+	x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
+	ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&control.y0_cntl, diff_control(y_target, y0_deg))));
+	ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&control.y1_cntl, diff_control(y_target, y1_deg))));
+	ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&control.x_cntl, diff_control(x_target, x_deg))));
+	err = abs_i32(diff_control(y_target, y0_deg));
+	if(abs_i32(diff_control(y_target, y1_deg)) > err) err = abs_i32(diff_control(y_target, y1_deg));
+	if(abs_i32(diff_control(x_target, x_deg)) > err) err = abs_i32(diff_control(x_target, x_deg));
+	control.err = err;
+	control.reached = result == 0;
+
+	if(control.pen_active) {
+		pen_deg = ev3_motor_get_counts(PEN_MOTOR_PORT);
+		ev3_motor_set_power(PEN_MOTOR_PORT, to_valid_power(c_cntl_next(&control.pen_cntl, diff_control(control.pen_target, pen_deg))));
+		control.pen_err = abs_i32(diff_control(control.pen_target, pen_deg));
+	} else {
+		pen_set_power_safe();
+	}
+}
+
+void motion_push_setpoint(SYSTIM t) {
+	setpoint_queue_push(&setpoints, (uint32_t)t,
+		mm_fix_to_deg(motion.x_fix, x_mm_to_deg_fix) + motion.pen_diff,
+		mm_fix_to_deg(motion.y_fix, y_mm_to_deg_fix));
+	control.reached = false; // 前に目標が足りなくなって最後の点に着いていても、次の周期で数え直す
+}
+
+// (start_x, start_y) から planner で動かし始める (制御タスクが止まっているときに呼ぶ)
+void motion_begin(const planner_limits_t *limits, float start_x, float start_y) {
+	SYSTIM now;
+
+	motion.pen_diff = CNTL_DEG(-((int)pen_mode) * PEN_BETWEEN_HALF_DEG);
+	motion.x_fix = (int32_t)(start_x * (1 << PLANNER_FIX_SHIFT));
+	motion.y_fix = (int32_t)(start_y * (1 << PLANNER_FIX_SHIFT));
+	planner_init(&motion.planner, limits, start_x, start_y);
+
+	// 微分のゲインは 4ms ごとで合わせたもの
+	c_init_cntl_PID(&control.y0_cntl, 3.7, 0.000005, 20.0 * 4 / CONTROL_PERIOD_MS, 0.99, 0);
+	c_init_cntl_PID(&control.y1_cntl, 3.7, 0.000005, 20.0 * 4 / CONTROL_PERIOD_MS, 0.99, 0);
+	c_init_cntl_PID(&control.x_cntl , 4.0, 0.000005, 15.0 * 4 / CONTROL_PERIOD_MS, 0.99, 0);
+	c_init_cntl_PD(&control.pen_cntl, 5.0, 10.0 * 10 / CONTROL_PERIOD_MS, 0); // pen_move_to (10ms ごと) と同じ微分の強さ
+	control.pen_active = false;
+	control.reached = false;
+	control.err = CNTL_DEG(1000);
+	control.pen_err = CNTL_DEG(1000);
+
+	setpoint_queue_init(&setpoints, setpoint_buffer, SETPOINT_CAPACITY);
+	get_tim(&now);
+	motion.next_time = now;
+	motion_push_setpoint(now);
+	control.mode = CONTROL_TRACK;
+}
+
+// planner を進めて、setpoints がいっぱいになるか planner が止まるまで目標を入れる
+// 戻り値: 1: planner が動いている, 0: 足した点を全部動き終えた
+int motion_fill(void) {
+	SYSTIM now;
+	int moving = 1;
+
+	// 目標が足りなくなって止まっていたら、止まっている位置から今の時刻で動き始める (過ぎた時刻の目標に飛ばないように)
+	get_tim(&now);
+	if((int32_t)(now - motion.next_time) > 0 && !setpoint_queue_is_full(&setpoints)) {
+		motion.next_time = now;
+		motion_push_setpoint(now);
+	}
+	while(moving && !setpoint_queue_is_full(&setpoints)) {
+		moving = planner_step_fixed(&motion.planner, PLANNER_TIME_MS(SETPOINT_PERIOD_MS), &motion.x_fix, &motion.y_fix);
+		motion.next_time += SETPOINT_PERIOD_MS;
+		motion_push_setpoint(motion.next_time);
+	}
+	return moving;
+}
+
+// 制御タスクを止めて、planner の最後の位置を x, y にする
+void motion_end(void) {
+	control.mode = CONTROL_IDLE;
+	x = mm_from_fix(motion.x_fix);
+	y = mm_from_fix(motion.y_fix);
+}
+
+#define TRAVEL_PEN_START_MM (0.5) // mm (台が目標にここまで近づいたらペンを下ろし始める。ペンが紙に着くまでに台は止まる)
+#define TRAVEL_FINISH_ERR (2) // deg (描くときの最後の点と同じ)
+
+// ペンを上げたまま (target_x, target_y) へ移動して、ペンを下ろす (goto_position + pen_down)
+// 途中は planner の台形の速度で動かし (goto_position のように 5deg・1deg に合わせて止まらない)、
+// 目標の TRAVEL_PEN_START_MM 手前まで来たら、台が止まるのを待たずにペンを下ろし始める
+void goto_position_pen_down(float target_x, float target_y) {
+	planner_limits_t limits;
+	int32_t y0_deg, y1_deg, x_deg;
+	const int32_t pen_diff = CNTL_DEG(-((int)pen_mode) * PEN_BETWEEN_HALF_DEG);
+	const int32_t target_y_deg = CNTL_DEG(target_y*y_mm_to_deg);
+	const int32_t target_x_deg = CNTL_DEG(target_x*x_mm_to_deg) + pen_diff;
+	const int32_t pen_start_y = CNTL_DEG(TRAVEL_PEN_START_MM*y_mm_to_deg);
+	const int32_t pen_start_x = CNTL_DEG(TRAVEL_PEN_START_MM*x_mm_to_deg);
+	const int timeout = 5000; // ms (planner が止まってから)
+	bool_t moving = true, lowering = false;
+	int time = 0;
+
+	// 今の台の位置から動かす (ペンを持ち替えた後は、ペンの間隔だけ台がずれている)
+	y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
+	y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
+	x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
+	planner_travel_limits(&limits);
+	motion_begin(&limits, (x_deg - (float)pen_diff / (1 << CNTL_ERR_SHIFT)) / x_mm_to_deg, (y0_deg + y1_deg) * 0.5 / y_mm_to_deg);
+	planner_add_point(&motion.planner, target_x, target_y);
+
+	while(1){
+		if(moving) {
+			moving = motion_fill() != 0;
+		}
+
+		y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
+		y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
+		x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
+		if(!lowering && pen_mode != CENTER &&
+		   abs_i32(target_y_deg - ((y0_deg + y1_deg) << (CNTL_ERR_SHIFT - 1))) < pen_start_y &&
+		   abs_i32(target_x_deg - (x_deg << CNTL_ERR_SHIFT)) < pen_start_x) {
+			lowering = true;
+			ev3_motor_stop(PEN_MOTOR_PORT, false);
+			control.pen_target = CNTL_DEG(pen_down_angle());
+			control.pen_active = true;
+			pen_is_down = true;
+		}
+		if(!moving && control.reached && control.err < CNTL_DEG(TRAVEL_FINISH_ERR) &&
+		   (pen_mode == CENTER || (lowering && control.pen_err < CNTL_DEG(2)))){
+			break;
+		}
+
+		tslp_tsk(SETPOINT_PERIOD_MS);
+		if(!moving) {
+			time += SETPOINT_PERIOD_MS;
+			if(time >= timeout) {
+				syslog(LOG_WARNING, "goto_position_pen_down timeout");
+				break;
+			}
+		}
+	}
+	motion_end();
+	if(lowering) {
+		ev3_motor_stop(PEN_MOTOR_PORT, true);
+	}
+	// CENTER のとき、またはペンを下ろし始める前に時間切れになったとき
+	pen_down();
+}
+
 #define MAX_COLOR (64)
 #define MAX_COLOR_NAME_LENGTH (64)
-#define MAX_POLYLINE_POINTS (8192)
+#define PATH_STREAM_CAPACITY (4096) // 先読みする点の数 (2のべき乗、1点12バイト)
+
+// i 番目の色を描くペンを選ぶ (2色より多いときは2色ごとに差し替えを待つ)
+void select_pen(char color_names[][MAX_COLOR_NAME_LENGTH], int color_n, int i) {
+	char str[128];
+	if(color_n == 1 && strcmp(color_names[0], "black") == 0) {
+		pen_set_mode(RIGHT_PEN);
+	}else if(color_n == 1 && strcmp(color_names[0], "red") == 0) {
+		pen_set_mode(LEFT_PEN);
+	}else if(color_n == 2 && strcmp(color_names[i], "red") == 0 && strcmp(color_names[1-i], "black") == 0) {
+		pen_set_mode(LEFT_PEN);
+	}else if(color_n == 2 && strcmp(color_names[i], "black") == 0 && strcmp(color_names[1-i], "red") == 0) {
+		pen_set_mode(RIGHT_PEN);
+	}else if(i % 2 == 0){
+		ev3_lcd_fill_rect(0, 0, EV3_LCD_WIDTH, EV3_LCD_HEIGHT, EV3_LCD_WHITE);
+		if(i == color_n - 1){
+			sprintf(str, "Left Color: %s", color_names[i]);
+			ev3_lcd_draw_string(str, 0, 0);
+		}else{
+			sprintf(str, "Left Color: %s", color_names[i]);
+			ev3_lcd_draw_string(str, 0, 0);
+			sprintf(str, "Right Color: %s", color_names[i+1]);
+			ev3_lcd_draw_string(str, 0, 20);
+		}
+		ev3_speaker_play_tone(NOTE_C4, 100);
+		tslp_tsk(100);
+		while(ev3_button_is_pressed(ENTER_BUTTON)) {
+			tslp_tsk(10);
+		}
+		while(ev3_button_is_pressed(ENTER_BUTTON) == false) {
+			tslp_tsk(10);
+		}
+		pen_set_mode(LEFT_PEN);
+	}else{
+		pen_set_mode(RIGHT_PEN);
+	}
+}
+
+// 読み込みタスク (LOADER_TASK) と描く側で共有する
+static path_cmd_t stream_cmds[PATH_STREAM_CAPACITY];
+static path_stream_t stream;
+static lppb_reader_t lppb_reader; // 大きいのでスタックに置かない
+static FILE *text_fp;
+static int text_color_n;
+static bool_t loader_use_lppb = false;
+
+static void stream_wait(void) {
+	tslp_tsk(1);
+}
+
+// 描いている間に次の線を読んでおく (MAIN_TASK が待っている間だけ動く)
+void loader_task(intptr_t unused) {
+	if(loader_use_lppb) {
+		path_stream_load_lppb(&stream, &lppb_reader);
+	} else {
+		path_stream_load_text(&stream, text_fp, text_color_n);
+	}
+}
+
+// 0.01mm の用紙の座標 → 中心が原点の座標(mm)
+float to_plot_x(int32_t ux) {
+	return ux * (1.0f / LPPB_UNITS_PER_MM) - A4_WIDTH_MM * 0.5;
+}
+float to_plot_y(int32_t uy) {
+	return A4_HEIGHT_MM * 0.5 - uy * (1.0f / LPPB_UNITS_PER_MM);
+}
+
+// stream から折れ線を1本取り出して描く (前後の点しか持たないので長さに上限はない)
+// 速さは planner が先読みして決める (角では止まらずに、曲がり具合に合わせて減速する)
+// 戻り値: PATH_CMD_PATH_END (1本描いた), PATH_CMD_COLOR_END, PATH_CMD_FILE_END, PATH_CMD_ERROR
+int draw_stream_polyline(path_stream_t *stream) {
+	planner_limits_t limits;
+	path_cmd_t first, cmd;
+	int end_type = PATH_CMD_ERROR;
+	bool_t stroke_read = false, moving;
+	const int timeout = 5000; // ms (planner が止まってから)
+	int time = 0;
+
+	path_stream_peek(stream, &first);
+	path_stream_pop(stream);
+	if(first.type != PATH_CMD_POINT) {
+		if(first.type == PATH_CMD_PATH_END) {
+			syslog(LOG_ERROR, "not enough points in polyline: 0");
+			return PATH_CMD_ERROR;
+		}
+		return first.type;
+	}
+	path_stream_peek(stream, &cmd);
+	if(cmd.type != PATH_CMD_POINT) {
+		syslog(LOG_ERROR, "not enough points in polyline: 1");
+		return PATH_CMD_ERROR;
+	}
+
+	goto_position_pen_down(to_plot_x(first.x), to_plot_y(first.y));
+
+	planner_default_limits(&limits);
+	motion_begin(&limits, x, y);
+	while(1){
+		// 読めている点を planner に足す (待たない。足りなければ planner は最後の点で止まるように動く)
+		while(!stroke_read && !planner_is_full(&motion.planner) && path_stream_try_peek(stream, &cmd)) {
+			path_stream_pop(stream);
+			if(cmd.type == PATH_CMD_POINT) {
+				planner_add_point(&motion.planner, to_plot_x(cmd.x), to_plot_y(cmd.y));
+			} else {
+				stroke_read = true;
+				end_type = cmd.type;
+			}
+		}
+		// 制御タスクが使う目標を先に入れておく
+		moving = motion_fill() != 0;
+		if(!moving && stroke_read) {
+			break;
+		}
+		tslp_tsk(SETPOINT_PERIOD_MS);
+	}
+
+	// 最後の点ではペンが目標値に到達するまで待つ (モーターが止まったら、時間切れで次の線に進む)
+	while(!(control.reached && control.err < CNTL_DEG(2))){
+		tslp_tsk(CONTROL_PERIOD_MS);
+		time += CONTROL_PERIOD_MS;
+		if(time >= timeout) {
+			syslog(LOG_WARNING, "draw_stream_polyline timeout");
+			break;
+		}
+	}
+	motion_end();
+
+	ev3_motor_stop(Y0_MOTOR_PORT, true);
+	ev3_motor_stop(Y1_MOTOR_PORT, true);
+	ev3_motor_stop(X_MOTOR_PORT, true);
+	//tslp_tsk(100);
+	for(int i=0; i<10; ++i){
+		pen_set_power_safe();
+		tslp_tsk(10);
+	}
+
+	pen_up();
+
+	return end_type == PATH_CMD_PATH_END ? PATH_CMD_PATH_END : PATH_CMD_ERROR;
+}
+
+// 読み込みタスクを起動して、色ごとに stream の線を描く
+int print_stream(char color_names[][MAX_COLOR_NAME_LENGTH], int color_n) {
+	int type;
+
+	act_tsk(LOADER_TASK);
+	ev3_sta_cyc(CONTROL_CYC);
+	for(int i=0; i<color_n; ++i){
+		select_pen(color_names, color_n, i);
+
+		while((type = draw_stream_polyline(&stream)) == PATH_CMD_PATH_END) {
+			;
+		}
+		if(type != PATH_CMD_COLOR_END) {
+			ev3_stp_cyc(CONTROL_CYC);
+			path_stream_cancel(&stream);
+			syslog(LOG_ERROR, "invalid path data in color %d", i);
+			return -1;
+		}
+	}
+
+	ev3_stp_cyc(CONTROL_CYC);
+	pen_set_mode(CENTER);
+	goto_position(0.0, 0.0);
+	return 0;
+}
+
+// テキスト形式 (optimized_path.txt)
 int print_file(char filename[]) {
 	FILE *fp;
 	int current_line = 0;
-	char str[128];
 	static char color_names[MAX_COLOR][MAX_COLOR_NAME_LENGTH];
-	static float x_points[MAX_POLYLINE_POINTS];
-	static float y_points[MAX_POLYLINE_POINTS];
-	int points_n;
 	int color_n;
 	int len;
-	float old_x = 0, old_y = 0;
-	float next_x, next_y;
-	const int timer_once = 4; // ms
-	int line_time, line_counts;
-	cntl_t y0_cntl, y1_cntl, x_cntl;
-	float y0_deg, y1_deg, x_deg;
 
 	fp = fopen(filename, "r");
 	if(fp == NULL) {
@@ -325,159 +696,46 @@ int print_file(char filename[]) {
 		}
 	}
 
-	for(int i=0; i<color_n; ++i){
-		if(color_n == 1 && strcmp(color_names[0], "black") == 0) {
-			pen_set_mode(RIGHT_PEN);
-		}else if(color_n == 1 && strcmp(color_names[0], "red") == 0) {
-			pen_set_mode(LEFT_PEN);
-		}else if(color_n == 2 && strcmp(color_names[i], "red") == 0 && strcmp(color_names[1-i], "black") == 0) {
-			pen_set_mode(LEFT_PEN);
-		}else if(color_n == 2 && strcmp(color_names[i], "black") == 0 && strcmp(color_names[1-i], "red") == 0) {
-			pen_set_mode(RIGHT_PEN);
-		}else if(i % 2 == 0){
-			ev3_lcd_fill_rect(0, 0, EV3_LCD_WIDTH, EV3_LCD_HEIGHT, EV3_LCD_WHITE);
-			if(i == color_n - 1){
-				sprintf(str, "Left Color: %s", color_names[i]);
-				ev3_lcd_draw_string(str, 0, 0);
-			}else{
-				sprintf(str, "Left Color: %s", color_names[i]);
-				ev3_lcd_draw_string(str, 0, 0);
-				sprintf(str, "Right Color: %s", color_names[i+1]);
-				ev3_lcd_draw_string(str, 0, 20);
-			}
-			ev3_speaker_play_tone(NOTE_C4, 100);
-			tslp_tsk(100);
-			while(ev3_button_is_pressed(ENTER_BUTTON)) {
-				tslp_tsk(10);
-			}
-			while(ev3_button_is_pressed(ENTER_BUTTON) == false) {
-				tslp_tsk(10);
-			}
-			pen_set_mode(LEFT_PEN);
-		}else{
-			pen_set_mode(RIGHT_PEN);
-		}
-
-		int next_color = 0;
-		while(next_color == 0){
-			points_n = 0;
-			while(1){
-				fgets(str, sizeof(str), fp);
-				++current_line;
-				if(strlen(str) == 0) {
-					fclose(fp);
-					syslog(LOG_ERROR, "empty line in polyline data");
-					syslog(LOG_ERROR, "at line %d", current_line);
-					return -1;
-				}
-				str[strlen(str)-1] = '\0';
-				if(strcmp(str, "n") == 0){
-					break;
-				}else if(strcmp(str, "e") == 0){
-					next_color = 1;
-					break;
-				}else{
-					if(points_n >= MAX_POLYLINE_POINTS) {
-						fclose(fp);
-						syslog(LOG_ERROR, "too many points in polyline");
-						syslog(LOG_ERROR, "at line %d", current_line);
-						return -1;
-					}
-					if(sscanf(str, "%f %f", &x_points[points_n], &y_points[points_n]) != 2) {
-						fclose(fp);
-						syslog(LOG_ERROR, "invalid point data: %s", str);
-						syslog(LOG_ERROR, "at line %d", current_line);
-						return -1;
-					}
-					++points_n;
-				}
-			}
-
-			float pen_diff = -((int)pen_mode) * PEN_BETWEEN_HALF_DEG; // deg
-
-			if(points_n < 2){
-				fclose(fp);
-				syslog(LOG_ERROR, "not enough points in polyline: %d", points_n);
-				return -1;
-			}
-
-			goto_position(x_points[0] - A4_WIDTH_MM * 0.5, A4_HEIGHT_MM * 0.5 - y_points[0]);
-			pen_down();
-
-			for(int j=1; j<points_n; ++j){
-				old_x = x;
-				old_y = y;
-				next_x = x_points[j] - A4_WIDTH_MM * 0.5;
-				next_y = A4_HEIGHT_MM * 0.5 - y_points[j];
-				line_time = my_max(fabs(next_x - x) * 1.0, fabs(next_y - y) * 0.4) / 10.0 * 1000.0; // ms
-				line_counts = line_time / timer_once + 1;
-
-				c_init_cntl_PID(&y0_cntl, 3.7, 0.000005, 20.0, 0.99, 0);
-				c_init_cntl_PID(&y1_cntl, 3.7, 0.000005, 20.0, 0.99, 0);
-				c_init_cntl_PID(&x_cntl , 4.0, 0.000005, 15.0, 0.99, 0);
-				for(int k=0; k<line_counts; ++k){
-					y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
-					y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
-					x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
-					x = old_x + (next_x - old_x) * (k + 1) / line_counts;
-					y = old_y + (next_y - old_y) * (k + 1) / line_counts;
-					ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&y0_cntl, diff_control(y*y_mm_to_deg, y0_deg))));
-					ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&y1_cntl, diff_control(y*y_mm_to_deg, y1_deg))));
-					ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x*x_mm_to_deg + pen_diff, x_deg))));
-					pen_set_power_safe();
-					tslp_tsk(timer_once);
-				}
-
-				if((j > 0 && j < points_n - 1) || j == points_n - 1) {
-					// 角度が急(鋭角)な場合はペンが目標値に到達するまで待つ
-					float ax = x_points[j-1] - x_points[j];
-					float ay = y_points[j-1] - y_points[j];
-					float bx = x_points[j+1] - x_points[j];
-					float by = y_points[j+1] - y_points[j];
-					if(ax * bx + ay * by > -0.0001) { // 内積で鋭角か判定
-						while(1){
-							y0_deg = ev3_motor_get_counts(Y0_MOTOR_PORT);
-							y1_deg = ev3_motor_get_counts(Y1_MOTOR_PORT);
-							x_deg = ev3_motor_get_counts(X_MOTOR_PORT);
-							ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&y0_cntl, diff_control(y*y_mm_to_deg, y0_deg))));
-							ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&y1_cntl, diff_control(y*y_mm_to_deg, y1_deg))));
-							ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x*x_mm_to_deg + pen_diff, x_deg))));
-							if(fabs(diff_control(y*y_mm_to_deg, y0_deg)) < 2.0 &&
-								fabs(diff_control(y*y_mm_to_deg, y1_deg)) < 2.0 &&
-								fabs(diff_control(x*x_mm_to_deg + pen_diff, x_deg)) < 2.0){
-								break;
-							}
-							pen_set_power_safe();
-							tslp_tsk(timer_once);
-						}
-					}
-				}
-
-				x = next_x;
-				y = next_y;
-			}
+	// 点は読み込みタスクが読む (fp は読み込みタスクが閉じる)
+	text_fp = fp;
+	text_color_n = color_n;
+	loader_use_lppb = false;
+	path_stream_init(&stream, stream_cmds, PATH_STREAM_CAPACITY, stream_wait);
+	if(print_stream(color_names, color_n) != 0) {
+		return -1;
+	}
 
-			ev3_motor_stop(Y0_MOTOR_PORT, true);
-			ev3_motor_stop(Y1_MOTOR_PORT, true);
-			ev3_motor_stop(X_MOTOR_PORT, true);
-			//tslp_tsk(100);
-			for(int i=0; i<10; ++i){
-				pen_set_power_safe();
-				tslp_tsk(10);
-			}
+	syslog(LOG_INFO, "Finished printing %s", filename);
+	return 0;
+}
 
-			pen_up();
-		}
+// LPPB 形式 (lppb.h)。座標は整数なので sscanf を使わずに読める
+int print_lppb_file(char filename[]) {
+	if(lppb_open(&lppb_reader, filename) != 0) {
+		syslog(LOG_ERROR, "Cannot open lppb file: %s", filename);
+		return -1;
 	}
 
-	pen_set_mode(CENTER);
-	goto_position(0.0, 0.0);
+	loader_use_lppb = true;
+	path_stream_init(&stream, stream_cmds, PATH_STREAM_CAPACITY, stream_wait);
+	if(print_stream(lppb_reader.header.color_names, lppb_reader.header.color_n) != 0) {
+		return -1;
+	}
 
-	fclose(fp);
 	syslog(LOG_INFO, "Finished printing %s", filename);
 	return 0;
 }
 
+// ev3rt/print_data を印刷する。path.lppb があればそちらを使う
+int print_data(void) {
+	FILE *lppb_fp = fopen("ev3rt/print_data/path.lppb", "rb");
+	if(lppb_fp != NULL) {
+		fclose(lppb_fp);
+		return print_lppb_file("ev3rt/print_data/path.lppb");
+	}
+	return print_file("ev3rt/print_data/path.txt");
+}
+
 void main_task(intptr_t unused) {
 	ev3_motor_config(Y0_MOTOR_PORT, LARGE_MOTOR);
 	ev3_motor_config(Y1_MOTOR_PORT, LARGE_MOTOR);
@@ -518,11 +776,11 @@ void main_task(intptr_t unused) {
 		}else if(ev3_button_is_pressed(LEFT_BUTTON)) {
 			x -= x_adjust_speed_mm_per_sec * 0.01;
 		}
-		ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&y0_cntl, diff_control(y*y_mm_to_deg, ev3_motor_get_counts(Y0_MOTOR_PORT)))));
-		ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&y1_cntl, diff_control(y*y_mm_to_deg, ev3_motor_get_counts(Y1_MOTOR_PORT)))));
+		ev3_motor_set_power(Y0_MOTOR_PORT, to_valid_power(c_cntl_next(&y0_cntl, diff_control(CNTL_DEG(y*y_mm_to_deg), ev3_motor_get_counts(Y0_MOTOR_PORT)))));
+		ev3_motor_set_power(Y1_MOTOR_PORT, to_valid_power(c_cntl_next(&y1_cntl, diff_control(CNTL_DEG(y*y_mm_to_deg), ev3_motor_get_counts(Y1_MOTOR_PORT)))));
 		sprintf(str, "Y: %d,%d deg", (int)ev3_motor_get_counts(Y0_MOTOR_PORT), (int)ev3_motor_get_counts(Y1_MOTOR_PORT));
 		ev3_lcd_draw_string(str, 0, 20);
-		ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(x*x_mm_to_deg, ev3_motor_get_counts(X_MOTOR_PORT)))));
+		ev3_motor_set_power(X_MOTOR_PORT, to_valid_power(c_cntl_next(&x_cntl, diff_control(CNTL_DEG(x*x_mm_to_deg), ev3_motor_get_counts(X_MOTOR_PORT)))));
 		sprintf(str, "X: %d deg", (int)ev3_motor_get_counts(X_MOTOR_PORT));
 		ev3_lcd_draw_string(str, 0, 40);
 
@@ -566,7 +824,7 @@ void main_task(intptr_t unused) {
 	x = 0.0;
 	y = 0.0;
 
-	print_file("ev3rt/print_data/path.txt");
+	print_data();
 
 	ext_tsk();
 }
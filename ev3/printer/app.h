@@ -68,6 +68,25 @@
 #define	STACK_SIZE		4096		/* タスクのスタックサイズ */
 #endif /* STACK_SIZE */
 
+/*
+ *  プリンタの定義 (ev3/sim のシミュレータからも使う)
+ */
+
+#define A4_WIDTH_MM (210.0)
+#define A4_HEIGHT_MM (297.0)
+
+#define Y0_MOTOR_PORT (EV3_PORT_A) // 右Lモーター
+#define Y1_MOTOR_PORT (EV3_PORT_B) // 左Lモーター
+#define X_MOTOR_PORT (EV3_PORT_C) // 左Mモーター
+#define PEN_MOTOR_PORT (EV3_PORT_D) // 右Mモーター
+
+#define PEN_BETWEEN_HALF_DEG (5474.0 * 0.5) // deg
+
+// 台を目標に合わせる制御の周期 (CONTROL_CYC が CONTROL_TASK を起こす)
+// 目標は時刻で補間するので、周期を変えても動く速さは変わらない
+#define CONTROL_PERIOD_MS (4) // ms
+#define CONTROL_PHASE_MS (1)  // ms (ev3_sta_cyc から最初に起こすまで)
+
 /*
  *  関数のプロトタイプ宣言
  */
@@ -76,15 +95,19 @@
 #include <stdio.h>
 
 // PIDC制御 (+不完全微分);
+// EV3 には FPU がないので整数で計算する。ゲインは初期化のときに float から変換する
+#define CNTL_GAIN_SHIFT (24) // ゲインは 1/2^24 単位 (128 未満)
+#define CNTL_ERR_SHIFT (8)   // 偏差 (deg) は 1/256 単位
+#define CNTL_DEG(deg) ((int32_t)((deg) * (1 << CNTL_ERR_SHIFT))) // deg → 偏差の単位
 typedef struct{
-    float kp, ki, kd, kc;
-    float li;
+    int32_t kp, ki, kd, kc;
+    int32_t li;
     int waitD;
 
-    float old_err, sum_err;
+    int32_t old_err, sum_err;
     bool_t old_err_empty;
 
-    float row_pass_d;
+    int32_t row_pass_d;
     int row_pass_d_time;
     bool_t use_row_pass_d;
 } cntl_t;
@@ -96,15 +119,34 @@ void c_init_cntl_PCD(cntl_t *state, float kp, float kc, float kd, int waitD);
 void c_init_cntl_PD_rowpass(cntl_t *state, float kp, float kd, int t, int waitD);
 void c_init_cntl_PID_rowpass(cntl_t *state, float kp, float ki, float kd, float li, int t, int waitD);
 void c_init_cntl_PCD_rowpass(cntl_t *state, float kp, float kc, float kd, int t, int waitD);
-float c_cntl_next(cntl_t *state, float err);
+// err: CNTL_DEG の単位、戻り値: モーターのパワー (0 の方向に切り捨て)
+int c_cntl_next(cntl_t *state, int32_t err);
 void c_cntl_wait(cntl_t *state);
 void c_cntl_skip(cntl_t *state);
 
+typedef enum {
+	LEFT_PEN = -1,
+	RIGHT_PEN = 1,
+	CENTER = 0 // pen is not used
+} pen_mode_t;
+
+// app.c の状態
+extern float x, y; // Current position(mm)
+extern const float y_mm_to_deg, x_mm_to_deg;
+extern pen_mode_t pen_mode;
+extern bool_t pen_is_down;
+
+// ev3rt/print_data を印刷する (位置合わせが終わった後に呼ぶ)
+int print_data(void);
+
 /**
  * Tasks
  */
 
 extern void	main_task(intptr_t exinf);
+extern void	loader_task(intptr_t exinf); // パスの先読み (LOW_PRIORITY)
+extern void	control_task(intptr_t exinf); // 台の制御 (TMIN_APP_TPRI、CONTROL_CYC で起こす)
+extern void	control_cyc(intptr_t exinf);
 
 // extern void	gpio_irq_dispatcher(intptr_t exinf);
 
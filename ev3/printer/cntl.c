@@ -1,18 +1,25 @@
 #include "ev3api.h"
 #include "app.h"
 
+// C の項の偏差の上限 (deg)。3乗が int64_t に収まるように
+#define CNTL_C_MAX_ERR (1000)
+
+static int32_t to_gain(float k) {
+    return (int32_t)(k * (float)(1 << CNTL_GAIN_SHIFT) + (k < 0 ? -0.5f : 0.5f));
+}
+
 static void reset_cntl(cntl_t *state) {
-    state->kp = 0.0;
-    state->kd = 0.0;
+    state->kp = 0;
+    state->kd = 0;
     state->waitD = 0;
-    state->old_err = 0.0;
+    state->old_err = 0;
     state->old_err_empty = true;
 
-    state->ki = 0.0;
-    state->li = 1.0;
-    state->sum_err = 0.0;
-    state->kc = 0.0;
-    state->row_pass_d = 0.0;
+    state->ki = 0;
+    state->li = 1 << CNTL_GAIN_SHIFT;
+    state->sum_err = 0;
+    state->kc = 0;
+    state->row_pass_d = 0;
     state->row_pass_d_time = 0;
     state->use_row_pass_d = false;
 }
@@ -20,50 +27,50 @@ static void reset_cntl(cntl_t *state) {
 void c_init_cntl_PD(cntl_t *state, float kp, float kd, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->kd = kd;
+    state->kp = to_gain(kp);
+    state->kd = to_gain(kd);
     state->waitD = waitD;
     state->old_err_empty = true;
 }
 void c_init_cntl_PID(cntl_t *state, float kp, float ki, float kd, float li, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->ki = ki;
-    state->li = li;
-    state->kd = kd;
+    state->kp = to_gain(kp);
+    state->ki = to_gain(ki);
+    state->li = to_gain(li);
+    state->kd = to_gain(kd);
     state->waitD = waitD;
     state->old_err_empty = true;
 }
 void c_init_cntl_PC(cntl_t *state, float kp, float kc) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->kc = kc;
+    state->kp = to_gain(kp);
+    state->kc = to_gain(kc);
 }
 void c_init_cntl_PIC(cntl_t *state, float kp, float ki, float kc, float li, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->kc = kc;
-    state->ki = ki;
-    state->li = li;
+    state->kp = to_gain(kp);
+    state->kc = to_gain(kc);
+    state->ki = to_gain(ki);
+    state->li = to_gain(li);
     state->waitD = waitD;
 }
 void c_init_cntl_PCD(cntl_t *state, float kp, float kc, float kd, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->kc = kc;
-    state->kd = kd;
+    state->kp = to_gain(kp);
+    state->kc = to_gain(kc);
+    state->kd = to_gain(kd);
     state->waitD = waitD;
     state->old_err_empty = true;
 }
 void c_init_cntl_PD_rowpass(cntl_t *state, float kp, float kd, int t, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->kd = kd;
+    state->kp = to_gain(kp);
+    state->kd = to_gain(kd);
     state->row_pass_d_time = t;
     state->use_row_pass_d = true;
     state->waitD = waitD;
@@ -72,10 +79,10 @@ void c_init_cntl_PD_rowpass(cntl_t *state, float kp, float kd, int t, int waitD)
 void c_init_cntl_PID_rowpass(cntl_t *state, float kp, float ki, float kd, float li, int t, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->ki = ki;
-    state->li = li;
-    state->kd = kd;
+    state->kp = to_gain(kp);
+    state->ki = to_gain(ki);
+    state->li = to_gain(li);
+    state->kd = to_gain(kd);
     state->row_pass_d_time = t;
     state->use_row_pass_d = true;
     state->waitD = waitD;
@@ -84,20 +91,21 @@ void c_init_cntl_PID_rowpass(cntl_t *state, float kp, float ki, float kd, float
 void c_init_cntl_PCD_rowpass(cntl_t *state, float kp, float kc, float kd, int t, int waitD) {
     reset_cntl(state);
 
-    state->kp = kp;
-    state->kc = kc;
-    state->kd = kd;
+    state->kp = to_gain(kp);
+    state->kc = to_gain(kc);
+    state->kd = to_gain(kd);
     state->row_pass_d_time = t;
     state->use_row_pass_d = true;
     state->waitD = waitD;
     state->old_err_empty = true;
 }
 
-float c_cntl_next(cntl_t *state, float err) {
-    float result = 0;
+int c_cntl_next(cntl_t *state, int32_t err) {
+    // ゲイン (2^24) x 偏差 (2^8) なので、足した結果は 1/2^32 単位
+    int64_t result = 0;
 
     // P
-    result += (state->kp) * err;
+    result += (int64_t)(state->kp) * err;
 
     // D
     if(state->kd){
@@ -106,9 +114,9 @@ float c_cntl_next(cntl_t *state, float err) {
         }else{
             if(state->use_row_pass_d){
                 state->row_pass_d += ((err - state->old_err) - state->row_pass_d) / (state->row_pass_d_time);
-                result += (state->kd) * (state->row_pass_d);
+                result += (int64_t)(state->kd) * (state->row_pass_d);
             }else{
-                result += (state->kd) * (err - (state->old_err));
+                result += (int64_t)(state->kd) * (err - (state->old_err));
             }
         }
         state->old_err = err;
@@ -117,16 +125,23 @@ float c_cntl_next(cntl_t *state, float err) {
     // I
     if(state->ki){
         state->sum_err += err;
-        result += (state->ki) * (state->sum_err);
-        state->sum_err *= (state->li);
+        result += (int64_t)(state->ki) * (state->sum_err);
+        state->sum_err = (int32_t)(((int64_t)(state->sum_err) * (state->li)) >> CNTL_GAIN_SHIFT);
     }
     
     // C
     if(state->kc){
-        result += (state->kc) * (err*err*err);
+        int64_t e = err;
+        if(e > CNTL_DEG(CNTL_C_MAX_ERR)) e = CNTL_DEG(CNTL_C_MAX_ERR);
+        if(e < -CNTL_DEG(CNTL_C_MAX_ERR)) e = -CNTL_DEG(CNTL_C_MAX_ERR);
+        result += (state->kc) * ((e * e * e) >> (CNTL_ERR_SHIFT * 2));
     }
 
-    return result;
+    // float で計算して int のパワーにしていたときと同じく 0 の方向に切り捨てる
+    if(result < 0){
+        return -(int)((-result) >> (CNTL_GAIN_SHIFT + CNTL_ERR_SHIFT));
+    }
+    return (int)(result >> (CNTL_GAIN_SHIFT + CNTL_ERR_SHIFT));
 }
 
 void c_cntl_wait(cntl_t *state) {
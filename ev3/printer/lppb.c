@@ -0,0 +1,243 @@
+#include "lppb.h"
+
+#include <string.h>
+
+// EV3 と Linux (lppe_lppb) の両方でビルドするので、標準Cライブラリだけを使う
+
+static int fill_buffer(lppb_reader_t *reader) {
+    reader->buf_len = fread(reader->buf, 1, LPPB_READ_BUFFER, reader->fp);
+    reader->buf_pos = 0;
+    return reader->buf_len > 0 ? 0 : -1;
+}
+
+static int read_bytes(lppb_reader_t *reader, void *dst, size_t n) {
+    unsigned char *out = (unsigned char *)dst;
+    while(n > 0){
+        if(reader->buf_pos == reader->buf_len && fill_buffer(reader) != 0){
+            return -1;
+        }
+        size_t chunk = reader->buf_len - reader->buf_pos;
+        if(chunk > n) chunk = n;
+        memcpy(out, reader->buf + reader->buf_pos, chunk);
+        reader->buf_pos += chunk;
+        out += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+// エンディアンによらないように1バイトずつ組み立てる
+static int read_u8(lppb_reader_t *reader, uint32_t *value) {
+    unsigned char b;
+    if(read_bytes(reader, &b, 1) != 0) return -1;
+    *value = b;
+    return 0;
+}
+
+static int read_u16(lppb_reader_t *reader, uint32_t *value) {
+    unsigned char b[2];
+    if(read_bytes(reader, b, 2) != 0) return -1;
+    *value = (uint32_t)b[0] | ((uint32_t)b[1] << 8);
+    return 0;
+}
+
+static int read_u32(lppb_reader_t *reader, uint32_t *value) {
+    unsigned char b[4];
+    if(read_bytes(reader, b, 4) != 0) return -1;
+    *value = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    return 0;
+}
+
+static int read_i32(lppb_reader_t *reader, int32_t *value) {
+    uint32_t u;
+    if(read_u32(reader, &u) != 0) return -1;
+    *value = (int32_t)u;
+    return 0;
+}
+
+int lppb_open(lppb_reader_t *reader, const char *filename) {
+    char magic[4];
+    uint32_t version, color_n, len;
+    lppb_header_t *header = &reader->header;
+
+    memset(header, 0, sizeof(*header));
+    reader->buf_pos = 0;
+    reader->buf_len = 0;
+    reader->fp = fopen(filename, "rb");
+    if(reader->fp == NULL){
+        return -1;
+    }
+
+    if(read_bytes(reader, magic, 4) != 0 || memcmp(magic, "LPPB", 4) != 0 ||
+       read_u16(reader, &version) != 0 || version != LPPB_VERSION ||
+       read_u16(reader, &color_n) != 0 || color_n < 1 || color_n > LPPB_MAX_COLOR ||
+       read_u32(reader, &header->path_n) != 0 ||
+       read_u32(reader, &header->point_n) != 0 ||
+       read_i32(reader, &header->min_x) != 0 ||
+       read_i32(reader, &header->min_y) != 0 ||
+       read_i32(reader, &header->max_x) != 0 ||
+       read_i32(reader, &header->max_y) != 0){
+        lppb_close(reader);
+        return -1;
+    }
+    header->version = (int)version;
+    header->color_n = (int)color_n;
+
+    for(int i=0; i<header->color_n; ++i){
+        if(read_u8(reader, &len) != 0 || len >= LPPB_MAX_COLOR_NAME_LENGTH ||
+           read_bytes(reader, header->color_names[i], len) != 0 ||
+           read_u32(reader, &header->color_path_n[i]) != 0){
+            lppb_close(reader);
+            return -1;
+        }
+        header->color_names[i][len] = '\0';
+    }
+
+    reader->color = 0;
+    reader->paths_left = header->color_path_n[0];
+    return 0;
+}
+
+// パスの先頭 (フラグと点の数) を読む。1: 読めた, 0: 今の色はもうない, -1: 壊れている
+static int read_path_header(lppb_reader_t *reader, uint32_t *flags, uint32_t *n) {
+    if(reader->fp == NULL){
+        return -1;
+    }
+    if(reader->paths_left == 0){
+        // 次に呼ばれたときは次の色から読む
+        if(reader->color + 1 < reader->header.color_n){
+            reader->color++;
+            reader->paths_left = reader->header.color_path_n[reader->color];
+        }
+        return 0;
+    }
+    reader->paths_left--;
+
+    if(read_u8(reader, flags) != 0 || read_u32(reader, n) != 0 || *n < 1){
+        return -1;
+    }
+    return 1;
+}
+
+int lppb_read_path(lppb_reader_t *reader, int32_t *xs, int32_t *ys, int max_points, int *points_n) {
+    uint32_t flags, n;
+    int32_t x, y;
+
+    const int header = read_path_header(reader, &flags, &n);
+    if(header != 1){
+        return header;
+    }
+    const int closed = (flags & LPPB_PATH_CLOSED) != 0;
+    if((int64_t)n + closed > (int64_t)max_points){
+        return -1;
+    }
+    if(read_i32(reader, &x) != 0 || read_i32(reader, &y) != 0){
+        return -1;
+    }
+    xs[0] = x;
+    ys[0] = y;
+
+    if(flags & LPPB_PATH_WIDE){
+        int32_t dx, dy;
+        for(uint32_t i=1; i<n; ++i){
+            if(read_i32(reader, &dx) != 0 || read_i32(reader, &dy) != 0){
+                return -1;
+            }
+            x += dx;
+            y += dy;
+            xs[i] = x;
+            ys[i] = y;
+        }
+    }else{
+        // 点が多いので、バッファに残っているぶんは read_bytes を通さずに読む
+        uint32_t i = 1;
+        while(i < n){
+            if(reader->buf_pos == reader->buf_len && fill_buffer(reader) != 0){
+                return -1;
+            }
+            const unsigned char *p = reader->buf + reader->buf_pos;
+            size_t available = (reader->buf_len - reader->buf_pos) / 4;
+            if(available == 0){
+                // 1点がバッファの境目をまたいでいる
+                unsigned char b[4];
+                if(read_bytes(reader, b, 4) != 0){
+                    return -1;
+                }
+                x += (int16_t)(b[0] | (b[1] << 8));
+                y += (int16_t)(b[2] | (b[3] << 8));
+                xs[i] = x;
+                ys[i] = y;
+                ++i;
+                continue;
+            }
+            if(available > n - i) available = n - i;
+            for(size_t k=0; k<available; ++k, p += 4){
+                x += (int16_t)(p[0] | (p[1] << 8));
+                y += (int16_t)(p[2] | (p[3] << 8));
+                xs[i] = x;
+                ys[i] = y;
+                ++i;
+            }
+            reader->buf_pos += available * 4;
+        }
+    }
+
+    if(closed){
+        xs[n] = xs[0];
+        ys[n] = ys[0];
+        ++n;
+    }
+    *points_n = (int)n;
+    return 1;
+}
+
+int lppb_begin_path(lppb_reader_t *reader, lppb_path_t *path) {
+    const int header = read_path_header(reader, &path->flags, &path->n);
+    if(header != 1){
+        return header;
+    }
+    path->i = 0;
+    return 1;
+}
+
+int lppb_next_point(lppb_reader_t *reader, lppb_path_t *path, int32_t *x, int32_t *y) {
+    if(path->i == 0){
+        if(read_i32(reader, &path->x) != 0 || read_i32(reader, &path->y) != 0){
+            return -1;
+        }
+        path->first_x = path->x;
+        path->first_y = path->y;
+    }else if(path->i < path->n){
+        if(path->flags & LPPB_PATH_WIDE){
+            int32_t dx, dy;
+            if(read_i32(reader, &dx) != 0 || read_i32(reader, &dy) != 0){
+                return -1;
+            }
+            path->x += dx;
+            path->y += dy;
+        }else{
+            unsigned char b[4];
+            if(read_bytes(reader, b, 4) != 0){
+                return -1;
+            }
+            path->x += (int16_t)(b[0] | (b[1] << 8));
+            path->y += (int16_t)(b[2] | (b[3] << 8));
+        }
+    }else if(path->i == path->n && (path->flags & LPPB_PATH_CLOSED)){
+        path->x = path->first_x;
+        path->y = path->first_y;
+    }else{
+        return 0;
+    }
+    path->i++;
+    *x = path->x;
+    *y = path->y;
+    return 1;
+}
+
+void lppb_close(lppb_reader_t *reader) {
+    if(reader->fp != NULL){
+        fclose(reader->fp);
+        reader->fp = NULL;
+    }
+}
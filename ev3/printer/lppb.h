@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+LPPB (LEGO Pen Printer Binary path)
+optimized_path.txt と同じ内容を小さく、sscanf なしで読めるようにしたバイナリ形式
+lppe (core/path_writer) が書き、EV3 (app.c) と lppe_lppb が読む
+
+数値はすべてリトルエンディアン、座標は 0.01mm 単位の整数
+
+ヘッダ:
+char[4]  "LPPB"
+uint16   バージョン (LPPB_VERSION)
+uint16   色の数 N (1-64)
+uint32   パスの数 (全部の色の合計)
+uint32   点の数 (全部の色の合計。閉じたパスは最初の点に戻る点も数える)
+int32    min_x, min_y, max_x, max_y (全部の点の範囲。点が無ければ全部0)
+
+色の表 (N 個):
+uint8    名前の長さ (0-63)
+char[]   名前 (終端の0なし)
+uint32   この色のパスの数
+
+色ごとのパス (色の表の順に、パスの数だけ):
+uint8    フラグ (LPPB_PATH_*)
+uint32   書いてある点の数 (1以上)
+int32    最初の点 x, y
+int16    2つ目以降は前の点との差 dx, dy (LPPB_PATH_WIDE なら int32)
+LPPB_PATH_CLOSED なら最後に最初の点へ戻る (戻る点は書いていない)
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LPPB_VERSION (1)
+#define LPPB_UNITS_PER_MM (100) // 0.01mm
+#define LPPB_MAX_COLOR (64)
+#define LPPB_MAX_COLOR_NAME_LENGTH (64) // 終端の0を含む
+#define LPPB_HEADER_SIZE (32)
+
+#define LPPB_PATH_WIDE (0x01)   // 差を int32 で書いている
+#define LPPB_PATH_CLOSED (0x02) // 最初の点に戻る
+
+#define LPPB_READ_BUFFER (4096)
+
+typedef struct {
+    int version;
+    int color_n;
+    uint32_t path_n, point_n;
+    int32_t min_x, min_y, max_x, max_y;
+    char color_names[LPPB_MAX_COLOR][LPPB_MAX_COLOR_NAME_LENGTH];
+    uint32_t color_path_n[LPPB_MAX_COLOR];
+} lppb_header_t;
+
+// 8KB ほどあるので、EV3 ではタスクのスタックに置かずに static にすること
+typedef struct {
+    FILE *fp;
+    lppb_header_t header;
+    int color;           // 今読んでいる色
+    uint32_t paths_left; // 今の色の残りのパスの数
+    unsigned char buf[LPPB_READ_BUFFER];
+    size_t buf_pos, buf_len;
+} lppb_reader_t;
+
+// ヘッダと色の表まで読む。失敗したら -1
+int lppb_open(lppb_reader_t *reader, const char *filename);
+// 今の色の次のパスを xs, ys (0.01mm) に読む
+// 1: 読めた, 0: 今の色はもうない (次に呼ぶと次の色を読む), -1: 壊れている・max_points に入らない
+int lppb_read_path(lppb_reader_t *reader, int32_t *xs, int32_t *ys, int max_points, int *points_n);
+
+// 1点ずつ読むときのパスの状態 (長さに上限がない)
+typedef struct {
+    uint32_t flags, n; // n は書いてある点の数
+    uint32_t i;        // 次に返す点
+    int32_t x, y, first_x, first_y;
+} lppb_path_t;
+
+// 今の色の次のパスを読み始める。1: 読めた, 0: 今の色はもうない (lppb_read_path と同じ), -1: 壊れている
+int lppb_begin_path(lppb_reader_t *reader, lppb_path_t *path);
+// パスの次の点 (0.01mm)。1: 読めた, 0: パスの終わり, -1: 壊れている
+int lppb_next_point(lppb_reader_t *reader, lppb_path_t *path, int32_t *x, int32_t *y);
+
+void lppb_close(lppb_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,129 @@
+#include "path_stream.h"
+
+#include <string.h>
+
+// EV3 と Linux (lppe_lppb) の両方でビルドするので、標準Cライブラリだけを使う
+// 中身を書いてから head を進める (読む側は head を見てから中身を読む) 順番を守る
+#if defined(__arm__) && !defined(__linux__)
+// EV3 は1コアなので、コンパイラが並べ替えないようにするだけでよい
+#define STREAM_LOAD(v) ({ __asm__ __volatile__("" ::: "memory"); uint32_t value_ = (v); __asm__ __volatile__("" ::: "memory"); value_; })
+#define STREAM_STORE(v, x) do { __asm__ __volatile__("" ::: "memory"); (v) = (x); } while(0)
+#else
+#define STREAM_LOAD(v) __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define STREAM_STORE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#endif
+
+void path_stream_init(path_stream_t *stream, path_cmd_t *cmds, uint32_t capacity, void (*wait)(void)) {
+    stream->cmds = cmds;
+    stream->capacity = capacity;
+    stream->head = 0;
+    stream->tail = 0;
+    stream->cancelled = 0;
+    stream->wait = wait;
+}
+
+int path_stream_push(path_stream_t *stream, int32_t type, int32_t x, int32_t y) {
+    // head, tail は増やし続けて、位置は capacity で割った余りにする
+    const uint32_t head = stream->head;
+    while(head - STREAM_LOAD(stream->tail) >= stream->capacity){
+        if(STREAM_LOAD(stream->cancelled)) return -1;
+        stream->wait();
+    }
+    if(STREAM_LOAD(stream->cancelled)) return -1;
+    path_cmd_t *cmd = &stream->cmds[head & (stream->capacity - 1)];
+    cmd->type = type;
+    cmd->x = x;
+    cmd->y = y;
+    STREAM_STORE(stream->head, head + 1);
+    return 0;
+}
+
+void path_stream_peek(path_stream_t *stream, path_cmd_t *cmd) {
+    const uint32_t tail = stream->tail;
+    while(STREAM_LOAD(stream->head) == tail){
+        stream->wait();
+    }
+    *cmd = stream->cmds[tail & (stream->capacity - 1)];
+}
+
+int path_stream_try_peek(path_stream_t *stream, path_cmd_t *cmd) {
+    const uint32_t tail = stream->tail;
+    if(STREAM_LOAD(stream->head) == tail){
+        return 0;
+    }
+    *cmd = stream->cmds[tail & (stream->capacity - 1)];
+    return 1;
+}
+
+void path_stream_pop(path_stream_t *stream) {
+    STREAM_STORE(stream->tail, stream->tail + 1);
+}
+
+void path_stream_cancel(path_stream_t *stream) {
+    STREAM_STORE(stream->cancelled, 1);
+}
+
+uint32_t path_stream_size(const path_stream_t *stream) {
+    return STREAM_LOAD(stream->head) - STREAM_LOAD(stream->tail);
+}
+
+int path_stream_load_lppb(path_stream_t *stream, lppb_reader_t *reader) {
+    lppb_path_t path;
+    int32_t x, y;
+    int result = 0;
+
+    for(int color=0; color<reader->header.color_n && result == 0; ++color){
+        int begin = 0;
+        while(result == 0 && (begin = lppb_begin_path(reader, &path)) == 1){
+            int point;
+            while((point = lppb_next_point(reader, &path, &x, &y)) == 1){
+                if(path_stream_push(stream, PATH_CMD_POINT, x, y) != 0){
+                    lppb_close(reader);
+                    return -1;
+                }
+            }
+            if(point < 0 || path_stream_push(stream, PATH_CMD_PATH_END, 0, 0) != 0){
+                result = -1;
+            }
+        }
+        if(result == 0 && (begin < 0 || path_stream_push(stream, PATH_CMD_COLOR_END, 0, 0) != 0)){
+            result = -1;
+        }
+    }
+    lppb_close(reader);
+    path_stream_push(stream, result == 0 ? PATH_CMD_FILE_END : PATH_CMD_ERROR, 0, 0);
+    return result;
+}
+
+int path_stream_load_text(path_stream_t *stream, FILE *fp, int color_n) {
+    char str[128];
+    float x, y;
+    int result = 0;
+    int color = 0;
+
+    while(result == 0 && color < color_n){
+        if(fgets(str, sizeof(str), fp) == NULL){
+            result = -1;
+            break;
+        }
+        if(strcmp(str, "n\n") == 0 || strcmp(str, "n") == 0){
+            if(path_stream_push(stream, PATH_CMD_PATH_END, 0, 0) != 0) result = -1;
+        }else if(strcmp(str, "e\n") == 0 || strcmp(str, "e") == 0){
+            if(path_stream_push(stream, PATH_CMD_PATH_END, 0, 0) != 0 ||
+               path_stream_push(stream, PATH_CMD_COLOR_END, 0, 0) != 0){
+                result = -1;
+            }
+            ++color;
+        }else if(sscanf(str, "%f %f", &x, &y) == 2){
+            // 0.01mm に丸める (lppb と同じ単位にそろえる)
+            const int32_t ux = (int32_t)(x * LPPB_UNITS_PER_MM + (x < 0 ? -0.5f : 0.5f));
+            const int32_t uy = (int32_t)(y * LPPB_UNITS_PER_MM + (y < 0 ? -0.5f : 0.5f));
+            if(path_stream_push(stream, PATH_CMD_POINT, ux, uy) != 0) result = -1;
+        }else{
+            result = -1;
+        }
+    }
+    fclose(fp);
+    path_stream_push(stream, result == 0 ? PATH_CMD_FILE_END : PATH_CMD_ERROR, 0, 0);
+    return result;
+}
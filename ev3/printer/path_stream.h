@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+Path Stream
+ファイルを読むタスクと描くタスクの間でパスを1点ずつ渡すリングバッファ
+読む側 (低い優先度) が描いている間に先を読んでおくので、ペンを上げたときに次の線がもう用意できている
+パスの長さに上限はない (描く側は前後の点しか持たない)
+
+書くのは1つのタスク、読むのも1つのタスクだけ (head は書く側、tail は読む側だけが進める)
+待つ処理は wait で渡す (EV3 では tslp_tsk、Linux (lppe_lppb) ではスレッドの yield)
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lppb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PATH_CMD_POINT = 0,     // x, y (0.01mm)
+    PATH_CMD_PATH_END = 1,  // 1本の終わり (ペンを上げる)
+    PATH_CMD_COLOR_END = 2, // 1色の終わり (最後の PATH_END の後)
+    PATH_CMD_FILE_END = 3,  // ファイルの終わり (最後の COLOR_END の後)
+    PATH_CMD_ERROR = 4      // 読めなかった (これ以降は何も来ない)
+} path_cmd_type_t;
+
+typedef struct {
+    int32_t type; // path_cmd_type_t
+    int32_t x, y;
+} path_cmd_t;
+
+typedef struct {
+    path_cmd_t *cmds;
+    uint32_t capacity; // 2のべき乗
+    uint32_t head; // 次に書く位置 (書く側だけが進める)
+    uint32_t tail; // 次に読む位置 (読む側だけが進める)
+    uint32_t cancelled; // 読む側がやめたら 1 (書く側は待つのをやめて終わる)
+    void (*wait)(void);
+} path_stream_t;
+
+// cmds は capacity 個 (2のべき乗) の領域
+void path_stream_init(path_stream_t *stream, path_cmd_t *cmds, uint32_t capacity, void (*wait)(void));
+// いっぱいなら空くまで待つ。cancel されたら -1
+int path_stream_push(path_stream_t *stream, int32_t type, int32_t x, int32_t y);
+// 先頭を見る (取り出さない)。空なら来るまで待つ
+void path_stream_peek(path_stream_t *stream, path_cmd_t *cmd);
+// 待たない peek。空なら 0
+int path_stream_try_peek(path_stream_t *stream, path_cmd_t *cmd);
+void path_stream_pop(path_stream_t *stream);
+void path_stream_cancel(path_stream_t *stream);
+// 今たまっている数 (デバッグ表示用)
+uint32_t path_stream_size(const path_stream_t *stream);
+
+// 書く側: ファイルの残りを全部 stream に流して閉じる。最後は FILE_END か ERROR
+// lppb は lppb_open の後、text は色の名前の行まで読んだ後 (color_n 色分のデータを読む)
+int path_stream_load_lppb(path_stream_t *stream, lppb_reader_t *reader);
+int path_stream_load_text(path_stream_t *stream, FILE *fp, int color_n);
+
+#ifdef __cplusplus
+}
+#endif
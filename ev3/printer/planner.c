@@ -0,0 +1,223 @@
+#include "planner.h"
+
+#include <math.h>
+
+// EV3 と Linux (lppe_lppb) の両方でビルドするので、標準Cライブラリだけを使う
+// 平方根と float は線分を足したときだけ使う (planner_step_fixed は整数の四則演算だけ)
+
+static float min_f(float a, float b) {
+    return a < b ? a : b;
+}
+
+static float max_f(float a, float b) {
+    return a > b ? a : b;
+}
+
+static int32_t to_fix(float v) {
+    return (int32_t)(v * (float)(1 << PLANNER_FIX_SHIFT) + (v < 0 ? -0.5f : 0.5f));
+}
+
+static float from_fix(int32_t v) {
+    return (float)v * (1.0f / (float)(1 << PLANNER_FIX_SHIFT));
+}
+
+// 固定小数点どうしのかけ算 (結果は a と同じ単位)
+static int32_t mul_fix(int32_t a, int32_t b, int shift) {
+    return (int32_t)(((int64_t)a * b) >> shift);
+}
+
+static planner_block_t *block_at(planner_t *planner, int i) {
+    return &planner->blocks[(planner->head + i) % PLANNER_BUFFER];
+}
+
+void planner_default_limits(planner_limits_t *limits) {
+    limits->max_speed_x = PLANNER_DEFAULT_MAX_SPEED_X;
+    limits->max_speed_y = PLANNER_DEFAULT_MAX_SPEED_Y;
+    limits->max_accel_x = PLANNER_DEFAULT_MAX_ACCEL_X;
+    limits->max_accel_y = PLANNER_DEFAULT_MAX_ACCEL_Y;
+    limits->junction_deviation = PLANNER_DEFAULT_JUNCTION_DEVIATION;
+    limits->min_speed = PLANNER_DEFAULT_MIN_SPEED;
+}
+
+void planner_travel_limits(planner_limits_t *limits) {
+    planner_default_limits(limits);
+    limits->max_speed_x = PLANNER_TRAVEL_MAX_SPEED_X;
+    limits->max_speed_y = PLANNER_TRAVEL_MAX_SPEED_Y;
+    limits->max_accel_x = PLANNER_TRAVEL_MAX_ACCEL_X;
+    limits->max_accel_y = PLANNER_TRAVEL_MAX_ACCEL_Y;
+}
+
+void planner_init(planner_t *planner, const planner_limits_t *limits, float x, float y) {
+    planner->limits = *limits;
+    planner->head = 0;
+    planner->count = 0;
+    planner->last_x = x;
+    planner->last_y = y;
+    planner->flast_x = to_fix(x);
+    planner->flast_y = to_fix(y);
+    planner->fmin_speed = to_fix(limits->min_speed);
+    planner->s = 0;
+    planner->v = 0;
+}
+
+int planner_is_full(const planner_t *planner) {
+    return planner->count >= PLANNER_BUFFER;
+}
+
+int planner_is_empty(const planner_t *planner) {
+    return planner->count == 0;
+}
+
+// 向き u のときに、どの軸も limit_x, limit_y を超えない大きさ
+static float limit_along(float ux, float uy, float limit_x, float limit_y) {
+    float limit = 1e9f;
+    if(fabsf(ux) > 1e-6f) limit = min_f(limit, limit_x / fabsf(ux));
+    if(fabsf(uy) > 1e-6f) limit = min_f(limit, limit_y / fabsf(uy));
+    return limit;
+}
+
+// 最後の線分の終わりで止まるとして、入るときの速さを決め直す
+static void recalculate(planner_t *planner) {
+    // 後ろから: 次の線分に入る速さまで減速できる速さ
+    float next_entry = 0;
+    const float v = from_fix(planner->v);
+    const float s = from_fix(planner->s);
+    for(int i=planner->count-1; i>=1; --i){
+        planner_block_t *b = block_at(planner, i);
+        b->entry_speed = min_f(b->max_entry_speed, sqrtf(next_entry * next_entry + 2.0f * b->accel * b->length));
+        next_entry = b->entry_speed;
+    }
+    // 前から: 前の線分で加速して届く速さ (今動いている線分は今の速さと残りの距離から)
+    planner_block_t *first = block_at(planner, 0);
+    float reachable = sqrtf(v * v + 2.0f * first->accel * max_f(first->length - s, 0));
+    for(int i=1; i<planner->count; ++i){
+        planner_block_t *b = block_at(planner, i);
+        if(b->entry_speed > reachable) b->entry_speed = reachable;
+        reachable = sqrtf(b->entry_speed * b->entry_speed + 2.0f * b->accel * b->length);
+        b->fentry_speed = to_fix(b->entry_speed);
+    }
+}
+
+int planner_add_point(planner_t *planner, float x, float y) {
+    if(planner_is_full(planner)){
+        return -1;
+    }
+    const float dx = x - planner->last_x;
+    const float dy = y - planner->last_y;
+    const float length = sqrtf(dx * dx + dy * dy);
+    if(length < 1e-4f){
+        return 0;
+    }
+
+    planner_block_t *b = block_at(planner, planner->count);
+    const planner_limits_t *limits = &planner->limits;
+    b->x0 = planner->last_x;
+    b->y0 = planner->last_y;
+    b->ux = dx / length;
+    b->uy = dy / length;
+    b->length = length;
+    b->nominal_speed = limit_along(b->ux, b->uy, limits->max_speed_x, limits->max_speed_y);
+    b->accel = limit_along(b->ux, b->uy, limits->max_accel_x, limits->max_accel_y);
+    b->max_entry_speed = 0;
+    b->entry_speed = 0;
+    b->fx0 = planner->flast_x;
+    b->fy0 = planner->flast_y;
+    b->fux = to_fix(b->ux);
+    b->fuy = to_fix(b->uy);
+    b->flength = to_fix(length);
+    b->fnominal_speed = to_fix(b->nominal_speed);
+    b->faccel = to_fix(b->accel);
+    b->fentry_speed = 0;
+
+    if(planner->count > 0){
+        // junction deviation: 角を半径 r の円弧で回るとみなし、円弧と角の距離が junction_deviation になる速さ
+        const planner_block_t *prev = block_at(planner, planner->count - 1);
+        const float cos_theta = -(prev->ux * b->ux + prev->uy * b->uy); // 0度 (折り返し) で 1、まっすぐで -1
+        float v_max = min_f(prev->nominal_speed, b->nominal_speed);
+        if(cos_theta > 0.999999f){
+            v_max = 0; // 折り返し
+        }else if(cos_theta > -0.999999f){
+            const float sin_half = sqrtf(0.5f * (1.0f - cos_theta));
+            const float a = min_f(prev->accel, b->accel);
+            v_max = min_f(v_max, sqrtf(a * limits->junction_deviation * sin_half / (1.0f - sin_half)));
+        }
+        b->max_entry_speed = v_max;
+    }
+
+    planner->count++;
+    planner->last_x = x;
+    planner->last_y = y;
+    planner->flast_x = to_fix(x);
+    planner->flast_y = to_fix(y);
+    recalculate(planner);
+    return 0;
+}
+
+// 速さ v で dt 進む距離 (PLANNER_FIX_SHIFT)
+static int32_t distance_in(int64_t v_sum, int32_t dt) {
+    return (int32_t)((v_sum * dt) >> (PLANNER_TIME_SHIFT + 1));
+}
+
+int planner_step_fixed(planner_t *planner, int32_t dt, int32_t *x, int32_t *y) {
+    while(planner->count > 0){
+        planner_block_t *b = block_at(planner, 0);
+        const int32_t exit_speed = planner->count > 1 ? block_at(planner, 1)->fentry_speed : 0;
+        const int32_t remaining = b->flength - planner->s;
+        const int32_t v = planner->v;
+        const int64_t v2_diff = (int64_t)v * v - (int64_t)exit_speed * exit_speed;
+
+        // 出口の速さまでちょうど減速できる位置に来たら減速、それまでは最高速度まで加速
+        // remaining <= (v^2 - exit^2) / 2a + v dt を、割り算をしないように 2a をかけて比べる
+        int32_t v_next;
+        const int32_t v_dt = mul_fix(v, dt, PLANNER_TIME_SHIFT);
+        if(2 * (int64_t)b->faccel * (remaining - v_dt) <= v2_diff){
+            // 残りがほとんど無いと v2_diff / 2remaining が int32 に収まらないので、加速度の2倍までに抑える
+            int64_t a = v2_diff / (2 * (int64_t)(remaining > 1 ? remaining : 1));
+            if(a < 0) a = 0;
+            if(a > 2 * (int64_t)b->faccel) a = 2 * (int64_t)b->faccel;
+            v_next = v - mul_fix((int32_t)a, dt, PLANNER_TIME_SHIFT);
+            if(v_next < exit_speed) v_next = exit_speed;
+        }else{
+            v_next = v + mul_fix(b->faccel, dt, PLANNER_TIME_SHIFT);
+            if(v_next > b->fnominal_speed) v_next = b->fnominal_speed;
+        }
+        if(v_next < planner->fmin_speed) v_next = planner->fmin_speed;
+
+        const int64_t v_sum = (int64_t)v + v_next;
+        const int32_t ds = distance_in(v_sum, dt);
+        if(planner->s + ds < b->flength){
+            planner->s += ds;
+            planner->v = v_next;
+            *x = b->fx0 + mul_fix(b->fux, planner->s, PLANNER_FIX_SHIFT);
+            *y = b->fy0 + mul_fix(b->fuy, planner->s, PLANNER_FIX_SHIFT);
+            return 1;
+        }
+
+        // この線分を抜けた。残りの時間で次の線分を進む
+        const int32_t used = v_sum > 0 ? (int32_t)(((int64_t)remaining << (PLANNER_TIME_SHIFT + 1)) / v_sum) : dt;
+        dt = dt > used ? dt - used : 0;
+        planner->head = (planner->head + 1) % PLANNER_BUFFER;
+        planner->count--;
+        planner->s = 0;
+        planner->v = exit_speed;
+        if(dt <= 0){
+            if(planner->count == 0) break;
+            b = block_at(planner, 0);
+            *x = b->fx0;
+            *y = b->fy0;
+            return 1;
+        }
+    }
+    planner->v = 0;
+    *x = planner->flast_x;
+    *y = planner->flast_y;
+    return 0;
+}
+
+int planner_step(planner_t *planner, float dt, float *x, float *y) {
+    int32_t fx, fy;
+    const int moving = planner_step_fixed(planner, (int32_t)(dt * (float)(1 << PLANNER_TIME_SHIFT) + 0.5f), &fx, &fy);
+    *x = from_fix(fx);
+    *y = from_fix(fy);
+    return moving;
+}
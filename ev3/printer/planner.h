@@ -0,0 +1,92 @@
+#pragma once
+
+/*
+Planner
+ペンを下ろしたまま描く折れ線の速さを先読みで決める
+次の PLANNER_BUFFER 本の線分を持ち、角の曲がり具合 (junction deviation) から角を通る速さを決めて、
+軸ごとの最高速度・加速度を超えない台形の速度で動かす
+(前は線分ごとに一定の速さで動かし、鋭角では止まって待っていた)
+
+座標は mm、時間は秒。EV3 と Linux (lppe_lppb --plan) の両方でビルドする
+EV3 には FPU がないので、線分を足すとき (先読み) だけ float を使い、
+制御周期ごとの planner_step_fixed は整数 (固定小数点) だけで計算する
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PLANNER_BUFFER (16) // 先読みする線分の数
+
+// planner_step_fixed の単位
+#define PLANNER_FIX_SHIFT (16)  // 位置 (mm)・速さ (mm/s)・加速度 (mm/s^2) は 1/65536 単位
+#define PLANNER_TIME_SHIFT (20) // 時間 (s) は 1/2^20 単位 (4ms = 4194)
+#define PLANNER_TIME_MS(ms) ((int32_t)(((int64_t)(ms) << PLANNER_TIME_SHIFT) / 1000))
+
+// 前の定速の動き (line_time = max(|dx| * 1.0, |dy| * 0.4) / 10 秒) と同じ最高速度
+#define PLANNER_DEFAULT_MAX_SPEED_X (10.0f)  // mm/s
+#define PLANNER_DEFAULT_MAX_SPEED_Y (25.0f)  // mm/s
+#define PLANNER_DEFAULT_MAX_ACCEL_X (50.0f)  // mm/s^2
+#define PLANNER_DEFAULT_MAX_ACCEL_Y (100.0f) // mm/s^2
+#define PLANNER_DEFAULT_JUNCTION_DEVIATION (0.05f) // mm (大きいほど角を速く曲がる)
+#define PLANNER_DEFAULT_MIN_SPEED (0.5f) // mm/s (止まる直前でもこれより遅くしない)
+
+// ペンを上げて移動するとき (goto_position_pen_down) の上限。X は M モーターのパワー100 とほぼ同じ (これより速くしても台が追いつかない)
+// (前の goto_position は Y をパワー60 (約37mm/s) に抑えていた)
+#define PLANNER_TRAVEL_MAX_SPEED_X (11.5f)  // mm/s
+#define PLANNER_TRAVEL_MAX_SPEED_Y (45.0f)  // mm/s
+#define PLANNER_TRAVEL_MAX_ACCEL_X (150.0f) // mm/s^2
+#define PLANNER_TRAVEL_MAX_ACCEL_Y (300.0f) // mm/s^2
+
+typedef struct {
+    float max_speed_x, max_speed_y; // mm/s
+    float max_accel_x, max_accel_y; // mm/s^2
+    float junction_deviation;       // mm
+    float min_speed;                // mm/s
+} planner_limits_t;
+
+typedef struct {
+    float x0, y0;          // 始点
+    float ux, uy;          // 向き (長さ1)
+    float length;          // mm
+    float nominal_speed;   // 向きで決まる最高速度
+    float accel;           // 向きで決まる加速度
+    float max_entry_speed; // 角で決まる、入るときの最高速度
+    float entry_speed;     // 計画した入るときの速さ
+
+    // planner_step_fixed が使う固定小数点の値 (PLANNER_FIX_SHIFT)
+    int32_t fx0, fy0, fux, fuy;
+    int32_t flength, fnominal_speed, faccel, fentry_speed;
+} planner_block_t;
+
+typedef struct {
+    planner_limits_t limits;
+    planner_block_t blocks[PLANNER_BUFFER];
+    int head;  // 今動いている線分
+    int count; // たまっている線分の数
+    float last_x, last_y; // 最後に足した点
+    int32_t flast_x, flast_y, fmin_speed;
+    int32_t s, v; // 今の線分を進んだ距離と今の速さ (PLANNER_FIX_SHIFT)
+} planner_t;
+
+void planner_default_limits(planner_limits_t *limits);
+// 移動用 (PLANNER_TRAVEL_*、角は通らないので junction deviation などは描くときと同じ)
+void planner_travel_limits(planner_limits_t *limits);
+// (x, y) に止まっているところから始める
+void planner_init(planner_t *planner, const planner_limits_t *limits, float x, float y);
+int planner_is_full(const planner_t *planner);
+int planner_is_empty(const planner_t *planner);
+// 最後の点から (x, y) への線分を足して、速さを計画し直す (たまっている最後の線分の終わりでは止まる)
+// 長さ0の線分は足さない。いっぱいなら -1
+int planner_add_point(planner_t *planner, float x, float y);
+// dt (PLANNER_TIME_SHIFT) 進めて、その時の目標位置 (PLANNER_FIX_SHIFT の mm) を返す
+// 1: 動いている, 0: 全部の線分を動き終えた (最後の点を返す)
+int planner_step_fixed(planner_t *planner, int32_t dt, int32_t *x, int32_t *y);
+// planner_step_fixed を float で呼ぶ (Linux のツール用。EV3 と同じ計算になる)
+int planner_step(planner_t *planner, float dt, float *x, float *y);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,66 @@
+#include "setpoint.h"
+
+// path_stream.c と同じく、中身を書いてから head を進める (読む側は head を見てから中身を読む)
+#if defined(__arm__) && !defined(__linux__)
+#define QUEUE_LOAD(v) ({ __asm__ __volatile__("" ::: "memory"); uint32_t value_ = (v); __asm__ __volatile__("" ::: "memory"); value_; })
+#define QUEUE_STORE(v, x) do { __asm__ __volatile__("" ::: "memory"); (v) = (x); } while(0)
+#else
+#define QUEUE_LOAD(v) __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define QUEUE_STORE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#endif
+
+void setpoint_queue_init(setpoint_queue_t *queue, setpoint_t *points, uint32_t capacity) {
+    queue->points = points;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+int setpoint_queue_is_full(const setpoint_queue_t *queue) {
+    return queue->head - QUEUE_LOAD(queue->tail) >= queue->capacity;
+}
+
+int setpoint_queue_push(setpoint_queue_t *queue, uint32_t t, int32_t x, int32_t y) {
+    const uint32_t head = queue->head;
+    if(setpoint_queue_is_full(queue)){
+        return -1;
+    }
+    setpoint_t *point = &queue->points[head & (queue->capacity - 1)];
+    point->t = t;
+    point->x = x;
+    point->y = y;
+    QUEUE_STORE(queue->head, head + 1);
+    return 0;
+}
+
+int setpoint_queue_sample(setpoint_queue_t *queue, uint32_t now, int32_t *x, int32_t *y) {
+    const uint32_t mask = queue->capacity - 1;
+    const uint32_t head = QUEUE_LOAD(queue->head);
+    uint32_t tail = queue->tail;
+    if(head == tail){
+        return -1;
+    }
+    // 次の点の時刻が来ていたら、今の点を捨てる (時刻は一周しても差で比べる)
+    while(head - tail >= 2 && (int32_t)(now - queue->points[(tail + 1) & mask].t) >= 0){
+        ++tail;
+    }
+    QUEUE_STORE(queue->tail, tail);
+
+    const setpoint_t *a = &queue->points[tail & mask];
+    if(head - tail == 1){
+        *x = a->x;
+        *y = a->y;
+        return (int32_t)(now - a->t) >= 0 ? 0 : 1;
+    }
+    const setpoint_t *b = &queue->points[(tail + 1) & mask];
+    const int32_t elapsed = (int32_t)(now - a->t);
+    if(elapsed <= 0){
+        *x = a->x;
+        *y = a->y;
+    }else{
+        const int32_t span = (int32_t)(b->t - a->t);
+        *x = a->x + (int32_t)((int64_t)(b->x - a->x) * elapsed / span);
+        *y = a->y + (int32_t)((int64_t)(b->y - a->y) * elapsed / span);
+    }
+    return 1;
+}
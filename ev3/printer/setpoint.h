@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+Setpoint Queue
+planner を動かすタスクと制御タスク (周期ハンドラで起こされる) の間で、時刻つきの目標位置を渡すリングバッファ
+制御タスクは起こされた時刻で前後の目標の間を補間するので、起きる間隔がずれても目標は時刻どおりに動く
+
+書くのは1つのタスク、読むのも1つのタスクだけ (head は書く側、tail は読む側だけが進める)
+読む側は最後の1点を残しておく (書く側が遅れたら、その点で止まって待つ)
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t t;   // 時刻 (ms, get_tim)
+    int32_t x, y; // 目標 (CNTL_DEG の単位)
+} setpoint_t;
+
+typedef struct {
+    setpoint_t *points;
+    uint32_t capacity; // 2のべき乗
+    uint32_t head; // 次に書く位置 (書く側だけが進める)
+    uint32_t tail; // 今の区間の始めの点 (読む側だけが進める)
+} setpoint_queue_t;
+
+// points は capacity 個 (2のべき乗) の領域。読む側が止まっているときに呼ぶ
+void setpoint_queue_init(setpoint_queue_t *queue, setpoint_t *points, uint32_t capacity);
+int setpoint_queue_is_full(const setpoint_queue_t *queue);
+// 時刻は前の点より後にする。いっぱいなら -1
+int setpoint_queue_push(setpoint_queue_t *queue, uint32_t t, int32_t x, int32_t y);
+// 時刻 now の目標を補間して返し、過ぎた点を捨てる
+// 1: まだ先の点がある, 0: 最後の点の時刻を過ぎた (最後の点を返す), -1: 空
+int setpoint_queue_sample(setpoint_queue_t *queue, uint32_t now, int32_t *x, int32_t *y);
+
+#ifdef __cplusplus
+}
+#endif
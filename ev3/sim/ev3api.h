@@ -0,0 +1,120 @@
+#pragma once
+
+/*
+EV3 Simulator
+EV3RT の ev3api.h のうち、ev3/printer が使うものだけを Linux で動かすための置き換え
+モーターは仮想時間で動かし (sim.c)、tslp_tsk は実際には待たずに仮想時間を進める
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include "kernel_cfg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  カーネル
+ */
+
+typedef int bool_t;
+typedef int32_t ER;
+typedef int32_t ID;
+typedef uint32_t RELTIM; // ms
+typedef uint32_t uint_t;
+typedef uint32_t SYSTIM; // ms
+
+#define E_OK (0)
+#define E_OBJ (-41)
+#define E_QOVR (-43)
+
+ER tslp_tsk(RELTIM tmout);
+ER act_tsk(ID tskid);
+ER ext_tsk(void);
+ER get_tim(SYSTIM *p_systim);
+
+// EV3_CRE_CYC で作った周期ハンドラ
+ER ev3_sta_cyc(ID cycid);
+ER ev3_stp_cyc(ID cycid);
+
+#define LOG_EMERG (0)
+#define LOG_ALERT (1)
+#define LOG_CRIT (2)
+#define LOG_ERROR (3)
+#define LOG_WARNING (4)
+#define LOG_NOTICE (5)
+#define LOG_INFO (6)
+#define LOG_DEBUG (7)
+
+void syslog(uint_t prio, const char *format, ...);
+
+/*
+ *  モーター
+ */
+
+typedef enum {
+    EV3_PORT_A = 0,
+    EV3_PORT_B = 1,
+    EV3_PORT_C = 2,
+    EV3_PORT_D = 3,
+    TNUM_MOTOR_PORT = 4
+} motor_port_t;
+
+typedef enum {
+    NONE_MOTOR = 0,
+    MEDIUM_MOTOR,
+    LARGE_MOTOR,
+    UNREGULATED_MOTOR,
+    TNUM_MOTOR_TYPE
+} motor_type_t;
+
+ER ev3_motor_config(motor_port_t port, motor_type_t type);
+int32_t ev3_motor_get_counts(motor_port_t port);
+ER ev3_motor_reset_counts(motor_port_t port);
+ER ev3_motor_set_power(motor_port_t port, int power);
+ER ev3_motor_stop(motor_port_t port, bool_t brake);
+
+/*
+ *  ボタン・LCD・スピーカー
+ */
+
+typedef enum {
+    LEFT_BUTTON = 0,
+    RIGHT_BUTTON,
+    UP_BUTTON,
+    DOWN_BUTTON,
+    ENTER_BUTTON,
+    BACK_BUTTON,
+    TNUM_BUTTON
+} button_t;
+
+bool_t ev3_button_is_pressed(button_t button);
+
+typedef enum {
+    EV3_FONT_SMALL = 0,
+    EV3_FONT_MEDIUM
+} lcdfont_t;
+
+typedef enum {
+    EV3_LCD_WHITE = 0,
+    EV3_LCD_BLACK = 1
+} lcdcolor_t;
+
+#define EV3_LCD_WIDTH (178)
+#define EV3_LCD_HEIGHT (128)
+
+ER ev3_lcd_set_font(lcdfont_t font);
+ER ev3_lcd_draw_string(const char *str, int32_t x, int32_t y);
+ER ev3_lcd_fill_rect(int32_t x, int32_t y, int32_t w, int32_t h, lcdcolor_t color);
+
+#define NOTE_C4 (261.63)
+
+ER ev3_speaker_set_volume(uint8_t volume);
+ER ev3_speaker_play_tone(uint16_t frequency, int32_t duration);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+シミュレータ用の kernel_cfg.h
+EV3RT では app.cfg から作られる。ID は app.cfg の CRE_TSK, EV3_CRE_CYC と合わせる
+*/
+
+#define TMIN_APP_TPRI (1)
+
+#define MAIN_TASK (1)
+#define LOADER_TASK (2)
+#define CONTROL_TASK (3)
+
+#define TNUM_TSKID (3)
+
+#define CONTROL_CYC (1)
+
+#define TNUM_CYCID (1)
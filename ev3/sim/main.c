@@ -0,0 +1,104 @@
+// ev3_sim: ev3/printer の app.c を仮想時間で動かして、印刷にかかる時間とペン先の軌跡を出す
+// usage: ev3_sim [--root DIR] [--trace out.csv] [--operator-ms N] [--max-time-s N] [--quiet]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "app.h"
+
+static int print_result = -1;
+
+static void printUsage(void) {
+    fprintf(stderr, "usage: ev3_sim [--root DIR] [--trace out.csv] [--operator-ms N] [--max-time-s N] [--quiet]\n");
+    fprintf(stderr, "  --root         directory that contains ev3rt/print_data/path.lppb or path.txt (default: .)\n");
+    fprintf(stderr, "  --trace        write the pen tip trajectory (t_ms,x_mm,y_mm,pen_down,pen_deg in paper coordinates)\n");
+    fprintf(stderr, "  --operator-ms  time until ENTER is pressed at each color change (default: %.0f)\n", SIM_DEFAULT_OPERATOR_MS);
+    fprintf(stderr, "  --max-time-s   stop when the simulated time exceeds this (default: %.0f)\n", SIM_DEFAULT_MAX_TIME_MS * 0.001);
+    fprintf(stderr, "  --quiet        show only warnings and errors from syslog\n");
+}
+
+// main_task の位置合わせ (人がボタンで動かす) は飛ばして、位置合わせが終わったところから印刷する
+static void sim_main_task(intptr_t unused) {
+    ev3_motor_config(Y0_MOTOR_PORT, LARGE_MOTOR);
+    ev3_motor_config(Y1_MOTOR_PORT, LARGE_MOTOR);
+    ev3_motor_config(X_MOTOR_PORT, MEDIUM_MOTOR);
+    ev3_motor_config(PEN_MOTOR_PORT, MEDIUM_MOTOR);
+
+    x = 0.0;
+    y = 0.0;
+
+    print_result = print_data();
+}
+
+int main(int argc, char **argv) {
+    sim_options_t options;
+    sim_stats_t stats;
+    const char *root = ".";
+    const char *trace_path = NULL;
+
+    options.operator_ms = SIM_DEFAULT_OPERATOR_MS;
+    options.max_time_ms = SIM_DEFAULT_MAX_TIME_MS;
+    options.trace = NULL;
+    options.quiet = 0;
+
+    for(int i=1; i<argc; ++i){
+        if(strcmp(argv[i], "--root") == 0 && i + 1 < argc){
+            root = argv[++i];
+        }else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc){
+            trace_path = argv[++i];
+        }else if(strcmp(argv[i], "--operator-ms") == 0 && i + 1 < argc){
+            options.operator_ms = atof(argv[++i]);
+        }else if(strcmp(argv[i], "--max-time-s") == 0 && i + 1 < argc){
+            options.max_time_ms = atof(argv[++i]) * 1000.0;
+        }else if(strcmp(argv[i], "--quiet") == 0){
+            options.quiet = 1;
+        }else{
+            printUsage();
+            return 1;
+        }
+    }
+
+    if(trace_path != NULL){
+        options.trace = fopen(trace_path, "w");
+        if(options.trace == NULL){
+            fprintf(stderr, "Failed to open trace file: %s\n", trace_path);
+            return 1;
+        }
+    }
+    // app.c は ev3rt/print_data/... を相対パスで開く
+    if(chdir(root) != 0){
+        fprintf(stderr, "Failed to change directory: %s\n", root);
+        return 1;
+    }
+
+    // app.cfg の CRE_TSK, EV3_CRE_CYC と同じ (MAIN_TASK は TA_ACT)
+    sim_init(&options);
+    sim_create_task(MAIN_TASK, sim_main_task, TMIN_APP_TPRI + 1, 1);
+    sim_create_task(LOADER_TASK, loader_task, LOW_PRIORITY, 0);
+    sim_create_task(CONTROL_TASK, control_task, TMIN_APP_TPRI, 0);
+    sim_create_cyclic(CONTROL_CYC, control_cyc, CONTROL_PERIOD_MS, CONTROL_PHASE_MS);
+    sim_run(&stats);
+
+    if(options.trace != NULL){
+        fclose(options.trace);
+    }
+
+    printf("total:     %10.1f s\n", stats.total_ms * 0.001);
+    printf("pen down:  %10.1f s  (%.1f mm)\n", stats.pen_down_ms * 0.001, stats.draw_mm);
+    printf("pen up:    %10.1f s  (%.1f mm)\n", stats.pen_up_ms * 0.001, stats.travel_mm);
+    printf("pen lifts: %10d\n", stats.lift_n);
+    printf("presses:   %10d  (%.1f s each)\n", stats.press_n, options.operator_ms * 0.001);
+
+    if(stats.timeout){
+        fprintf(stderr, "Simulation stopped at %.1f s (--max-time-s)\n", options.max_time_ms * 0.001);
+        return 2;
+    }
+    if(print_result != 0){
+        fprintf(stderr, "Printing failed\n");
+        return 1;
+    }
+    return 0;
+}
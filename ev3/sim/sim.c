@@ -0,0 +1,471 @@
+#include "sim.h"
+#include "app.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ *  モーター
+ */
+
+// 負荷なしでパワー100のときの回転速度と、目標の速度に近づく時定数
+#define SIM_LARGE_MAX_SPEED (1050.0)  // deg/s (175rpm)
+#define SIM_LARGE_TAU (0.06)          // s
+#define SIM_MEDIUM_MAX_SPEED (1560.0) // deg/s (260rpm)
+#define SIM_MEDIUM_TAU (0.03)         // s
+#define SIM_BRAKE_TAU (0.01)          // s (ブレーキで止める)
+#define SIM_COAST_TAU (0.2)           // s (パワー0 で惰性で止まる)
+#define SIM_DEAD_POWER (2)            // これ以下のパワーでは摩擦で回らない
+
+#define SIM_PRESS_MS (200.0) // ENTER を押している時間
+
+// ペン先が紙に着くペンのモーターの角度 (上げた位置が 0、下ろしきると pen_down_angle の 145deg)
+// pen_is_down は下ろし始めたときに立つので、描いた時間と距離はこの角度で数える
+#define SIM_PEN_CONTACT_DEG (140.0) // deg
+
+typedef struct {
+    motor_type_t type;
+    int power;
+    bool_t brake;
+    double speed;  // deg/s
+    double counts; // deg
+} sim_motor_t;
+
+static sim_motor_t motors[TNUM_MOTOR_PORT];
+
+static double motor_target_speed(const sim_motor_t *m) {
+    const double max_speed = m->type == LARGE_MOTOR ? SIM_LARGE_MAX_SPEED : SIM_MEDIUM_MAX_SPEED;
+    const int power = abs(m->power);
+    if(m->brake || power <= SIM_DEAD_POWER) return 0;
+    const double speed = max_speed * (power - SIM_DEAD_POWER) / (100.0 - SIM_DEAD_POWER);
+    return m->power > 0 ? speed : -speed;
+}
+
+static double motor_tau(const sim_motor_t *m) {
+    if(m->brake) return SIM_BRAKE_TAU;
+    if(m->power == 0) return SIM_COAST_TAU;
+    return m->type == LARGE_MOTOR ? SIM_LARGE_TAU : SIM_MEDIUM_TAU;
+}
+
+// dt 秒の間パワーは変わらないので、一次遅れを式のまま解く
+static void motor_advance(sim_motor_t *m, double dt) {
+    const double target = motor_target_speed(m);
+    const double tau = motor_tau(m);
+    const double e = exp(-dt / tau);
+    m->counts += target * dt + (m->speed - target) * tau * (1.0 - e);
+    m->speed = target + (m->speed - target) * e;
+}
+
+static int valid_port(motor_port_t port) {
+    return port >= 0 && port < TNUM_MOTOR_PORT;
+}
+
+ER ev3_motor_config(motor_port_t port, motor_type_t type) {
+    if(!valid_port(port)) return E_OBJ;
+    memset(&motors[port], 0, sizeof(motors[port]));
+    motors[port].type = type;
+    return E_OK;
+}
+
+int32_t ev3_motor_get_counts(motor_port_t port) {
+    if(!valid_port(port)) return 0;
+    return (int32_t)floor(motors[port].counts + 0.5);
+}
+
+ER ev3_motor_reset_counts(motor_port_t port) {
+    if(!valid_port(port)) return E_OBJ;
+    motors[port].counts = 0;
+    return E_OK;
+}
+
+ER ev3_motor_set_power(motor_port_t port, int power) {
+    if(!valid_port(port)) return E_OBJ;
+    if(power > 100) power = 100;
+    if(power < -100) power = -100;
+    motors[port].power = power;
+    motors[port].brake = false;
+    return E_OK;
+}
+
+ER ev3_motor_stop(motor_port_t port, bool_t brake) {
+    if(!valid_port(port)) return E_OBJ;
+    motors[port].power = 0;
+    motors[port].brake = brake;
+    return E_OK;
+}
+
+/*
+ *  タスクと仮想時間
+ */
+
+typedef enum {
+    TASK_NONE = 0, // 登録されていない
+    TASK_DORMANT,
+    TASK_READY,    // 動ける (動いているタスクも含む)
+    TASK_SLEEPING
+} task_state_t;
+
+typedef struct {
+    void (*entry)(intptr_t);
+    int priority; // 小さいほど優先
+    task_state_t state;
+    int act_count; // 動いている間に act_tsk された回数 (TOPPERS と同じく 1 まで)
+    double wake_ms;
+    int started;   // スレッドを作った (終わっても次の起動のために残す)
+    jmp_buf exit_jmp; // ext_tsk で entry から抜ける
+    pthread_cond_t cond;
+} sim_task_t;
+
+// EV3_CRE_CYC の周期ハンドラ。時刻が来たら pick_next の中 (非タスクコンテキスト) で呼ぶ
+typedef struct {
+    void (*handler)(intptr_t);
+    double period_ms, phase_ms;
+    int active;
+    double next_ms;
+} sim_cyclic_t;
+
+static sim_task_t tasks[TNUM_TSKID + 1];
+static sim_cyclic_t cyclics[TNUM_CYCID + 1];
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static ID running = 0; // 動いてよいタスク (0: 誰も動かない)
+static int finished = 0;
+static double now_ms = 0;
+static __thread ID self = 0;
+static int in_handler = 0; // 周期ハンドラを呼んでいる (sim_lock を持っている)
+
+static sim_options_t options;
+static sim_stats_t stats;
+
+static bool_t last_pen_down = false;
+static pen_mode_t last_pen_mode = CENTER;
+static double last_pen_x = 0, last_pen_y = 0;
+
+// 今のペン先の位置 (用紙の座標、mm)。app.c の goto_position の逆
+static void pen_position(double *px, double *py) {
+    const double x_plot = (motors[X_MOTOR_PORT].counts + ((int)pen_mode) * PEN_BETWEEN_HALF_DEG) / x_mm_to_deg;
+    const double y_plot = (motors[Y0_MOTOR_PORT].counts + motors[Y1_MOTOR_PORT].counts) * 0.5 / y_mm_to_deg;
+    *px = x_plot + A4_WIDTH_MM * 0.5;
+    *py = A4_HEIGHT_MM * 0.5 - y_plot;
+}
+
+// ペン先が紙に着いている。CENTER のときはペンのモーターを使わないので app.c の状態のまま
+static bool_t pen_contact(void) {
+    if(pen_mode == CENTER) return pen_is_down;
+    return fabs(motors[PEN_MOTOR_PORT].counts) >= SIM_PEN_CONTACT_DEG;
+}
+
+// 仮想時間を t まで進める (sim_lock を持って呼ぶ)
+static void advance_to(double t) {
+    const double dt = t - now_ms;
+    double px, py;
+
+    for(int i=0; i<TNUM_MOTOR_PORT; ++i){
+        motor_advance(&motors[i], dt * 0.001);
+    }
+    now_ms = t;
+
+    // ペンを持ち替えたときはペン先が飛ぶので、距離に数えない
+    pen_position(&px, &py);
+    const double d = pen_mode == last_pen_mode ? hypot(px - last_pen_x, py - last_pen_y) : 0;
+    const bool_t contact = pen_contact();
+    if(contact){
+        stats.pen_down_ms += dt;
+        stats.draw_mm += d;
+    }else{
+        stats.pen_up_ms += dt;
+        stats.travel_mm += d;
+    }
+    if(last_pen_down && !contact){
+        stats.lift_n++;
+    }
+    last_pen_down = contact;
+    last_pen_mode = pen_mode;
+    last_pen_x = px;
+    last_pen_y = py;
+
+    if(options.trace != NULL){
+        fprintf(options.trace, "%.1f,%.3f,%.3f,%d,%.1f\n", now_ms, px, py, contact ? 1 : 0, motors[PEN_MOTOR_PORT].counts);
+    }
+}
+
+// 次に動かすタスク (sim_lock を持って呼ぶ)
+// 動けるタスクがなければ、一番早く起きるタスクの時刻まで時間を進める。0: もう動くタスクがない
+static ID pick_next(void) {
+    while(!finished){
+        ID best = 0;
+        double wake = INFINITY;
+        for(ID id=1; id<=TNUM_CYCID; ++id){
+            sim_cyclic_t *cyc = &cyclics[id];
+            while(cyc->active && cyc->next_ms <= now_ms){
+                cyc->next_ms += cyc->period_ms;
+                in_handler = 1;
+                cyc->handler(0);
+                in_handler = 0;
+            }
+            if(cyc->active && cyc->next_ms < wake) wake = cyc->next_ms;
+        }
+        for(ID id=1; id<=TNUM_TSKID; ++id){
+            sim_task_t *task = &tasks[id];
+            if(task->state == TASK_SLEEPING && task->wake_ms <= now_ms){
+                task->state = TASK_READY;
+            }
+            if(task->state == TASK_READY){
+                if(best == 0 || task->priority < tasks[best].priority) best = id;
+            }else if(task->state == TASK_SLEEPING && task->wake_ms < wake){
+                wake = task->wake_ms;
+            }
+        }
+        if(best != 0) return best;
+        if(wake == INFINITY) return 0;
+        if(wake > options.max_time_ms){
+            stats.timeout = 1;
+            return 0;
+        }
+        advance_to(wake);
+    }
+    return 0;
+}
+
+static void switch_to(ID next) {
+    running = next;
+    if(next == 0){
+        finished = 1;
+        pthread_cond_signal(&done_cond);
+    }else{
+        pthread_cond_signal(&tasks[next].cond);
+    }
+}
+
+// 優先するタスクがあれば切り替えて、self の番に戻るまで待つ (sim_lock を持って呼ぶ)
+// 終わったら (finished) 戻らない。残ったスレッドは sim_run の後でプロセスと一緒に終わる
+static void dispatch(void) {
+    const ID next = pick_next();
+    if(next == self) return;
+    switch_to(next);
+    while(running != self){
+        pthread_cond_wait(&tasks[self].cond, &sim_lock);
+    }
+}
+
+// entry から戻った (または ext_tsk) ので休止状態にする。起動要求がたまっていればもう一度動かす
+// 戻ってきたら、次に起動されて self の番になったとき (sim_lock を持って呼ぶ)
+static void task_end(void) {
+    if(tasks[self].act_count > 0){
+        tasks[self].act_count--;
+        tasks[self].state = TASK_READY;
+    }else{
+        tasks[self].state = TASK_DORMANT;
+    }
+    // MAIN_TASK が終わったら印刷は終わり
+    switch_to(self == MAIN_TASK ? 0 : pick_next());
+    while(running != self){
+        pthread_cond_wait(&tasks[self].cond, &sim_lock);
+    }
+}
+
+// タスクごとに1つのスレッドで、起動されるたびに entry を呼ぶ (周期で起こされるタスクのたびにスレッドを作らない)
+static void *task_thread(void *arg) {
+    self = (ID)(intptr_t)arg;
+    pthread_mutex_lock(&sim_lock);
+    while(1){
+        while(running != self){
+            pthread_cond_wait(&tasks[self].cond, &sim_lock);
+        }
+        pthread_mutex_unlock(&sim_lock);
+        if(setjmp(tasks[self].exit_jmp) == 0){
+            tasks[self].entry(0);
+        }
+        pthread_mutex_lock(&sim_lock);
+        task_end();
+    }
+    return NULL;
+}
+
+// sim_lock を持って呼ぶ
+static ER activate(ID id) {
+    pthread_t thread;
+    if(id < 1 || id > TNUM_TSKID || tasks[id].state == TASK_NONE) return E_OBJ;
+    if(tasks[id].state != TASK_DORMANT){
+        if(tasks[id].act_count > 0) return E_QOVR;
+        tasks[id].act_count++;
+        return E_OK;
+    }
+    tasks[id].state = TASK_READY;
+    if(!tasks[id].started){
+        if(pthread_create(&thread, NULL, task_thread, (void *)(intptr_t)id) != 0){
+            tasks[id].state = TASK_DORMANT;
+            return E_OBJ;
+        }
+        pthread_detach(thread);
+        tasks[id].started = 1;
+    }
+    return E_OK;
+}
+
+ER tslp_tsk(RELTIM tmout) {
+    pthread_mutex_lock(&sim_lock);
+    tasks[self].state = TASK_SLEEPING;
+    tasks[self].wake_ms = now_ms + tmout;
+    dispatch();
+    pthread_mutex_unlock(&sim_lock);
+    return E_OK;
+}
+
+ER act_tsk(ID tskid) {
+    // 周期ハンドラからは起動するだけ (ハンドラが終わってから pick_next が選ぶ)
+    if(in_handler){
+        return activate(tskid);
+    }
+    pthread_mutex_lock(&sim_lock);
+    const ER result = activate(tskid);
+    if(result == E_OK){
+        dispatch();
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return result;
+}
+
+ER ext_tsk(void) {
+    longjmp(tasks[self].exit_jmp, 1);
+    return E_OK;
+}
+
+ER get_tim(SYSTIM *p_systim) {
+    *p_systim = (SYSTIM)floor(now_ms);
+    return E_OK;
+}
+
+ER ev3_sta_cyc(ID cycid) {
+    if(cycid < 1 || cycid > TNUM_CYCID || cyclics[cycid].handler == NULL) return E_OBJ;
+    if(!in_handler) pthread_mutex_lock(&sim_lock);
+    if(!cyclics[cycid].active){
+        cyclics[cycid].active = 1;
+        cyclics[cycid].next_ms = now_ms + cyclics[cycid].phase_ms;
+    }
+    if(!in_handler) pthread_mutex_unlock(&sim_lock);
+    return E_OK;
+}
+
+ER ev3_stp_cyc(ID cycid) {
+    if(cycid < 1 || cycid > TNUM_CYCID || cyclics[cycid].handler == NULL) return E_OBJ;
+    if(!in_handler) pthread_mutex_lock(&sim_lock);
+    cyclics[cycid].active = 0;
+    if(!in_handler) pthread_mutex_unlock(&sim_lock);
+    return E_OK;
+}
+
+void syslog(uint_t prio, const char *format, ...) {
+    va_list args;
+    if(options.quiet && prio > LOG_WARNING) return;
+    fprintf(stderr, "[%10.3f] ", now_ms * 0.001);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+/*
+ *  ボタン・LCD・スピーカー
+ */
+
+static double press_at = -1; // 次に ENTER を押す時刻
+static int press_counted = 0;
+
+bool_t ev3_button_is_pressed(button_t button) {
+    if(button != ENTER_BUTTON) return false;
+    // 押し終わった後に待ち始めたら、operator_ms 後に押す
+    if(press_at < 0 || now_ms >= press_at + SIM_PRESS_MS){
+        press_at = now_ms + options.operator_ms;
+        press_counted = 0;
+    }
+    if(now_ms < press_at) return false;
+    if(!press_counted){
+        stats.press_n++;
+        press_counted = 1;
+    }
+    return true;
+}
+
+ER ev3_lcd_set_font(lcdfont_t font) {
+    return E_OK;
+}
+
+ER ev3_lcd_draw_string(const char *str, int32_t x, int32_t y) {
+    return E_OK;
+}
+
+ER ev3_lcd_fill_rect(int32_t x, int32_t y, int32_t w, int32_t h, lcdcolor_t color) {
+    return E_OK;
+}
+
+ER ev3_speaker_set_volume(uint8_t volume) {
+    return E_OK;
+}
+
+ER ev3_speaker_play_tone(uint16_t frequency, int32_t duration) {
+    return E_OK;
+}
+
+/*
+ *  シミュレータ
+ */
+
+void sim_init(const sim_options_t *opts) {
+    options = *opts;
+    memset(&stats, 0, sizeof(stats));
+    memset(motors, 0, sizeof(motors));
+    for(ID id=1; id<=TNUM_TSKID; ++id){
+        tasks[id].state = TASK_NONE;
+        tasks[id].act_count = 0;
+        tasks[id].started = 0;
+        pthread_cond_init(&tasks[id].cond, NULL);
+    }
+    memset(cyclics, 0, sizeof(cyclics));
+    now_ms = 0;
+    running = 0;
+    finished = 0;
+    press_at = -1;
+    last_pen_down = false;
+    last_pen_mode = CENTER;
+    pen_position(&last_pen_x, &last_pen_y);
+    if(options.trace != NULL){
+        fprintf(options.trace, "t_ms,x_mm,y_mm,pen_down,pen_deg\n");
+    }
+}
+
+void sim_create_task(ID id, void (*entry)(intptr_t), int priority, int start) {
+    if(id < 1 || id > TNUM_TSKID) return;
+    pthread_mutex_lock(&sim_lock);
+    tasks[id].entry = entry;
+    tasks[id].priority = priority;
+    tasks[id].state = TASK_DORMANT;
+    if(start){
+        activate(id);
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void sim_create_cyclic(ID id, void (*handler)(intptr_t), RELTIM period, RELTIM phase) {
+    if(id < 1 || id > TNUM_CYCID) return;
+    pthread_mutex_lock(&sim_lock);
+    cyclics[id].handler = handler;
+    cyclics[id].period_ms = period;
+    cyclics[id].phase_ms = phase;
+    cyclics[id].active = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void sim_run(sim_stats_t *result) {
+    pthread_mutex_lock(&sim_lock);
+    switch_to(pick_next());
+    while(!finished){
+        pthread_cond_wait(&done_cond, &sim_lock);
+    }
+    stats.total_ms = now_ms;
+    *result = stats;
+    pthread_mutex_unlock(&sim_lock);
+}
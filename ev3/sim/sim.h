@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+EV3 Simulator
+ev3/printer の app.c を Linux で動かして、印刷にかかる時間を測る
+
+- タスクはスレッドで動かすが、同時に動くのは1つだけ (優先度の高い順、TOPPERS と同じ)
+- 周期ハンドラ (EV3_CRE_CYC) は時刻が来たらタスクを選ぶ前に呼ぶ。ハンドラから act_tsk できる
+- tslp_tsk は仮想時間を進める。動けるタスクがなくなったら、一番早く起きるタスクの時刻まで進める
+- モーターは一次遅れ (パワー → 目標の回転速度に時定数で近づく) で動かす
+- ENTER は「待ち始めてから operator_ms 後に押す人」がいるとみなす
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ev3api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_DEFAULT_OPERATOR_MS (3000.0)
+#define SIM_DEFAULT_MAX_TIME_MS (24.0 * 3600.0 * 1000.0)
+
+typedef struct {
+    double operator_ms; // ENTER を待ち始めてから押すまで
+    double max_time_ms; // これを超えたら止める (制御が収束しないときなど)
+    FILE *trace;        // NULL でなければ t_ms,x_mm,y_mm,pen_down,pen_deg を書く (用紙の座標)
+    int quiet;          // syslog を表示しない
+} sim_options_t;
+
+typedef struct {
+    double total_ms;
+    double pen_down_ms, pen_up_ms; // ペン先が紙に着いている / 離れている時間
+    double draw_mm, travel_mm; // ペン先が動いた距離 (紙に着いている / 離れている)
+    int lift_n;  // ペン先が紙から離れた回数
+    int press_n; // ENTER を押した回数
+    int timeout; // max_time_ms で止めた
+} sim_stats_t;
+
+void sim_init(const sim_options_t *options);
+// app.cfg の CRE_TSK に当たる。start なら TA_ACT (すぐに起動する)
+void sim_create_task(ID id, void (*entry)(intptr_t), int priority, int start);
+// app.cfg の EV3_CRE_CYC に当たる (TA_NULL: ev3_sta_cyc で動かし始める)。時間は ms
+void sim_create_cyclic(ID id, void (*handler)(intptr_t), RELTIM period, RELTIM phase);
+// MAIN_TASK が終わるまで (または max_time_ms まで) 動かす
+void sim_run(sim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,5 @@
+#pragma once
+
+/*
+シミュレータ用の target_test.h (EV3RT ではターゲット依存の定義が入る)
+*/
@@ -0,0 +1,434 @@
+// lppe_bench: img_module の重い処理の速さを測る
+// usage: lppe_bench [--images dir] [--scales 0.5,1] [--sizes 512,1024,2048] [--repeat N] [--warmup N]
+//                   [--filter kernel] [--threads N] [--json file]
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
+#include <memory>
+
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+#include "img/vector_data.hpp"
+#include "img/colormap_generator.hpp"
+#include "core/preview_geometry.hpp"
+#include "trace/json.hpp"
+#include "cross/cross.hpp"
+
+namespace fs = std::filesystem;
+
+#define BENCH_JSON_VERSION (1)
+#define SYNTHETIC_SEED (20250601)
+
+struct BenchOptions {
+    std::string images_dir;
+    std::vector<double> scales = {0.5, 1.0};
+    std::vector<int> sizes = {512, 1024, 2048};
+    int repeat = 7;
+    int warmup = 1;
+    std::string filter;
+    int threads = -1; // -1: OpenCV の既定のまま
+    std::string json_path;
+};
+
+struct BenchInput {
+    std::string name;
+    cv::Mat color; // BGR
+    cv::Mat mask;  // 0/255 (インクを置く領域)
+};
+
+struct BenchResult {
+    std::string kernel;
+    std::string input;
+    int width = 0, height = 0;
+    std::string unit; // "px" または "points"
+    double units = 0; // 1回の実行で処理する量
+    double median_ms = 0, p95_ms = 0, mean_ms = 0, min_ms = 0;
+    double throughput = 0; // units / 秒 (中央値から)
+};
+
+static void printUsage() {
+    std::cerr << "usage: lppe_bench [--images dir] [--scales 0.5,1] [--sizes 512,1024,2048] [--repeat N] [--warmup N]" << std::endl;
+    std::cerr << "                  [--filter kernel] [--threads N] [--json file]" << std::endl;
+    std::cerr << "  --images   real images to measure (default: <exe dir>/saves/images)" << std::endl;
+    std::cerr << "  --scales   resize factors applied to the real images" << std::endl;
+    std::cerr << "  --sizes    side lengths of the synthetic inputs (0 to skip)" << std::endl;
+    std::cerr << "  --filter   run only kernels whose name contains this string" << std::endl;
+    std::cerr << "  --json     write the results as JSON for tracking over time" << std::endl;
+}
+
+template <typename T>
+static std::vector<T> parseList(const std::string& str) {
+    std::vector<T> values;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        values.push_back(static_cast<T>(std::atof(item.c_str())));
+    }
+    return values;
+}
+
+static bool isImageFile(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tif" || ext == ".tiff" || ext == ".webp";
+}
+
+static cv::Mat makeMask(const cv::Mat& color) {
+    cv::Mat gray, mask;
+    cv::cvtColor(color, gray, cv::COLOR_BGR2GRAY);
+    cv::threshold(gray, mask, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+    return mask;
+}
+
+// 色の付いた図形と太い線を白地に描く (シードが同じなら毎回同じ画像)
+static BenchInput makeSyntheticInput(int size) {
+    static const cv::Scalar palette[] = {
+        cv::Scalar(0, 0, 255), cv::Scalar(0, 255, 0), cv::Scalar(255, 0, 0),
+        cv::Scalar(255, 255, 0), cv::Scalar(255, 0, 255), cv::Scalar(0, 255, 255), cv::Scalar(0, 0, 0),
+    };
+    const int palette_size = static_cast<int>(sizeof(palette) / sizeof(palette[0]));
+    cv::RNG rng(SYNTHETIC_SEED);
+    BenchInput input;
+    input.name = "synthetic_" + std::to_string(size);
+    input.color = cv::Mat(size, size, CV_8UC3, cv::Scalar(255, 255, 255));
+
+    const int shapes = (std::max)(8, size / 16);
+    for (int i = 0; i < shapes; ++i) {
+        const cv::Scalar color = palette[rng.uniform(0, palette_size)];
+        const cv::Point center(rng.uniform(0, size), rng.uniform(0, size));
+        const int r = rng.uniform(size / 64 + 2, size / 12 + 3);
+        switch (rng.uniform(0, 3)) {
+            case 0:
+                cv::ellipse(input.color, center, cv::Size(r, rng.uniform(r / 2 + 1, r + 1)), rng.uniform(0, 180), 0, 360, color, cv::FILLED, cv::LINE_8);
+                break;
+            case 1:
+                cv::rectangle(input.color, cv::Rect(center.x, center.y, r, r), color, cv::FILLED, cv::LINE_8);
+                break;
+            default: {
+                const cv::Point end(rng.uniform(0, size), rng.uniform(0, size));
+                cv::line(input.color, center, end, color, rng.uniform(1, (std::max)(2, size / 128)), cv::LINE_8);
+                break;
+            }
+        }
+    }
+    input.mask = makeMask(input.color);
+    return input;
+}
+
+static cv::Mat resizeImage(const cv::Mat& src, double scale) {
+    if (std::abs(scale - 1.0) < 1e-9) return src.clone();
+    cv::Mat dst;
+    cv::resize(src, dst, cv::Size(), scale, scale, scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+    return dst;
+}
+
+static std::vector<BenchInput> loadInputs(const BenchOptions& options) {
+    std::vector<BenchInput> inputs;
+    std::error_code ec;
+    if (!options.images_dir.empty() && fs::is_directory(options.images_dir, ec)) {
+        std::vector<fs::path> files;
+        for (const auto& entry : fs::directory_iterator(options.images_dir, ec)) {
+            if (entry.is_regular_file() && isImageFile(entry.path())) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            cv::Mat img = cv::imread(file.string(), cv::IMREAD_COLOR);
+            if (img.empty()) {
+                std::cerr << "Failed to load image: " << file << std::endl;
+                continue;
+            }
+            for (double scale : options.scales) {
+                if (scale <= 0) continue;
+                BenchInput input;
+                std::ostringstream name;
+                name << file.filename().string() << "@" << scale;
+                input.name = name.str();
+                input.color = resizeImage(img, scale);
+                input.mask = makeMask(input.color);
+                inputs.push_back(std::move(input));
+            }
+        }
+    } else if (!options.images_dir.empty()) {
+        std::cerr << "Image directory not found: " << options.images_dir << " (only synthetic inputs are used)" << std::endl;
+    }
+    for (int size : options.sizes) {
+        if (size > 0) inputs.push_back(makeSyntheticInput(size));
+    }
+    return inputs;
+}
+
+// warmup 回捨ててから repeat 回測る。run は1回分の処理量を返す
+static BenchResult measure(const BenchOptions& options, const std::string& kernel, const BenchInput& input,
+    const std::string& unit, const std::function<double()>& run) {
+    BenchResult result;
+    result.kernel = kernel;
+    result.input = input.name;
+    result.width = input.color.cols;
+    result.height = input.color.rows;
+    result.unit = unit;
+
+    for (int i = 0; i < options.warmup; ++i) {
+        run();
+    }
+    std::vector<double> times;
+    for (int i = 0; i < options.repeat; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        result.units = run();
+        const auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    const size_t n = times.size();
+    result.median_ms = (n % 2 == 1) ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) * 0.5;
+    // p95 は nearest-rank
+    const size_t rank = static_cast<size_t>(std::ceil(0.95 * n));
+    result.p95_ms = times[(std::max)(size_t(1), rank) - 1];
+    double sum = 0;
+    for (double t : times) sum += t;
+    result.mean_ms = sum / n;
+    result.min_ms = times.front();
+    result.throughput = result.median_ms > 0 ? result.units / (result.median_ms / 1000.0) : 0;
+    return result;
+}
+
+static size_t countPoints(const VectorData& data) {
+    size_t points = 0;
+    for (const auto* lines : {&data.polylines, &data.contours, &data.hatch_lines}) {
+        for (const auto& [id, polylines] : *lines) {
+            for (const auto& polyline : polylines) {
+                points += polyline.size();
+            }
+        }
+    }
+    return points;
+}
+
+static std::vector<std::vector<cv::Point2f>> toFloat(const std::vector<std::vector<cv::Point>>& polylines) {
+    std::vector<std::vector<cv::Point2f>> result;
+    result.reserve(polylines.size());
+    for (const auto& polyline : polylines) {
+        result.emplace_back(polyline.begin(), polyline.end());
+    }
+    return result;
+}
+
+static std::vector<BenchResult> runBenchmarks(const BenchOptions& options, const std::vector<BenchInput>& inputs) {
+    std::vector<BenchResult> results;
+    auto enabled = [&](const std::string& kernel) {
+        return options.filter.empty() || kernel.find(options.filter) != std::string::npos;
+    };
+    auto report = [&](const BenchResult& r) {
+        std::cout << std::left << std::setw(28) << r.kernel << std::setw(28) << r.input
+            << std::right << std::fixed << std::setprecision(2)
+            << std::setw(10) << r.median_ms << std::setw(10) << r.p95_ms
+            << std::setw(14) << std::setprecision(3) << r.throughput / 1e6 << " M" << r.unit << "/s" << std::endl;
+        results.push_back(r);
+    };
+
+    Colors colors = {
+        {"Red", "FF0000"}, {"Green", "00FF00"}, {"Blue", "0000FF"},
+        {"Cyan", "00FFFF"}, {"Magenta", "FF00FF"}, {"Yellow", "FFFF00"},
+        {"Black", "000000"}, {"White", "FFFFFF"},
+    };
+    std::shared_ptr<const PaletteLUT> lut;
+    if (enabled("generateMultiColorMap+LUT")) {
+        lut = buildPaletteLUT(colors);
+    }
+
+    std::cout << std::left << std::setw(28) << "kernel" << std::setw(28) << "input"
+        << std::right << std::setw(10) << "median ms" << std::setw(10) << "p95 ms" << std::setw(14) << "throughput" << std::endl;
+
+    for (const auto& input : inputs) {
+        const double pixels = static_cast<double>(input.color.total());
+
+        // 後段の入力は1回だけ作っておく
+        cv::Mat thinned;
+        NWGThinningLUTParallel(input.mask, thinned);
+        thinned = thinned.clone(); // extractPolylines は連続したメモリを前提にしている
+
+        if (enabled("NWGThinningLUTParallel")) {
+            report(measure(options, "NWGThinningLUTParallel", input, "px", [&]() {
+                cv::Mat dst;
+                NWGThinningLUTParallel(input.mask, dst);
+                return pixels;
+            }));
+        }
+        if (enabled("extractPolylines")) {
+            report(measure(options, "extractPolylines", input, "px", [&]() {
+                auto polylines = extractPolylines(thinned);
+                return pixels;
+            }));
+        }
+        if (enabled("generateHatchLines")) {
+            report(measure(options, "generateHatchLines", input, "px", [&]() {
+                auto hatch = generateHatchLines(input.mask, 4, 45);
+                return pixels;
+            }));
+        }
+        if (enabled("extractContoursFromFilled")) {
+            report(measure(options, "extractContoursFromFilled", input, "px", [&]() {
+                std::vector<std::vector<cv::Point>> polylines, contours;
+                extractContoursFromFilled(input.mask, polylines, contours);
+                return pixels;
+            }));
+        }
+        if (enabled("generateMultiColorMap")) {
+            report(measure(options, "generateMultiColorMap", input, "px", [&]() {
+                ColorMap color_map;
+                cv::Mat view_map;
+                generateMultiColorMap(input.color, colors, color_map, view_map);
+                return pixels;
+            }));
+        }
+        if (lut) {
+            report(measure(options, "generateMultiColorMap+LUT", input, "px", [&]() {
+                ColorMap color_map;
+                cv::Mat view_map;
+                generateMultiColorMap(input.color, colors, color_map, view_map, lut.get());
+                return pixels;
+            }));
+        }
+        if (enabled("optimizeVectorData") || enabled("buildPreviewGeometry")) {
+            VectorData data;
+            data.width = input.color.cols;
+            data.height = input.color.rows;
+            data.color_names[0] = "black";
+            data.color_values[0] = cv::Scalar(0, 0, 0);
+            data.polylines[0] = toFloat(extractPolylines(thinned));
+            std::vector<std::vector<cv::Point>> polylines, contours;
+            extractContoursFromFilled(input.mask, polylines, contours);
+            data.contours[0] = toFloat(contours);
+            data.hatch_lines[0] = generateHatchLines(input.mask, 4, 45);
+            const double points = static_cast<double>(countPoints(data));
+            if (enabled("optimizeVectorData")) {
+                report(measure(options, "optimizeVectorData", input, "points", [&]() {
+                    VectorData optimized;
+                    optimizeVectorData(data, optimized);
+                    return points;
+                }));
+            }
+            if (enabled("buildPreviewGeometry")) {
+                // GUI のプレビューと同じく、1000px の枠に全体表示したときと、真ん中を8倍に拡大したとき
+                updateBounds(data);
+                PreviewStyle style;
+                style.view = VectorView::Points;
+                PreviewGeometry geometry;
+                const PreviewViewport fit = fitPreviewViewport(static_cast<float>(data.width), static_cast<float>(data.height), 0, 0, 1000, 1000);
+                PreviewViewport zoomed = fit;
+                zoomed.zoom = fit.zoom * 8;
+                zoomed.pan_x = data.width * 0.5f - zoomed.width * 0.5f / zoomed.zoom;
+                zoomed.pan_y = data.height * 0.5f - zoomed.height * 0.5f / zoomed.zoom;
+                report(measure(options, "buildPreviewGeometry", input, "points", [&]() {
+                    buildPreviewGeometry(data, fit, style, geometry);
+                    return points;
+                }));
+                report(measure(options, "buildPreviewGeometry/zoom8", input, "points", [&]() {
+                    buildPreviewGeometry(data, zoomed, style, geometry);
+                    return points;
+                }));
+            }
+        }
+    }
+    return results;
+}
+
+static bool writeJson(const std::string& path, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        std::cerr << "Failed to open file for writing: " << path << std::endl;
+        return false;
+    }
+    const std::time_t now = std::time(nullptr);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    ofs << std::setprecision(6) << std::fixed;
+    ofs << "{\n";
+    ofs << "  \"version\": " << BENCH_JSON_VERSION << ",\n";
+    ofs << "  \"timestamp\": \"" << timestamp << "\",\n";
+    ofs << "  \"opencv_version\": \"" << CV_VERSION << "\",\n";
+    ofs << "  \"opencv_threads\": " << cv::getNumThreads() << ",\n";
+    ofs << "  \"repeat\": " << options.repeat << ",\n";
+    ofs << "  \"warmup\": " << options.warmup << ",\n";
+    ofs << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        ofs << "    {\"kernel\": \"" << jsonEscape(r.kernel) << "\", \"input\": \"" << jsonEscape(r.input) << "\""
+            << ", \"width\": " << r.width << ", \"height\": " << r.height
+            << ", \"unit\": \"" << r.unit << "\", \"units\": " << r.units
+            << ", \"median_ms\": " << r.median_ms << ", \"p95_ms\": " << r.p95_ms
+            << ", \"mean_ms\": " << r.mean_ms << ", \"min_ms\": " << r.min_ms
+            << ", \"throughput_per_s\": " << r.throughput << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    ofs << "  ]\n";
+    ofs << "}\n";
+    return ofs.good();
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    options.images_dir = getExecutableDir() + "/saves/images";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--images" && has_value) {
+            options.images_dir = argv[++i];
+        } else if (arg == "--scales" && has_value) {
+            options.scales = parseList<double>(argv[++i]);
+        } else if (arg == "--sizes" && has_value) {
+            options.sizes = parseList<int>(argv[++i]);
+        } else if (arg == "--repeat" && has_value) {
+            options.repeat = (std::max)(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup = (std::max)(0, std::atoi(argv[++i]));
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+    if (options.threads >= 0) {
+        cv::setNumThreads(options.threads);
+    }
+
+    const auto inputs = loadInputs(options);
+    if (inputs.empty()) {
+        std::cerr << "No inputs to measure." << std::endl;
+        return 1;
+    }
+    const auto results = runBenchmarks(options, inputs);
+
+    if (!options.json_path.empty()) {
+        if (!writeJson(options.json_path, options, results)) {
+            return 1;
+        }
+        std::cout << "results: " << options.json_path << std::endl;
+    }
+    return 0;
+}
@@ -1,4 +1,7 @@
 cd build
 ninja
 cp -r gui_app ../lppe
+cp lppe_cli ../lppe_cli
+cp lppe_bench ../lppe_bench
+cp lppe_golden ../lppe_golden
 cd ..
@@ -0,0 +1,683 @@
+#include "disk_cache.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <map>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "img/content_hash.hpp"
+
+namespace fs = std::filesystem;
+
+#define CACHE_VERSION (2)
+#define CACHE_ALIGNMENT (64) // 画素データの境界 (SIMDでそのまま読める)
+#define CACHE_EXTENSION ".lppc"
+
+enum CacheEntryKind : uint32_t {
+    CACHE_KIND_MAT = 1,
+    CACHE_KIND_COLORMAP = 2,
+    CACHE_KIND_VECTOR_DATA = 3,
+    CACHE_KIND_DRAW_PATH = 4,
+};
+
+struct CacheFileHeader {
+    char magic[4];     // "LPPC"
+    uint32_t version;
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t key;      // キーのハッシュ (この後ろにキーのバイト列が続く)
+};
+static_assert(sizeof(CacheFileHeader) == 24, "CacheFileHeader must be packed");
+
+// 読み込み専用のメモリマップ
+class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return;
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) return;
+            ptr = static_cast<const uchar*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (ptr != nullptr) length = static_cast<size_t>(file_size.QuadPart);
+#else
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+            void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) return;
+            ptr = static_cast<const uchar*>(p);
+            length = static_cast<size_t>(st.st_size);
+#endif
+        }
+        ~MappedFile() {
+#if defined(_WIN32)
+            if (ptr != nullptr) UnmapViewOfFile(ptr);
+            if (mapping != nullptr) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+            if (ptr != nullptr) munmap(const_cast<uchar*>(ptr), length);
+            if (fd >= 0) ::close(fd);
+#endif
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uchar* data() const { return ptr; }
+        size_t size() const { return length; }
+    private:
+        const uchar* ptr = nullptr;
+        size_t length = 0;
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+};
+
+// 書き込み: 位置を数えながら順に書く
+class CacheWriter {
+    public:
+        explicit CacheWriter(std::ofstream& ofs) : ofs(ofs) {}
+
+        void bytes(const void* data, size_t size) {
+            ofs.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            pos += size;
+        }
+        template <typename T>
+        void pod(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "pod requires a trivially copyable type");
+            bytes(&value, sizeof(T));
+        }
+        void string(const std::string& str) {
+            pod(static_cast<uint32_t>(str.size()));
+            bytes(str.data(), str.size());
+        }
+        void scalar(const cv::Scalar& s) {
+            for (int c = 0; c < 4; ++c) {
+                pod(s[c]);
+            }
+        }
+        void align() {
+            static const char zeros[CACHE_ALIGNMENT] = {};
+            const size_t pad = (CACHE_ALIGNMENT - pos % CACHE_ALIGNMENT) % CACHE_ALIGNMENT;
+            bytes(zeros, pad);
+        }
+        void mat(const cv::Mat& m) {
+            pod(static_cast<int32_t>(m.rows));
+            pod(static_cast<int32_t>(m.cols));
+            pod(static_cast<int32_t>(m.type()));
+            align();
+            const size_t row_bytes = m.cols * m.elemSize();
+            for (int y = 0; y < m.rows; ++y) {
+                bytes(m.ptr(y), row_bytes);
+            }
+        }
+        // 0/255 のマスクを1画素1bitに詰める
+        void mask(const cv::Mat& m) {
+            pod(static_cast<int32_t>(m.rows));
+            pod(static_cast<int32_t>(m.cols));
+            align();
+            std::vector<uchar> packed((m.cols + 7) / 8);
+            for (int y = 0; y < m.rows; ++y) {
+                std::fill(packed.begin(), packed.end(), 0);
+                const uchar* row = m.ptr<uchar>(y);
+                for (int x = 0; x < m.cols; ++x) {
+                    if (row[x]) packed[x >> 3] |= static_cast<uchar>(1 << (x & 7));
+                }
+                bytes(packed.data(), packed.size());
+            }
+        }
+        void lines(const std::map<int, std::vector<std::vector<cv::Point2f>>>& lines) {
+            pod(static_cast<uint32_t>(lines.size()));
+            for (const auto& [color_id, polylines] : lines) {
+                pod(static_cast<int32_t>(color_id));
+                pod(static_cast<uint32_t>(polylines.size()));
+                for (const auto& polyline : polylines) {
+                    pod(static_cast<uint32_t>(polyline.size()));
+                    bytes(polyline.data(), polyline.size() * sizeof(cv::Point2f));
+                }
+            }
+        }
+        bool good() const { return ofs.good(); }
+        size_t size() const { return pos; }
+    private:
+        std::ofstream& ofs;
+        size_t pos = 0;
+};
+
+// 読み込み: マップしたメモリを先頭から読む。範囲外を読もうとしたら ok = false
+class CacheReader {
+    public:
+        CacheReader(const uchar* data, size_t size) : data(data), size(size) {}
+
+        const uchar* bytes(size_t n) {
+            if (!ok || n > size - pos) {
+                ok = false;
+                return nullptr;
+            }
+            const uchar* p = data + pos;
+            pos += n;
+            return p;
+        }
+        template <typename T>
+        T pod() {
+            T value{};
+            const uchar* p = bytes(sizeof(T));
+            if (p != nullptr) std::memcpy(&value, p, sizeof(T));
+            return value;
+        }
+        std::string string() {
+            const uint32_t n = pod<uint32_t>();
+            const uchar* p = bytes(n);
+            return p ? std::string(reinterpret_cast<const char*>(p), n) : std::string();
+        }
+        cv::Scalar scalar() {
+            cv::Scalar s;
+            for (int c = 0; c < 4; ++c) {
+                s[c] = pod<double>();
+            }
+            return s;
+        }
+        void align() {
+            const size_t pad = (CACHE_ALIGNMENT - pos % CACHE_ALIGNMENT) % CACHE_ALIGNMENT;
+            bytes(pad);
+        }
+        // rows 行 x row_bytes バイトが残っているか (確保する前に確かめる)
+        bool has(size_t rows, size_t row_bytes) {
+            if (!ok || (row_bytes != 0 && rows > (size - pos) / row_bytes)) {
+                ok = false;
+                return false;
+            }
+            return true;
+        }
+        cv::Mat mat() {
+            const int rows = pod<int32_t>();
+            const int cols = pod<int32_t>();
+            const int type = pod<int32_t>();
+            align();
+            if (!ok || rows < 0 || cols < 0) {
+                ok = false;
+                return cv::Mat();
+            }
+            if (rows == 0 || cols == 0) return cv::Mat();
+            const size_t elem_size = CV_ELEM_SIZE(type);
+            if (!has(rows, static_cast<size_t>(cols) * elem_size)) return cv::Mat();
+            const uchar* p = bytes(static_cast<size_t>(rows) * cols * elem_size);
+            if (p == nullptr) return cv::Mat();
+            // マップはすぐ閉じるので、ここで1回だけコピーする
+            return cv::Mat(rows, cols, type, const_cast<uchar*>(p)).clone();
+        }
+        cv::Mat mask() {
+            const int rows = pod<int32_t>();
+            const int cols = pod<int32_t>();
+            align();
+            if (!ok || rows < 0 || cols < 0) {
+                ok = false;
+                return cv::Mat();
+            }
+            const size_t row_bytes = (static_cast<size_t>(cols) + 7) / 8;
+            if (!has(rows, row_bytes)) return cv::Mat();
+            cv::Mat m(rows, cols, CV_8UC1);
+            for (int y = 0; y < rows; ++y) {
+                const uchar* packed = bytes(row_bytes);
+                if (packed == nullptr) return cv::Mat();
+                uchar* row = m.ptr<uchar>(y);
+                for (int x = 0; x < cols; ++x) {
+                    row[x] = (packed[x >> 3] >> (x & 7)) & 1 ? 255 : 0;
+                }
+            }
+            return m;
+        }
+        std::map<int, std::vector<std::vector<cv::Point2f>>> lines() {
+            std::map<int, std::vector<std::vector<cv::Point2f>>> result;
+            const uint32_t colors = pod<uint32_t>();
+            for (uint32_t c = 0; c < colors && ok; ++c) {
+                const int color_id = pod<int32_t>();
+                const uint32_t count = pod<uint32_t>();
+                auto& polylines = result[color_id];
+                for (uint32_t i = 0; i < count && ok; ++i) {
+                    const uint32_t points = pod<uint32_t>();
+                    const uchar* p = bytes(static_cast<size_t>(points) * sizeof(cv::Point2f));
+                    if (p == nullptr) break;
+                    std::vector<cv::Point2f> polyline(points);
+                    std::memcpy(polyline.data(), p, points * sizeof(cv::Point2f));
+                    polylines.push_back(std::move(polyline));
+                }
+            }
+            return result;
+        }
+
+        bool ok = true;
+    private:
+        const uchar* data;
+        size_t size;
+        size_t pos = 0;
+};
+
+void DiskCache::open(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "DiskCache: failed to create directory: " << dir << " (" << ec.message() << ")" << std::endl;
+        directory.clear();
+        return;
+    }
+    directory = dir;
+
+    // 既にあるエントリの容量を数える (書きかけの一時ファイルは消す)
+    usage_bytes = 0;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
+        if (entry.path().extension() == CACHE_EXTENSION) {
+            usage_bytes += static_cast<size_t>(entry.file_size(ec));
+        } else if (entry.path().extension() == ".tmp") {
+            fs::remove(entry.path(), ec);
+        }
+    }
+    evictEntries();
+}
+
+bool DiskCache::isOpen() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return enabled && !directory.empty();
+}
+
+void DiskCache::setEnabled(bool value) {
+    std::lock_guard<std::mutex> lock(mtx);
+    enabled = value;
+}
+
+bool DiskCache::isEnabled() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return enabled;
+}
+
+void DiskCache::setBudgetMB(size_t mb) {
+    std::lock_guard<std::mutex> lock(mtx);
+    budget_bytes = mb << 20;
+    evictEntries();
+}
+
+size_t DiskCache::getBudgetMB() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return budget_bytes >> 20;
+}
+
+size_t DiskCache::getUsageMB() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return usage_bytes >> 20;
+}
+
+void DiskCache::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (directory.empty()) return;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() == CACHE_EXTENSION) {
+            fs::remove(entry.path(), ec);
+        }
+    }
+    usage_bytes = 0;
+}
+
+std::string DiskCache::entryPath(uint32_t kind, uint64_t hash) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%u_%016llx" CACHE_EXTENSION, kind, static_cast<unsigned long long>(hash));
+    std::lock_guard<std::mutex> lock(mtx);
+    return (fs::path(directory) / name).string();
+}
+
+template <typename Parse>
+bool DiskCache::loadEntry(uint32_t kind, const CacheKey& key, Parse parse) {
+    if (!isOpen()) return false;
+    const uint64_t hash = key.hash();
+    const std::string path = entryPath(kind, hash);
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return false;
+
+    bool ok = false;
+    {
+        MappedFile file(path);
+        if (file.data() != nullptr && file.size() >= sizeof(CacheFileHeader)) {
+            CacheFileHeader header;
+            std::memcpy(&header, file.data(), sizeof(header));
+            if (std::memcmp(header.magic, "LPPC", 4) == 0 && header.version == CACHE_VERSION
+                && header.kind == kind && header.key == hash) {
+                CacheReader reader(file.data(), file.size());
+                reader.bytes(sizeof(CacheFileHeader));
+                const std::string stored_key = reader.string();
+                if (reader.ok && stored_key != key.data()) {
+                    // ハッシュだけが同じ別のキー。他のキーのエントリなので消さない
+                    return false;
+                }
+                ok = parse(reader) && reader.ok;
+            }
+        }
+    }
+    if (!ok) {
+        // 古い形式や壊れたエントリは消しておく
+        std::lock_guard<std::mutex> lock(mtx);
+        const size_t bytes = static_cast<size_t>(fs::file_size(path, ec));
+        if (!ec && fs::remove(path, ec)) {
+            usage_bytes -= (std::min)(usage_bytes, bytes);
+        }
+        return false;
+    }
+    // 使った順に消すため、更新日時を今にする
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+template <typename Write>
+void DiskCache::storeEntry(uint32_t kind, const CacheKey& key, Write write) {
+    if (!isOpen()) return;
+    static std::atomic<uint64_t> tmp_counter{0};
+    const uint64_t hash = key.hash();
+    const std::string path = entryPath(kind, hash);
+    const std::string tmp_path = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()))
+        + "_" + std::to_string(tmp_counter.fetch_add(1)) + ".tmp";
+
+    size_t bytes = 0;
+    bool ok = false;
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!ofs) {
+            std::cerr << "DiskCache: failed to open file for writing: " << tmp_path << std::endl;
+            return;
+        }
+        CacheFileHeader header{{'L', 'P', 'P', 'C'}, CACHE_VERSION, kind, 0, hash};
+        CacheWriter writer(ofs);
+        writer.pod(header);
+        writer.string(key.data());
+        write(writer);
+        ofs.flush();
+        ok = writer.good();
+        bytes = writer.size();
+    }
+
+    std::error_code ec;
+    if (!ok) {
+        std::cerr << "DiskCache: failed to write " << tmp_path << std::endl;
+        fs::remove(tmp_path, ec);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    const size_t old_bytes = fs::exists(path, ec) ? static_cast<size_t>(fs::file_size(path, ec)) : 0;
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        std::cerr << "DiskCache: failed to store entry: " << path << " (" << ec.message() << ")" << std::endl;
+        fs::remove(tmp_path, ec);
+        return;
+    }
+    usage_bytes -= (std::min)(usage_bytes, old_bytes);
+    usage_bytes += bytes;
+    evictEntries();
+}
+
+void DiskCache::evictEntries() {
+    if (usage_bytes <= budget_bytes || directory.empty()) return;
+
+    struct Entry {
+        fs::file_time_type time;
+        size_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    std::error_code ec;
+    size_t total = 0;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() != CACHE_EXTENSION) continue;
+        Entry e{entry.last_write_time(ec), static_cast<size_t>(entry.file_size(ec)), entry.path()};
+        total += e.size;
+        entries.push_back(std::move(e));
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    for (const auto& e : entries) {
+        if (total <= budget_bytes) break;
+        if (fs::remove(e.path, ec)) total -= e.size;
+    }
+    usage_bytes = total;
+}
+
+bool DiskCache::loadMat(const CacheKey& key, cv::Mat& mat) {
+    cv::Mat loaded;
+    if (!loadEntry(CACHE_KIND_MAT, key, [&](CacheReader& r) {
+        loaded = r.mat();
+        return !loaded.empty();
+    })) {
+        return false;
+    }
+    mat = loaded;
+    return true;
+}
+
+void DiskCache::storeMat(const CacheKey& key, const cv::Mat& mat) {
+    if (mat.empty()) return;
+    storeEntry(CACHE_KIND_MAT, key, [&](CacheWriter& w) {
+        w.mat(mat);
+    });
+}
+
+bool DiskCache::loadColorMap(const CacheKey& key, ColorMap& color_map, cv::Mat& view_map) {
+    ColorMap loaded;
+    cv::Mat loaded_view;
+    if (!loadEntry(CACHE_KIND_COLORMAP, key, [&](CacheReader& r) {
+        loaded.colorMap = r.mat();
+        loaded_view = r.mat();
+        const uint32_t names = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < names && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.MapOfColorName[id] = r.string();
+        }
+        const uint32_t values = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < values && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.MapOfColorValueBGR[id] = r.scalar();
+        }
+        const uint32_t masks = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < masks && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.MapOfColor[id] = r.mask();
+        }
+        return !loaded.colorMap.empty();
+    })) {
+        return false;
+    }
+    color_map = loaded;
+    view_map = loaded_view;
+    return true;
+}
+
+void DiskCache::storeColorMap(const CacheKey& key, const ColorMap& color_map, const cv::Mat& view_map) {
+    if (color_map.colorMap.empty()) return;
+    storeEntry(CACHE_KIND_COLORMAP, key, [&](CacheWriter& w) {
+        w.mat(color_map.colorMap);
+        w.mat(view_map);
+        w.pod(static_cast<uint32_t>(color_map.MapOfColorName.size()));
+        for (const auto& [id, name] : color_map.MapOfColorName) {
+            w.pod(static_cast<int32_t>(id));
+            w.string(name);
+        }
+        w.pod(static_cast<uint32_t>(color_map.MapOfColorValueBGR.size()));
+        for (const auto& [id, value] : color_map.MapOfColorValueBGR) {
+            w.pod(static_cast<int32_t>(id));
+            w.scalar(value);
+        }
+        w.pod(static_cast<uint32_t>(color_map.MapOfColor.size()));
+        for (const auto& [id, mask] : color_map.MapOfColor) {
+            w.pod(static_cast<int32_t>(id));
+            w.mask(mask);
+        }
+    });
+}
+
+bool DiskCache::loadVectorData(const CacheKey& key, VectorData& data) {
+    VectorData loaded;
+    if (!loadEntry(CACHE_KIND_VECTOR_DATA, key, [&](CacheReader& r) {
+        loaded.width = r.pod<int32_t>();
+        loaded.height = r.pod<int32_t>();
+        const uint32_t names = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < names && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.color_names[id] = r.string();
+        }
+        const uint32_t values = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < values && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.color_values[id] = r.scalar();
+        }
+        loaded.polylines = r.lines();
+        loaded.contours = r.lines();
+        loaded.hatch_lines = r.lines();
+        const uint32_t masks = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < masks && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.filled_masks[id] = r.mask();
+        }
+        return loaded.width > 0 && loaded.height > 0;
+    })) {
+        return false;
+    }
+    updateBounds(loaded); // 範囲は保存せず、読み込むときに作り直す
+    data = std::move(loaded);
+    return true;
+}
+
+void DiskCache::storeVectorData(const CacheKey& key, const VectorData& data) {
+    if (data.width <= 0 || data.height <= 0) return;
+    storeEntry(CACHE_KIND_VECTOR_DATA, key, [&](CacheWriter& w) {
+        w.pod(static_cast<int32_t>(data.width));
+        w.pod(static_cast<int32_t>(data.height));
+        w.pod(static_cast<uint32_t>(data.color_names.size()));
+        for (const auto& [id, name] : data.color_names) {
+            w.pod(static_cast<int32_t>(id));
+            w.string(name);
+        }
+        w.pod(static_cast<uint32_t>(data.color_values.size()));
+        for (const auto& [id, value] : data.color_values) {
+            w.pod(static_cast<int32_t>(id));
+            w.scalar(value);
+        }
+        w.lines(data.polylines);
+        w.lines(data.contours);
+        w.lines(data.hatch_lines);
+        w.pod(static_cast<uint32_t>(data.filled_masks.size()));
+        for (const auto& [id, mask] : data.filled_masks) {
+            w.pod(static_cast<int32_t>(id));
+            w.mask(mask);
+        }
+    });
+}
+
+bool DiskCache::loadDrawPath(const CacheKey& key, draw_path& path) {
+    draw_path loaded;
+    if (!loadEntry(CACHE_KIND_DRAW_PATH, key, [&](CacheReader& r) {
+        const uint32_t names = r.pod<uint32_t>();
+        for (uint32_t i = 0; i < names && r.ok; ++i) {
+            const int id = r.pod<int32_t>();
+            loaded.color_names[id] = r.string();
+        }
+        const uint32_t colors = r.pod<uint32_t>();
+        for (uint32_t c = 0; c < colors && r.ok; ++c) {
+            const int id = r.pod<int32_t>();
+            const uint32_t count = r.pod<uint32_t>();
+            auto& paths = loaded.paths[id];
+            for (uint32_t i = 0; i < count && r.ok; ++i) {
+                const uint32_t points = r.pod<uint32_t>();
+                const uchar* p = r.bytes(static_cast<size_t>(points) * 2 * sizeof(float));
+                if (p == nullptr) break;
+                std::vector<point> pts(points);
+                for (uint32_t k = 0; k < points; ++k) {
+                    float xy[2];
+                    std::memcpy(xy, p + k * sizeof(xy), sizeof(xy));
+                    pts[k] = {xy[0], xy[1]};
+                }
+                paths.push_back(std::move(pts));
+            }
+        }
+        return true;
+    })) {
+        return false;
+    }
+    path = std::move(loaded);
+    return true;
+}
+
+void DiskCache::storeDrawPath(const CacheKey& key, const draw_path& path) {
+    storeEntry(CACHE_KIND_DRAW_PATH, key, [&](CacheWriter& w) {
+        w.pod(static_cast<uint32_t>(path.color_names.size()));
+        for (const auto& [id, name] : path.color_names) {
+            w.pod(static_cast<int32_t>(id));
+            w.string(name);
+        }
+        w.pod(static_cast<uint32_t>(path.paths.size()));
+        std::vector<float> xy;
+        for (const auto& [id, paths] : path.paths) {
+            w.pod(static_cast<int32_t>(id));
+            w.pod(static_cast<uint32_t>(paths.size()));
+            for (const auto& pts : paths) {
+                w.pod(static_cast<uint32_t>(pts.size()));
+                xy.clear();
+                for (const auto& pt : pts) {
+                    xy.push_back(pt.first);
+                    xy.push_back(pt.second);
+                }
+                w.bytes(xy.data(), xy.size() * sizeof(float));
+            }
+        }
+    });
+}
+
+static uint64_t hashLines(const std::map<int, std::vector<std::vector<cv::Point2f>>>& lines, uint64_t h) {
+    h = hashValue(lines.size(), h);
+    for (const auto& [color_id, polylines] : lines) {
+        h = hashValue(color_id, h);
+        h = hashValue(polylines.size(), h);
+        for (const auto& polyline : polylines) {
+            h = hashValue(polyline.size(), h);
+            h = hashBytes(polyline.data(), polyline.size() * sizeof(cv::Point2f), h);
+        }
+    }
+    return h;
+}
+
+// 線のダイジェストの2つ目に使う seed
+#define LINES_DIGEST_SEED_2 (0xBB67AE8584CAA73BULL)
+
+void addVectorDataKey(CacheKey& key, const VectorData& data) {
+    key.add(static_cast<int32_t>(data.width));
+    key.add(static_cast<int32_t>(data.height));
+    key.add(static_cast<uint32_t>(data.color_names.size()));
+    for (const auto& [id, name] : data.color_names) {
+        key.add(static_cast<int32_t>(id));
+        key.add(name);
+    }
+    for (const uint64_t seed : {HASH_SEED, static_cast<uint64_t>(LINES_DIGEST_SEED_2)}) {
+        uint64_t h = hashLines(data.polylines, seed);
+        h = hashLines(data.contours, h);
+        key.add(hashLines(data.hatch_lines, h));
+    }
+}
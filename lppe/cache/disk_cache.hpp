@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+#include <opencv4/opencv2/core/mat.hpp>
+
+#include "img/colormap_generator.hpp"
+#include "img/content_hash.hpp"
+#include "img/vector_data.hpp"
+#include "optimizer/optimizer.hpp"
+
+/*
+Disk Cache
+各段の計算結果をファイルに残し、再起動や画像を開き直したあとも使い回す
+キーは段の名前・版・パラメータと入力のダイジェストを並べたもの (img/content_hash の CacheKey)
+
+1エントリ1ファイル: <directory>/<kind>_<キーのハッシュ 16桁>.lppc
+ファイルは固定長ヘッダ + キーのバイト列 + レコードの列で、画素データは64バイト境界に置く
+読むときはキーのバイト列まで比べるので、ハッシュが衝突しても別の結果は返さない
+読み込みはファイルをメモリマップして、画素データを1回コピーするだけ (テキストのパースは無い)
+書き込みは一時ファイルに書いてから rename するので、途中で落ちても壊れたエントリは残らない
+容量が予算を超えたら、最後に使った時刻 (更新日時) が古いものから消す
+*/
+
+class DiskCache {
+    public:
+        static DiskCache& instance() {
+            static DiskCache cache;
+            return cache;
+        }
+
+        // directory が無ければ作る。開くまでは load は常に失敗し、store は何もしない
+        void open(const std::string& directory);
+        void setEnabled(bool enabled);
+        bool isEnabled() const;
+        void setBudgetMB(size_t mb);
+        size_t getBudgetMB() const;
+        size_t getUsageMB() const;
+        void clear();
+
+        // フィルタの出力など、任意の cv::Mat
+        bool loadMat(const CacheKey& key, cv::Mat& mat);
+        void storeMat(const CacheKey& key, const cv::Mat& mat);
+        // 色分けの結果 (各色のマスクは1画素1bitに詰めて保存する)
+        bool loadColorMap(const CacheKey& key, ColorMap& color_map, cv::Mat& view_map);
+        void storeColorMap(const CacheKey& key, const ColorMap& color_map, const cv::Mat& view_map);
+        // ベクタ化の結果 (線・色と、プレビューで描く塗りのマスク。塗りは1画素1bitに詰める)
+        // 線に変換し終わった edge_masks と outline_masks は保存しない
+        bool loadVectorData(const CacheKey& key, VectorData& data);
+        void storeVectorData(const CacheKey& key, const VectorData& data);
+        // 最適化の結果
+        bool loadDrawPath(const CacheKey& key, draw_path& path);
+        void storeDrawPath(const CacheKey& key, const draw_path& path);
+
+    private:
+        DiskCache() = default;
+        bool isOpen() const;
+        std::string entryPath(uint32_t kind, uint64_t hash) const;
+        template <typename Parse>
+        bool loadEntry(uint32_t kind, const CacheKey& key, Parse parse);
+        template <typename Write>
+        void storeEntry(uint32_t kind, const CacheKey& key, Write write);
+        void evictEntries(); // mtx をロックした状態で呼ぶ
+
+        std::string directory;
+        bool enabled = true;
+        size_t usage_bytes = 0;
+        size_t budget_bytes = size_t(2048) << 20;
+        mutable std::mutex mtx;
+};
+
+// 各段のアルゴリズムの版。その段の出力が変わる変更をしたら上げる (古いエントリは使われなくなる)
+constexpr uint32_t CACHE_STAGE_FILTER_VERSION = 1;
+constexpr uint32_t CACHE_STAGE_COLORMAP_VERSION = 1;
+constexpr uint32_t CACHE_STAGE_VECTORIZE_VERSION = 1;
+constexpr uint32_t CACHE_STAGE_OPTIMIZE_VERSION = 1;
+
+// VectorData の大きさ・色名と、線のダイジェストをキーに足す (マスクは含めない)
+void addVectorDataKey(CacheKey& key, const VectorData& data);
@@ -0,0 +1,227 @@
+// lppe_cli: GUIなしで画像をまとめて変換する
+// usage: lppe_cli <pipeline file> <output dir> <image or directory>... [-j threads] [--trace file] [--binary]
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+#include "core/pipeline.hpp"
+#include "trace/trace.hpp"
+
+namespace fs = std::filesystem;
+
+static void printUsage() {
+    std::cerr << "usage: lppe_cli <pipeline file> <output dir> <image or directory>... [-j threads] [--trace file] [--binary]" << std::endl;
+    std::cerr << "  writes <output dir>/<image name>/optimized_path.txt and <output dir>/timing_report.csv" << std::endl;
+    std::cerr << "  (the report also has the estimated EV3 print time: drawing, travel, pen up/down and color changes)" << std::endl;
+    std::cerr << "  --binary writes optimized_path.lppb (compact LPPB format, see ev3/printer/lppb.h) instead of .txt" << std::endl;
+    std::cerr << "  --trace writes every stage as Chrome trace_event JSON (chrome://tracing, ui.perfetto.dev)" << std::endl;
+}
+
+static bool isImageFile(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tif" || ext == ".tiff" || ext == ".webp";
+}
+
+struct BatchItem {
+    fs::path input;
+    fs::path output;
+    bool ok = false;
+    PipelineTimings timings;
+    PrintTimeEstimate print_time; // EV3 で印刷にかかる時間の見積もり
+};
+
+int main(int argc, char** argv) {
+    std::vector<std::string> positional;
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    std::string trace_path;
+    bool binary = false;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "-j" && i + 1 < argc){
+            threads = std::atoi(argv[++i]);
+        }else if(arg == "--trace" && i + 1 < argc){
+            trace_path = argv[++i];
+        }else if(arg == "--binary"){
+            binary = true;
+        }else if(arg == "-h" || arg == "--help"){
+            printUsage();
+            return 0;
+        }else{
+            positional.push_back(arg);
+        }
+    }
+    if(positional.size() < 3){
+        printUsage();
+        return 1;
+    }
+    threads = (std::max)(1, threads);
+    TraceRecorder::instance().setEnabled(!trace_path.empty());
+
+    PipelineDescription desc;
+    if(!loadPipelineDescription(positional[0], desc)){
+        return 1;
+    }
+    const fs::path output_dir = positional[1];
+    std::error_code dir_ec;
+    fs::create_directories(output_dir, dir_ec);
+    if(dir_ec){
+        std::cerr << "Failed to create directory: " << output_dir << " (" << dir_ec.message() << ")" << std::endl;
+        return 1;
+    }
+
+    // 入力 (ディレクトリなら中の画像をすべて)
+    std::vector<fs::path> inputs;
+    for(size_t i = 2; i < positional.size(); ++i) {
+        const fs::path path = positional[i];
+        if(fs::is_directory(path)){
+            std::vector<fs::path> found;
+            for(const auto& entry : fs::directory_iterator(path)) {
+                if(entry.is_regular_file() && isImageFile(entry.path())){
+                    found.push_back(entry.path());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            inputs.insert(inputs.end(), found.begin(), found.end());
+        }else if(fs::is_regular_file(path)){
+            inputs.push_back(path);
+        }else{
+            std::cerr << "Input not found: " << path << std::endl;
+            return 1;
+        }
+    }
+    if(inputs.empty()){
+        std::cerr << "No input images." << std::endl;
+        return 1;
+    }
+
+    std::vector<BatchItem> items(inputs.size());
+    for(size_t i = 0; i < inputs.size(); ++i) {
+        items[i].input = inputs[i];
+        items[i].output = output_dir / inputs[i].stem() / (binary ? "optimized_path.lppb" : "optimized_path.txt");
+    }
+
+    // 画像単位で並列にするので、1枚の中の OpenCV の並列化は止める
+    threads = (std::min)(threads, static_cast<int>(items.size()));
+    if(threads > 1){
+        cv::setNumThreads(1);
+    }
+
+    // パレットが同じなので LUT は1つを共有する
+    const auto lut = buildPipelineLUT(desc);
+
+    std::atomic<size_t> next{0};
+    std::mutex log_mtx;
+    auto worker = [&]() {
+        while(true) {
+            const size_t i = next.fetch_add(1);
+            if(i >= items.size()) break;
+            BatchItem& item = items[i];
+
+            cv::Mat img = cv::imread(item.input.string(), cv::IMREAD_COLOR);
+            if(img.empty()){
+                std::lock_guard<std::mutex> lock(log_mtx);
+                std::cerr << "Failed to load image: " << item.input << std::endl;
+                continue;
+            }
+            std::error_code ec;
+            fs::create_directories(item.output.parent_path(), ec);
+            if(ec){
+                std::lock_guard<std::mutex> lock(log_mtx);
+                std::cerr << "Failed to create directory: " << item.output.parent_path() << " (" << ec.message() << ")" << std::endl;
+                continue;
+            }
+            item.ok = runPipeline(img, desc, item.output.string(), item.timings, lut.get(), &item.print_time);
+
+            std::lock_guard<std::mutex> lock(log_mtx);
+            std::cout << (item.ok ? "[done] " : "[failed] ") << item.input.string()
+                << " (" << std::fixed << std::setprecision(1) << item.timings.total_ms << " ms";
+            if(item.ok){
+                std::cout << ", print " << formatDuration(item.print_time.total_s());
+            }
+            std::cout << ")" << std::endl;
+        }
+    };
+    std::vector<std::thread> pool;
+    for(int t = 0; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    for(auto& th : pool) {
+        th.join();
+    }
+
+    // 処理時間のレポート
+    const fs::path report_path = output_dir / "timing_report.csv";
+    std::ofstream report(report_path);
+    bool report_ok = static_cast<bool>(report);
+    if(!report_ok){
+        std::cerr << "Failed to open file for writing: " << report_path << std::endl;
+    }
+    report << "image,ok,filter_ms,colormap_ms,convert_ms,layout_ms,optimize_ms,write_ms,total_ms,"
+        << "print_s,draw_s,travel_s,pen_s,color_change_s" << std::endl;
+    report << std::fixed << std::setprecision(3);
+    int failed = 0;
+    PipelineTimings sum;
+    PrintTimeEstimate print_sum;
+    for(const auto& item : items) {
+        const auto& t = item.timings;
+        const auto& p = item.print_time;
+        report << item.input.string() << "," << (item.ok ? 1 : 0) << ","
+            << t.filter_ms << "," << t.colormap_ms << "," << t.convert_ms << ","
+            << t.layout_ms << "," << t.optimize_ms << "," << t.write_ms << "," << t.total_ms << ","
+            << p.total_s() << "," << p.draw_s << "," << p.travel_s << "," << p.pen_s << "," << p.color_change_s << std::endl;
+        if(!item.ok){
+            ++failed;
+            continue;
+        }
+        sum.filter_ms += t.filter_ms;
+        sum.colormap_ms += t.colormap_ms;
+        sum.convert_ms += t.convert_ms;
+        sum.layout_ms += t.layout_ms;
+        sum.optimize_ms += t.optimize_ms;
+        sum.write_ms += t.write_ms;
+        sum.total_ms += t.total_ms;
+        print_sum.draw_s += p.draw_s;
+        print_sum.travel_s += p.travel_s;
+        print_sum.pen_s += p.pen_s;
+        print_sum.color_change_s += p.color_change_s;
+    }
+    if(report_ok){
+        report.close();
+        if(!report){
+            std::cerr << "Failed to write file: " << report_path << std::endl;
+            report_ok = false;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << items.size() - failed << "/" << items.size() << " images converted with " << threads << " threads" << std::endl;
+    std::cout << "total per stage (ms): filter " << sum.filter_ms << ", colormap " << sum.colormap_ms
+        << ", convert " << sum.convert_ms << ", layout " << sum.layout_ms << ", optimize " << sum.optimize_ms
+        << ", write " << sum.write_ms << std::endl;
+    std::cout << "estimated print time: " << formatDuration(print_sum.total_s())
+        << " (drawing " << formatDuration(print_sum.draw_s) << ", travel " << formatDuration(print_sum.travel_s)
+        << ", pen up/down " << formatDuration(print_sum.pen_s) << ", color changes " << formatDuration(print_sum.color_change_s) << ")" << std::endl;
+    if(report_ok){
+        std::cout << "report: " << report_path.string() << std::endl;
+    }
+    if(!trace_path.empty()){
+        TraceRecorder::instance().writeChromeTrace(trace_path);
+    }
+
+    // レポートが書けなければ、全部の画像が通っても失敗にする (バッチが成功と見なさないように)
+    return (failed == 0 && report_ok) ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#include "affine.hpp"
+
+#include <cmath>
+
+Affine2D Affine2D::translation(double tx, double ty) {
+    return {1, 0, tx, 0, 1, ty};
+}
+
+Affine2D Affine2D::rotation(double rad) {
+    const double cs = std::cos(rad);
+    const double sn = std::sin(rad);
+    return {cs, -sn, 0, sn, cs, 0};
+}
+
+Affine2D Affine2D::scaling(double sx, double sy) {
+    return {sx, 0, 0, 0, sy, 0};
+}
+
+Affine2D Affine2D::then(const Affine2D& n) const {
+    return {
+        n.a * a + n.b * d, n.a * b + n.b * e, n.a * c + n.b * f + n.c,
+        n.d * a + n.e * d, n.d * b + n.e * e, n.d * c + n.e * f + n.f,
+    };
+}
+
+cv::Point2f Affine2D::apply(const cv::Point2f& p) const {
+    return cv::Point2f(static_cast<float>(a * p.x + b * p.y + c), static_cast<float>(d * p.x + e * p.y + f));
+}
+
+void transformPoints(const cv::Point2f* src, cv::Point2f* dst, size_t n, const Affine2D& m) {
+    const float a = static_cast<float>(m.a), b = static_cast<float>(m.b), c = static_cast<float>(m.c);
+    const float d = static_cast<float>(m.d), e = static_cast<float>(m.e), f = static_cast<float>(m.f);
+    const float* s = reinterpret_cast<const float*>(src);
+    float* o = reinterpret_cast<float*>(dst);
+    for (size_t i = 0; i < n; ++i) {
+        const float x = s[2 * i];
+        const float y = s[2 * i + 1];
+        o[2 * i] = a * x + b * y + c;
+        o[2 * i + 1] = d * x + e * y + f;
+    }
+}
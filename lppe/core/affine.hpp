@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+#include <opencv4/opencv2/core/types.hpp>
+
+/*
+Affine2D
+new x = a x + b y + c
+new y = d x + e y + f
+いくつもの変換を1つの行列にまとめてから、点の列に1回だけ掛ける
+*/
+
+struct Affine2D {
+    double a = 1, b = 0, c = 0;
+    double d = 0, e = 1, f = 0;
+
+    static Affine2D translation(double tx, double ty);
+    static Affine2D rotation(double rad); // 反時計回り (y軸が下向きの画像座標では時計回りに見える)
+    static Affine2D scaling(double sx, double sy);
+
+    // this を掛けたあとに next を掛ける変換
+    Affine2D then(const Affine2D& next) const;
+    cv::Point2f apply(const cv::Point2f& p) const;
+};
+
+// dst[i] = m(src[i])。src == dst でもよい
+// x, y が交互に並んだ float 列として1回で回すので、コンパイラがベクトル化しやすい
+void transformPoints(const cv::Point2f* src, cv::Point2f* dst, size_t n, const Affine2D& m);
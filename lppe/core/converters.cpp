@@ -0,0 +1,294 @@
+#include "converters.hpp"
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include <opencv4/opencv2/imgproc.hpp>
+
+#include "img/content_hash.hpp"
+#include "trace/trace.hpp"
+
+void addConverterParams(CacheKey& key, const EdgeConverterParams& params) {
+    key.add(params.min_size).add(params.opening_radius);
+}
+
+void addConverterParams(CacheKey& key, const FillConverterParams& params) {
+    key.add(params.outline_mode);
+    key.add(params.canny_mode);
+    key.add(params.low_threshold).add(params.high_threshold);
+    key.add(params.color_edges);
+    key.add(params.back_outline);
+    key.add(params.closing_radius).add(params.erosion_radius);
+    key.add(params.min_size).add(params.opening_radius);
+}
+
+void addConverterParams(CacheKey& key, const LineAndFillConverterParams& params) {
+    key.add(params.outline_mode);
+    key.add(params.radius);
+    key.add(params.min_size).add(params.opening_radius);
+}
+
+void addConverterParams(CacheKey& key, const OutlineConverterParams& params) {
+    key.add(params.min_size).add(params.opening_radius);
+}
+
+int scalePxLength(int px, float px_scale) {
+    if (px == 0) return 0;
+    int scaled = (std::max)(1, static_cast<int>(std::lround(std::abs(px) * px_scale)));
+    return (px > 0) ? scaled : -scaled;
+}
+
+int scalePxArea(int px, float px_scale) {
+    return (std::max)(1, static_cast<int>(std::lround(px * px_scale * px_scale)));
+}
+
+void convertEdge(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const EdgeConverterParams& params, const ConvertContext& ctx, VectorData& outData) {
+    ScopedTrace trace("converter/edge");
+    trace.count("pixels", static_cast<double>(original.total()));
+    if(original.empty() || original.channels() != 3) {
+        std::cerr << "convertEdge: original image is empty or not a 3-channel BGR image." << std::endl;
+        return;
+    }
+    if(colorMap.colorMap.empty() || colorMap.colorMap.type() != CV_8UC1) {
+        std::cerr << "convertEdge: colorMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+    if(modeMap.empty() || modeMap.type() != CV_8UC1) {
+        std::cerr << "convertEdge: modeMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+
+    // 縮小画像で実行するときはpx単位のパラメータも縮める
+    const int opening_px = scalePxLength(params.opening_radius, ctx.px_scale);
+
+    for(auto pair : colorMap.MapOfColorName) {
+        int color_id = pair.first;
+
+        if(colorMap.MapOfColor.find(color_id) == colorMap.MapOfColor.end()) {
+            continue;
+        }
+        if(pair.second == "white"){
+            continue; // Skip background color
+        }
+        cv::Mat mask = colorMap.MapOfColor.at(color_id);
+        if(mask.empty() || mask.type() != CV_8UC1) {
+            continue;
+        }
+
+        removeSmallComponentsTiled(mask, scalePxArea(params.min_size, ctx.px_scale), ctx.tiling).copyTo(mask);
+        if(opening_px > 0){
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * opening_px + 1, 2 * opening_px + 1),
+                                                        cv::Point(opening_px, opening_px));
+            morphologyTiled(mask, mask, cv::MORPH_OPEN, element, ctx.tiling);
+        }
+
+        outData.edge_masks[color_id] = outData.edge_masks[color_id] | (mask & (modeMap == mode));
+    }
+}
+
+void convertFill(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const FillConverterParams& params, const ConvertContext& ctx, VectorData& outData) {
+    ScopedTrace trace("converter/fill");
+    trace.count("pixels", static_cast<double>(original.total()));
+    if(original.empty() || original.channels() != 3) {
+        std::cerr << "convertFill: original image is empty or not a 3-channel BGR image." << std::endl;
+        return;
+    }
+    if(colorMap.colorMap.empty() || colorMap.colorMap.type() != CV_8UC1) {
+        std::cerr << "convertFill: colorMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+    if(modeMap.empty() || modeMap.type() != CV_8UC1) {
+        std::cerr << "convertFill: modeMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+
+    // 縮小画像で実行するときはpx単位のパラメータも縮める
+    const int opening_px = scalePxLength(params.opening_radius, ctx.px_scale);
+    const int closing_px = scalePxLength(params.closing_radius, ctx.px_scale);
+    const int erosion_px = scalePxLength(params.erosion_radius, ctx.px_scale);
+
+    cv::Mat back_outline_mask;
+
+    for(auto pair : colorMap.MapOfColorName) {
+        int color_id = pair.first;
+
+        if(colorMap.MapOfColor.find(color_id) == colorMap.MapOfColor.end()) {
+            continue;
+        }
+
+        cv::Mat mask = colorMap.MapOfColor.at(color_id);
+        if(mask.empty() || mask.type() != CV_8UC1) {
+            continue;
+        }
+
+        removeSmallComponentsTiled(mask, scalePxArea(params.min_size, ctx.px_scale), ctx.tiling).copyTo(mask);
+        if(opening_px > 0){
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * opening_px + 1, 2 * opening_px + 1),
+                                                        cv::Point(opening_px, opening_px));
+            morphologyTiled(mask, mask, cv::MORPH_OPEN, element, ctx.tiling);
+        }
+        
+        cv::Mat col_mask = outData.filled_masks[color_id] | (mask & (modeMap == mode));
+        if(closing_px > 0){
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * closing_px + 1, 2 * closing_px + 1),
+                                                        cv::Point(closing_px, closing_px));
+            morphologyTiled(col_mask, col_mask, cv::MORPH_CLOSE, element, ctx.tiling);
+        }
+        cv::Mat uneroded = col_mask.clone();
+        if(erosion_px > 0){
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * erosion_px + 1, 2 * erosion_px + 1),
+                                                        cv::Point(erosion_px, erosion_px));
+            morphologyTiled(col_mask, col_mask, cv::MORPH_DILATE, element, ctx.tiling);
+        }else if(erosion_px < 0){
+            int radius = -erosion_px;
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * radius + 1, 2 * radius + 1),
+                                                        cv::Point(radius, radius));
+            morphologyTiled(col_mask, col_mask, cv::MORPH_ERODE, element, ctx.tiling);
+        }
+
+        if(pair.second == "white"){
+            if(params.back_outline.size() > 0){
+                back_outline_mask = (~(colorMap.MapOfColor.at(color_id))) & (modeMap == mode);
+            }
+            continue;
+        }
+
+        outData.filled_masks[color_id] = col_mask;
+        if(params.outline_mode) {
+            outData.outline_masks[color_id] = outData.outline_masks[color_id] | (uneroded & (modeMap == mode));
+        }
+    }
+
+    if(params.back_outline.size() > 0 || !(back_outline_mask.empty())){
+        for(auto& pair : colorMap.MapOfColorName) {
+            if(pair.second == params.back_outline){
+                std::cout << "Applying back outline to color: " << pair.second << std::endl;
+                outData.outline_masks[pair.first] = outData.outline_masks[pair.first] | back_outline_mask;
+            }
+        }
+    }
+    if(params.canny_mode.size() > 0){
+        cv::Mat canny_mask;
+        canny(original, canny_mask, params.low_threshold, params.high_threshold);
+        for(auto& pair : colorMap.MapOfColorName) {
+            if(pair.second == params.canny_mode){
+                outData.edge_masks[pair.first] = outData.edge_masks[pair.first] | (canny_mask & (modeMap == mode));
+            }
+        }
+    }
+    if(params.color_edges.size() > 0){
+        cv::Mat edge_mask;
+        extractEdgeFromGroupMap(colorMap.colorMap, edge_mask);
+        for(auto& pair : colorMap.MapOfColorName) {
+            if(pair.second == params.color_edges){
+                outData.edge_masks[pair.first] = outData.edge_masks[pair.first] | (edge_mask & (modeMap == mode));
+            }
+        }
+    }
+}
+
+void convertLineAndFill(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const LineAndFillConverterParams& params, const ConvertContext& ctx, VectorData& outData) {
+    ScopedTrace trace("converter/line_and_fill");
+    trace.count("pixels", static_cast<double>(original.total()));
+    if(original.empty() || original.channels() != 3) {
+        std::cerr << "convertLineAndFill: original image is empty or not a 3-channel BGR image." << std::endl;
+        return;
+    }
+    if(colorMap.colorMap.empty() || colorMap.colorMap.type() != CV_8UC1) {
+        std::cerr << "convertLineAndFill: colorMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+    if(modeMap.empty() || modeMap.type() != CV_8UC1) {
+        std::cerr << "convertLineAndFill: modeMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+
+    // 縮小画像で実行するときはpx単位のパラメータも縮める
+    const int opening_px = scalePxLength(params.opening_radius, ctx.px_scale);
+
+    cv::Mat rbit, lines, thinned_lines, filled, vis;
+    for(auto pair : colorMap.MapOfColorName) {
+        int color_id = pair.first;
+
+        if(colorMap.MapOfColor.find(color_id) == colorMap.MapOfColor.end()) {
+            continue;
+        }
+        if(pair.second == "white"){
+            continue; // Skip background color
+        }
+        cv::Mat mask = colorMap.MapOfColor.at(color_id);
+        if(mask.empty() || mask.type() != CV_8UC1) {
+            continue;
+        }
+
+        removeSmallComponentsTiled(mask, scalePxArea(params.min_size, ctx.px_scale), ctx.tiling).copyTo(rbit);
+        if(opening_px > 0){
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * opening_px + 1, 2 * opening_px + 1),
+                                                        cv::Point(opening_px, opening_px));
+            morphologyTiled(rbit, rbit, cv::MORPH_OPEN, element, ctx.tiling);
+        }
+        classifyPixels(rbit & (modeMap == mode), lines, thinned_lines, filled, vis, scalePxLength(params.radius, ctx.px_scale));
+
+        outData.edge_masks[color_id] = outData.edge_masks[color_id] | lines;
+        outData.filled_masks[color_id] = outData.filled_masks[color_id] | filled;
+        if(params.outline_mode) {
+            outData.outline_masks[color_id] = outData.outline_masks[color_id] | filled;
+        }
+    }
+}
+
+void convertOutline(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const OutlineConverterParams& params, const ConvertContext& ctx, VectorData& outData) {
+    ScopedTrace trace("converter/outline");
+    trace.count("pixels", static_cast<double>(original.total()));
+    if(original.empty() || original.channels() != 3) {
+        std::cerr << "convertOutline: original image is empty or not a 3-channel BGR image." << std::endl;
+        return;
+    }
+    if(colorMap.colorMap.empty() || colorMap.colorMap.type() != CV_8UC1) {
+        std::cerr << "convertOutline: colorMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+    if(modeMap.empty() || modeMap.type() != CV_8UC1) {
+        std::cerr << "convertOutline: modeMap is empty or not CV_8UC1." << std::endl;
+        return;
+    }
+
+    // 縮小画像で実行するときはpx単位のパラメータも縮める
+    const int opening_px = scalePxLength(params.opening_radius, ctx.px_scale);
+
+    for(auto pair : colorMap.MapOfColorName) {
+        int color_id = pair.first;
+
+        if(colorMap.MapOfColor.find(color_id) == colorMap.MapOfColor.end()) {
+            continue;
+        }
+        if(pair.second == "white"){
+            continue; // Skip background color
+        }
+        cv::Mat mask = colorMap.MapOfColor.at(color_id);
+        if(mask.empty() || mask.type() != CV_8UC1) {
+            continue;
+        }
+
+        removeSmallComponentsTiled(mask, scalePxArea(params.min_size, ctx.px_scale), ctx.tiling).copyTo(mask);
+        if(opening_px > 0){
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                        cv::Size(2 * opening_px + 1, 2 * opening_px + 1),
+                                                        cv::Point(opening_px, opening_px));
+            morphologyTiled(mask, mask, cv::MORPH_OPEN, element, ctx.tiling);
+        }
+
+        outData.outline_masks[color_id] = outData.outline_masks[color_id] | (mask & (modeMap == mode));
+    }
+}
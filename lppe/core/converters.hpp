@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include <opencv4/opencv2/core/mat.hpp>
+
+#include "img/colormap_generator.hpp"
+#include "img/content_hash.hpp"
+#include "img/vector_data.hpp"
+#include "img/tiling.hpp"
+
+/*
+Converters
+ColorMap を VectorData のマスクに変換する (GUIなしで使える部分)
+gui/vector_converters はパラメータの編集だけを受け持つ
+*/
+
+struct ConvertContext {
+    float px_scale = 1.0f; // 縮小画像で実行するときの倍率 (px単位のパラメータに掛ける)
+    TileSettings tiling;
+};
+
+struct EdgeConverterParams {
+    int min_size = 1;
+    int opening_radius = 0;
+};
+
+struct FillConverterParams {
+    bool outline_mode = false;
+    std::string canny_mode = "";
+    int low_threshold = 100;
+    int high_threshold = 200;
+    std::string color_edges = "";
+    std::string back_outline = "";
+    int closing_radius = 0;
+    int erosion_radius = 0;
+    int min_size = 1;
+    int opening_radius = 0;
+};
+
+struct LineAndFillConverterParams {
+    bool outline_mode = false;
+    int radius = 7;
+    int min_size = 1;
+    int opening_radius = 0;
+};
+
+struct OutlineConverterParams {
+    int min_size = 1;
+    int opening_radius = 0;
+};
+
+// パラメータをキャッシュのキーに足す
+void addConverterParams(CacheKey& key, const EdgeConverterParams& params);
+void addConverterParams(CacheKey& key, const FillConverterParams& params);
+void addConverterParams(CacheKey& key, const LineAndFillConverterParams& params);
+void addConverterParams(CacheKey& key, const OutlineConverterParams& params);
+
+int scalePxLength(int px, float px_scale); // 0はそのまま、符号は保つ
+int scalePxArea(int px, float px_scale);   // 面積 (px^2) 用、1以上
+
+// modeMap == mode の画素だけを outData のマスクに書き足す
+void convertEdge(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const EdgeConverterParams& params, const ConvertContext& ctx, VectorData& outData);
+void convertFill(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const FillConverterParams& params, const ConvertContext& ctx, VectorData& outData);
+void convertLineAndFill(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const LineAndFillConverterParams& params, const ConvertContext& ctx, VectorData& outData);
+void convertOutline(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode,
+    const OutlineConverterParams& params, const ConvertContext& ctx, VectorData& outData);
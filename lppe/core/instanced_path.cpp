@@ -0,0 +1,55 @@
+#include "instanced_path.hpp"
+
+#include "path_writer.hpp"
+#include "trace/trace.hpp"
+
+void replicateDrawPath(const draw_path& base, const std::vector<Affine2D>& placements, draw_path& out) {
+    out.paths.clear();
+    out.color_names = base.color_names;
+    for(const auto& [color_id, paths] : base.paths) {
+        auto& dst = out.paths[color_id];
+        dst.reserve(paths.size() * placements.size());
+        for(const auto& m : placements) {
+            for(const auto& pts : paths) {
+                std::vector<point> moved;
+                moved.reserve(pts.size());
+                for(const auto& pt : pts) {
+                    const cv::Point2f p = m.apply(cv::Point2f(pt.first, pt.second));
+                    moved.emplace_back(p.x, p.y);
+                }
+                dst.push_back(std::move(moved));
+            }
+        }
+    }
+}
+
+static void optimizePath(const VectorData& data, bool beam_search, draw_path& out) {
+    Optimizer optimizer;
+    const unoptimized_path u_path = convertToUnoptimizedPath(data);
+    if(beam_search){
+        optimizer.optimize_beam_search(u_path, out);
+    }else{
+        optimizer.optimize_greedy(u_path, out);
+    }
+}
+
+void optimizeInstancedLayout(const InstancedLayout& layout, bool beam_search, draw_path& out) {
+    ScopedTrace trace("optimize/instanced");
+    trace.count("instances", static_cast<double>(layout.placements.size()));
+
+    draw_path base_path;
+    optimizePath(layout.base, beam_search, base_path);
+    replicateDrawPath(base_path, layout.placements, out);
+
+    draw_path shared_path;
+    optimizePath(layout.shared, beam_search, shared_path);
+    for(auto& [color_id, paths] : shared_path.paths) {
+        auto& dst = out.paths[color_id];
+        for(auto& pts : paths) {
+            dst.push_back(std::move(pts));
+        }
+    }
+    for(const auto& [color_id, name] : shared_path.color_names) {
+        out.color_names.emplace(color_id, name);
+    }
+}
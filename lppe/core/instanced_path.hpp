@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "layout.hpp"
+#include "optimizer/optimizer.hpp"
+
+/*
+Instanced Path
+InstancedLayout の base を1回だけ最適化して、その順番を全部の場所に写す
+場所の間は、前の場所の最後の点から次の場所の最初の点までペンを上げて1回動くだけになる
+(最適化の時間とメモリは1つ分のまま)
+*/
+
+// base の各パスを placements の順に写して並べる (色ごとに、1つ目の場所の全パス → 2つ目の場所の全パス → ...)
+void replicateDrawPath(const draw_path& base, const std::vector<Affine2D>& placements, draw_path& out);
+// base を最適化して写し、shared は別に最適化して色ごとに最後に足す
+void optimizeInstancedLayout(const InstancedLayout& layout, bool beam_search, draw_path& out);
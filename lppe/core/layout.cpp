@@ -0,0 +1,289 @@
+#include "layout.hpp"
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+
+#include <opencv4/opencv2/imgproc.hpp>
+
+#include "trace/trace.hpp"
+#include "affine.hpp"
+
+// 全部の点に m を掛けたときの範囲 (1回なめるだけで、途中の VectorData は作らない)
+// 点がなければ false
+static bool transformedBounds(const VectorData& data, const Affine2D& m, double& min_x, double& min_y, double& max_x, double& max_y) {
+    float lo_x = FLT_MAX, lo_y = FLT_MAX, hi_x = -FLT_MAX, hi_y = -FLT_MAX;
+    const float a = static_cast<float>(m.a), b = static_cast<float>(m.b), c = static_cast<float>(m.c);
+    const float d = static_cast<float>(m.d), e = static_cast<float>(m.e), f = static_cast<float>(m.f);
+    auto scan = [&](const std::map<int, std::vector<std::vector<cv::Point2f>>>& groups) {
+        for(const auto& [color, lines] : groups) {
+            for(const auto& line : lines) {
+                for(const auto& pt : line) {
+                    const float x = a * pt.x + b * pt.y + c;
+                    const float y = d * pt.x + e * pt.y + f;
+                    lo_x = (std::min)(lo_x, x);
+                    hi_x = (std::max)(hi_x, x);
+                    lo_y = (std::min)(lo_y, y);
+                    hi_y = (std::max)(hi_y, y);
+                }
+            }
+        }
+    };
+    scan(data.polylines);
+    scan(data.contours);
+    scan(data.hatch_lines);
+    if(lo_x > hi_x){
+        min_x = min_y = max_x = max_y = 0;
+        return false;
+    }
+    min_x = lo_x;
+    min_y = lo_y;
+    max_x = hi_x;
+    max_y = hi_y;
+    return true;
+}
+
+// src の線を transforms の順に1つずつ写して dst に足す (double_mode では上段の線のあとに下段の線が並ぶ)
+// 写したばかりの線から範囲も作っておく
+static void appendTransformed(const std::map<int, std::vector<std::vector<cv::Point2f>>>& src,
+    std::map<int, std::vector<std::vector<cv::Point2f>>>& dst, std::map<int, std::vector<VectorBounds>>& dst_bounds,
+    std::map<int, VectorBounds>& color_bounds, const std::vector<Affine2D>& transforms) {
+    for(const auto& [color, lines] : src) {
+        auto& out = dst[color];
+        auto& out_bounds = dst_bounds[color];
+        VectorBounds& color_bound = color_bounds[color];
+        out.reserve(out.size() + lines.size() * transforms.size());
+        out_bounds.reserve(out_bounds.size() + lines.size() * transforms.size());
+        for(const auto& m : transforms) {
+            for(const auto& line : lines) {
+                out.emplace_back(line.size());
+                transformPoints(line.data(), out.back().data(), line.size(), m);
+                out_bounds.push_back(VectorBounds::of(out.back()));
+                color_bound.add(out_bounds.back());
+            }
+        }
+    }
+}
+
+// 90度単位の回転なら、範囲の四隅を写せばそのまま回転後の範囲になる
+static bool rotatedCachedBounds(const VectorData& data, const Affine2D& m, int direction, double& min_x, double& min_y, double& max_x, double& max_y) {
+    if(direction % 90 != 0 || !boundsUpToDate(data) || data.bounds.empty()){
+        return false;
+    }
+    const VectorBounds& b = data.bounds;
+    VectorBounds rotated;
+    rotated.add(m.apply(cv::Point2f(b.min_x, b.min_y)));
+    rotated.add(m.apply(cv::Point2f(b.max_x, b.min_y)));
+    rotated.add(m.apply(cv::Point2f(b.min_x, b.max_y)));
+    rotated.add(m.apply(cv::Point2f(b.max_x, b.max_y)));
+    min_x = rotated.min_x;
+    min_y = rotated.min_y;
+    max_x = rotated.max_x;
+    max_y = rotated.max_y;
+    return true;
+}
+
+// 倍率 size_percent を掛けたあとの縮小率 (double_mode では配置のときに掛け終わっているので 1)
+static double finalScale(const LayoutSettings& settings) {
+    return settings.double_mode ? 1.0 : static_cast<double>(settings.size_percent) / 100.0;
+}
+
+// src の線・色と、それを transforms の場所に置いた線を dst に入れる
+static void placeVectorData(const VectorData& src, const std::vector<Affine2D>& transforms, VectorData& dst) {
+    appendTransformed(src.polylines, dst.polylines, dst.polyline_bounds, dst.color_bounds, transforms);
+    appendTransformed(src.contours, dst.contours, dst.contour_bounds, dst.color_bounds, transforms);
+    appendTransformed(src.hatch_lines, dst.hatch_lines, dst.hatch_bounds, dst.color_bounds, transforms);
+    dst.bounds = VectorBounds();
+    for(const auto& [color, b] : dst.color_bounds) {
+        dst.bounds.add(b);
+    }
+    dst.color_names = src.color_names;
+    dst.color_values = src.color_values;
+}
+
+bool layoutInstances(const VectorData& vector_data, const LayoutSettings& settings, InstancedLayout& dst) {
+    ScopedTrace trace("layout");
+    if(vector_data.width <= 0 || vector_data.height <= 0){
+        std::cerr << "layoutInstances: Invalid vector data size." << std::endl;
+        return false;
+    }
+
+    const int paper_width = settings.paper_width;
+    const int paper_height = settings.paper_height;
+    const int paper_margin = settings.paper_margin;
+    if(paper_width <= 2 * paper_margin || paper_height <= 2 * paper_margin){
+        std::cerr << "layoutInstances: Invalid paper size or margin." << std::endl;
+        return false;
+    }
+
+    int drawable_width = paper_width - 2 * paper_margin;
+    int drawable_height = paper_height - 2 * paper_margin;
+
+    // 中心を原点に移して回転する
+    const Affine2D rotate = Affine2D::translation(-vector_data.width * 0.5, -vector_data.height * 0.5)
+        .then(Affine2D::rotation(settings.direction * CV_PI / 180.0));
+
+    // 回転したあとの範囲 (キャッシュした範囲から求まらなければ、点を写しながら1回なめる)
+    double min_x, min_y, max_x, max_y;
+    const bool has_points = rotatedCachedBounds(vector_data, rotate, settings.direction, min_x, min_y, max_x, max_y)
+        || transformedBounds(vector_data, rotate, min_x, min_y, max_x, max_y);
+
+    // scale to fit paper (点がなければそのまま)
+    Affine2D fit;
+    if(has_points && settings.allow_center_drift){
+        double scale = (std::min)(
+            static_cast<double>(drawable_width) / (max_x - min_x),
+            static_cast<double>(drawable_height) / (max_y - min_y)
+        );
+        double center_x = (min_x + max_x) * 0.5;
+        double center_y = (min_y + max_y) * 0.5;
+        fit = {scale, 0, -center_x * scale, 0, scale, -center_y * scale};
+    }else if(has_points){
+        double scale = (std::min)(
+            static_cast<double>(drawable_width * 0.5) / (std::max)(max_x, -min_x),
+            static_cast<double>(drawable_height * 0.5) / (std::max)(max_y, -min_y)
+        );
+        fit = Affine2D::scaling(scale, scale);
+    }
+    const Affine2D fitted = rotate.then(fit);
+
+    const double final_scale = finalScale(settings);
+    const Affine2D place = Affine2D::scaling(final_scale, final_scale).then(Affine2D::translation(paper_width * 0.5, paper_height * 0.5));
+
+    // 1つ目の場所までを1つの行列にまとめて base を作り、2つ目からは base からの移動だけを持つ
+    Affine2D first;
+    dst.placements.assign(1, Affine2D());
+    if(settings.double_mode){
+        // rotate 90 degrees and sqrt(1/2) scale, then upper / lower half
+        double size_scale = static_cast<double>(settings.size_percent) / 100.0;
+        const Affine2D half = fitted.then({0, -std::sqrt(0.5) * size_scale, 0, std::sqrt(0.5) * size_scale, 0, 0});
+        first = half.then(Affine2D::translation(0, -drawable_height * 0.25)).then(place);
+        dst.placements.push_back(Affine2D::translation(0, drawable_height * 0.5)); // 下半分
+    }else{
+        first = fitted.then(place);
+    }
+
+    dst.base = VectorData();
+    placeVectorData(vector_data, {first}, dst.base);
+    dst.base.width = paper_width;
+    dst.base.height = paper_height;
+    dst.shared = VectorData();
+    dst.shared.color_names = vector_data.color_names;
+    dst.shared.color_values = vector_data.color_values;
+    dst.shared.width = paper_width;
+    dst.shared.height = paper_height;
+    dst.width = paper_width;
+    dst.height = paper_height;
+    trace.count("instances", static_cast<double>(dst.placements.size()));
+    return true;
+}
+
+void flattenInstances(const InstancedLayout& layout, VectorData& dst, bool with_shared) {
+    dst = VectorData();
+    placeVectorData(layout.base, layout.placements, dst);
+    if(with_shared){
+        placeVectorData(layout.shared, {Affine2D()}, dst);
+        for(const auto& [color, name] : layout.base.color_names) {
+            dst.color_names[color] = name;
+        }
+        for(const auto& [color, value] : layout.base.color_values) {
+            dst.color_values[color] = value;
+        }
+    }
+    dst.width = layout.width;
+    dst.height = layout.height;
+}
+
+bool layoutVectorData(const VectorData& vector_data, const LayoutSettings& settings, VectorData& dst) {
+    InstancedLayout layout;
+    if(!layoutInstances(vector_data, settings, layout)){
+        return false;
+    }
+    flattenInstances(layout, dst, false);
+    return true;
+}
+
+void addLayoutBorder(const LayoutSettings& settings, VectorData& data) {
+    if(!settings.add_border){
+        return;
+    }
+    const int paper_width = settings.paper_width;
+    const int paper_height = settings.paper_height;
+    const int paper_margin = settings.paper_margin;
+    const bool had_bounds = boundsUpToDate(data);
+
+    int border_color = -1;
+    for(const auto& [color, name] : data.color_names) {
+        border_color = color;
+        if(name == "black") {
+            break;
+        }
+    }
+    if(!data.contours.count(border_color)){
+        data.contours[border_color] = {};
+    }
+    if(!data.polylines.count(border_color)){
+        data.polylines[border_color] = {};
+    }
+    data.contours.at(border_color).push_back({
+        cv::Point2f(paper_margin, paper_margin),
+        cv::Point2f(paper_width - paper_margin, paper_margin),
+        cv::Point2f(paper_width - paper_margin, paper_height - paper_margin),
+        cv::Point2f(paper_margin, paper_height - paper_margin)
+    });
+    if(settings.double_mode){
+        data.polylines.at(border_color).push_back({
+            cv::Point2f(paper_margin, paper_height * 0.5),
+            cv::Point2f(paper_width - paper_margin, paper_height * 0.5)
+        });
+    }
+
+    // 足した線の範囲だけ足す (キャッシュが古ければ全部作り直す)
+    if(!had_bounds){
+        updateBounds(data);
+        return;
+    }
+    auto add_last = [&](const std::vector<std::vector<cv::Point2f>>& lines, std::vector<VectorBounds>& bounds) {
+        while(bounds.size() < lines.size()){
+            bounds.push_back(VectorBounds::of(lines[bounds.size()]));
+            data.color_bounds[border_color].add(bounds.back());
+            data.bounds.add(bounds.back());
+        }
+    };
+    add_last(data.contours.at(border_color), data.contour_bounds[border_color]);
+    add_last(data.polylines.at(border_color), data.polyline_bounds[border_color]);
+}
+
+void drawLayoutGuides(cv::Mat& img, const LayoutSettings& settings, double N) {
+    if(img.empty()){
+        return;
+    }
+    const int paper_width = settings.paper_width;
+    const int paper_height = settings.paper_height;
+    const int paper_margin = settings.paper_margin;
+    const double final_scale = finalScale(settings);
+
+    // draw border
+    if(settings.size_percent < 100){
+        cv::rectangle(img,
+            cv::Point((paper_width * 0.5 - (paper_width * 0.5 - paper_margin) * final_scale) * N,
+                      (paper_height * 0.5 - (paper_height * 0.5 - paper_margin) * final_scale) * N),
+            cv::Point((paper_width * 0.5 + (paper_width * 0.5 - paper_margin) * final_scale) * N - 1,
+                      (paper_height * 0.5 + (paper_height * 0.5 - paper_margin) * final_scale) * N - 1),
+            cv::Scalar(255,0,0), 1, cv::LINE_AA
+        );
+    }
+    cv::rectangle(img,
+        cv::Point(paper_margin * N, paper_margin * N),
+        cv::Point((paper_width - paper_margin) * N - 1, (paper_height - paper_margin) * N - 1),
+        cv::Scalar(0,0,255), 1, cv::LINE_AA
+    );
+    if(settings.double_mode){
+        cv::line(img,
+            cv::Point(paper_margin * N, paper_height * 0.5 * N),
+            cv::Point((paper_width - paper_margin) * N - 1, paper_height * 0.5 * N),
+            cv::Scalar(0,0,255), 1, cv::LINE_AA
+        );
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv4/opencv2/core/mat.hpp>
+
+#include "img/vector_data.hpp"
+#include "affine.hpp"
+
+/*
+Layout
+画像座標の VectorData を用紙(mm)の上に配置する
+*/
+
+struct LayoutSettings {
+    bool double_mode = false; // 90度回転して上下に2枚並べる
+    bool add_border = false;  // 余白の内側に枠線を足す
+    int paper_width = 210;  // mm
+    int paper_height = 297; // mm
+    int paper_margin = 20;  // mm
+    int direction = 0; // 0-359
+    bool allow_center_drift = true;
+    int size_percent = 100; // 1-100
+};
+
+// 同じ絵を何か所にも置く配置 (double_mode では上下に2つ。N面付けにも同じ形で使える)
+// 絵は base に1つ分だけ持ち、置く場所ごとの変換を placements に持つ
+// 最適化も base の1つ分だけ解いて、その順番を全部の場所に写す (core/instanced_path)
+struct InstancedLayout {
+    VectorData base;   // 1つ目の場所に置いた絵 (用紙の座標, mm)
+    std::vector<Affine2D> placements; // base をさらに動かす変換 (先頭は恒等変換)
+    VectorData shared; // 場所によらず1回だけ描くもの (枠線など)
+    int width = 0, height = 0; // 用紙の大きさ (mm)
+};
+
+// 失敗したら false
+// 枠線はまだ足さない (addLayoutBorder(settings, dst.shared) で足す)
+bool layoutInstances(const VectorData& src, const LayoutSettings& settings, InstancedLayout& dst);
+// 全部の場所に置いた絵を1つの VectorData にする (with_shared なら shared も足す)
+void flattenInstances(const InstancedLayout& layout, VectorData& dst, bool with_shared = true);
+// layoutInstances + flattenInstances (shared なし)
+// dst.width, dst.height は用紙の大きさ(mm)になる
+bool layoutVectorData(const VectorData& src, const LayoutSettings& settings, VectorData& dst);
+// add_border が有効なら、黒 (なければ最後の色) で枠線を足す
+void addLayoutBorder(const LayoutSettings& settings, VectorData& data);
+// 1mm = N px で描いたプレビューに余白と縮小範囲の線を描く
+void drawLayoutGuides(cv::Mat& img, const LayoutSettings& settings, double N);
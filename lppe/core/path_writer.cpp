@@ -0,0 +1,306 @@
+#include "path_writer.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <climits>
+
+#include "trace/trace.hpp"
+#include "lppb.h"
+
+unoptimized_path convertToUnoptimizedPath(const VectorData& data) {
+    // polylines -> polylines
+    // contours -> contours
+    // hatch_lines -> polylines
+
+    unoptimized_path u_path;
+    u_path.polylines.clear();
+    u_path.contours.clear();
+    u_path.color_names = data.color_names;
+
+    std::map<int, std::vector<std::vector<point>>> polylines_pts;
+
+    for(const auto& [color_id, lines] : data.polylines) {
+        for(const auto& line : lines) {
+            std::vector<point> pts;
+            pts.reserve(line.size());
+            for(const auto& pt : line) {
+                pts.emplace_back(pt.x, pt.y);
+            }
+            if(!pts.empty()) {
+                polylines_pts[color_id].push_back(pts);
+            }
+        }
+    }
+    for(const auto& [color_id, lines] : data.hatch_lines) {
+        for(const auto& line : lines) {
+            std::vector<point> pts;
+            pts.reserve(line.size());
+            for(const auto& pt : line) {
+                pts.emplace_back(pt.x, pt.y);
+            }
+            if(!pts.empty()) {
+                polylines_pts[color_id].push_back(pts);
+            }
+        }
+    }
+    u_path.polylines = polylines_pts;
+
+    for(const auto& [color_id, lines] : data.contours) {
+        for(const auto& line : lines) {
+            std::vector<point> pts;
+            pts.reserve(line.size());
+            for(const auto& pt : line) {
+                pts.emplace_back(pt.x, pt.y);
+            }
+            if(!pts.empty()) {
+                u_path.contours[color_id].push_back(pts);
+            }
+        }
+    }
+
+    return u_path;
+}
+
+bool writePathFile(const std::string& filename, const draw_path& path) {
+    ScopedTrace trace("write_path");
+    {
+        size_t lines = 0, points = 0;
+        for(const auto& [color_id, paths] : path.paths) {
+            lines += paths.size();
+            for(const auto& pts : paths) {
+                points += pts.size();
+            }
+        }
+        trace.count("polylines", static_cast<double>(lines));
+        trace.count("points", static_cast<double>(points));
+    }
+    /*
+    ファイル構造：
+    N: 色の数 (1-64)
+    n: next polyline
+    e: end of color
+    color name: 64文字以下
+    x y: 座標(mm) float
+
+    N
+    color 0 name
+    color 1 name
+    ...
+    color (N-1) name
+    color 0 data
+    color 1 data
+    ...
+    color (N-1) data
+
+    color data:
+    x y
+    x y
+    ...
+    n
+    x y
+    x y
+    ...
+    n
+    ...
+    e
+    */
+
+    if(path.paths.empty()){
+        std::cerr << "No optimized paths to write." << std::endl;
+        return false;
+    }
+    if(path.color_names.empty()){
+        std::cerr << "No color names available." << std::endl;
+        return false;
+    }
+    if(path.color_names.size() > 64){
+        std::cerr << "Too many colors to write (max 64)." << std::endl;
+        return false;
+    }
+
+    std::ofstream ofs(filename);
+    if(!ofs){
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<int> valid_color_ids;
+    for(const auto& [color_id, paths] : path.paths) {
+        if(paths.size() > 0){
+            valid_color_ids.push_back(color_id);
+        }
+    }
+    // std::endl は1行ごとに flush するので '\n' で書く
+    ofs << valid_color_ids.size() << '\n';
+    for(const auto& color_id : valid_color_ids) {
+        auto it = path.color_names.find(color_id);
+        ofs << (it != path.color_names.end() ? it->second : std::string()) << '\n';
+    }
+    for(const auto& color_id : valid_color_ids) {
+        const auto& paths = path.paths.at(color_id);
+        for(size_t i = 0; i < paths.size(); ++i) {
+            for(const auto& pt : paths[i]) {
+                ofs << pt.first << ' ' << pt.second << '\n';
+            }
+            if(i + 1 < paths.size()){
+                ofs << "n\n"; // next polyline
+            }
+        }
+        ofs << "e\n"; // end of color
+    }
+
+    ofs.close();
+    std::cout << "Optimized path written to " << filename << std::endl;
+    return true;
+}
+
+// 書き出し用のバッファ (リトルエンディアン)
+static void putU8(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+}
+static void putU16(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+static void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >> 24));
+}
+bool writeBinaryPathFile(const std::string& filename, const draw_path& path) {
+    ScopedTrace trace("write_path_binary");
+
+    if(path.paths.empty()){
+        std::cerr << "No optimized paths to write." << std::endl;
+        return false;
+    }
+    if(path.color_names.empty()){
+        std::cerr << "No color names available." << std::endl;
+        return false;
+    }
+
+    std::vector<int> valid_color_ids;
+    for(const auto& [color_id, paths] : path.paths) {
+        if(paths.size() > 0){
+            valid_color_ids.push_back(color_id);
+        }
+    }
+    if(valid_color_ids.size() > LPPB_MAX_COLOR){
+        std::cerr << "Too many colors to write (max " << LPPB_MAX_COLOR << ")." << std::endl;
+        return false;
+    }
+
+    // 座標は 0.01mm の整数にしてから差をとる (誤差がたまらないように)
+    std::vector<int32_t> xs, ys;
+    std::vector<uint8_t> body;
+    std::vector<uint32_t> color_paths(valid_color_ids.size(), 0);
+    uint32_t total_paths = 0, total_points = 0;
+    int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+    for(size_t c = 0; c < valid_color_ids.size(); ++c) {
+        for(const auto& pts : path.paths.at(valid_color_ids[c])) {
+            if(pts.empty()) continue;
+            xs.clear();
+            ys.clear();
+            for(const auto& pt : pts) {
+                const int32_t x = static_cast<int32_t>(std::lround(pt.first * LPPB_UNITS_PER_MM));
+                const int32_t y = static_cast<int32_t>(std::lround(pt.second * LPPB_UNITS_PER_MM));
+                xs.push_back(x);
+                ys.push_back(y);
+                min_x = (std::min)(min_x, x);
+                min_y = (std::min)(min_y, y);
+                max_x = (std::max)(max_x, x);
+                max_y = (std::max)(max_y, y);
+            }
+            color_paths[c]++;
+            total_paths++;
+            total_points += static_cast<uint32_t>(xs.size());
+
+            uint32_t flags = 0;
+            size_t n = xs.size();
+            if(n >= 3 && xs.front() == xs.back() && ys.front() == ys.back()){
+                flags |= LPPB_PATH_CLOSED;
+                --n;
+            }
+            for(size_t i = 1; i < n; ++i) {
+                const int64_t dx = static_cast<int64_t>(xs[i]) - xs[i - 1];
+                const int64_t dy = static_cast<int64_t>(ys[i]) - ys[i - 1];
+                if(dx < INT16_MIN || dx > INT16_MAX || dy < INT16_MIN || dy > INT16_MAX){
+                    flags |= LPPB_PATH_WIDE;
+                    break;
+                }
+            }
+
+            putU8(body, flags);
+            putU32(body, static_cast<uint32_t>(n));
+            putU32(body, static_cast<uint32_t>(xs[0]));
+            putU32(body, static_cast<uint32_t>(ys[0]));
+            for(size_t i = 1; i < n; ++i) {
+                const int32_t dx = xs[i] - xs[i - 1];
+                const int32_t dy = ys[i] - ys[i - 1];
+                if(flags & LPPB_PATH_WIDE){
+                    putU32(body, static_cast<uint32_t>(dx));
+                    putU32(body, static_cast<uint32_t>(dy));
+                }else{
+                    putU16(body, static_cast<uint16_t>(dx));
+                    putU16(body, static_cast<uint16_t>(dy));
+                }
+            }
+        }
+    }
+    if(total_points == 0){
+        // 点が無ければ範囲は全部0にする (INT32_MAX / INT32_MIN のままにしない)
+        min_x = min_y = max_x = max_y = 0;
+    }
+    trace.count("polylines", static_cast<double>(total_paths));
+    trace.count("points", static_cast<double>(total_points));
+
+    std::vector<uint8_t> head;
+    head.reserve(LPPB_HEADER_SIZE + valid_color_ids.size() * (LPPB_MAX_COLOR_NAME_LENGTH + 5));
+    head.insert(head.end(), {'L', 'P', 'P', 'B'});
+    putU16(head, LPPB_VERSION);
+    putU16(head, static_cast<uint32_t>(valid_color_ids.size()));
+    putU32(head, total_paths);
+    putU32(head, total_points);
+    putU32(head, static_cast<uint32_t>(min_x));
+    putU32(head, static_cast<uint32_t>(min_y));
+    putU32(head, static_cast<uint32_t>(max_x));
+    putU32(head, static_cast<uint32_t>(max_y));
+    for(size_t c = 0; c < valid_color_ids.size(); ++c) {
+        auto it = path.color_names.find(valid_color_ids[c]);
+        std::string name = it != path.color_names.end() ? it->second : std::string();
+        if(name.size() >= LPPB_MAX_COLOR_NAME_LENGTH){
+            std::cerr << "Color name too long: " << name << std::endl;
+            return false;
+        }
+        putU8(head, static_cast<uint32_t>(name.size()));
+        head.insert(head.end(), name.begin(), name.end());
+        putU32(head, color_paths[c]);
+    }
+
+    std::ofstream ofs(filename, std::ios::binary);
+    if(!ofs){
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(head.data()), static_cast<std::streamsize>(head.size()));
+    ofs.write(reinterpret_cast<const char*>(body.data()), static_cast<std::streamsize>(body.size()));
+    ofs.close();
+    if(!ofs){
+        std::cerr << "Failed to write file: " << filename << std::endl;
+        return false;
+    }
+    std::cout << "Optimized path written to " << filename << " (" << head.size() + body.size() << " bytes)" << std::endl;
+    return true;
+}
+
+bool writePathFileByExtension(const std::string& filename, const draw_path& path) {
+    const std::string ext = ".lppb";
+    if(filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0){
+        return writeBinaryPathFile(filename, path);
+    }
+    return writePathFile(filename, path);
+}
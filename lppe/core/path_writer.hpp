@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "img/vector_data.hpp"
+#include "optimizer/optimizer.hpp"
+
+/*
+Path Writer
+VectorData → 最適化前のパス、最適化後のパス → optimized_path.txt / optimized_path.lppb
+*/
+
+// polylines, hatch_lines → polylines、contours → contours
+unoptimized_path convertToUnoptimizedPath(const VectorData& data);
+
+// EV3 の print_file が読むテキスト形式で書き出す。失敗したら false
+bool writePathFile(const std::string& filename, const draw_path& path);
+// 同じ内容を LPPB 形式 (ev3/printer/lppb.h) で書き出す。失敗したら false
+bool writeBinaryPathFile(const std::string& filename, const draw_path& path);
+// 拡張子が .lppb なら writeBinaryPathFile、それ以外は writePathFile
+bool writePathFileByExtension(const std::string& filename, const draw_path& path);
@@ -0,0 +1,554 @@
+#include "pipeline.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <charconv>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+#include "optimizer/optimizer.hpp"
+#include "core/path_writer.hpp"
+#include "core/instanced_path.hpp"
+#include "trace/trace.hpp"
+
+static bool is_integer(const std::string& s) {
+    if (s.empty()) return false;
+    const char* begin = s.data();
+    const char* end   = s.data() + s.size();
+    int value;
+    auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+static bool parseInt(const std::string& s, int& value) {
+    if(!is_integer(s)) return false;
+    value = std::stoi(s);
+    return true;
+}
+
+static bool parseDouble(const std::string& s, double& value) {
+    if(s.empty()) return false;
+    char* end = nullptr;
+    value = std::strtod(s.c_str(), &end);
+    return end == s.c_str() + s.size();
+}
+
+static bool parseFloat(const std::string& s, float& value) {
+    double d;
+    if(!parseDouble(s, d)) return false;
+    value = static_cast<float>(d);
+    return true;
+}
+
+static bool parseBool(const std::string& s, bool& value) {
+    if(s == "1" || s == "true" || s == "on"){
+        value = true;
+        return true;
+    }
+    if(s == "0" || s == "false" || s == "off"){
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+// 空白で区切る
+static std::vector<std::string> splitArgs(const std::string& line) {
+    std::vector<std::string> args;
+    std::istringstream iss(line);
+    std::string arg;
+    while(iss >> arg) {
+        args.push_back(arg);
+    }
+    return args;
+}
+
+// args[first] 以降の key=value を読む (= が無いものは key → "")
+static std::map<std::string, std::string> parseKeyValues(const std::vector<std::string>& args, size_t first) {
+    std::map<std::string, std::string> kv;
+    for(size_t i = first; i < args.size(); ++i) {
+        const auto pos = args[i].find('=');
+        if(pos == std::string::npos) {
+            kv[args[i]] = "";
+        } else {
+            kv[args[i].substr(0, pos)] = args[i].substr(pos + 1);
+        }
+    }
+    return kv;
+}
+
+static std::string normalizeHex(std::string hex) {
+    if(!hex.empty() && hex[0] == '#') hex.erase(0, 1);
+    return hex;
+}
+
+void parseHatchCommand(const std::vector<std::string>& args, std::map<std::string, HatchLineSetting>& settings) {
+    if(args.size() <= 2){
+        return;
+    }
+    settings[args[1]] = HatchLineSetting();
+    auto key = args[1];
+    for(size_t i=2; i<args.size(); ++i){
+        std::string value = args[i];
+        if(value == "/" || value == "-" || value == "\\" || value == "|" || value == "+" || value == "x"){
+            settings[key].mode = value;
+        }else if(is_integer(value)){
+            int spacing = std::stoi(value);
+            if(spacing >= 1 && spacing <= 1000){
+                settings[key].spacing = spacing;
+            }
+        }else if(value.size() > 0){
+            settings[key].substitute_color = value;
+        }
+    }
+}
+
+static bool parseFilter(const std::vector<std::string>& args, PipelineFilter& filter) {
+    if(args.size() < 2) return false;
+    if(args[1] == "grayscale"){
+        filter.type = PipelineFilterType::Grayscale;
+        if(args.size() >= 3){
+            if(args[2] == "lab") filter.grayscale_mode = GrayscaleMode::Lab;
+            else if(args[2] == "default") filter.grayscale_mode = GrayscaleMode::Default;
+            else return false;
+        }
+        return true;
+    }
+    if(args[1] == "bilateral"){
+        filter.type = PipelineFilterType::Bilateral;
+        for(const auto& [key, value] : parseKeyValues(args, 2)) {
+            bool ok = false;
+            if(key == "diameter") ok = parseInt(value, filter.diameter) && filter.diameter >= 1;
+            else if(key == "sigma_color") ok = parseDouble(value, filter.sigma_color);
+            else if(key == "sigma_space") ok = parseDouble(value, filter.sigma_space);
+            else if(key == "loops") ok = parseInt(value, filter.loops) && filter.loops >= 1;
+            else if(key == "max_error") ok = parseDouble(value, filter.max_error);
+            else if(key == "mode"){
+                ok = (value == "exact" || value == "fast");
+                filter.bilateral_mode = (value == "fast") ? BilateralMode::Fast : BilateralMode::Exact;
+            }
+            if(!ok){
+                std::cerr << "Invalid bilateral parameter: " << key << "=" << value << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool parseColorMap(const std::vector<std::string>& args, PipelineColorMap& cm, bool& thresholds_given) {
+    if(args.size() < 2) return false;
+    if(args[1] == "binary") cm.multi = false;
+    else if(args[1] == "multi") cm.multi = true;
+    else return false;
+
+    for(const auto& [key, value] : parseKeyValues(args, 2)) {
+        bool ok = false;
+        if(key == "threshold") ok = parseInt(value, cm.threshold) && cm.threshold >= 0 && cm.threshold <= 255;
+        else if(key == "achro") ok = parseBool(value, cm.detect_achro);
+        else if(key == "achros") ok = parseInt(value, cm.achros) && cm.achros >= 2 && cm.achros <= 4;
+        else if(key == "sensitivity") ok = parseFloat(value, cm.achro_sensitivity) && cm.achro_sensitivity >= 0.0f && cm.achro_sensitivity <= 1.0f;
+        else if(key == "lut") ok = parseBool(value, cm.use_lut);
+        else if(key == "thresholds"){
+            cm.achro_thresholds.clear();
+            std::stringstream ss(value);
+            std::string item;
+            ok = true;
+            while(std::getline(ss, item, ',')){
+                int t;
+                if(!parseInt(item, t) || t < 0 || t > 255){
+                    ok = false;
+                    break;
+                }
+                cm.achro_thresholds.push_back(t);
+            }
+            thresholds_given = true;
+        }
+        if(!ok){
+            std::cerr << "Invalid colormap parameter: " << key << "=" << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseConverter(const std::vector<std::string>& args, PipelineConverter& converter) {
+    if(args.size() < 2) return false;
+    const auto kv = parseKeyValues(args, 2);
+    // 共通の min_size, opening を読む
+    auto common = [](const std::string& key, const std::string& value, int& min_size, int& opening_radius, bool& ok) {
+        if(key == "min_size"){
+            ok = parseInt(value, min_size) && min_size >= 1;
+            return true;
+        }
+        if(key == "opening"){
+            ok = parseInt(value, opening_radius) && opening_radius >= 0;
+            return true;
+        }
+        return false;
+    };
+
+    if(args[1] == "edge"){
+        converter.type = PipelineConverterType::Edge;
+        auto& p = converter.edge;
+        for(const auto& [key, value] : kv) {
+            bool ok = false;
+            common(key, value, p.min_size, p.opening_radius, ok);
+            if(!ok){
+                std::cerr << "Invalid edge parameter: " << key << "=" << value << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    if(args[1] == "fill"){
+        converter.type = PipelineConverterType::Fill;
+        auto& p = converter.fill;
+        for(const auto& [key, value] : kv) {
+            bool ok = false;
+            if(common(key, value, p.min_size, p.opening_radius, ok)){}
+            else if(key == "outline") ok = parseBool(value, p.outline_mode);
+            else if(key == "canny"){ p.canny_mode = value; ok = true; }
+            else if(key == "low") ok = parseInt(value, p.low_threshold);
+            else if(key == "high") ok = parseInt(value, p.high_threshold);
+            else if(key == "color_edges"){ p.color_edges = value; ok = true; }
+            else if(key == "back_outline"){ p.back_outline = value; ok = true; }
+            else if(key == "closing") ok = parseInt(value, p.closing_radius) && p.closing_radius >= 0;
+            else if(key == "erosion") ok = parseInt(value, p.erosion_radius);
+            if(!ok){
+                std::cerr << "Invalid fill parameter: " << key << "=" << value << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    if(args[1] == "line_and_fill"){
+        converter.type = PipelineConverterType::LineAndFill;
+        auto& p = converter.line_and_fill;
+        for(const auto& [key, value] : kv) {
+            bool ok = false;
+            if(common(key, value, p.min_size, p.opening_radius, ok)){}
+            else if(key == "outline") ok = parseBool(value, p.outline_mode);
+            else if(key == "radius") ok = parseInt(value, p.radius) && p.radius >= 1;
+            if(!ok){
+                std::cerr << "Invalid line_and_fill parameter: " << key << "=" << value << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    if(args[1] == "outline"){
+        converter.type = PipelineConverterType::Outline;
+        auto& p = converter.outline;
+        for(const auto& [key, value] : kv) {
+            bool ok = false;
+            common(key, value, p.min_size, p.opening_radius, ok);
+            if(!ok){
+                std::cerr << "Invalid outline parameter: " << key << "=" << value << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool parseVector(const std::vector<std::string>& args, PipelineDescription& desc) {
+    for(const auto& [key, value] : parseKeyValues(args, 1)) {
+        bool ok = false;
+        if(key == "hatch_spacing") ok = parseInt(value, desc.hatch_line_spacing) && desc.hatch_line_spacing >= 1;
+        else if(key == "jitter") ok = parseFloat(value, desc.no_jitter_epsilon) && desc.no_jitter_epsilon >= 0.0f;
+        else if(key == "min_length") ok = parseFloat(value, desc.min_polyline_length) && desc.min_polyline_length >= 0.0f;
+        if(!ok){
+            std::cerr << "Invalid vector parameter: " << key << "=" << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseTiling(const std::vector<std::string>& args, TileSettings& tiling) {
+    tiling.enabled = true;
+    for(const auto& [key, value] : parseKeyValues(args, 1)) {
+        int budget;
+        if(key != "budget_mb" || !parseInt(value, budget) || budget < 16){
+            std::cerr << "Invalid tiling parameter: " << key << "=" << value << std::endl;
+            return false;
+        }
+        tiling.memory_budget_mb = static_cast<size_t>(budget);
+    }
+    return true;
+}
+
+static bool parseLayout(const std::vector<std::string>& args, LayoutSettings& layout) {
+    for(const auto& [key, value] : parseKeyValues(args, 1)) {
+        bool ok = false;
+        if(key == "paper"){
+            const auto pos = value.find('x');
+            ok = pos != std::string::npos
+                && parseInt(value.substr(0, pos), layout.paper_width)
+                && parseInt(value.substr(pos + 1), layout.paper_height)
+                && layout.paper_width > 0 && layout.paper_width <= 1000
+                && layout.paper_height > 0 && layout.paper_height <= 1000;
+        }
+        else if(key == "margin") ok = parseInt(value, layout.paper_margin) && layout.paper_margin >= 0;
+        else if(key == "direction"){
+            ok = parseInt(value, layout.direction);
+            layout.direction = (layout.direction % 360 + 360) % 360;
+        }
+        else if(key == "center_drift") ok = parseBool(value, layout.allow_center_drift);
+        else if(key == "size") ok = parseInt(value, layout.size_percent) && layout.size_percent >= 1 && layout.size_percent <= 100;
+        else if(key == "double") ok = parseBool(value, layout.double_mode);
+        else if(key == "border") ok = parseBool(value, layout.add_border);
+        if(!ok){
+            std::cerr << "Invalid layout parameter: " << key << "=" << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadPipelineDescription(const std::string& filename, PipelineDescription& desc) {
+    std::ifstream ifs(filename);
+    if(!ifs){
+        std::cerr << "Failed to open pipeline file: " << filename << std::endl;
+        return false;
+    }
+
+    desc = PipelineDescription();
+    Colors colors, achro_colors;
+    bool thresholds_given = false;
+    bool converter_given = false;
+
+    std::string line;
+    int line_no = 0;
+    while(std::getline(ifs, line)) {
+        ++line_no;
+        auto args = splitArgs(line);
+        if(args.empty() || args[0][0] == '#') {
+            continue;
+        }
+
+        bool ok = false;
+        const std::string& cmd = args[0];
+        if(cmd == "filter"){
+            PipelineFilter filter;
+            ok = parseFilter(args, filter);
+            if(ok) desc.filters.push_back(filter);
+        }else if(cmd == "colormap"){
+            ok = parseColorMap(args, desc.colormap, thresholds_given);
+        }else if(cmd == "color" || cmd == "achro_color"){
+            ok = (args.size() == 3);
+            int b, g, r;
+            if(ok) ok = convertHexToBGR(normalizeHex(args[2]), b, g, r);
+            if(ok) ((cmd == "color") ? colors : achro_colors).push_back({args[1], normalizeHex(args[2])});
+        }else if(cmd == "converter"){
+            if(converter_given){
+                std::cerr << "Only one converter can be used for a whole image." << std::endl;
+            }else{
+                ok = parseConverter(args, desc.converter);
+                converter_given = true;
+            }
+        }else if(cmd == "hatch"){
+            ok = (args.size() > 2);
+            parseHatchCommand(args, desc.hatch_settings);
+        }else if(cmd == "vector"){
+            ok = parseVector(args, desc);
+        }else if(cmd == "tiling"){
+            ok = parseTiling(args, desc.tiling);
+        }else if(cmd == "layout"){
+            ok = parseLayout(args, desc.layout);
+        }else if(cmd == "optimizer"){
+            ok = (args.size() == 2 && (args[1] == "greedy" || args[1] == "beam"));
+            desc.beam_search = ok && args[1] == "beam";
+        }
+
+        if(!ok){
+            std::cerr << filename << ":" << line_no << ": cannot read: " << line << std::endl;
+            return false;
+        }
+    }
+
+    auto& cm = desc.colormap;
+    if(!colors.empty()){
+        cm.colors = colors;
+    }
+    // achro 系は GUI の既定値に合わせる
+    if(!achro_colors.empty()){
+        cm.achro_colors = achro_colors;
+    }else{
+        const Colors all = {{"black", "000000"}, {"gray", "555555"}, {"light gray", "AAAAAA"}, {"white", "FFFFFF"}};
+        cm.achro_colors.clear();
+        for(size_t i = 0; i < all.size(); ++i){
+            if(cm.achros == 2 && (i == 1 || i == 2)) continue;
+            if(cm.achros == 3 && i == 2) continue;
+            cm.achro_colors.push_back(all[i]);
+        }
+    }
+    if(!thresholds_given){
+        switch(cm.achros){
+            case 2: cm.achro_thresholds = {127}; break;
+            case 3: cm.achro_thresholds = {85, 170}; break;
+            case 4: cm.achro_thresholds = {64, 128, 192}; break;
+        }
+    }
+    if(cm.multi && cm.detect_achro){
+        if(static_cast<int>(cm.achro_colors.size()) != cm.achros){
+            std::cerr << filename << ": " << cm.achros << " achro colors are required." << std::endl;
+            return false;
+        }
+        if(static_cast<int>(cm.achro_thresholds.size()) != cm.achros - 1
+            || !std::is_sorted(cm.achro_thresholds.begin(), cm.achro_thresholds.end(), std::less_equal<int>())){
+            std::cerr << filename << ": achro thresholds must be " << cm.achros - 1 << " values in ascending order." << std::endl;
+            return false;
+        }
+    }
+    if(cm.multi && cm.colors.empty()){
+        std::cerr << filename << ": no colors for multi color map." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const PaletteLUT> buildPipelineLUT(const PipelineDescription& desc) {
+    if(!desc.colormap.multi || !desc.colormap.use_lut){
+        return nullptr;
+    }
+    return buildPaletteLUT(desc.colormap.colors);
+}
+
+static void applyFilter(const PipelineFilter& filter, const cv::Mat& src, cv::Mat& dst) {
+    switch(filter.type){
+        case PipelineFilterType::Grayscale:
+            convertToGrayScale(src, dst, filter.grayscale_mode);
+            break;
+        case PipelineFilterType::Bilateral:
+            bilateral(src, dst, filter.diameter, filter.sigma_color, filter.sigma_space, filter.loops,
+                filter.bilateral_mode, filter.max_error);
+            break;
+    }
+}
+
+static void generateColorMap(const cv::Mat& src, const PipelineColorMap& cm, const PaletteLUT* lut, ColorMap& color_map) {
+    cv::Mat view_map;
+    if(!cm.multi){
+        generateBinaryColorMap(src, cm.threshold, color_map, view_map);
+        return;
+    }
+    Colors colors = cm.colors;
+    if(cm.detect_achro){
+        Colors achro_colors = cm.achro_colors;
+        std::vector<float> thresholds;
+        for(int t : cm.achro_thresholds){
+            thresholds.push_back(t / 255.0f * 100.0f);
+        }
+        generateAchroColorMap(src, cm.achro_sensitivity, thresholds, achro_colors, colors, color_map, view_map, lut);
+    }else{
+        generateMultiColorMap(src, colors, color_map, view_map, lut);
+    }
+}
+
+bool runPipeline(const cv::Mat& src, const PipelineDescription& desc, const std::string& output_path,
+    PipelineTimings& timings, const PaletteLUT* lut, PrintTimeEstimate* print_time) {
+    if(src.empty() || src.type() != CV_8UC3){
+        std::cerr << "runPipeline: source image is empty or not a 3-channel BGR image." << std::endl;
+        return false;
+    }
+
+    ScopedTrace trace("pipeline");
+    trace.count("pixels", static_cast<double>(src.total()));
+
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    auto stage_start = start;
+    auto lap = [&](double& ms) {
+        const auto now = Clock::now();
+        ms = std::chrono::duration<double, std::milli>(now - stage_start).count();
+        stage_start = now;
+    };
+    timings = PipelineTimings();
+
+    // フィルタ
+    cv::Mat filtered = src;
+    for(const auto& filter : desc.filters){
+        cv::Mat dst;
+        applyFilter(filter, filtered, dst);
+        filtered = dst;
+    }
+    lap(timings.filter_ms);
+
+    // 色分け
+    ColorMap color_map;
+    generateColorMap(filtered, desc.colormap, lut, color_map);
+    if(color_map.colorMap.empty()){
+        std::cerr << "runPipeline: color map generation failed." << std::endl;
+        return false;
+    }
+    lap(timings.colormap_ms);
+
+    // ベクタ化 (ConverterManager と同じ手順, 全画素をコンバータ1番に割り当てる)
+    VectorData data;
+    data.width = src.cols;
+    data.height = src.rows;
+    data.color_names = color_map.MapOfColorName;
+    for(const auto& [color_id, _] : color_map.MapOfColor) {
+        data.filled_masks[color_id] = cv::Mat::zeros(src.size(), CV_8UC1);
+        data.edge_masks[color_id] = cv::Mat::zeros(src.size(), CV_8UC1);
+        data.outline_masks[color_id] = cv::Mat::zeros(src.size(), CV_8UC1);
+        data.color_values[color_id] = cv::Scalar(0,0,0);
+        if(color_map.MapOfColorValueBGR.find(color_id) != color_map.MapOfColorValueBGR.end()) {
+            data.color_values[color_id] = color_map.MapOfColorValueBGR.at(color_id);
+        }
+    }
+    const int mode = 1;
+    cv::Mat mode_map(src.size(), CV_8UC1, cv::Scalar(mode));
+    ConvertContext ctx;
+    ctx.tiling = desc.tiling;
+    switch(desc.converter.type){
+        case PipelineConverterType::Edge:
+            convertEdge(src, color_map, mode_map, mode, desc.converter.edge, ctx, data);
+            break;
+        case PipelineConverterType::Fill:
+            convertFill(src, color_map, mode_map, mode, desc.converter.fill, ctx, data);
+            break;
+        case PipelineConverterType::LineAndFill:
+            convertLineAndFill(src, color_map, mode_map, mode, desc.converter.line_and_fill, ctx, data);
+            break;
+        case PipelineConverterType::Outline:
+            convertOutline(src, color_map, mode_map, mode, desc.converter.outline, ctx, data);
+            break;
+    }
+    lastConvertToVectorData(data, desc.hatch_line_spacing, 45, 20, desc.no_jitter_epsilon, desc.min_polyline_length, desc.hatch_settings, desc.tiling);
+    lap(timings.convert_ms);
+
+    // 用紙に配置
+    InstancedLayout laid_out;
+    if(!layoutInstances(data, desc.layout, laid_out)){
+        return false;
+    }
+    addLayoutBorder(desc.layout, laid_out.shared);
+    lap(timings.layout_ms);
+
+    // 最適化 (double_mode でも1つ分だけ解いて写す)
+    draw_path path;
+    optimizeInstancedLayout(laid_out, desc.beam_search, path);
+    lap(timings.optimize_ms);
+
+    // 書き出し
+    const bool written = writePathFileByExtension(output_path, path);
+    lap(timings.write_ms);
+
+    if(print_time){
+        PrintTimeModel model;
+        model.paper_width = static_cast<float>(laid_out.width);
+        model.paper_height = static_cast<float>(laid_out.height);
+        *print_time = estimatePrintTime(path, model);
+    }
+
+    timings.total_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return written;
+}
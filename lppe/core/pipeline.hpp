@@ -0,0 +1,127 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv4/opencv2/core/mat.hpp>
+
+#include "img/colormap_generator.hpp"
+#include "img/filter_funcs.hpp"
+#include "img/tiling.hpp"
+#include "img/vector_data.hpp"
+#include "core/converters.hpp"
+#include "core/layout.hpp"
+#include "core/print_time.hpp"
+
+/*
+Pipeline
+GUI の各タブ (フィルタ → 色分け → ベクタ化 → 配置 → 最適化 → 書き出し) を1枚の画像に対してまとめて実行する
+設定はテキストファイル (1行1コマンド, # 以降はコメント) から読む
+
+filter grayscale [lab|default]
+filter bilateral diameter=3 sigma_color=15 sigma_space=10 loops=10 mode=exact|fast max_error=2
+colormap binary threshold=160
+colormap multi achro=1 achros=3 thresholds=85,170 sensitivity=0.15 lut=1
+color <name> <RRGGBB>         (1つでも書けば有彩色パレットを置き換える)
+achro_color <name> <RRGGBB>   (書いた順に黒→白。achros 個まで)
+converter edge|fill|line_and_fill|outline key=value ...   (GUI の各スライダーと同じ名前)
+hatch <color> [/|-|\|+|x] [spacing] [substitute color]   (シェルの hatch と同じ)
+vector hatch_spacing=10 jitter=4 min_length=0
+tiling budget_mb=256
+layout paper=210x297 margin=20 direction=0 center_drift=1 size=100 double=0 border=0
+optimizer greedy|beam
+*/
+
+enum class PipelineFilterType {
+    Grayscale,
+    Bilateral,
+};
+
+struct PipelineFilter {
+    PipelineFilterType type = PipelineFilterType::Grayscale;
+    GrayscaleMode grayscale_mode = GrayscaleMode::Lab;
+    int diameter = 3;
+    double sigma_color = 15.0;
+    double sigma_space = 10.0;
+    int loops = 10;
+    BilateralMode bilateral_mode = BilateralMode::Exact;
+    double max_error = 2.0;
+};
+
+struct PipelineColorMap {
+    bool multi = false;
+    int threshold = 160; // binary
+    bool detect_achro = true;
+    int achros = 3;
+    std::vector<int> achro_thresholds = {85, 170}; // 0-255, achros-1 個
+    float achro_sensitivity = 0.15f;
+    bool use_lut = true;
+    Colors colors = {
+        {"Red", "FF0000"},
+        {"Green", "00FF00"},
+        {"Blue", "0000FF"},
+        {"Cyan", "00FFFF"},
+        {"Magenta", "FF00FF"},
+        {"Yellow", "FFFF00"},
+    };
+    Colors achro_colors = {
+        {"black", "000000"},
+        {"gray", "555555"},
+        {"white", "FFFFFF"},
+    };
+};
+
+enum class PipelineConverterType {
+    Edge,
+    Fill,
+    LineAndFill,
+    Outline,
+};
+
+// GUI では領域ごとにコンバータを塗り分けるが、ここでは画像全体に1つだけ使う
+struct PipelineConverter {
+    PipelineConverterType type = PipelineConverterType::Fill;
+    EdgeConverterParams edge;
+    FillConverterParams fill;
+    LineAndFillConverterParams line_and_fill;
+    OutlineConverterParams outline;
+};
+
+struct PipelineDescription {
+    std::vector<PipelineFilter> filters;
+    PipelineColorMap colormap;
+    PipelineConverter converter;
+    std::map<std::string, HatchLineSetting> hatch_settings;
+    int hatch_line_spacing = 10;
+    float no_jitter_epsilon = 4.0f;
+    float min_polyline_length = 0.0f;
+    TileSettings tiling;
+    LayoutSettings layout;
+    bool beam_search = false;
+};
+
+// 各段の処理時間 (ms)
+struct PipelineTimings {
+    double filter_ms = 0.0;
+    double colormap_ms = 0.0;
+    double convert_ms = 0.0;
+    double layout_ms = 0.0;
+    double optimize_ms = 0.0;
+    double write_ms = 0.0;
+    double total_ms = 0.0;
+};
+
+// 読めない行があれば、行番号付きで std::cerr に出して false
+bool loadPipelineDescription(const std::string& filename, PipelineDescription& desc);
+
+// hatch コマンド (args[0] == "hatch") を settings に反映する
+void parseHatchCommand(const std::vector<std::string>& args, std::map<std::string, HatchLineSetting>& settings);
+
+// multi モードで LUT を使うなら、同じパレットで使い回せるLUTを作る (使わなければ nullptr)
+std::shared_ptr<const PaletteLUT> buildPipelineLUT(const PipelineDescription& desc);
+
+// src (BGR) を変換して output_path に optimized_path.txt の形式で書き出す (拡張子が .lppb なら LPPB 形式)
+// print_time があれば、EV3 で印刷にかかる時間の見積もりを入れる
+bool runPipeline(const cv::Mat& src, const PipelineDescription& desc, const std::string& output_path,
+    PipelineTimings& timings, const PaletteLUT* lut = nullptr, PrintTimeEstimate* print_time = nullptr);
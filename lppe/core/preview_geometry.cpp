@@ -0,0 +1,234 @@
+#include "preview_geometry.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define PREVIEW_COLOR_RED (0xFF0000FFu)
+#define PREVIEW_COLOR_GREEN (0xFF00FF00u)
+#define PREVIEW_COLOR_BLUE (0xFFFF0000u)
+#define PREVIEW_COLOR_BLACK (0xFF000000u)
+#define PREVIEW_COLOR_TRAVEL (0xFF3030FFu) // 薄い赤
+
+void PreviewGeometry::clear() {
+    points.clear();
+    strokes.clear();
+    markers.clear();
+    input_points = 0;
+    culled_lines = 0;
+}
+
+uint32_t previewColor(const cv::Scalar& bgr) {
+    auto channel = [](double v) {
+        return static_cast<uint32_t>(std::clamp(static_cast<int>(std::lround(v)), 0, 255));
+    };
+    return 0xFF000000u | (channel(bgr[0]) << 16) | (channel(bgr[1]) << 8) | channel(bgr[2]);
+}
+
+PreviewViewport fitPreviewViewport(float data_width, float data_height, float origin_x, float origin_y, float width, float height) {
+    PreviewViewport viewport;
+    viewport.origin_x = origin_x;
+    viewport.origin_y = origin_y;
+    viewport.width = width;
+    viewport.height = height;
+    if (data_width <= 0 || data_height <= 0 || width <= 0 || height <= 0) {
+        return viewport;
+    }
+    viewport.zoom = (std::min)(width / data_width, height / data_height);
+    viewport.pan_x = data_width * 0.5f - width * 0.5f / viewport.zoom;
+    viewport.pan_y = data_height * 0.5f - height * 0.5f / viewport.zoom;
+    return viewport;
+}
+
+// 線ごとの色の番号から決まった色を作る (RandomColored 用。描くたびに同じ色になる)
+static uint32_t hashedColor(int color_id, size_t index) {
+    uint32_t h = static_cast<uint32_t>(color_id) * 0x9E3779B1u ^ static_cast<uint32_t>(index) * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return 0xFF000000u | (h & 0x00FFFFFFu);
+}
+
+// データ座標の表示範囲
+struct VisibleRect {
+    float min_x, min_y, max_x, max_y;
+    bool intersects(const VectorBounds& b) const {
+        return !b.empty() && b.max_x >= min_x && b.min_x <= max_x && b.max_y >= min_y && b.min_y <= max_y;
+    }
+};
+
+static VisibleRect visibleRect(const PreviewViewport& viewport) {
+    const float zoom = viewport.zoom > 0 ? viewport.zoom : 1.0f;
+    return {viewport.pan_x, viewport.pan_y, viewport.pan_x + viewport.width / zoom, viewport.pan_y + viewport.height / zoom};
+}
+
+// データ座標 → 画面座標
+static Affine2D screenTransform(const PreviewViewport& viewport) {
+    const double zoom = viewport.zoom;
+    return {zoom, 0, viewport.origin_x - viewport.pan_x * zoom, 0, zoom, viewport.origin_y - viewport.pan_y * zoom};
+}
+
+// 範囲を m で写した範囲 (四隅を写すので、回転があれば少し広めになる)
+static VectorBounds transformBounds(const VectorBounds& b, const Affine2D& m) {
+    if (b.empty()) return b;
+    VectorBounds moved;
+    moved.add(m.apply(cv::Point2f(b.min_x, b.min_y)));
+    moved.add(m.apply(cv::Point2f(b.max_x, b.min_y)));
+    moved.add(m.apply(cv::Point2f(b.min_x, b.max_y)));
+    moved.add(m.apply(cv::Point2f(b.max_x, b.max_y)));
+    return moved;
+}
+
+// to_screen で画面座標にして、前に残した点から min_step_px 以内の点を間引きながら out に足す
+// (最後の点は必ず残す)。get(i) は i 番目の点のデータ座標
+template <typename GetPoint>
+static void appendStroke(size_t n, const GetPoint& get, bool closed, uint32_t color,
+    const Affine2D& to_screen, float min_step_px, PreviewGeometry& out) {
+    if (n < 2) return;
+    const float min_step2 = min_step_px * min_step_px;
+
+    PreviewStroke stroke;
+    stroke.color = color;
+    stroke.first = static_cast<uint32_t>(out.points.size());
+    stroke.closed = closed;
+    for (size_t i = 0; i < n; ++i) {
+        const cv::Point2f s = to_screen.apply(get(i));
+        if (i > 0 && i + 1 < n) {
+            const cv::Point2f d = s - out.points.back();
+            if (d.x * d.x + d.y * d.y < min_step2) continue;
+        }
+        out.points.push_back(s);
+    }
+    stroke.count = static_cast<uint32_t>(out.points.size() - stroke.first);
+    out.input_points += n;
+    out.strokes.push_back(stroke);
+}
+
+static void appendMarkers(const std::vector<cv::Point2f>& line, bool ends_only, uint32_t end_color, uint32_t mid_color,
+    const Affine2D& to_screen, PreviewGeometry& out) {
+    for (size_t i = 0; i < line.size(); ++i) {
+        const bool end = i == 0 || i + 1 == line.size();
+        if (!end && ends_only) continue;
+        out.markers.push_back({to_screen.apply(line[i]), end ? end_color : mid_color});
+    }
+}
+
+// data を place で動かしたものを out に足す
+static void appendVectorData(const VectorData& data, const Affine2D& place, const PreviewViewport& viewport,
+    const PreviewStyle& style, PreviewGeometry& out) {
+    const VisibleRect visible = visibleRect(viewport);
+    const Affine2D to_screen = place.then(screenTransform(viewport));
+    const bool cached = boundsUpToDate(data);
+    const bool points = style.view == VectorView::Points;
+    const bool markers = points && viewport.zoom >= style.marker_min_zoom;
+
+    enum class Kind { Polyline, Contour, Hatch };
+    auto emit = [&](const std::map<int, std::vector<std::vector<cv::Point2f>>>& groups,
+        const std::map<int, std::vector<VectorBounds>>& bounds, Kind kind) {
+        if (kind == Kind::Hatch && !points && style.view != VectorView::Hatch) return;
+        for (const auto& [color_id, lines] : groups) {
+            if (cached) {
+                auto it = data.color_bounds.find(color_id);
+                if (it != data.color_bounds.end() && !visible.intersects(transformBounds(it->second, place))) {
+                    out.culled_lines += lines.size();
+                    continue;
+                }
+            }
+            const std::vector<VectorBounds>* line_bounds = cached ? &bounds.at(color_id) : nullptr;
+            const uint32_t own = previewColor(data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255));
+            for (size_t i = 0; i < lines.size(); ++i) {
+                const auto& line = lines[i];
+                const VectorBounds b = line_bounds ? (*line_bounds)[i] : VectorBounds::of(line);
+                if (!visible.intersects(transformBounds(b, place))) {
+                    out.culled_lines++;
+                    continue;
+                }
+                uint32_t color = own;
+                if (style.view == VectorView::RandomColored) {
+                    color = hashedColor(color_id, i);
+                } else if (points) {
+                    color = kind == Kind::Polyline ? PREVIEW_COLOR_RED : kind == Kind::Contour ? PREVIEW_COLOR_GREEN : PREVIEW_COLOR_BLUE;
+                }
+                const bool closed = kind == Kind::Contour;
+                appendStroke(line.size(), [&](size_t k) { return line[k]; }, closed, color, to_screen, style.min_step_px, out);
+                if (markers && line.size() >= 2) {
+                    if (kind == Kind::Polyline) appendMarkers(line, false, PREVIEW_COLOR_BLUE, PREVIEW_COLOR_GREEN, to_screen, out);
+                    if (kind == Kind::Contour) appendMarkers(line, false, PREVIEW_COLOR_BLUE, PREVIEW_COLOR_BLUE, to_screen, out);
+                    if (kind == Kind::Hatch) appendMarkers(line, true, PREVIEW_COLOR_RED, PREVIEW_COLOR_RED, to_screen, out);
+                }
+            }
+        }
+    };
+    emit(data.polylines, data.polyline_bounds, Kind::Polyline);
+    emit(data.contours, data.contour_bounds, Kind::Contour);
+    emit(data.hatch_lines, data.hatch_bounds, Kind::Hatch);
+}
+
+void buildPreviewGeometry(const VectorData& data, const PreviewViewport& viewport, const PreviewStyle& style, PreviewGeometry& out) {
+    out.clear();
+    if (viewport.zoom <= 0 || viewport.width <= 0 || viewport.height <= 0) return;
+    appendVectorData(data, Affine2D(), viewport, style, out);
+}
+
+void buildPreviewGeometry(const InstancedLayout& layout, const PreviewViewport& viewport, const PreviewStyle& style, PreviewGeometry& out) {
+    out.clear();
+    if (viewport.zoom <= 0 || viewport.width <= 0 || viewport.height <= 0) return;
+    // 絵は1つ分のまま、置く場所ごとに変換だけ変えて作る
+    for (const auto& place : layout.placements) {
+        appendVectorData(layout.base, place, viewport, style, out);
+    }
+}
+
+void computeDrawPathBounds(const draw_path& path, DrawPathBounds& out) {
+    out.paths.clear();
+    for (const auto& [color_id, paths] : path.paths) {
+        auto& bounds = out.paths[color_id];
+        bounds.reserve(paths.size());
+        for (const auto& pts : paths) {
+            VectorBounds b;
+            for (const auto& pt : pts) {
+                b.add(cv::Point2f(pt.first, pt.second));
+            }
+            bounds.push_back(b);
+        }
+    }
+}
+
+void buildPreviewGeometry(const draw_path& path, const DrawPathBounds& bounds, const PreviewViewport& viewport, const PreviewStyle& style, PreviewGeometry& out) {
+    out.clear();
+    if (viewport.zoom <= 0 || viewport.width <= 0 || viewport.height <= 0) return;
+
+    const VisibleRect visible = visibleRect(viewport);
+    const Affine2D to_screen = screenTransform(viewport);
+    for (const auto& [color_id, paths] : path.paths) {
+        auto it = bounds.paths.find(color_id);
+        const std::vector<VectorBounds>* path_bounds = (it != bounds.paths.end() && it->second.size() == paths.size()) ? &it->second : nullptr;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            const auto& pts = paths[i];
+            VectorBounds b;
+            if (path_bounds) {
+                b = (*path_bounds)[i];
+            } else {
+                for (const auto& pt : pts) {
+                    b.add(cv::Point2f(pt.first, pt.second));
+                }
+            }
+            if (!visible.intersects(b)) {
+                out.culled_lines++;
+            } else {
+                appendStroke(pts.size(), [&](size_t k) { return cv::Point2f(pts[k].first, pts[k].second); },
+                    false, PREVIEW_COLOR_BLACK, to_screen, style.min_step_px, out);
+            }
+            // パス間の移動
+            if (style.show_travel && i + 1 < paths.size() && !pts.empty() && !paths[i + 1].empty()) {
+                const cv::Point2f from(pts.back().first, pts.back().second);
+                const cv::Point2f to(paths[i + 1].front().first, paths[i + 1].front().second);
+                VectorBounds travel;
+                travel.add(from);
+                travel.add(to);
+                if (visible.intersects(travel)) {
+                    appendStroke(2, [&](size_t k) { return k == 0 ? from : to; }, false, PREVIEW_COLOR_TRAVEL, to_screen, 0.0f, out);
+                }
+            }
+        }
+    }
+}
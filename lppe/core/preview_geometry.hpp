@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+#include <opencv4/opencv2/core/types.hpp>
+
+#include "img/vector_data.hpp"
+#include "optimizer/optimizer.hpp"
+#include "layout.hpp"
+
+/*
+PreviewGeometry
+VectorData / draw_path を画面座標の折れ線の列にする (ImGui の ImDrawList にそのまま渡せる形)
+GUI なしでも作れるので、lppe_bench で速さを測れる
+
+    画面座標 = (データ座標 - (pan_x, pan_y)) * zoom + (origin_x, origin_y)
+
+表示範囲に入らない線は線ごとの範囲 (VectorData の *_bounds) で捨て、
+縮小表示では画面上で min_step_px より近い点を間引く
+*/
+
+struct PreviewViewport {
+    float origin_x = 0, origin_y = 0; // 表示領域の左上 (画面座標)
+    float width = 0, height = 0;      // 表示領域の大きさ (px)
+    float pan_x = 0, pan_y = 0;       // 表示領域の左上に来るデータ座標
+    float zoom = 1;                   // データ1単位 = zoom px
+
+    bool operator==(const PreviewViewport&) const = default;
+};
+
+struct PreviewStyle {
+    VectorView view = VectorView::Hatch; // Color は塗り (filled_masks) を描かない
+    float min_step_px = 1.0f;  // これより近い点は間引く (0 で間引かない)
+    float marker_min_zoom = 1.0f; // Points の頂点の印はこの倍率以上でだけ作る
+    bool show_travel = true;   // draw_path: ペンを上げて動く線も作る
+
+    bool operator==(const PreviewStyle&) const = default;
+};
+
+// 色は ImU32 (IM_COL32) と同じ並び 0xAABBGGRR
+struct PreviewStroke {
+    uint32_t color = 0;
+    uint32_t first = 0; // PreviewGeometry::points の中の位置
+    uint32_t count = 0;
+    bool closed = false;
+};
+
+struct PreviewMarker {
+    cv::Point2f pos;
+    uint32_t color = 0;
+};
+
+struct PreviewGeometry {
+    std::vector<cv::Point2f> points; // 全部の線の点 (画面座標)。ImVec2 と同じ並び
+    std::vector<PreviewStroke> strokes;
+    std::vector<PreviewMarker> markers;
+    size_t input_points = 0; // 表示範囲に入った線の元の点の数
+    size_t culled_lines = 0; // 表示範囲の外で捨てた線の数
+
+    // 確保したメモリは残す (毎フレーム作り直すため)
+    void clear();
+};
+
+uint32_t previewColor(const cv::Scalar& bgr);
+// data_width x data_height の全体が表示領域の真ん中に収まる表示範囲
+PreviewViewport fitPreviewViewport(float data_width, float data_height, float origin_x, float origin_y, float width, float height);
+
+void buildPreviewGeometry(const VectorData& data, const PreviewViewport& viewport, const PreviewStyle& style, PreviewGeometry& out);
+// base を placements の場所ごとに作る (全部の場所に置いた VectorData は作らない。shared は描かない)
+void buildPreviewGeometry(const InstancedLayout& layout, const PreviewViewport& viewport, const PreviewStyle& style, PreviewGeometry& out);
+// draw_path の各パスの範囲 (VectorData の *_bounds にあたるもの。パスが変わったときに1回だけ作る)
+struct DrawPathBounds {
+    std::map<int, std::vector<VectorBounds>> paths; // paths[color][i] は path.paths[color][i] の範囲
+};
+void computeDrawPathBounds(const draw_path& path, DrawPathBounds& out);
+// bounds は path から computeDrawPathBounds で作ったもの
+void buildPreviewGeometry(const draw_path& path, const DrawPathBounds& bounds, const PreviewViewport& viewport, const PreviewStyle& style, PreviewGeometry& out);
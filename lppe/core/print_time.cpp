@@ -0,0 +1,147 @@
+#include "print_time.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "planner.h"
+
+// app.c の pen_mode_t
+enum PenMode {
+    LEFT_PEN = -1,
+    CENTER_PEN = 0,
+    RIGHT_PEN = 1,
+};
+
+// app.c の select_pen と同じ: 黒と赤だけなら持ち替えずに描き、それ以外は2色ごとに差し替えを待つ
+static PenMode selectPen(const std::vector<std::string>& names, int i, bool& wait_for_operator) {
+    const int n = static_cast<int>(names.size());
+    wait_for_operator = false;
+    if(n == 1 && names[0] == "black") return RIGHT_PEN;
+    if(n == 1 && names[0] == "red") return LEFT_PEN;
+    if(n == 2 && names[i] == "red" && names[1-i] == "black") return LEFT_PEN;
+    if(n == 2 && names[i] == "black" && names[1-i] == "red") return RIGHT_PEN;
+    if(i % 2 == 0){
+        wait_for_operator = true;
+        return LEFT_PEN;
+    }
+    return RIGHT_PEN;
+}
+
+// planner を draw_stream_polyline と同じように timer_once ごとに進めて、動いている周期を数える
+static double planStrokeSeconds(planner_t& planner, const planner_limits_t& limits, const std::vector<point>& pts, float dt) {
+    planner_init(&planner, &limits, pts[0].first, pts[0].second);
+    size_t next = 1;
+    long ticks = 0;
+    float x, y;
+    while(true){
+        while(next < pts.size() && !planner_is_full(&planner)){
+            planner_add_point(&planner, pts[next].first, pts[next].second);
+            ++next;
+        }
+        if(planner_step(&planner, dt, &x, &y) == 0 && next >= pts.size()){
+            break;
+        }
+        ++ticks;
+    }
+    return ticks * dt;
+}
+
+PrintTimeEstimate estimatePrintTime(const draw_path& path, const PrintTimeModel& model) {
+    PrintTimeEstimate estimate;
+    planner_t planner;
+    planner_limits_t limits, travel_limits;
+    planner_default_limits(&limits);
+    planner_travel_limits(&travel_limits);
+    const float dt = model.timer_once_ms * 0.001f;
+
+    // 書き出すのは線のある色だけ (writePathFile と同じ)
+    std::vector<const std::vector<std::vector<point>>*> colors;
+    std::vector<std::string> names;
+    for(const auto& [color_id, paths] : path.paths) {
+        if(paths.empty()) continue;
+        colors.push_back(&paths);
+        auto it = path.color_names.find(color_id);
+        names.push_back(it != path.color_names.end() ? it->second : std::string());
+    }
+
+    // 台の位置 (EV3 の座標、mm)。ペン先はペンの分だけずれる
+    double carriage_x = 0.0, carriage_y = 0.0;
+    auto travelTo = [&](double target_x, double target_y) {
+        const double dx = target_x - carriage_x;
+        const double dy = target_y - carriage_y;
+        const std::vector<point> move = {
+            {static_cast<float>(carriage_x), static_cast<float>(carriage_y)},
+            {static_cast<float>(target_x), static_cast<float>(target_y)},
+        };
+        estimate.travel_s += planStrokeSeconds(planner, travel_limits, move, dt) + model.travel_settle_ms * 0.001;
+        estimate.travel_mm += std::sqrt(dx * dx + dy * dy);
+        carriage_x = target_x;
+        carriage_y = target_y;
+    };
+
+    for(int i = 0; i < static_cast<int>(colors.size()); ++i) {
+        bool wait_for_operator;
+        const PenMode pen = selectPen(names, i, wait_for_operator);
+        if(wait_for_operator){
+            estimate.color_change_s += model.color_change_ms * 0.001;
+            estimate.color_changes++;
+        }
+        const double pen_diff = -static_cast<int>(pen) * model.pen_offset_mm;
+
+        for(const auto& pts : *colors[i]) {
+            if(pts.empty()) continue;
+            // 用紙の座標 → EV3 の座標 (to_plot_x, to_plot_y)
+            std::vector<point> plot;
+            plot.reserve(pts.size());
+            for(const auto& pt : pts) {
+                plot.emplace_back(pt.first - model.paper_width * 0.5f, model.paper_height * 0.5f - pt.second);
+            }
+
+            travelTo(plot[0].first + pen_diff, plot[0].second);
+            estimate.pen_s += (model.pen_down_ms + model.pen_up_ms) * 0.001;
+            estimate.draw_s += planStrokeSeconds(planner, limits, plot, dt) + model.stroke_settle_ms * 0.001;
+            for(size_t k = 1; k < plot.size(); ++k) {
+                estimate.draw_mm += std::hypot(plot[k].first - plot[k-1].first, plot[k].second - plot[k-1].second);
+            }
+            carriage_x = plot.back().first + pen_diff;
+            carriage_y = plot.back().second;
+            estimate.strokes++;
+        }
+    }
+
+    // 最後は中心に戻る (pen_set_mode(CENTER); goto_position(0, 0))
+    if(estimate.strokes > 0){
+        travelTo(0.0, 0.0);
+    }
+    return estimate;
+}
+
+std::string formatDuration(double seconds) {
+    const long total = static_cast<long>(std::round(seconds));
+    char buf[64];
+    if(total >= 3600){
+        std::snprintf(buf, sizeof(buf), "%ldh %02ldm %02lds", total / 3600, (total / 60) % 60, total % 60);
+    }else if(total >= 60){
+        std::snprintf(buf, sizeof(buf), "%ldm %02lds", total / 60, total % 60);
+    }else{
+        std::snprintf(buf, sizeof(buf), "%lds", total);
+    }
+    return buf;
+}
+
+std::string formatPrintTime(const PrintTimeEstimate& estimate) {
+    char buf[128];
+    std::string text = "Estimated Print Time: " + formatDuration(estimate.total_s()) + "\n";
+    std::snprintf(buf, sizeof(buf), "  drawing: %s (%.1f m)\n", formatDuration(estimate.draw_s).c_str(), estimate.draw_mm / 1000.0);
+    text += buf;
+    std::snprintf(buf, sizeof(buf), "  travel: %s (%.1f m)\n", formatDuration(estimate.travel_s).c_str(), estimate.travel_mm / 1000.0);
+    text += buf;
+    std::snprintf(buf, sizeof(buf), "  pen up/down: %s (%d strokes)\n", formatDuration(estimate.pen_s).c_str(), estimate.strokes);
+    text += buf;
+    if(estimate.color_changes > 0){
+        std::snprintf(buf, sizeof(buf), "  color changes: %s (%d, waiting for ENTER)\n", formatDuration(estimate.color_change_s).c_str(), estimate.color_changes);
+        text += buf;
+    }
+    return text;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+
+#include "optimizer/optimizer.hpp"
+
+/*
+Print Time
+EV3 (ev3/printer/app.c) が draw_path を印刷するのにかかる時間を見積もる
+
+- ペンを下ろした線: EV3 と同じ planner.c を timer_once ごとに進めて数え、線の終わりで止まるまでの時間を足す
+- 移動 (goto_position_pen_down): 移動用の上限 (PLANNER_TRAVEL_*) で planner を進めて数え、最後に合わせる時間を足す
+  ペンを持ち替えると台が PEN_BETWEEN_HALF_DEG の2倍動く
+- ペンの上げ下げ (pen_move_to): 1回ごとの時間。下ろすのは移動の最後と重なるので、重ならない分だけ
+- 色の差し替え: ENTER を押すまで待つ (select_pen と同じ条件)
+
+定数は ev3_sim (ev3/sim) で測って合わせた。ファームウェアの動きを変えたら合わせ直す
+draw_s は ev3_sim の pen down (ペン先が紙に着いている時間) に当たる。ペンを下ろしている途中は pen_s と travel_s に入る
+*/
+
+struct PrintTimeModel {
+    float timer_once_ms = 4.0f;        // planner を進める間隔 (app.c の SETPOINT_PERIOD_MS)
+    float stroke_settle_ms = 143.0f;   // 最後の点に着くまで待つ + 止まってから 10x10ms
+    float travel_settle_ms = 46.0f;    // planner が止まってから TRAVEL_FINISH_ERR に合わせる
+    float pen_down_ms = 60.0f;         // ペンを下ろす時間のうち、移動の最後と重ならない分
+    float pen_up_ms = 140.0f;          // pen_move_to(0)
+    float pen_offset_mm = 20.1f;       // PEN_BETWEEN_HALF_DEG / x_mm_to_deg (中心からペンまで)
+    float color_change_ms = 3100.0f;   // 音 (100ms) + ENTER を押すまで
+    float paper_width = 210.0f;        // 用紙の座標 → EV3 の座標 (中心が原点)
+    float paper_height = 297.0f;
+};
+
+struct PrintTimeEstimate {
+    double draw_s = 0.0;   // ペンを下ろして描いている
+    double travel_s = 0.0; // ペンを上げて移動している
+    double pen_s = 0.0;    // ペンの上げ下げ
+    double color_change_s = 0.0; // ENTER 待ち
+    int strokes = 0;
+    int color_changes = 0;
+    double draw_mm = 0.0;
+    double travel_mm = 0.0;
+
+    double total_s() const { return draw_s + travel_s + pen_s + color_change_s; }
+};
+
+PrintTimeEstimate estimatePrintTime(const draw_path& path, const PrintTimeModel& model = PrintTimeModel());
+
+// "1h 23m 45s" のように
+std::string formatDuration(double seconds);
+// 内訳を複数行で (GUI の Analysis と CLI の表示用)
+std::string formatPrintTime(const PrintTimeEstimate& estimate);
@@ -0,0 +1,331 @@
+#include "golden.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include <opencv4/opencv2/imgproc.hpp>
+
+#define GOLDEN_VERSION (1)
+
+GoldenGroups goldenFromVectorData(const VectorData& data) {
+    GoldenGroups groups;
+    groups["polylines"] = data.polylines;
+    groups["contours"] = data.contours;
+    groups["hatch_lines"] = data.hatch_lines;
+    return groups;
+}
+
+GoldenGroups goldenFromDrawPath(const draw_path& path) {
+    GoldenGroups groups;
+    GoldenLines& lines = groups["paths"];
+    for (const auto& [color_id, paths] : path.paths) {
+        auto& dst = lines[color_id];
+        for (const auto& pts : paths) {
+            std::vector<cv::Point2f> line;
+            line.reserve(pts.size());
+            for (const auto& p : pts) {
+                line.emplace_back(p.first, p.second);
+            }
+            dst.push_back(std::move(line));
+        }
+    }
+    return groups;
+}
+
+GoldenGroups goldenFromPolylines(const std::vector<std::vector<cv::Point>>& polylines, const std::string& group) {
+    GoldenGroups groups;
+    auto& dst = groups[group][0];
+    for (const auto& polyline : polylines) {
+        dst.emplace_back(polyline.begin(), polyline.end());
+    }
+    return groups;
+}
+
+bool writeGolden(const std::string& filename, const GoldenGroups& groups) {
+    std::ofstream ofs(filename);
+    if (!ofs) {
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+    ofs << "golden " << GOLDEN_VERSION << "\n";
+    ofs << std::fixed << std::setprecision(4);
+    for (const auto& [name, lines] : groups) {
+        for (const auto& [color_id, polylines] : lines) {
+            ofs << "group " << name << " " << color_id << " " << polylines.size() << "\n";
+            for (const auto& polyline : polylines) {
+                ofs << polyline.size();
+                for (const auto& p : polyline) {
+                    ofs << " " << p.x << " " << p.y;
+                }
+                ofs << "\n";
+            }
+        }
+    }
+    return ofs.good();
+}
+
+bool readGolden(const std::string& filename, GoldenGroups& groups) {
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        return false;
+    }
+    std::string magic;
+    int version = 0;
+    if (!(ifs >> magic >> version) || magic != "golden" || version != GOLDEN_VERSION) {
+        std::cerr << "Invalid golden file: " << filename << std::endl;
+        return false;
+    }
+    groups.clear();
+    std::string tag;
+    while (ifs >> tag) {
+        std::string name;
+        int color_id = 0;
+        size_t count = 0;
+        if (tag != "group" || !(ifs >> name >> color_id >> count)) {
+            std::cerr << "Invalid golden file: " << filename << std::endl;
+            return false;
+        }
+        auto& polylines = groups[name][color_id];
+        for (size_t i = 0; i < count; ++i) {
+            size_t points = 0;
+            if (!(ifs >> points)) {
+                std::cerr << "Invalid golden file: " << filename << std::endl;
+                return false;
+            }
+            std::vector<cv::Point2f> polyline(points);
+            for (auto& p : polyline) {
+                ifs >> p.x >> p.y;
+            }
+            if (!ifs) {
+                std::cerr << "Invalid golden file: " << filename << std::endl;
+                return false;
+            }
+            polylines.push_back(std::move(polyline));
+        }
+    }
+    return true;
+}
+
+static float pointSegmentDistance(const cv::Point2f& p, const cv::Point2f& a, const cv::Point2f& b) {
+    const cv::Point2f ab = b - a;
+    const float len_sq = ab.dot(ab);
+    float t = len_sq > 0 ? (p - a).dot(ab) / len_sq : 0.0f;
+    t = std::clamp(t, 0.0f, 1.0f);
+    const cv::Point2f d = p - (a + ab * t);
+    return std::sqrt(d.dot(d));
+}
+
+// 線分をグリッドに登録して、点から近い線分だけを調べる
+class SegmentIndex {
+    public:
+        SegmentIndex(const std::vector<std::vector<cv::Point2f>>& polylines, float radius)
+            : cell((std::max)(radius * 2.0f, 4.0f)) {
+            for (const auto& polyline : polylines) {
+                if (polyline.size() == 1) {
+                    add(polyline[0], polyline[0], radius);
+                }
+                for (size_t i = 1; i < polyline.size(); ++i) {
+                    add(polyline[i - 1], polyline[i], radius);
+                }
+            }
+        }
+
+        // radius 以内に線分が無ければ負の値
+        float nearest(const cv::Point2f& p, float radius) const {
+            auto it = cells.find(key(cellOf(p.x), cellOf(p.y)));
+            if (it == cells.end()) return -1.0f;
+            float best = -1.0f;
+            for (int s : it->second) {
+                const float d = pointSegmentDistance(p, segments[s].first, segments[s].second);
+                if (d <= radius && (best < 0 || d < best)) best = d;
+            }
+            return best;
+        }
+
+    private:
+        int cellOf(float v) const { return static_cast<int>(std::floor(v / cell)); }
+        static int64_t key(int cx, int cy) { return (static_cast<int64_t>(cx) << 32) ^ static_cast<uint32_t>(cy); }
+
+        // 線分を radius だけ太らせた範囲に重なるセルに登録する
+        // (長い斜めの線の外接矩形全体には登録せず、線に沿って cell/2 ごとに近くのセルだけ)
+        void add(const cv::Point2f& a, const cv::Point2f& b, float radius) {
+            const int index = static_cast<int>(segments.size());
+            segments.emplace_back(a, b);
+            const float step = cell * 0.5f;
+            const float reach = radius + step * 0.5f;
+            const int n = (std::max)(1, static_cast<int>(std::ceil(cv::norm(b - a) / step)));
+            for (int k = 0; k <= n; ++k) {
+                const cv::Point2f q = a + (b - a) * (static_cast<float>(k) / n);
+                for (int cy = cellOf(q.y - reach); cy <= cellOf(q.y + reach); ++cy) {
+                    for (int cx = cellOf(q.x - reach); cx <= cellOf(q.x + reach); ++cx) {
+                        auto& list = cells[key(cx, cy)];
+                        if (list.empty() || list.back() != index) list.push_back(index);
+                    }
+                }
+            }
+        }
+
+        float cell;
+        std::vector<std::pair<cv::Point2f, cv::Point2f>> segments;
+        std::unordered_map<int64_t, std::vector<int>> cells;
+};
+
+static double totalLength(const std::vector<std::vector<cv::Point2f>>& polylines) {
+    double length = 0;
+    for (const auto& polyline : polylines) {
+        for (size_t i = 1; i < polyline.size(); ++i) {
+            length += cv::norm(polyline[i] - polyline[i - 1]);
+        }
+    }
+    return length;
+}
+
+// from の線の上の点 (頂点と、その間を step ごと) が to の線から radius 以内にあるか
+// 外れた点の数を返し、example に外れた点のうち最初のものを入れる
+static size_t countOutliers(const std::vector<std::vector<cv::Point2f>>& from, const SegmentIndex& to, float radius, cv::Point2f& example) {
+    const float step = (std::max)(radius, 0.5f);
+    size_t outliers = 0;
+    auto check = [&](const cv::Point2f& p) {
+        if (to.nearest(p, radius) < 0) {
+            if (outliers == 0) example = p;
+            ++outliers;
+        }
+    };
+    for (const auto& polyline : from) {
+        if (polyline.empty()) continue;
+        check(polyline[0]);
+        for (size_t i = 1; i < polyline.size(); ++i) {
+            const cv::Point2f a = polyline[i - 1], b = polyline[i];
+            const int n = static_cast<int>(std::ceil(cv::norm(b - a) / step));
+            for (int k = 1; k <= n; ++k) {
+                check(a + (b - a) * (static_cast<float>(k) / n));
+            }
+        }
+    }
+    return outliers;
+}
+
+static std::string describe(const std::string& group, int color_id) {
+    return group + " (color " + std::to_string(color_id) + ")";
+}
+
+GoldenReport compareGolden(const GoldenGroups& actual, const GoldenGroups& expected, const GoldenTolerance& tol) {
+    GoldenReport report;
+    auto fail = [&](const std::string& message) {
+        report.ok = false;
+        report.messages.push_back(message);
+    };
+    static const GoldenLines empty_lines;
+    static const std::vector<std::vector<cv::Point2f>> empty_polylines;
+
+    std::vector<std::string> names;
+    for (const auto& [name, lines] : expected) names.push_back(name);
+    for (const auto& [name, lines] : actual) {
+        if (!expected.contains(name)) names.push_back(name);
+    }
+    for (const auto& name : names) {
+        const GoldenLines& a_lines = actual.contains(name) ? actual.at(name) : empty_lines;
+        const GoldenLines& e_lines = expected.contains(name) ? expected.at(name) : empty_lines;
+        std::vector<int> ids;
+        for (const auto& [id, polylines] : e_lines) ids.push_back(id);
+        for (const auto& [id, polylines] : a_lines) {
+            if (!e_lines.contains(id)) ids.push_back(id);
+        }
+        for (int id : ids) {
+            const auto& a = a_lines.contains(id) ? a_lines.at(id) : empty_polylines;
+            const auto& e = e_lines.contains(id) ? e_lines.at(id) : empty_polylines;
+
+            const double a_len = totalLength(a), e_len = totalLength(e);
+            const double len_diff = std::abs(a_len - e_len) / (std::max)(e_len, 1.0);
+            if (len_diff > tol.length_ratio) {
+                std::ostringstream ss;
+                ss << describe(name, id) << ": total length " << a_len << " px, expected " << e_len
+                    << " px (" << std::setprecision(3) << len_diff * 100 << "% off)";
+                fail(ss.str());
+            }
+
+            cv::Point2f example;
+            const size_t extra = countOutliers(a, SegmentIndex(e, tol.distance_px), tol.distance_px, example);
+            if (extra > 0) {
+                std::ostringstream ss;
+                ss << describe(name, id) << ": " << extra << " sampled points are farther than " << tol.distance_px
+                    << " px from the expected lines (e.g. " << example.x << ", " << example.y << ")";
+                fail(ss.str());
+            }
+            const size_t missing = countOutliers(e, SegmentIndex(a, tol.distance_px), tol.distance_px, example);
+            if (missing > 0) {
+                std::ostringstream ss;
+                ss << describe(name, id) << ": " << missing << " expected points are not covered within " << tol.distance_px
+                    << " px (e.g. " << example.x << ", " << example.y << ")";
+                fail(ss.str());
+            }
+        }
+    }
+    return report;
+}
+
+// ペンを上げて動く距離 (同じ色の中で、前のパスの終点 → 次のパスの始点)
+static double travelLength(const GoldenLines& lines) {
+    double travel = 0;
+    for (const auto& [color_id, paths] : lines) {
+        for (size_t i = 1; i < paths.size(); ++i) {
+            if (paths[i - 1].empty() || paths[i].empty()) continue;
+            travel += cv::norm(paths[i].front() - paths[i - 1].back());
+        }
+    }
+    return travel;
+}
+
+GoldenReport compareGoldenPath(const GoldenGroups& actual, const GoldenGroups& expected, const GoldenTolerance& tol) {
+    GoldenReport report = compareGolden(actual, expected, tol);
+    static const GoldenLines empty_lines;
+    const double a_travel = travelLength(actual.contains("paths") ? actual.at("paths") : empty_lines);
+    const double e_travel = travelLength(expected.contains("paths") ? expected.at("paths") : empty_lines);
+    // 短くなるのは改善なので、長くなったときだけ失敗にする
+    if (a_travel > e_travel * (1.0 + tol.travel_ratio) + 1e-6) {
+        std::ostringstream ss;
+        ss << "pen-up travel " << a_travel << ", expected at most " << e_travel * (1.0 + tol.travel_ratio);
+        report.ok = false;
+        report.messages.push_back(ss.str());
+    }
+    return report;
+}
+
+// expected の画素から最も遠い actual の画素の距離
+static double maxDistanceToMask(const cv::Mat& from, const cv::Mat& to) {
+    if (cv::countNonZero(from) == 0) return 0;
+    if (cv::countNonZero(to) == 0) return std::numeric_limits<double>::infinity();
+    cv::Mat inverted, dist;
+    cv::compare(to, 0, inverted, cv::CMP_EQ); // to の画素が 0 になる
+    cv::distanceTransform(inverted, dist, cv::DIST_L2, cv::DIST_MASK_PRECISE);
+    double max_dist = 0;
+    cv::minMaxLoc(dist, nullptr, &max_dist, nullptr, nullptr, from != 0);
+    return max_dist;
+}
+
+GoldenReport compareGoldenMask(const cv::Mat& actual, const cv::Mat& expected, const GoldenTolerance& tol) {
+    GoldenReport report;
+    if (actual.size() != expected.size()) {
+        report.ok = false;
+        report.messages.push_back("size " + std::to_string(actual.cols) + "x" + std::to_string(actual.rows)
+            + ", expected " + std::to_string(expected.cols) + "x" + std::to_string(expected.rows));
+        return report;
+    }
+    const double extra = maxDistanceToMask(actual, expected);
+    const double missing = maxDistanceToMask(expected, actual);
+    if (extra > tol.distance_px || missing > tol.distance_px) {
+        std::ostringstream ss;
+        ss << "pixels off by up to " << (std::max)(extra, missing) << " px (tolerance " << tol.distance_px
+            << "), " << cv::countNonZero(actual) << " pixels set, expected " << cv::countNonZero(expected);
+        report.ok = false;
+        report.messages.push_back(ss.str());
+    }
+    return report;
+}
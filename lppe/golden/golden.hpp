@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <opencv4/opencv2/core.hpp>
+
+#include "img/vector_data.hpp"
+#include "optimizer/optimizer.hpp"
+
+/*
+Golden
+各段の出力を基準ファイル (golden) と比べる
+高速化で点の順番や線の分け方が変わっても、形が許容誤差の中なら同じとみなす
+
+基準ファイルはテキスト (差分が読めるように):
+    golden 1
+    group <名前> <色番号> <線の数>
+    <点の数> x y x y ...
+    ...
+*/
+
+// 色番号 → 線の列。VectorData の polylines / contours / hatch_lines や draw_path をこれに直して比べる
+using GoldenLines = std::map<int, std::vector<std::vector<cv::Point2f>>>;
+using GoldenGroups = std::map<std::string, GoldenLines>;
+
+GoldenGroups goldenFromVectorData(const VectorData& data);
+GoldenGroups goldenFromDrawPath(const draw_path& path);
+GoldenGroups goldenFromPolylines(const std::vector<std::vector<cv::Point>>& polylines, const std::string& group);
+
+bool writeGolden(const std::string& filename, const GoldenGroups& groups);
+bool readGolden(const std::string& filename, GoldenGroups& groups);
+
+struct GoldenTolerance {
+    float distance_px = 1.5f;  // 点から相手の線までの距離の上限
+    float length_ratio = 0.02f; // 線の長さの合計の相対誤差の上限
+    float travel_ratio = 0.05f; // draw_path のペンを上げて動く距離の相対誤差の上限
+};
+
+struct GoldenReport {
+    bool ok = true;
+    std::vector<std::string> messages; // 失敗の理由
+};
+
+// 形の比較 (線の順番・向き・分け方は問わない)
+GoldenReport compareGolden(const GoldenGroups& actual, const GoldenGroups& expected, const GoldenTolerance& tol);
+// draw_path の比較 (形に加えて、ペンを上げて動く距離)
+GoldenReport compareGoldenPath(const GoldenGroups& actual, const GoldenGroups& expected, const GoldenTolerance& tol);
+// 二値画像の比較 (両方向に、一方の画素から他方の一番近い画素までの距離)
+GoldenReport compareGoldenMask(const cv::Mat& actual, const cv::Mat& expected, const GoldenTolerance& tol);
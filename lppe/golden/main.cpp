@@ -0,0 +1,342 @@
+// lppe_golden: 各段の出力を基準ファイルと比べる (高速化した処理が同じ結果を出すかの確認)
+// usage: lppe_golden [--update] [--images dir] [--golden dir] [--max-side px] [--tolerance px]
+//                    [--length-tolerance ratio] [--travel-tolerance ratio]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <cctype>
+#include <cstdlib>
+
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+#include "golden.hpp"
+#include "reference.hpp"
+#include "img/vector_data.hpp"
+#include "img/filter_funcs.hpp"
+#include "optimizer/optimizer.hpp"
+#include "core/path_writer.hpp"
+#include "cross/cross.hpp"
+
+namespace fs = std::filesystem;
+
+// 比べる段の設定 (基準ファイルを作り直さない限り変えないこと)
+#define GOLDEN_HATCH_SPACING (6)
+#define GOLDEN_HATCH_ANGLE (45)
+#define GOLDEN_MIN_SIZE (20)
+#define GOLDEN_JITTER_EPSILON (1.0f)
+#define GOLDEN_CLASSIFY_RADIUS (7)
+#define GOLDEN_TILE_BUDGET_MB (1) // --max-side 512 でも複数のタイルに分かれる大きさ
+
+// 基準ファイルを使わず、reference.cpp や Exact と比べる段
+#define GOLDEN_COLORMAP_MISMATCH (0.001) // 色の境目で float の丸めの差で変わってよい画素の割合
+#define GOLDEN_BILATERAL_DIAMETER (9)
+#define GOLDEN_BILATERAL_SIGMA (40.0)
+#define GOLDEN_BILATERAL_ERROR (2.0) // Fast と Exact の画像全体の平均絶対誤差の上限 (bilateral の max_error と同じ)
+
+struct GoldenOptions {
+    bool update = false;
+    std::string images_dir;
+    std::string golden_dir;
+    int max_side = 512;
+    GoldenTolerance tolerance;
+};
+
+struct GoldenInput {
+    std::string name;
+    cv::Mat mask;  // 0/255
+    cv::Mat color; // BGR (mask と同じ大きさ)
+};
+
+// 色の量子化を比べるパレット
+static const Colors GOLDEN_PALETTE = {
+    {"black", "000000"}, {"white", "FFFFFF"}, {"red", "E03030"}, {"green", "30A040"},
+    {"blue", "3050D0"}, {"yellow", "F0D020"}, {"brown", "805020"},
+};
+
+static void printUsage() {
+    std::cerr << "usage: lppe_golden [--update] [--images dir] [--golden dir] [--max-side px] [--tolerance px]" << std::endl;
+    std::cerr << "                   [--length-tolerance ratio] [--travel-tolerance ratio]" << std::endl;
+    std::cerr << "  --update   (re)write the golden files from the current build instead of comparing" << std::endl;
+    std::cerr << "             (golden/record_golden.sh runs this on the baseline commit)" << std::endl;
+    std::cerr << "  --images   reference images (default: <exe dir>/saves/images)" << std::endl;
+    std::cerr << "  --golden   golden files (default: <exe dir>/saves/golden)" << std::endl;
+}
+
+static bool isImageFile(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tif" || ext == ".tiff" || ext == ".webp";
+}
+
+// 参照画像を max_side に縮めて二値化する
+static std::vector<GoldenInput> loadInputs(const GoldenOptions& options) {
+    std::vector<GoldenInput> inputs;
+    std::error_code ec;
+    if (!fs::is_directory(options.images_dir, ec)) {
+        std::cerr << "Image directory not found: " << options.images_dir << std::endl;
+        return inputs;
+    }
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(options.images_dir, ec)) {
+        if (entry.is_regular_file() && isImageFile(entry.path())) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files) {
+        cv::Mat img = cv::imread(file.string(), cv::IMREAD_GRAYSCALE);
+        cv::Mat color = cv::imread(file.string(), cv::IMREAD_COLOR);
+        if (img.empty() || color.empty()) {
+            std::cerr << "Failed to load image: " << file << std::endl;
+            continue;
+        }
+        const int side = (std::max)(img.cols, img.rows);
+        if (side > options.max_side) {
+            const double scale = static_cast<double>(options.max_side) / side;
+            cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_AREA);
+            cv::resize(color, color, cv::Size(), scale, scale, cv::INTER_AREA);
+        }
+        GoldenInput input;
+        input.name = file.stem().string();
+        input.color = color;
+        cv::threshold(img, input.mask, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+// 1枚分の各段の出力
+struct StageOutputs {
+    cv::Mat thinned;
+    cv::Mat thinned_in_place; // NWGThinningInPlace の結果 (thinned と同じになるはず)
+    GoldenGroups polylines;
+    GoldenGroups contours;
+    GoldenGroups hatch;
+    GoldenGroups vector_data;
+    GoldenGroups path;
+    GoldenGroups tiled_vector_data; // タイルに分けたときの vector_data (vector_data と同じになるはず)
+    cv::Mat colormap, colormap_lut, colormap_reference; // generateMultiColorMap (LUT無し・有り) と reference の index map
+    double bilateral_error = 0.0; // Fast と Exact の平均絶対誤差
+};
+
+static StageOutputs runStages(const GoldenInput& input) {
+    StageOutputs out;
+
+    NWGThinningLUTParallel(input.mask, out.thinned);
+    out.polylines = goldenFromPolylines(extractPolylines(out.thinned.clone()), "polylines");
+    out.thinned_in_place = input.mask.clone();
+    NWGThinningInPlace(out.thinned_in_place);
+
+    std::vector<std::vector<cv::Point>> polylines, contours;
+    extractContoursFromFilled(input.mask, polylines, contours);
+    out.contours = goldenFromPolylines(polylines, "polylines");
+    out.contours["contours"] = goldenFromPolylines(contours, "contours")["contours"];
+
+    out.hatch["hatch_lines"][0] = generateHatchLines(input.mask, GOLDEN_HATCH_SPACING, GOLDEN_HATCH_ANGLE);
+
+    // GUI の Line and Fill と同じ分け方で、ベクタ化から最適化まで
+    cv::Mat lines, thinned_lines, filled, vis;
+    classifyPixels(input.mask, lines, thinned_lines, filled, vis, GOLDEN_CLASSIFY_RADIUS);
+    VectorData data;
+    data.width = input.mask.cols;
+    data.height = input.mask.rows;
+    data.color_names[0] = "black";
+    data.color_values[0] = cv::Scalar(0, 0, 0);
+    data.edge_masks[0] = lines;
+    data.filled_masks[0] = filled;
+    data.outline_masks[0] = filled.clone();
+
+    // lastConvertToVectorData はマスクを書き換えるので、タイル分割の方には別のコピーを渡す
+    VectorData tiled = data;
+    tiled.edge_masks[0] = lines.clone();
+    tiled.filled_masks[0] = filled.clone();
+    tiled.outline_masks[0] = filled.clone();
+    TileSettings tiling;
+    tiling.enabled = true;
+    tiling.memory_budget_mb = GOLDEN_TILE_BUDGET_MB;
+    lastConvertToVectorData(tiled, GOLDEN_HATCH_SPACING, GOLDEN_HATCH_ANGLE, GOLDEN_MIN_SIZE, GOLDEN_JITTER_EPSILON, 0.0f, {}, tiling);
+    out.tiled_vector_data = goldenFromVectorData(tiled);
+
+    lastConvertToVectorData(data, GOLDEN_HATCH_SPACING, GOLDEN_HATCH_ANGLE, GOLDEN_MIN_SIZE, GOLDEN_JITTER_EPSILON, 0.0f, {});
+    out.vector_data = goldenFromVectorData(data);
+
+    draw_path path;
+    Optimizer optimizer;
+    optimizer.optimize_greedy(convertToUnoptimizedPath(data), path);
+    out.path = goldenFromDrawPath(path);
+
+    // 色の量子化: 行ごとにまとめた処理と LUT を、高速化する前の処理と比べる
+    Colors palette = GOLDEN_PALETTE;
+    ColorMap color_map;
+    cv::Mat view;
+    generateMultiColorMap(input.color, palette, color_map, view);
+    out.colormap = color_map.colorMap;
+    const auto lut = buildPaletteLUT(palette);
+    generateMultiColorMap(input.color, palette, color_map, view, lut.get());
+    out.colormap_lut = color_map.colorMap;
+    out.colormap_reference = referenceMultiColorIndex(input.color, palette);
+
+    // バイラテラル: Fast (一部だけ Exact と比べて、外れたら Exact にする) を画像全体で Exact と比べる
+    cv::Mat fast, exact, diff;
+    bilateral(input.color, fast, GOLDEN_BILATERAL_DIAMETER, GOLDEN_BILATERAL_SIGMA, GOLDEN_BILATERAL_SIGMA, 1, BilateralMode::Fast);
+    bilateral(input.color, exact, GOLDEN_BILATERAL_DIAMETER, GOLDEN_BILATERAL_SIGMA, GOLDEN_BILATERAL_SIGMA, 1, BilateralMode::Exact);
+    cv::absdiff(fast, exact, diff);
+    const cv::Scalar mean = cv::mean(diff);
+    out.bilateral_error = (mean[0] + mean[1] + mean[2]) / 3.0;
+    return out;
+}
+
+int main(int argc, char** argv) {
+    GoldenOptions options;
+    options.images_dir = getExecutableDir() + "/saves/images";
+    options.golden_dir = getExecutableDir() + "/saves/golden";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--update") {
+            options.update = true;
+        } else if (arg == "--images" && has_value) {
+            options.images_dir = argv[++i];
+        } else if (arg == "--golden" && has_value) {
+            options.golden_dir = argv[++i];
+        } else if (arg == "--max-side" && has_value) {
+            options.max_side = (std::max)(16, std::atoi(argv[++i]));
+        } else if (arg == "--tolerance" && has_value) {
+            options.tolerance.distance_px = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--length-tolerance" && has_value) {
+            options.tolerance.length_ratio = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--travel-tolerance" && has_value) {
+            options.tolerance.travel_ratio = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    const auto inputs = loadInputs(options);
+    if (inputs.empty()) {
+        std::cerr << "No reference images." << std::endl;
+        return 1;
+    }
+    if (options.update) {
+        std::error_code ec;
+        fs::create_directories(options.golden_dir, ec);
+        if (ec) {
+            std::cerr << "Failed to create directory: " << options.golden_dir << " (" << ec.message() << ")" << std::endl;
+            return 1;
+        }
+    }
+
+    int passed = 0, failed = 0, missing = 0;
+    for (const auto& input : inputs) {
+        const StageOutputs out = runStages(input);
+        const fs::path base = fs::path(options.golden_dir) / input.name;
+
+        // 段ごと: 書き出し / 読み込みと比較
+        auto check = [&](const std::string& stage, const std::function<bool(const std::string&)>& write,
+            const std::function<bool(const std::string&, GoldenReport&)>& compare, const std::string& ext) {
+            const std::string filename = base.string() + "." + stage + ext;
+            if (options.update) {
+                if (write(filename)) {
+                    std::cout << "[written] " << input.name << " " << stage << std::endl;
+                } else {
+                    ++failed;
+                }
+                return;
+            }
+            GoldenReport report;
+            if (!compare(filename, report)) {
+                std::cout << "[missing] " << input.name << " " << stage << " (" << filename << ")" << std::endl;
+                ++missing;
+                return;
+            }
+            std::cout << (report.ok ? "[pass] " : "[FAIL] ") << input.name << " " << stage << std::endl;
+            for (const auto& message : report.messages) {
+                std::cout << "    " << message << std::endl;
+            }
+            report.ok ? ++passed : ++failed;
+        };
+        auto check_lines = [&](const std::string& stage, const GoldenGroups& actual, bool is_path) {
+            check(stage, [&](const std::string& filename) { return writeGolden(filename, actual); },
+                [&](const std::string& filename, GoldenReport& report) {
+                    GoldenGroups expected;
+                    if (!readGolden(filename, expected)) return false;
+                    report = is_path ? compareGoldenPath(actual, expected, options.tolerance)
+                                     : compareGolden(actual, expected, options.tolerance);
+                    return true;
+                }, ".txt");
+        };
+
+        check("thinning", [&](const std::string& filename) { return cv::imwrite(filename, out.thinned); },
+            [&](const std::string& filename, GoldenReport& report) {
+                cv::Mat expected = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+                if (expected.empty()) return false;
+                report = compareGoldenMask(out.thinned, expected, options.tolerance);
+                return true;
+            }, ".png");
+        check_lines("polylines", out.polylines, false);
+        check_lines("contours", out.contours, false);
+        check_lines("hatch", out.hatch, false);
+        check_lines("vector_data", out.vector_data, false);
+        check_lines("path", out.path, true);
+
+        // タイル分割: 基準ファイルではなく、同じビルドのタイルに分けない結果と比べる
+        if (!options.update) {
+            GoldenReport report = compareGolden(out.tiled_vector_data, out.vector_data, options.tolerance);
+            const int diff = cv::countNonZero(out.thinned_in_place != out.thinned);
+            if (diff > 0) {
+                report.ok = false;
+                report.messages.push_back("in-place thinning differs from NWGThinningLUTParallel at " + std::to_string(diff) + " pixels");
+            }
+            std::cout << (report.ok ? "[pass] " : "[FAIL] ") << input.name << " tiled" << std::endl;
+            for (const auto& message : report.messages) {
+                std::cout << "    " << message << std::endl;
+            }
+            report.ok ? ++passed : ++failed;
+        }
+
+        // 色の量子化とバイラテラル: 基準ファイルではなく、reference.cpp と Exact と比べる
+        if (!options.update) {
+            GoldenReport report;
+            const double pixels = static_cast<double>(out.colormap_reference.total());
+            auto check_colormap = [&](const std::string& label, const cv::Mat& actual) {
+                const int diff = cv::countNonZero(actual != out.colormap_reference);
+                if (diff > pixels * GOLDEN_COLORMAP_MISMATCH) {
+                    report.ok = false;
+                    report.messages.push_back(label + ": " + std::to_string(diff) + " pixels differ from the reference palette mapping");
+                }
+            };
+            check_colormap("colormap", out.colormap);
+            check_colormap("colormap with LUT", out.colormap_lut);
+            if (out.bilateral_error > GOLDEN_BILATERAL_ERROR) {
+                report.ok = false;
+                report.messages.push_back("bilateral: fast mode differs from exact by " + std::to_string(out.bilateral_error) + " on average");
+            }
+            std::cout << (report.ok ? "[pass] " : "[FAIL] ") << input.name << " kernels" << std::endl;
+            for (const auto& message : report.messages) {
+                std::cout << "    " << message << std::endl;
+            }
+            report.ok ? ++passed : ++failed;
+        }
+    }
+
+    if (options.update) {
+        std::cout << "golden files written to " << options.golden_dir << std::endl;
+        return failed == 0 ? 0 : 1;
+    }
+    std::cout << passed << " passed, " << failed << " failed, " << missing << " missing" << std::endl;
+    if (missing > 0) {
+        std::cout << "run golden/record_golden.sh to record the missing golden files from the baseline kernels" << std::endl;
+    }
+    return (failed == 0 && missing == 0) ? 0 : 1;
+}
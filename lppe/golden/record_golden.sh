@@ -0,0 +1,24 @@
+#!/bin/sh
+# saves/golden を基準のコミットの lppe_golden で作り直す (今のビルドで --update すると、速くした処理の結果が基準になってしまう)
+# usage: golden/record_golden.sh <commit>
+#
+# 基準には lppe_golden を足したコミットを渡す (git log --diff-filter=A --format=%H -- lppe/golden/main.cpp)
+# ベースラインからそこまでの変更は、golden で見る段 (細線化・抽出・ハッチ・ベクタ化・最適化) には
+# trace と中断の呼び出しと結果を決まった順にする修正を足しただけ
+# 色の量子化とバイラテラルフィルタの高速化は golden の段を通らず、タイル分割は有効にしたときだけ通る
+set -e
+if [ $# -ne 1 ]; then
+    echo "usage: $0 <commit>" >&2
+    exit 1
+fi
+cd "$(dirname "$0")/.."
+base=$(git rev-parse --verify "$1^{commit}")
+
+work=$(mktemp -d)
+git worktree add --detach "$work" "$base"
+trap 'git worktree remove --force "$work"' EXIT
+
+# GUI は glad を手で置いたマシンでしかビルドできないので外す
+cmake -S "$work/lppe" -B "$work/lppe/build" -DCMAKE_BUILD_TYPE=Release -DLPPE_BUILD_GUI=OFF
+cmake --build "$work/lppe/build" --target lppe_golden -j
+"$work/lppe/build/lppe_golden" --update --images saves/images --golden saves/golden
@@ -0,0 +1,43 @@
+#include "reference.hpp"
+
+#include <cfloat>
+
+#include <opencv4/opencv2/imgproc.hpp>
+
+static cv::Vec3f referenceBGR2Lab(int b, int g, int r) {
+    cv::Mat bgrMat(1, 1, CV_32FC3);
+    bgrMat.at<cv::Vec3f>(0, 0) = cv::Vec3f(b / 255.0f, g / 255.0f, r / 255.0f);
+    cv::Mat labMat;
+    cv::cvtColor(bgrMat, labMat, cv::COLOR_BGR2Lab);
+    return labMat.at<cv::Vec3f>(0, 0);
+}
+
+cv::Mat referenceMultiColorIndex(const cv::Mat& src, const Colors& colors) {
+    CV_Assert(src.type() == CV_8UC3);
+
+    cv::Mat floatMat;
+    src.convertTo(floatMat, CV_32FC3, 1.0 / 255.0);
+    cv::Mat labMat;
+    cv::cvtColor(floatMat, labMat, cv::COLOR_BGR2Lab);
+
+    cv::Mat indexMap(src.size(), CV_8UC1, cv::Scalar(255));
+    cv::Mat minDist(src.size(), CV_32F, cv::Scalar(FLT_MAX));
+    cv::Mat dist(src.size(), CV_32F);
+    for (size_t i = 0; i < colors.size(); ++i) {
+        int b, g, r;
+        convertHexToBGR(colors[i].second, b, g, r);
+        const cv::Vec3f c = referenceBGR2Lab(b, g, r);
+        for (int y = 0; y < labMat.rows; ++y) {
+            const cv::Vec3f* lab = labMat.ptr<cv::Vec3f>(y);
+            float* d = dist.ptr<float>(y);
+            for (int x = 0; x < labMat.cols; ++x) {
+                const cv::Vec3f v = lab[x] - c;
+                d[x] = v.dot(v);
+            }
+        }
+        const cv::Mat mask = dist < minDist;
+        dist.copyTo(minDist, mask);
+        indexMap.setTo(static_cast<uchar>(i), mask);
+    }
+    return indexMap;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <opencv4/opencv2/core.hpp>
+
+#include "img/colormap_generator.hpp"
+
+/*
+Reference
+高速化する前の処理を、そのままの形でここに残す
+基準ファイル (saves/golden) が無くても、速くした処理をこれと同じビルドの中で比べられる
+*/
+
+// 高速化する前の generateMultiColorMap の index map
+// 画素ごとに Lab の距離が一番近いパレットの番号 (同じ距離なら先の色)
+cv::Mat referenceMultiColorIndex(const cv::Mat& src, const Colors& colors);
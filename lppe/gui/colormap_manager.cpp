@@ -14,8 +14,11 @@
 
 #include "gui_helpers.hpp"
 #include "img/colormap_generator.hpp"
+#include "img/content_hash.hpp"
+#include "cache/disk_cache.hpp"
 
 #define MAX_COLORS (64)
+#define MAX_CACHED_PALETTE_LUTS (4) // 1つ16MB
 
 static int current_predefined_colormap_index = 0;
 static const std::vector<std::pair<std::string, Colors>> predefined_colormaps = {
@@ -78,6 +81,13 @@ void ColorMapManager::drawGui(GLuint *button_textures) {
         if(ImGui::Checkbox("Detect Achro", &detect_achro)) {
             newest_colormap_available = false;
         }
+        ImGui::SameLine();
+        if(ImGui::Checkbox("Use LUT", &use_palette_lut)) {
+            newest_colormap_available = false;
+        }
+        if(ImGui::IsItemHovered()){
+            ImGui::SetTooltip("Precompute a BGR -> color table per palette.\nFirst run is slower, later runs with the same palette are instant.");
+        }
     }
 
     std::set<std::string> color_set;
@@ -373,6 +383,15 @@ void ColorMapManager::drawGui(GLuint *button_textures) {
     if(!generatable){
         ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Color map cannot be generated due to errors above.");
     }
+
+    // 設定が変わったら、古い設定での計算は待たずに捨てる
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(calculating && !newest_colormap_available){
+            jobs.cancel();
+            calculating = false;
+        }
+    }
 }
 
 void ColorMapManager::startGenerateColorMap(const cv::Mat& src) {
@@ -380,10 +399,6 @@ void ColorMapManager::startGenerateColorMap(const cv::Mat& src) {
         std::cerr << "Color map cannot be generated due to errors." << std::endl;
         return;
     }
-    if(isCalculating()){
-        std::cerr << "Color map generation is already in progress." << std::endl;
-        return;
-    }
     if(newest_colormap_available){
         std::cerr << "A newer color map is already available." << std::endl;
         return;
@@ -394,66 +409,143 @@ void ColorMapManager::startGenerateColorMap(const cv::Mat& src) {
     }
 
     std::lock_guard<std::mutex> lock(mtx);
-    // スレッドを作成して計算を開始
-    generating_src = src.clone();
+    // 設定はジョブごとにコピーしておく (計算中にGUIで変更されてもよいように)
+    cv::Mat generating_src = src.clone();
+    ColorMapMode mode = current_colormap_mode;
+    int binary_threshold = threshold;
+    bool achro = detect_achro;
+    float sensitivity = achro_sensitivity;
+    bool use_lut = use_palette_lut;
+    Colors colors = colormap_colors;
+
+    std::vector<float> achro_thresholds_vec;
+    Colors achro_colors_vec;
+    for(size_t i=0; i<4; ++i){
+        switch(achros){
+            case 2:
+                if(i == 1 || i == 2) continue;
+                break;
+            case 3:
+                if(i == 2) continue;
+                break;
+            case 4:
+                break;
+            default:
+                std::cerr << "Invalid achros value: " << achros << std::endl;
+                break;
+        }
+        achro_colors_vec.push_back(achro_colors[i]);
+    }
+    for(size_t i=0; i<achros-1; ++i){
+        achro_thresholds_vec.push_back(achro_thresholds[i] / 255.0f * 100.0f);
+    }
+
+    // ディスクキャッシュのキー (入力画像と、結果に効く設定すべて)
+    CacheKey key("colormap", CACHE_STAGE_COLORMAP_VERSION);
+    key.addMat(generating_src);
+    key.add(mode);
+    if(mode == ColorMapMode::COLOR_MAP_MODE_BINARY){
+        key.add(binary_threshold);
+    }else{
+        key.add(achro);
+        key.add(use_lut);
+        key.add(static_cast<uint32_t>(colors.size()));
+        for(const auto& [name, hex] : colors){
+            key.add(name).add(hex);
+        }
+        if(achro){
+            key.add(sensitivity);
+            key.add(static_cast<uint32_t>(achro_thresholds_vec.size()));
+            for(float t : achro_thresholds_vec){
+                key.add(t);
+            }
+            key.add(static_cast<uint32_t>(achro_colors_vec.size()));
+            for(const auto& [name, hex] : achro_colors_vec){
+                key.add(name).add(hex);
+            }
+        }
+    }
+
     generating_colormap = ColorMap();
     calculating = true;
     newest_colormap_available = true;
-    
-    std::thread([this]() {
+
+    jobs.start([=, this](const CancelToken& token) mutable {
         ColorMap new_colormap;
         cv::Mat new_viewmap;
 
-        switch(current_colormap_mode){
+        if(DiskCache::instance().loadColorMap(key, new_colormap, new_viewmap)){
+            std::lock_guard<std::mutex> lock(mtx);
+            if(token.isCancelled()) return;
+            generating_colormap = new_colormap;
+            view_map = new_viewmap;
+            calculating = false;
+            return;
+        }
+
+        switch(mode){
             case ColorMapMode::COLOR_MAP_MODE_BINARY:
-                generateBinaryColorMap(generating_src, threshold, new_colormap, new_viewmap);
+                generateBinaryColorMap(generating_src, binary_threshold, new_colormap, new_viewmap);
                 break;
-            case ColorMapMode::COLOR_MAP_MODE_MULTI:
-                if(detect_achro){
-                    std::vector<float> achro_thresholds_vec;
-                    Colors achro_colors_vec;
-                    for(size_t i=0; i<4; ++i){
-                        switch(achros){
-                            case 2:
-                                if(i == 1 || i == 2) continue;
-                                break;
-                            case 3:
-                                if(i == 2) continue;
-                                break;
-                            case 4:
-                                break;
-                            default:
-                                std::cerr << "Invalid achros value: " << achros << std::endl;
-                                break;
-                        }
-                        achro_colors_vec.push_back(achro_colors[i]);
-                    }
-                    for(size_t i=0; i<achros-1; ++i){
-                        achro_thresholds_vec.push_back(achro_thresholds[i] / 255.0f * 100.0f);
-                    }
-                    generateAchroColorMap(generating_src, achro_sensitivity, achro_thresholds_vec, achro_colors_vec, colormap_colors, new_colormap, new_viewmap);
+            case ColorMapMode::COLOR_MAP_MODE_MULTI: {
+                std::shared_ptr<const PaletteLUT> lut = use_lut ? getPaletteLUT(colors) : nullptr;
+                checkCancelled();
+                if(achro){
+                    generateAchroColorMap(generating_src, sensitivity, achro_thresholds_vec, achro_colors_vec, colors, new_colormap, new_viewmap, lut.get());
                 }else{
-                    generateMultiColorMap(generating_src, colormap_colors, new_colormap, new_viewmap);
+                    generateMultiColorMap(generating_src, colors, new_colormap, new_viewmap, lut.get());
                 }
                 break;
+            }
             default:
-                std::cerr << "Invalid ColorMapMode: " << static_cast<int>(current_colormap_mode) << std::endl;
+                std::cerr << "Invalid ColorMapMode: " << static_cast<int>(mode) << std::endl;
                 break;
         }
+        DiskCache::instance().storeColorMap(key, new_colormap, new_viewmap);
 
         {
             std::lock_guard<std::mutex> lock(mtx);
+            if(token.isCancelled()) return;
             generating_colormap = new_colormap;
             view_map = new_viewmap;
             calculating = false;
         }
-    }).detach();
+    });
+}
+
+std::shared_ptr<const PaletteLUT> ColorMapManager::getPaletteLUT(const Colors& colors) {
+    std::lock_guard<std::mutex> lock(lut_mtx);
+    for(auto it = palette_lut_cache.begin(); it != palette_lut_cache.end(); ++it){
+        if((*it)->matches(colors)){
+            // 最近使ったものを後ろへ
+            std::shared_ptr<const PaletteLUT> lut = *it;
+            palette_lut_cache.erase(it);
+            palette_lut_cache.push_back(lut);
+            return lut;
+        }
+    }
+
+    std::shared_ptr<const PaletteLUT> lut = buildPaletteLUT(colors);
+    palette_lut_cache.push_back(lut);
+    if(palette_lut_cache.size() > MAX_CACHED_PALETTE_LUTS){
+        palette_lut_cache.erase(palette_lut_cache.begin());
+    }
+    return lut;
 }
 
 bool ColorMapManager::isCalculating() const {
     return calculating;
 }
 
+void ColorMapManager::changedInput() {
+    std::lock_guard<std::mutex> lock(mtx);
+    newest_colormap_available = false;
+    if(calculating){
+        jobs.cancel();
+        calculating = false;
+    }
+}
+
 bool ColorMapManager::isNewestColorMapAvailable() const {
     std::lock_guard<std::mutex> lock(mtx);
     return newest_colormap_available;
@@ -4,6 +4,7 @@
 #include <string>
 #include <mutex>
 #include <thread>
+#include <memory>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,6 +12,8 @@
 #include <opencv4/opencv2/core/mat.hpp>
 
 #include "shell_manager.hpp"
+#include "img/colormap_generator.hpp"
+#include "job/job.hpp"
 
 enum class ColorMapMode {
     COLOR_MAP_MODE_BINARY,
@@ -24,9 +27,12 @@ public:
     void startGenerateColorMap(const cv::Mat& src);
     bool isCalculating() const;
     bool isNewestColorMapAvailable() const;
+    void changedInput();
     ColorMap getColorMap() const;
     cv::Mat getViewMap() const;
 private:
+    std::shared_ptr<const PaletteLUT> getPaletteLUT(const Colors& colors);
+
     Colors colormap_colors = {
         {"Red", "FF0000"},
         {"Green", "00FF00"},
@@ -47,10 +53,15 @@ private:
     int achros = 3; // 2(black/white),3(black/gray/white),4(black/gray/light gray/white)
     std::array<int, 4> achro_thresholds = {85, 170, 255, 255};
     float achro_sensitivity = 0.15f; // 0.0 ~ 1.0
+    bool use_palette_lut = true; // パレットごとのLUTで量子化する
+
+    // パレットのLUT (新しいものが後ろ)
+    std::vector<std::shared_ptr<const PaletteLUT>> palette_lut_cache;
+    std::mutex lut_mtx;
 
     bool generatable = true;
 
-    cv::Mat generating_src;
+    LatestJobRunner jobs;
     ColorMap generating_colormap;
     cv::Mat view_map;
     bool calculating = false;
@@ -3,9 +3,13 @@
 #include <iostream>
 #include <thread>
 #include <atomic>
+#include <cmath>
+#include <algorithm>
 
 #include "gui.hpp"
 #include "gui_helpers.hpp"
+#include "img/content_hash.hpp"
+#include "cache/disk_cache.hpp"
 
 ConverterManager::ConverterManager() {
     // Register built-in converters
@@ -47,6 +51,24 @@ void ConverterManager::drawGui(int& selected_index, GLuint *button_textures) {
     }
     ImGui::PopItemWidth();
 
+    // 大きな画像ではフィルタと細線化の後の処理をタイルに分けて、一時メモリを抑える
+    if(ImGui::Checkbox("Tiled Processing", &tile_settings.enabled)){
+        newest_data_available = false;
+    }
+    if(tile_settings.enabled){
+        ImGui::SameLine();
+        ImGui::Text("Memory Budget (MB)");
+        ImGui::SameLine();
+        ImGui::PushItemWidth(150);
+        int budget_mb = static_cast<int>(tile_settings.memory_budget_mb);
+        if(ImGui::InputInt("##Memory Budget", &budget_mb, 16, 128)){
+            budget_mb = std::clamp(budget_mb, 16, 8192);
+            tile_settings.memory_budget_mb = static_cast<size_t>(budget_mb);
+            newest_data_available = false;
+        }
+        ImGui::PopItemWidth();
+    }
+
     ImGui::Text("Add Vector Converter");
     ImGui::SameLine();
     ImGui::Dummy(ImVec2(2, 0));
@@ -115,25 +137,98 @@ void ConverterManager::drawGui(int& selected_index, GLuint *button_textures) {
             gui_selected_index = -1;
         }
     }
+
+    // Parameters changed while calculating: drop the stale job
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(calculating && !newest_data_available) {
+            jobs.cancel();
+            calculating = false;
+        }
+    }
 }
 
-void ConverterManager::startCalculation(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& mode_map, const ShellManager& shell_manager) {
+void ConverterManager::startCalculation(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& mode_map, const ShellManager& shell_manager, float px_scale) {
     std::lock_guard<std::mutex> lock(mtx);
 
-    if(calculating) {
-        std::cerr << "ConverterManager::startCalculation: Already calculating." << std::endl;
-        return; // Already calculating
-    }
     calculating = true;
     newest_data_available = true;
 
-    // Copy inputs
-    original_copy = original.clone();
-    colorMap_copy = colorMap.clone();
-    mode_map_copy = mode_map.clone();
-    shell_manager_copy = shell_manager; // Assuming ShellManager is copyable
+    // Copy inputs (each job owns its own copy, so a newer job never touches them)
+    cv::Mat original_copy = original.clone();
+    ColorMap colorMap_copy = colorMap.clone();
+    cv::Mat mode_map_copy = mode_map.clone();
+    ShellManager shell_manager_copy = shell_manager; // Assuming ShellManager is copyable
+    auto converters_copy = std::make_shared<std::vector<std::unique_ptr<VectorConverter>>>();
+    for(const auto& converter : converters) {
+        converters_copy->push_back(converter->clone());
+        converters_copy->back()->px_scale = px_scale;
+        converters_copy->back()->tiling = tile_settings;
+    }
+    std::vector<int> converter_ids_copy = converter_ids;
+    TileSettings tile_settings_copy = tile_settings;
+    // Parameters in px follow the input scale
+    int hatch_line_spacing_copy = (std::max)(1, static_cast<int>(std::lround(hatch_line_spacing * px_scale)));
+    float no_jitter_epsilon_copy = no_jitter_epsilon * px_scale;
+    float min_polyline_length_copy = min_polyline_length * px_scale;
+    int min_size_copy = (std::max)(1, static_cast<int>(std::lround(20 * px_scale * px_scale)));
+    for(auto& [name, setting] : shell_manager_copy.hatchLineSettings) {
+        if(setting.spacing > 0) {
+            setting.spacing = (std::max)(1, static_cast<int>(std::lround(setting.spacing * px_scale)));
+        }
+    }
+
+    jobs.start([=, this](const CancelToken& token) {
+        // ディスクキャッシュのキー (入力・色分け・各コンバータ・仕上げの設定)
+        CacheKey key("vectorize", CACHE_STAGE_VECTORIZE_VERSION);
+        key.addMat(original_copy);
+        key.addMat(colorMap_copy.colorMap);
+        key.add(static_cast<uint32_t>(colorMap_copy.MapOfColor.size()));
+        for(const auto& [id, mask] : colorMap_copy.MapOfColor) {
+            key.add(id).addMat(mask);
+        }
+        key.add(static_cast<uint32_t>(colorMap_copy.MapOfColorName.size()));
+        for(const auto& [id, name] : colorMap_copy.MapOfColorName) {
+            key.add(id).add(name);
+        }
+        key.add(static_cast<uint32_t>(colorMap_copy.MapOfColorValueBGR.size()));
+        for(const auto& [id, value] : colorMap_copy.MapOfColorValueBGR) {
+            key.add(id);
+            for(int c = 0; c < 4; ++c) {
+                key.add(value[c]);
+            }
+        }
+        key.addMat(mode_map_copy);
+        key.add(static_cast<uint32_t>(converters_copy->size()));
+        for(const auto& converter : *converters_copy) {
+            converter->addFingerprint(key);
+        }
+        key.add(static_cast<uint32_t>(shell_manager_copy.hatchLineSettings.size()));
+        for(const auto& [name, setting] : shell_manager_copy.hatchLineSettings) {
+            key.add(name);
+            key.add(setting.spacing);
+            key.add(setting.mode);
+            key.add(setting.substitute_color);
+        }
+        key.add(hatch_line_spacing_copy);
+        key.add(no_jitter_epsilon_copy);
+        key.add(min_polyline_length_copy);
+        key.add(min_size_copy);
+        key.add(px_scale);
+        key.add(tile_settings_copy.enabled);
+        key.add(tile_settings_copy.memory_budget_mb);
+
+        VectorData cached_data;
+        if(DiskCache::instance().loadVectorData(key, cached_data)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(token.isCancelled()) return;
+            vector_data = std::move(cached_data);
+            vector_data_version++;
+            view_img = cv::Mat(); // プレビューは表示するときに描く
+            calculating = false;
+            return;
+        }
 
-    std::thread([this]() {
         VectorData new_vector_data;
         new_vector_data.width = original_copy.cols;
         new_vector_data.height = original_copy.rows;
@@ -150,24 +245,25 @@ void ConverterManager::startCalculation(const cv::Mat& original, const ColorMap&
                 new_vector_data.color_values[color_id] = colorMap_copy.MapOfColorValueBGR.at(color_id);
             }
         }
-        for(size_t i = 1; i < converters.size(); ++i) { // skip "Empty" converter at index 0
+        for(size_t i = 1; i < converters_copy->size(); ++i) { // skip "Empty" converter at index 0
+            checkCancelled();
+            const auto& converter = (*converters_copy)[i];
             int mode = i; // mode corresponds to converter index
-            std::cout << "Applying converter: " << converters[i]->getConverterName() << " (ID: " << converter_ids[i] << ")" << std::endl;
-            converters[i]->apply(original_copy, colorMap_copy, mode_map_copy, mode, new_vector_data);
-            std::cout << "Finished converter: " << converters[i]->getConverterName() << std::endl;
+            std::cout << "Applying converter: " << converter->getConverterName() << " (ID: " << converter_ids_copy[i] << ")" << std::endl;
+            converter->apply(original_copy, colorMap_copy, mode_map_copy, mode, new_vector_data);
+            std::cout << "Finished converter: " << converter->getConverterName() << std::endl;
         }
-        cv::Mat view_map_temp, view_map_with_points_temp, view_map_with_hatch_temp, view_random_colored_temp;
-        lastConvertToVectorData(new_vector_data, view_map_temp, view_map_with_points_temp, view_map_with_hatch_temp, view_random_colored_temp, hatch_line_spacing, 45, 20, no_jitter_epsilon, min_polyline_length, shell_manager_copy.hatchLineSettings);
+        lastConvertToVectorData(new_vector_data, hatch_line_spacing_copy, 45, min_size_copy, no_jitter_epsilon_copy, min_polyline_length_copy, shell_manager_copy.hatchLineSettings, tile_settings_copy);
+        DiskCache::instance().storeVectorData(key, new_vector_data);
         {
             std::lock_guard<std::mutex> lock(mtx);
+            if(token.isCancelled()) return;
             vector_data = std::move(new_vector_data);
-            view_map = std::move(view_map_temp);
-            view_map_with_points = std::move(view_map_with_points_temp);
-            view_map_with_hatch = std::move(view_map_with_hatch_temp);
-            view_random_colored = std::move(view_random_colored_temp);
+            vector_data_version++;
+            view_img = cv::Mat(); // プレビューは表示するときに描く
             calculating = false;
         }
-    }).detach();
+    });
 }
 
 bool ConverterManager::isCalculating() const {
@@ -183,6 +279,10 @@ bool ConverterManager::isNewestDataAvailable() const {
 void ConverterManager::changedInput() {
     std::lock_guard<std::mutex> lock(mtx);
     newest_data_available = false; // Mark data as outdated if input image changed
+    if(calculating) {
+        jobs.cancel(); // Drop the stale job instead of waiting for it
+        calculating = false;
+    }
 }
 
 void ConverterManager::getVectorData(VectorData& outData) const {
@@ -190,14 +290,24 @@ void ConverterManager::getVectorData(VectorData& outData) const {
     outData = vector_data;
 }
 
-bool ConverterManager::getViewMaps(cv::Mat& viewMap, cv::Mat& viewMapWithPoints, cv::Mat& viewMapWithHatch, cv::Mat& viewRandomColored) const {
+ImVec2 ConverterManager::drawPreview(VectorPreview& preview, VectorView view, int max_width, int max_height) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(vector_data.width <= 0 || vector_data.height <= 0) {
+        return ImVec2(0, 0);
+    }
+    return preview.draw(vector_data, vector_data_version, view, max_width, max_height);
+}
+
+cv::Mat ConverterManager::getViewImage(VectorView view, int max_width, int max_height) {
     std::lock_guard<std::mutex> lock(mtx);
-    if(view_map.empty() || view_map_with_points.empty() || view_map_with_hatch.empty() || view_random_colored.empty()) {
-        return false;
-    }
-    viewMap = view_map;
-    viewMapWithPoints = view_map_with_points;
-    viewMapWithHatch = view_map_with_hatch;
-    viewRandomColored = view_random_colored;
-    return true;
+    if(vector_data.width <= 0 || vector_data.height <= 0) {
+        return cv::Mat();
+    }
+    const double scale = fitVectorViewScale(vector_data, max_width, max_height, CONVERTER_VIEW_MAX_SCALE);
+    if(view_img.empty() || view != view_img_kind || scale != view_img_scale) {
+        view_img = renderVectorView(vector_data, view, scale);
+        view_img_kind = view;
+        view_img_scale = scale;
+    }
+    return view_img;
 }
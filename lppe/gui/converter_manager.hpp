@@ -7,7 +7,11 @@
 #include <opencv4/opencv2/core/mat.hpp>
 
 #include "vector_converters.hpp"
+#include "vector_preview.hpp"
 #include "shell_manager.hpp"
+#include "job/job.hpp"
+
+#define CONVERTER_VIEW_MAX_SCALE (2.0) // プレビューの最大倍率 (画像1px = 2px)
 
 class ConverterManager {
 public:
@@ -17,25 +21,30 @@ public:
     bool isCalculating() const;
     bool isNewestDataAvailable() const;
     void changedInput();
-    void startCalculation(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& mode_map, const ShellManager& shell_manager);
+    // px_scale: scale of a downscaled (proxy) input; px parameters are multiplied by it
+    void startCalculation(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& mode_map, const ShellManager& shell_manager, float px_scale = 1.0f);
     void getVectorData(VectorData& outData) const;
-    bool getViewMaps(cv::Mat& viewMap, cv::Mat& viewMapWithPoints, cv::Mat& viewMapWithHatch, cv::Mat& viewRandomColored) const;
+    // 選んでいる1枚だけを max_width x max_height に収まる大きさで描く (前と同じ条件なら描き直さない)
+    cv::Mat getViewImage(VectorView view, int max_width, int max_height);
+    // 画像にせずに ImDrawList へ直接描く。データがなければ何もせず (0, 0) を返す
+    ImVec2 drawPreview(VectorPreview& preview, VectorView view, int max_width, int max_height) const;
 
 private:
     std::vector<std::unique_ptr<VectorConverter>> converters;
     std::vector<int> converter_ids;
-    cv::Mat original_copy;
-    ColorMap colorMap_copy;
-    cv::Mat mode_map_copy;
-    ShellManager shell_manager_copy;
+    LatestJobRunner jobs;
     int selected_converter_id = -1;
     int gui_selected_index = 0;
     int hatch_line_spacing = 10;
     float no_jitter_epsilon = 4.0; // px
     float min_polyline_length = 0.0; // px
+    TileSettings tile_settings;
     bool calculating = false;
     bool newest_data_available = false;
     VectorData vector_data;
-    cv::Mat view_map, view_map_with_points, view_map_with_hatch, view_random_colored;
+    uint64_t vector_data_version = 0; // vector_data を置き換えるたびに増やす (プレビューの作り直しの判定)
+    cv::Mat view_img; // getViewImage で最後に描いたもの (データが変わったら空にする)
+    VectorView view_img_kind = VectorView::Color;
+    double view_img_scale = 0;
     mutable std::mutex mtx;
 };
@@ -4,33 +4,46 @@
 #include <thread>
 #include <mutex>
 
+#include "img/content_hash.hpp"
+#include "cache/disk_cache.hpp"
+
 // 与えられたfilterと画像のコピーを取り、スレッドを作って計算を開始する
-void FilterCalcManager::startCalculation(std::vector<std::unique_ptr<Filter>>& filters, const cv::Mat& inputImage) {
+// 計算中なら古い計算は取り消す
+void FilterCalcManager::startCalculation(std::vector<std::unique_ptr<Filter>>& filters, const cv::Mat& inputImage, float px_scale) {
     std::lock_guard<std::mutex> lock(mtx);
-    if (calculating) {
-        std::cerr << "Calculation is already in progress." << std::endl;
-        return; // すでに計算中なら何もしない
-    }
-    // フィルターと画像のコピーを作成
-    filters_copy.clear();
-    filters_copy.reserve(filters.size());
+    // フィルターと画像のコピーを作成 (ジョブごとに持つ)
+    auto filters_copy = std::make_shared<std::vector<std::unique_ptr<Filter>>>();
+    filters_copy->reserve(filters.size());
     for (const auto& filter : filters) {
-        filters_copy.push_back(filter->clone());
+        filters_copy->push_back(filter->clone());
+        filters_copy->back()->px_scale = px_scale;
     }
-    inputImage_copy = inputImage.clone();
+    cv::Mat inputImage_copy = inputImage.clone();
     processedImages.clear();
     lastCompletedFilterIndex = -1;
     calculating = true;
     newestImageAvailable = true;
 
-    // スレッドを作成して計算を開始
-    std::thread([this]() {
-        cv::Mat currentImage = inputImage_copy.clone();
-        for (size_t i = 0; i < filters_copy.size(); ++i) {
+    jobs.start([this, filters_copy, inputImage_copy](const CancelToken& token) {
+        cv::Mat currentImage = inputImage_copy;
+        CacheKey key("filter", CACHE_STAGE_FILTER_VERSION);
+        key.addMat(currentImage);
+        for (size_t i = 0; i < filters_copy->size(); ++i) {
+            checkCancelled();
+            // 入力とそこまでのパラメータが同じなら前回の結果を使う
+            (*filters_copy)[i]->addFingerprint(key);
             cv::Mat dst;
-            filters_copy[i]->apply(currentImage, dst);
+            if (!findCachedStage(key, dst)) {
+                // メモリに無ければディスクを見る
+                if (!DiskCache::instance().loadMat(key, dst)) {
+                    (*filters_copy)[i]->apply(currentImage, dst);
+                    DiskCache::instance().storeMat(key, dst);
+                }
+                storeCachedStage(key, dst);
+            }
             {
                 std::lock_guard<std::mutex> lock(mtx);
+                if (token.isCancelled()) return;
                 processedImages.push_back(dst);
                 lastCompletedFilterIndex = i; // 最後に完了したフィルターのインデックスを更新
             }
@@ -38,9 +51,10 @@ void FilterCalcManager::startCalculation(std::vector<std::unique_ptr<Filter>>& f
         }
         {
             std::lock_guard<std::mutex> lock(mtx);
+            if (token.isCancelled()) return;
             calculating = false;
         }
-    }).detach();
+    });
 }
 
 bool FilterCalcManager::isCalculating() const {
@@ -56,6 +70,11 @@ bool FilterCalcManager::isNewestImageAvailable() const {
 void FilterCalcManager::changedInput() {
     std::lock_guard<std::mutex> lock(mtx);
     newestImageAvailable = false;
+    if (calculating) {
+        // 古い入力での計算は待たずに捨てる
+        jobs.cancel();
+        calculating = false;
+    }
 }
 
 int FilterCalcManager::getLastCompletedFilterIndex() const {
@@ -67,3 +86,51 @@ std::vector<cv::Mat> FilterCalcManager::getProcessedImages() const {
     std::lock_guard<std::mutex> lock(mtx);
     return processedImages;
 }
+
+void FilterCalcManager::setCacheBudgetMB(size_t mb) {
+    std::lock_guard<std::mutex> lock(mtx);
+    cache_budget_bytes = mb << 20;
+    evictCachedStages();
+}
+
+size_t FilterCalcManager::getCacheBudgetMB() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return cache_budget_bytes >> 20;
+}
+
+size_t FilterCalcManager::getCacheUsageMB() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return cache_bytes >> 20;
+}
+
+bool FilterCalcManager::findCachedStage(const CacheKey& key, cv::Mat& dst) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = stage_cache.begin(); it != stage_cache.end(); ++it) {
+        if (it->key == key) {
+            stage_cache.splice(stage_cache.begin(), stage_cache, it);
+            dst = it->image;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FilterCalcManager::storeCachedStage(const CacheKey& key, const cv::Mat& image) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const size_t bytes = image.total() * image.elemSize();
+    if (bytes > cache_budget_bytes) {
+        return; // 1枚で予算を超えるものは保持しない
+    }
+    stage_cache.push_front({key, image});
+    cache_bytes += bytes;
+    evictCachedStages();
+}
+
+// mtx をロックした状態で呼ぶこと
+void FilterCalcManager::evictCachedStages() {
+    while (cache_bytes > cache_budget_bytes && !stage_cache.empty()) {
+        const cv::Mat& image = stage_cache.back().image;
+        cache_bytes -= image.total() * image.elemSize();
+        stage_cache.pop_back();
+    }
+}
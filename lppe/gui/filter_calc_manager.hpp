@@ -1,13 +1,16 @@
 #pragma once
 
 #include <vector>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <cstdint>
 
 #include <opencv4/opencv2/core/mat.hpp>
 
 #include "gui.hpp"
+#include "job/job.hpp"
 
 class FilterCalcManager {
 public:
@@ -15,15 +18,31 @@ public:
     FilterCalcManager(const FilterCalcManager&) = delete;
     FilterCalcManager& operator=(const FilterCalcManager&) = delete;
 
-    void startCalculation(std::vector<std::unique_ptr<Filter>>& filters, const cv::Mat& inputImage);
+    // px_scale: 縮小画像で実行するときの倍率 (各フィルタのpx単位のパラメータに掛ける)
+    void startCalculation(std::vector<std::unique_ptr<Filter>>& filters, const cv::Mat& inputImage, float px_scale = 1.0f);
     bool isCalculating() const;
     int getLastCompletedFilterIndex() const;
     std::vector<cv::Mat> getProcessedImages() const;
     bool isNewestImageAvailable() const;
     void changedInput();
+    void setCacheBudgetMB(size_t mb);
+    size_t getCacheBudgetMB() const;
+    size_t getCacheUsageMB() const;
 private:
-    std::vector<std::unique_ptr<Filter>> filters_copy;
-    cv::Mat inputImage_copy;
+    // 各段の出力のキャッシュ
+    // キーは 入力画像のダイジェスト に 先頭からその段までのフィルタのパラメータを順に足したもの
+    struct StageCacheEntry {
+        CacheKey key;
+        cv::Mat image;
+    };
+    bool findCachedStage(const CacheKey& key, cv::Mat& dst);
+    void storeCachedStage(const CacheKey& key, const cv::Mat& image);
+    void evictCachedStages();
+    std::list<StageCacheEntry> stage_cache; // 先頭が最近使ったもの
+    size_t cache_bytes = 0;
+    size_t cache_budget_bytes = size_t(512) << 20;
+
+    LatestJobRunner jobs;
     std::vector<cv::Mat> processedImages;
     bool calculating = false;
     bool newestImageAvailable = false;
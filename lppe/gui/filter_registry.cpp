@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <atomic>
+#include <cmath>
+#include <algorithm>
 
 static std::atomic<int> unique_id_counter{0};
 
@@ -9,6 +11,15 @@ Filter::Filter() {
     unique_id = ++unique_id_counter;
 }
 
+int Filter::scalePxLength(int px) const {
+    if (px <= 0) return px;
+    return (std::max)(1, static_cast<int>(std::lround(px * px_scale)));
+}
+
+double Filter::scalePxLength(double px) const {
+    return px * px_scale;
+}
+
 void FilterRegistry::registerFilter(const std::string& name, Creator creator) {
     filter_names.push_back(name);
     creators.push_back(std::move(creator));
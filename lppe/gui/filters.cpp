@@ -16,12 +16,14 @@
 #include <opencv4/opencv2/imgcodecs.hpp>
 
 #include "img/filter_funcs.hpp"
+#include "img/content_hash.hpp"
 #include "cross/cross.hpp"
 
 #define MAX_DIAMETER (9)
 #define MAX_SIGMA_COLOR (50.0f)
 #define MAX_SIGMA_SPACE (50.0f)
 #define MAX_LOOPS (20)
+#define MAX_BILATERAL_ERROR (10.0f)
 
 static int next_id = 0;
 
@@ -32,6 +34,10 @@ GrayscaleFilter::GrayscaleFilter() : mode(GrayscaleMode::Lab) {}
 void GrayscaleFilter::apply(const cv::Mat& src, cv::Mat& dst) {
     convertToGrayScale(src, dst, mode);
 }
+void GrayscaleFilter::addFingerprint(CacheKey& key) const {
+    key.add(getFilterName());
+    key.add(mode);
+}
 bool GrayscaleFilter::drawGui() {
     bool changed = false;
     const int index = (mode == GrayscaleMode::Lab) ? 0 : 1;
@@ -54,9 +60,28 @@ bool GrayscaleFilter::drawGui() {
     return changed;
 }
 
+static const char* bilateral_modes[] = {
+    "Exact", "Fast"
+};
 BilateralFilter::BilateralFilter() {}
 void BilateralFilter::apply(const cv::Mat& src, cv::Mat& dst) {
-    bilateral(src, dst, diameter, static_cast<double>(sigmaColor), static_cast<double>(sigmaSpace), loops);
+    // 縮小画像では近傍の大きさも縮める (直径は奇数)
+    int scaled_diameter = scalePxLength(diameter);
+    if (scaled_diameter % 2 == 0) scaled_diameter += 1;
+    bilateral(src, dst, scaled_diameter, static_cast<double>(sigmaColor), scalePxLength(static_cast<double>(sigmaSpace)), loops,
+        mode, static_cast<double>(max_error));
+}
+void BilateralFilter::addFingerprint(CacheKey& key) const {
+    key.add(getFilterName());
+    key.add(diameter);
+    key.add(sigmaColor);
+    key.add(sigmaSpace);
+    key.add(loops);
+    key.add(mode);
+    key.add(px_scale);
+    if(mode == BilateralMode::Fast){
+        key.add(max_error);
+    }
 }
 bool BilateralFilter::drawGui() {
     bool changed = false;
@@ -69,6 +94,47 @@ bool BilateralFilter::drawGui() {
         auto old_sigmaColor = sigmaColor;
         auto old_sigmaSpace = sigmaSpace;
         auto old_loops = loops;
+        auto old_mode = mode;
+        auto old_max_error = max_error;
+
+        // mode
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::Text("mode");
+        ImGui::TableSetColumnIndex(1);
+        const int index = (mode == BilateralMode::Exact) ? 0 : 1;
+        ImGui::SetNextItemWidth(150);
+        if(ImGui::BeginCombo("##bilateral mode combo box", bilateral_modes[index])){
+            for(int i = 0; i < IM_ARRAYSIZE(bilateral_modes); ++i){
+                bool is_selected = (i == index);
+                if (ImGui::Selectable(bilateral_modes[i], is_selected)) {
+                    mode = (i == 0) ? BilateralMode::Exact : BilateralMode::Fast;
+                }
+                if (is_selected) {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+
+        if(mode == BilateralMode::Fast){
+            // max error
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("max error");
+            ImGui::TableSetColumnIndex(1);
+            ImGui::PushItemWidth(150);
+            ImGui::SliderFloat("##slider_max_error", &max_error, 0.0f, MAX_BILATERAL_ERROR, "%.2f");
+            ImGui::PopItemWidth();
+            if(ImGui::IsItemHovered()){
+                ImGui::SetTooltip("Falls back to exact when the mean error against exact exceeds this.");
+            }
+            if(max_error < 0.0f){
+                max_error = 0.0f;
+            }else if(max_error > MAX_BILATERAL_ERROR){
+                max_error = MAX_BILATERAL_ERROR;
+            }
+        }
 
         // diameter
         ImGui::TableNextRow();
@@ -141,7 +207,8 @@ bool BilateralFilter::drawGui() {
         }
 
         if(diameter != old_diameter || sigmaColor != old_sigmaColor
-            || sigmaSpace != old_sigmaSpace || loops != old_loops){
+            || sigmaSpace != old_sigmaSpace || loops != old_loops
+            || mode != old_mode || max_error != old_max_error){
             changed = true;
         }
         ImGui::EndTable();
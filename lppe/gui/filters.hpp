@@ -15,6 +15,7 @@ class GrayscaleFilter : public Filter {
         void apply(const cv::Mat& src, cv::Mat& dst) override;
         bool drawGui() override;
         std::string getFilterName() const override { return "Grayscale"; }
+        void addFingerprint(CacheKey& key) const override;
     private:
         GrayscaleMode mode = GrayscaleMode::Lab;
 };
@@ -28,9 +29,12 @@ class BilateralFilter : public Filter {
         void apply(const cv::Mat& src, cv::Mat& dst) override;
         bool drawGui() override;
         std::string getFilterName() const override { return "Bilateral"; }
+        void addFingerprint(CacheKey& key) const override;
     private:
         int diameter = 3;
         float sigmaColor = 15.0f;
         float sigmaSpace = 10.0f;
         int loops = 10;
+        BilateralMode mode = BilateralMode::Exact;
+        float max_error = 2.0f; // Fast のときの許容誤差 (平均絶対誤差, 0~255)
 };
@@ -4,6 +4,7 @@
 #include <thread>
 #include <mutex>
 #include <string>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -26,7 +27,9 @@
 #include "output_manager.hpp"
 #include "shell_manager.hpp"
 #include "optimizer.hpp"
+#include "profile_panel.hpp"
 #include "cross/cross.hpp"
+#include "cache/disk_cache.hpp"
 
 #define MAX_FILTERS (100)
 
@@ -44,12 +47,54 @@ static int current_image_index = 0;
 
 static cv::Scalar hovered_color(-1, -1, -1);
 
+// プロキシ (縮小画像) でのプレビュー
+// フィルタ → カラーマップ → ベクタ変換 を縮小画像で実行し、px単位のパラメータも同じ倍率で縮める
+// フル解像度での実行は Output タブから明示的に行う
+static bool proxy_enabled = false;
+static int proxy_max_side = 1024; // px
+static cv::Mat proxy_img;
+static float proxy_scale = 1.0f;
+static bool full_resolution_run = false; // フル解像度で実行中、または実行した結果を表示中
+
+static void updateProxyImage() {
+    proxy_img.release();
+    proxy_scale = 1.0f;
+    if(editing_img.empty()){
+        return;
+    }
+    const int long_side = (std::max)(editing_img.cols, editing_img.rows);
+    if(long_side <= proxy_max_side){
+        return; // 縮小する必要がない
+    }
+    proxy_scale = static_cast<float>(proxy_max_side) / long_side;
+    cv::resize(editing_img, proxy_img, cv::Size(), proxy_scale, proxy_scale, cv::INTER_AREA);
+}
+static bool useProxy() {
+    return proxy_enabled && !full_resolution_run && !proxy_img.empty();
+}
+static const cv::Mat& pipelineImage() {
+    return useProxy() ? proxy_img : editing_img;
+}
+static float pipelineScale() {
+    return useProxy() ? proxy_scale : 1.0f;
+}
+static cv::Mat pipelineModeMap() {
+    if(!useProxy()){
+        return mode_map;
+    }
+    cv::Mat scaled;
+    cv::resize(mode_map, scaled, proxy_img.size(), 0, 0, cv::INTER_NEAREST);
+    return scaled;
+}
+
 void setup() {
+    DiskCache::instance().open(getExecutableDir() + "/cache");
     editing_img = imread_color(getExecutableDir() + "/assets/images/default.jpeg");
     mode_map = cv::Mat::zeros(editing_img.size(), CV_8UC1);
     if (editing_img.empty()) {
         std::cerr << "Failed to load image." << std::endl;
     }
+    updateProxyImage();
     for(int i = 0; i < BUTTON_TEXTURES; ++i){
         button_textures[i] = 0;
     }
@@ -197,10 +242,46 @@ void drawFilterTabGui() {
     ImGui::SameLine();
     ImGui::BeginDisabled(filter_calc_manager.isCalculating() || filter_calc_manager.isNewestImageAvailable());
     if(ImGui::Button("Apply Filters")){
-        filter_calc_manager.startCalculation(filters, editing_img);
+        filter_calc_manager.startCalculation(filters, pipelineImage(), pipelineScale());
         current_image_index = -1;
     }
     ImGui::EndDisabled();
+    ImGui::SameLine();
+    {
+        int cache_budget_mb = static_cast<int>(filter_calc_manager.getCacheBudgetMB());
+        ImGui::PushItemWidth(100);
+        if(ImGui::InputInt("Cache (MB)", &cache_budget_mb, 64, 256)){
+            if(cache_budget_mb < 0) cache_budget_mb = 0;
+            filter_calc_manager.setCacheBudgetMB(static_cast<size_t>(cache_budget_mb));
+        }
+        ImGui::PopItemWidth();
+        if(ImGui::IsItemHovered()){
+            ImGui::SetTooltip("Filter outputs kept for reuse: %zu MB in use", filter_calc_manager.getCacheUsageMB());
+        }
+    }
+    // ディスクキャッシュ (再起動後も各段の結果を使い回す)
+    {
+        DiskCache& disk_cache = DiskCache::instance();
+        bool disk_enabled = disk_cache.isEnabled();
+        if(ImGui::Checkbox("Disk Cache", &disk_enabled)){
+            disk_cache.setEnabled(disk_enabled);
+        }
+        ImGui::SameLine();
+        int disk_budget_mb = static_cast<int>(disk_cache.getBudgetMB());
+        ImGui::PushItemWidth(100);
+        if(ImGui::InputInt("Disk (MB)", &disk_budget_mb, 256, 1024)){
+            if(disk_budget_mb < 0) disk_budget_mb = 0;
+            disk_cache.setBudgetMB(static_cast<size_t>(disk_budget_mb));
+        }
+        ImGui::PopItemWidth();
+        if(ImGui::IsItemHovered()){
+            ImGui::SetTooltip("Stage results stored under cache/: %zu MB in use", disk_cache.getUsageMB());
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Clear Disk Cache")){
+            disk_cache.clear();
+        }
+    }
     drawFiltersGui();
 }
 
@@ -223,10 +304,16 @@ void drawColorMapTabGui() {
     if(generate && color_map_manager.isGeneratable() && !color_map_manager.isCalculating() && filter_calc_manager.isNewestImageAvailable()){
         cv::Mat src;
         if(filter_calc_manager.getProcessedImages().empty()){
-            src = editing_img;
+            src = pipelineImage();
         } else {
             src = filter_calc_manager.getProcessedImages().back();
         }
+        if(src.size() != pipelineImage().size()){
+            // プロキシの切り替え前のフィルタ結果
+            std::cerr << "Filter output size does not match. Apply filters again." << std::endl;
+            filter_calc_manager.changedInput();
+            return;
+        }
         color_map_manager.startGenerateColorMap(src);
 
         converter_manager.changedInput();
@@ -260,10 +347,21 @@ int drawEditor(const cv::Mat& img, int convert_to_vector_mode, int draw_mode, cv
         mode_map_colored.setTo(converter_gui_colors[i], mode_map == (int)i);
     }
 
+    // プロキシで作ったカラーマップは元の大きさに戻して表示する
+    auto colorMapViewForEditor = [&img]() {
+        cv::Mat view = color_map_manager.getViewMap();
+        if(!view.empty() && view.size() != img.size()){
+            cv::Mat resized;
+            cv::resize(view, resized, img.size(), 0, 0, cv::INTER_NEAREST);
+            return resized;
+        }
+        return view;
+    };
+
     // αブレンド
     cv::Mat mixed_img;
     if(!color_map_manager.isCalculating() && color_map_manager.isNewestColorMapAvailable()){
-        cv::addWeighted(mode_map_colored, 0.5, color_map_manager.getViewMap(), 0.5, 0.0, mixed_img);
+        cv::addWeighted(mode_map_colored, 0.5, colorMapViewForEditor(), 0.5, 0.0, mixed_img);
     } else {
         cv::addWeighted(mode_map_colored, 0.5, img, 0.5, 0.0, mixed_img);
     }
@@ -277,7 +375,7 @@ int drawEditor(const cv::Mat& img, int convert_to_vector_mode, int draw_mode, cv
         if(!color_map_manager.isNewestColorMapAvailable() || color_map_manager.isCalculating()){
             draw_img = img.clone();
         }else{
-            draw_img = color_map_manager.getViewMap().clone();
+            draw_img = colorMapViewForEditor().clone();
         }
     }else if(convert_to_vector_mode == 2){
         draw_img = mixed_img.clone();
@@ -356,7 +454,13 @@ void drawConvertersGui() {
             std::cerr << "Mode map is invalid." << std::endl;
             return;
         }
-        converter_manager.startCalculation(editing_img, color_map_manager.getColorMap(), mode_map, shell_manager);
+        ColorMap color_map = color_map_manager.getColorMap();
+        if(color_map.colorMap.size() != pipelineImage().size()){
+            std::cerr << "Color map size does not match. Generate the color map again." << std::endl;
+            color_map_manager.changedInput();
+            return;
+        }
+        converter_manager.startCalculation(pipelineImage(), color_map, pipelineModeMap(), shell_manager, pipelineScale());
     }
     ImGui::EndDisabled();
     if(converter_manager.isCalculating()){
@@ -367,6 +471,10 @@ void drawConvertersGui() {
 }
 
 static bool write_display_img = false;
+// ベクタのプレビューを画像にせず ImDrawList に直接描く (拡大縮小・移動ができる)
+// "View" (4) は塗りも描くので画像のまま
+static bool direct_vector_preview = true;
+static VectorPreview converter_preview, output_preview, optimizer_preview;
 // 0: original, 1: colormap, 2: mixed, 3: area, 4: view, 5: view with points, 6: view with hatch, 7: view random colored
 static int convert_to_vector_mode = 0;
 static int draw_mode = 1; // 0: draw, 1: rectangle
@@ -428,6 +536,8 @@ void drawConvertToVectorTabGui() {
     }else{
         write_display_img = false;
     }
+    ImGui::SameLine();
+    ImGui::Checkbox("Direct Preview (wheel: zoom, drag: pan)", &direct_vector_preview);
 
     ImGui::Dummy(ImVec2(0, 10));
 
@@ -464,7 +574,97 @@ void drawConvertToVectorTabGui() {
 }
 
 static OutputManager output_manager;
+
+// プロキシの設定が変わったときなど、パイプライン全体をやり直す
+static void markPipelineChanged() {
+    filter_calc_manager.changedInput();
+    color_map_manager.changedInput();
+    converter_manager.changedInput();
+}
+
+// フル解像度での実行 (毎フレーム進み具合を確認して次の段を始める)
+enum class FullRunStage {
+    NONE,
+    FILTERS,
+    COLOR_MAP,
+    CONVERT,
+    OUTPUT,
+};
+static FullRunStage full_run_stage = FullRunStage::NONE;
+
+static void startFullResolutionRun() {
+    full_resolution_run = true;
+    markPipelineChanged();
+    filter_calc_manager.startCalculation(filters, pipelineImage(), pipelineScale());
+    full_run_stage = FullRunStage::FILTERS;
+}
+
+static void abortFullResolutionRun() {
+    std::cerr << "Full resolution run was interrupted by a change." << std::endl;
+    full_run_stage = FullRunStage::NONE;
+}
+
+static void advanceFullResolutionRun() {
+    switch(full_run_stage){
+        case FullRunStage::NONE:
+            break;
+        case FullRunStage::FILTERS:
+            if(!filter_calc_manager.isNewestImageAvailable()){
+                abortFullResolutionRun();
+            }else if(!filter_calc_manager.isCalculating()){
+                auto processed = filter_calc_manager.getProcessedImages();
+                color_map_manager.startGenerateColorMap(processed.empty() ? pipelineImage() : processed.back());
+                converter_manager.changedInput();
+                full_run_stage = FullRunStage::COLOR_MAP;
+            }
+            break;
+        case FullRunStage::COLOR_MAP:
+            if(!color_map_manager.isNewestColorMapAvailable()){
+                abortFullResolutionRun();
+            }else if(!color_map_manager.isCalculating()){
+                converter_manager.startCalculation(pipelineImage(), color_map_manager.getColorMap(), pipelineModeMap(), shell_manager, pipelineScale());
+                full_run_stage = FullRunStage::CONVERT;
+            }
+            break;
+        case FullRunStage::CONVERT:
+            if(!converter_manager.isNewestDataAvailable()){
+                abortFullResolutionRun();
+            }else if(!converter_manager.isCalculating()){
+                VectorData vector_data;
+                converter_manager.getVectorData(vector_data);
+                output_manager.startCalculation(vector_data);
+                full_run_stage = FullRunStage::OUTPUT;
+            }
+            break;
+        case FullRunStage::OUTPUT:
+            if(!output_manager.isCalculatingViewImage()){
+                full_run_stage = FullRunStage::NONE;
+            }
+            break;
+    }
+}
+
 void drawOutputGui() {
+    if(proxy_enabled && !proxy_img.empty()){
+        if(full_run_stage != FullRunStage::NONE){
+            ImGui::Text("Full resolution run in progress...");
+        }else if(full_resolution_run){
+            ImGui::Text("Showing full resolution result.");
+            ImGui::SameLine();
+            if(ImGui::Button("Back to Proxy")){
+                full_resolution_run = false;
+                markPipelineChanged();
+            }
+        }else{
+            ImGui::Text("Proxy preview (%.0f%%)", proxy_scale * 100.0f);
+            ImGui::SameLine();
+            if(ImGui::Button("Render Full Resolution")){
+                startFullResolutionRun();
+            }
+        }
+        ImGui::Separator();
+    }
+
     VectorData vector_data;
     converter_manager.getVectorData(vector_data);
     output_manager.drawGui(vector_data, button_textures);
@@ -478,13 +678,18 @@ void drawShellGui() {
 
 static OptimizerGui optimizer_gui;
 void drawOptimizeGui() {
-    VectorData vector_data;
-    output_manager.getOutputData(vector_data);
-    optimizer_gui.drawGui(vector_data);
+    optimizer_gui.drawGui(output_manager.getOutputLayout());
 }
 
-static int tab_mode = 0; // 0: filter, 1: colormap, 2: convert to vector, 3: output, 4: shell, 5: optimize
+static ProfilePanel profile_panel;
+void drawProfileGui() {
+    profile_panel.drawGui();
+}
+
+static int tab_mode = 0; // 0: filter, 1: colormap, 2: convert to vector, 3: output, 4: shell, 5: optimize, 6: profile
 void drawGui(float fps) {
+    advanceFullResolutionRun();
+
     if(ImGui::BeginMenuBar()) {
         if (ImGui::BeginMenu("File")) {
             if (ImGui::MenuItem("Open Image")) {
@@ -527,65 +732,23 @@ void drawGui(float fps) {
         ImVec2 img_size = drawMat(display_img, max_width, max_height, &hovered_color);
         ImGui::SetColumnWidth(0, img_size.x + ImGui::GetStyle().ItemSpacing.x * 2);
     }else if(tab_mode == 2){
-        if(convert_to_vector_mode > 3){
-            if(convert_to_vector_mode == 4){
-                if(converter_manager.isNewestDataAvailable() && !converter_manager.isCalculating()){
-                    cv::Mat view_map;
-                    cv::Mat view_map_with_points;
-                    cv::Mat view_map_with_hatch;
-                    cv::Mat view_random_colored;
-                    if(converter_manager.getViewMaps(view_map, view_map_with_points, view_map_with_hatch, view_random_colored)){
-                        display_img = view_map;
-                    } else {
-                        display_img = editing_img;
-                    }
-                } else {
-                    display_img = editing_img;
-                }
-            } else if(convert_to_vector_mode == 5){
-                if(converter_manager.isNewestDataAvailable() && !converter_manager.isCalculating()){
-                    cv::Mat view_map;
-                    cv::Mat view_map_with_points;
-                    cv::Mat view_map_with_hatch;
-                    cv::Mat view_random_colored;
-                    if(converter_manager.getViewMaps(view_map, view_map_with_points, view_map_with_hatch, view_random_colored)){
-                        display_img = view_map_with_points;
-                    } else {
-                        display_img = editing_img;
-                    }
-                } else {
-                    display_img = editing_img;
-                }
-            } else if(convert_to_vector_mode == 6){
-                if(converter_manager.isNewestDataAvailable() && !converter_manager.isCalculating()){
-                    cv::Mat view_map;
-                    cv::Mat view_map_with_points;
-                    cv::Mat view_map_with_hatch;
-                    cv::Mat view_random_colored;
-                    if(converter_manager.getViewMaps(view_map, view_map_with_points, view_map_with_hatch, view_random_colored)){
-                        display_img = view_map_with_hatch;
-                    } else {
-                        display_img = editing_img;
-                    }
-                } else {
-                    display_img = editing_img;
-                }
-            } else if(convert_to_vector_mode == 7){
+        ImVec2 preview_size(0, 0);
+        if(direct_vector_preview && convert_to_vector_mode >= 5 && convert_to_vector_mode <= 7
+            && converter_manager.isNewestDataAvailable() && !converter_manager.isCalculating()){
+            preview_size = converter_manager.drawPreview(converter_preview, static_cast<VectorView>(convert_to_vector_mode - 4), max_width, max_height);
+        }
+        if(preview_size.x > 0){
+            ImGui::SetColumnWidth(0, preview_size.x + ImGui::GetStyle().ItemSpacing.x * 2);
+        }else if(convert_to_vector_mode > 3){
+            // 4-7: 選んでいる1枚だけを表示する大きさで描く
+            if(convert_to_vector_mode <= 7){
                 if(converter_manager.isNewestDataAvailable() && !converter_manager.isCalculating()){
-                    cv::Mat view_map;
-                    cv::Mat view_map_with_points;
-                    cv::Mat view_map_with_hatch;
-                    cv::Mat view_random_colored;
-                    if(converter_manager.getViewMaps(view_map, view_map_with_points, view_map_with_hatch, view_random_colored)){
-                        display_img = view_random_colored;
-                    } else {
-                        display_img = editing_img;
-                    }
-                } else {
-                    display_img = editing_img;
+                    display_img = converter_manager.getViewImage(static_cast<VectorView>(convert_to_vector_mode - 4), max_width, max_height);
                 }
             } else {
                 std::cerr << "Invalid convert_to_vector_mode: " << convert_to_vector_mode << std::endl;
+            }
+            if(display_img.empty()){
                 display_img = editing_img;
             }
             ImVec2 img_size = drawMat(display_img, max_width, max_height, &hovered_color);
@@ -594,6 +757,9 @@ void drawGui(float fps) {
             int width = drawEditor(editing_img, convert_to_vector_mode, draw_mode, mode_map, max_width, max_height);
             ImGui::SetColumnWidth(0, width + ImGui::GetStyle().ItemSpacing.x * 2);
         }
+        if(write_display_img && display_img.empty() && preview_size.x > 0){
+            display_img = converter_manager.getViewImage(static_cast<VectorView>(convert_to_vector_mode - 4), max_width, max_height);
+        }
         if(write_display_img && !display_img.empty()){
             std::string write_path = getExecutableDir() + "/display_img.png";
             if(imwrite(write_path, display_img)){
@@ -603,24 +769,55 @@ void drawGui(float fps) {
             }
         }
     }else if(tab_mode == 3){
-        display_img = output_manager.getViewImage();
-        if(display_img.empty()){
-            display_img = editing_img;
+        ImVec2 img_size(0, 0);
+        if(direct_vector_preview){
+            img_size = output_manager.drawPreview(output_preview, max_width, max_height);
+        }
+        if(img_size.x <= 0){
+            display_img = output_manager.getViewImage(max_width, max_height);
+            if(display_img.empty()){
+                display_img = editing_img;
+            }
+            img_size = drawMat(display_img, max_width, max_height, &hovered_color);
         }
-        ImVec2 img_size = drawMat(display_img, max_width, max_height, &hovered_color);
         ImGui::SetColumnWidth(0, img_size.x + ImGui::GetStyle().ItemSpacing.x * 2);
-    }else if(tab_mode == 4){
+    }else if(tab_mode == 4 || tab_mode == 6){
         display_img = editing_img;
         ImVec2 img_size = drawMat(display_img, max_width, max_height, &hovered_color);
         ImGui::SetColumnWidth(0, img_size.x + ImGui::GetStyle().ItemSpacing.x * 2);
     }else if(tab_mode == 5){
-        display_img = optimizer_gui.getViewImage();
-        if(display_img.empty()) display_img = editing_img;
-        ImVec2 img_size = drawMat(display_img, max_width, max_height, &hovered_color);
+        ImVec2 img_size(0, 0);
+        if(direct_vector_preview){
+            img_size = optimizer_gui.drawPreview(optimizer_preview, max_width, max_height);
+        }
+        if(img_size.x <= 0){
+            display_img = optimizer_gui.getViewImage();
+            if(display_img.empty()) display_img = editing_img;
+            img_size = drawMat(display_img, max_width, max_height, &hovered_color);
+        }
         ImGui::SetColumnWidth(0, img_size.x + ImGui::GetStyle().ItemSpacing.x * 2);
     }
     ImGui::NextColumn();
     ImGui::Text("Image Size: %d x %d", editing_img.cols, editing_img.rows);
+    if(ImGui::Checkbox("Proxy Preview", &proxy_enabled)){
+        full_resolution_run = false;
+        full_run_stage = FullRunStage::NONE;
+        markPipelineChanged();
+    }
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!proxy_enabled);
+    ImGui::PushItemWidth(100);
+    if(ImGui::InputInt("Max Side (px)", &proxy_max_side, 128, 512)){
+        proxy_max_side = std::clamp(proxy_max_side, 128, 8192);
+        updateProxyImage();
+        markPipelineChanged();
+    }
+    ImGui::PopItemWidth();
+    ImGui::EndDisabled();
+    if(useProxy()){
+        ImGui::SameLine();
+        ImGui::Text("%d x %d", proxy_img.cols, proxy_img.rows);
+    }
 
     if (fps > 0) {
         ImGui::Text("FPS: %.1f", fps);
@@ -684,6 +881,12 @@ void drawGui(float fps) {
             drawOptimizeGui();
             ImGui::EndTabItem();
         }
+        if(ImGui::BeginTabItem("Profile")){
+            tab_mode = 6;
+            ImGui::Dummy(ImVec2(0, 5));
+            drawProfileGui();
+            ImGui::EndTabItem();
+        }
         ImGui::EndTabBar();
     }
 
@@ -696,6 +899,8 @@ void drawGui(float fps) {
                 editing_img = imread_color(out_path);
                 mode_map = cv::Mat::zeros(editing_img.size(), CV_8UC1);
                 current_image_index = -1;
+                updateProxyImage();
+                full_resolution_run = false;
                 filter_calc_manager.changedInput();
                 std::cout << "Selected file: " << out_path << std::endl;
             }
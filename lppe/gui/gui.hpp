@@ -14,6 +14,7 @@
 #include <opencv4/opencv2/core/mat.hpp>
 
 #include "img/colormap_generator.hpp"
+#include "img/content_hash.hpp"
 #include "img/vector_data.hpp"
 
 class Filter{
@@ -23,7 +24,12 @@ class Filter{
         virtual void apply(const cv::Mat& src, cv::Mat& dst) = 0;
         virtual bool drawGui() = 0; // return true if parameters changed
         virtual std::string getFilterName() const = 0;
+        virtual void addFingerprint(CacheKey& key) const = 0; // 結果に効くパラメータをキーに足す (同じ値なら同じ出力になること)
         int unique_id;
+        float px_scale = 1.0f; // 縮小画像で実行するときの倍率 (px単位のパラメータに掛ける)
+    protected:
+        int scalePxLength(int px) const; // 0はそのまま、正なら1以上
+        double scalePxLength(double px) const;
 };
 class FilterRegistry {
     public:
@@ -65,7 +71,10 @@ class VectorConverter {
         virtual void apply(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode, VectorData& vectorData) = 0;
         virtual bool drawGui() = 0; // return true if parameters changed
         virtual std::string getConverterName() const = 0;
+        virtual void addFingerprint(CacheKey& key) const = 0; // 結果に効くパラメータをキーに足す (同じ値なら同じ出力になること)
         int unique_id;
+        float px_scale = 1.0f; // 縮小画像で実行するときの倍率 (px単位のパラメータに掛ける)
+        TileSettings tiling; // 大きな画像をタイルに分けて処理する設定
 };
 class VectorConverterRegistry {
     public:
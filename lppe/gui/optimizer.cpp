@@ -1,7 +1,6 @@
 #include "optimizer.hpp"
 
 #include <iostream>
-#include <fstream>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -15,61 +14,13 @@
 #include <opencv4/opencv2/imgproc/imgproc.hpp>
 
 #include "cross/cross.hpp"
+#include "core/path_writer.hpp"
+#include "core/instanced_path.hpp"
+#include "core/print_time.hpp"
+#include "img/content_hash.hpp"
+#include "cache/disk_cache.hpp"
 
-static unoptimized_path convertToUnoptimizedPath(const VectorData& data) {
-    // polylines -> polylines
-    // contours -> contours
-    // hatch_lines -> polylines
-
-    unoptimized_path u_path;
-    u_path.polylines.clear();
-    u_path.contours.clear();
-    u_path.color_names = data.color_names;
-
-    std::map<int, std::vector<std::vector<point>>> polylines_pts;
-
-    for(const auto& [color_id, lines] : data.polylines) {
-        for(const auto& line : lines) {
-            std::vector<point> pts;
-            pts.reserve(line.size());
-            for(const auto& pt : line) {
-                pts.emplace_back(pt.x, pt.y);
-            }
-            if(!pts.empty()) {
-                polylines_pts[color_id].push_back(pts);
-            }
-        }
-    }
-    for(const auto& [color_id, lines] : data.hatch_lines) {
-        for(const auto& line : lines) {
-            std::vector<point> pts;
-            pts.reserve(line.size());
-            for(const auto& pt : line) {
-                pts.emplace_back(pt.x, pt.y);
-            }
-            if(!pts.empty()) {
-                polylines_pts[color_id].push_back(pts);
-            }
-        }
-    }
-    u_path.polylines = polylines_pts;
-
-    for(const auto& [color_id, lines] : data.contours) {
-        for(const auto& line : lines) {
-            std::vector<point> pts;
-            pts.reserve(line.size());
-            for(const auto& pt : line) {
-                pts.emplace_back(pt.x, pt.y);
-            }
-            if(!pts.empty()) {
-                u_path.contours[color_id].push_back(pts);
-            }
-        }
-    }
-
-    return u_path;
-}
-static void analyzePath(const VectorData& vector_data, const draw_path& path, cv::Mat& view_img, std::string& analysis, int N) {
+static void analyzePath(int width, int height, const draw_path& path, cv::Mat& view_img, std::string& analysis, int N) {
     int total_points = 0;
     int total_paths = 0;
 
@@ -111,7 +62,13 @@ static void analyzePath(const VectorData& vector_data, const draw_path& path, cv
     analysis += "Total Length: " + std::to_string(total_length) + "\n";
     analysis += "(" + std::to_string(static_cast<int>(std::round(total_length / 1000.0f))) + " meters)\n";
 
-    view_img = cv::Mat::zeros(N * vector_data.height, N * vector_data.width, CV_8UC3);
+    // 長さだけでは EV3 での時間がわからないので、ファームウェアの動きから見積もる
+    PrintTimeModel model;
+    model.paper_width = static_cast<float>(width);
+    model.paper_height = static_cast<float>(height);
+    analysis += formatPrintTime(estimatePrintTime(path, model));
+
+    view_img = cv::Mat::zeros(N * height, N * width, CV_8UC3);
     view_img.setTo(cv::Scalar(255,255,255));
 
     for(const auto& [color_id, paths] : path.paths) {
@@ -140,42 +97,62 @@ static void analyzePath(const VectorData& vector_data, const draw_path& path, cv
     }
 }
 
-void OptimizerGui::drawGui(const VectorData& data) {
+// 配置と探索方法が同じなら同じ結果になる
+static CacheKey instancedLayoutKey(const InstancedLayout& layout, bool beam_search) {
+    CacheKey key("optimize", CACHE_STAGE_OPTIMIZE_VERSION);
+    key.add(beam_search);
+    addVectorDataKey(key, layout.base);
+    key.add(static_cast<uint32_t>(layout.placements.size()));
+    for(const auto& m : layout.placements) {
+        key.add(m.a).add(m.b).add(m.c).add(m.d).add(m.e).add(m.f);
+    }
+    addVectorDataKey(key, layout.shared);
+    return key;
+}
+
+void OptimizerGui::drawGui(std::shared_ptr<const InstancedLayout> new_layout) {
     std::lock_guard<std::mutex> lock(mtx);
-    if(calculating) {
-        ImGui::Text("Calculating... Please wait.");
-        return;
-    }
-    data_copy = data;
+    layout = new_layout;
 
     ImGui::Text("Optimize the drawing paths for shorter travel distance.");
-    if(ImGui::Button("Start Optimization")) {
+    // 計算中に押した場合は、古い計算を取り消してやり直す
+    ImGui::BeginDisabled(!layout);
+    if(ImGui::Button(calculating ? "Restart Optimization" : "Start Optimization")) {
         calculating = true;
         optimized_paths.paths.clear();
-        optimized_paths.color_names = data.color_names;
-        std::thread([this]() {
+        optimized_paths.color_names = layout->base.color_names;
+        paths_version++;
+        auto job_layout = layout;
+        bool use_beam_search = beam_search;
+        jobs.start([this, job_layout, use_beam_search](const CancelToken& token) {
             draw_path result;
-            Optimizer optimizer;
-            auto u_path = convertToUnoptimizedPath(this->data_copy);
-            if(this->beam_search) {
-                optimizer.optimize_beam_search(u_path, result);
-            } else {
-                optimizer.optimize_greedy(u_path, result);
+            const CacheKey key = instancedLayoutKey(*job_layout, use_beam_search);
+            if(!DiskCache::instance().loadDrawPath(key, result)) {
+                optimizeInstancedLayout(*job_layout, use_beam_search, result);
+                checkCancelled();
+                DiskCache::instance().storeDrawPath(key, result);
             }
             std::cout << "Optimization completed." << std::endl;
             cv::Mat view_img;
             std::string analysis;
-            analyzePath(this->data_copy, result, view_img, analysis, 5);
+            analyzePath(job_layout->width, job_layout->height, result, view_img, analysis, 5);
             std::cout << "Analysis:\n" << analysis << std::endl;
             {
                 std::lock_guard<std::mutex> lock(this->mtx);
+                if(token.isCancelled()) return;
                 this->optimized_paths = result;
+                this->paths_version++;
                 this->calculating = false;
                 this->data_available = true;
                 this->view_img = view_img;
                 this->analysis = analysis;
             }
-        }).detach();
+        });
+    }
+    ImGui::EndDisabled();
+    if(calculating) {
+        ImGui::SameLine();
+        ImGui::Text("Calculating... Please wait.");
     }
 
     if(ImGui::Checkbox("Use Beam Search (slower, better)", &beam_search)){}
@@ -186,9 +163,18 @@ void OptimizerGui::drawGui(const VectorData& data) {
     }
 
     ImGui::Dummy(ImVec2(0,20));
+    ImGui::BeginDisabled(calculating);
     if(ImGui::Button("Write to file")){
-        write_path_to_file(getExecutableDir() + "/output/optimized_path.txt", optimized_paths);
+        if(write_binary){
+            writeBinaryPathFile(getExecutableDir() + "/output/optimized_path.lppb", optimized_paths);
+        }else{
+            writePathFile(getExecutableDir() + "/output/optimized_path.txt", optimized_paths);
+        }
     }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    // EV3 は path.lppb があればそちらを読む
+    ImGui::Checkbox("Binary (.lppb)", &write_binary);
 }
 
 bool OptimizerGui::getOptimizedData(draw_path& out_paths) {
@@ -201,87 +187,18 @@ bool OptimizerGui::getOptimizedData(draw_path& out_paths) {
     }
 }
 
-cv::Mat OptimizerGui::getViewImage() const {
+ImVec2 OptimizerGui::drawPreview(VectorPreview& preview, int max_width, int max_height) const {
     std::lock_guard<std::mutex> lock(mtx);
-    if(data_copy.width <= 0 || data_copy.height <= 0){
-        return cv::Mat();
+    if(!data_available || !layout || layout->width <= 0 || layout->height <= 0){
+        return ImVec2(0, 0);
     }
-    return view_img;
+    return preview.draw(optimized_paths, paths_version, static_cast<float>(layout->width), static_cast<float>(layout->height), max_width, max_height);
 }
 
-void OptimizerGui::write_path_to_file(const std::string& filename, const draw_path& path) {
-    /*
-    ファイル構造：
-    N: 色の数 (1-64)
-    n: next polyline
-    e: end of color
-    color name: 64文字以下
-    x y: 座標(mm) float
-
-    N
-    color 0 name
-    color 1 name
-    ...
-    color (N-1) name
-    color 0 data
-    color 1 data
-    ...
-    color (N-1) data
-
-    color data:
-    x y
-    x y
-    ...
-    n
-    x y
-    x y
-    ...
-    n
-    ...
-    e
-    */
-
-    std::ofstream ofs(filename);
-    if(!ofs){
-        std::cerr << "Failed to open file for writing: " << filename << std::endl;
-        return;
-    }
-
-    if(optimized_paths.paths.empty()){
-        std::cerr << "No optimized paths to write." << std::endl;
-        return;
-    }
-    if(optimized_paths.color_names.empty()){
-        std::cerr << "No color names available." << std::endl;
-        return;
-    }
-    if(optimized_paths.color_names.size() > 64){
-        std::cerr << "Too many colors to write (max 64)." << std::endl;
-        return;
-    }
-    std::vector<int> valid_color_ids;
-    for(const auto& [color_id, paths] : optimized_paths.paths) {
-        if(paths.size() > 0){
-            valid_color_ids.push_back(color_id);
-        }
-    }
-    ofs << valid_color_ids.size() << std::endl;
-    for(const auto& color_id : valid_color_ids) {
-        ofs << optimized_paths.color_names[color_id] << std::endl;
-    }
-    for(const auto& color_id : valid_color_ids) {
-        const auto& paths = optimized_paths.paths[color_id];
-        for(size_t i = 0; i < paths.size(); ++i) {
-            for(const auto& pt : paths[i]) {
-                ofs << pt.first << " " << pt.second << std::endl;
-            }
-            if(i + 1 < paths.size()){
-                ofs << "n" << std::endl; // next polyline
-            }
-        }
-        ofs << "e" << std::endl; // end of color
+cv::Mat OptimizerGui::getViewImage() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!layout || layout->width <= 0 || layout->height <= 0){
+        return cv::Mat();
     }
-
-    ofs.close();
-    std::cout << "Optimized path written to " << filename << std::endl;
+    return view_img;
 }
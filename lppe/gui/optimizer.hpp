@@ -1,27 +1,36 @@
 #pragma once
 
 #include "img/vector_data.hpp"
+#include "core/layout.hpp"
 #include "optimizer/optimizer.hpp"
+#include "job/job.hpp"
+#include "vector_preview.hpp"
 
 #include <thread>
 #include <mutex>
+#include <memory>
 
 class OptimizerGui {
 public:
-    void drawGui(const VectorData& data);
+    // layout が nullptr (配置の計算中) のときは開始できない
+    void drawGui(std::shared_ptr<const InstancedLayout> layout);
     bool getOptimizedData(draw_path& out_paths);
     cv::Mat getViewImage() const;
+    // 画像にせずに ImDrawList へ直接描く。結果がなければ (0, 0) を返す
+    ImVec2 drawPreview(VectorPreview& preview, int max_width, int max_height) const;
     bool isCalculating() const { return calculating; }
 private:
-    void write_path_to_file(const std::string& filename, const draw_path& path);
     bool calculating = false;
-    VectorData data_copy;
+    std::shared_ptr<const InstancedLayout> layout; // 最後に渡された配置 (コピーはしない)
     draw_path optimized_paths;
+    uint64_t paths_version = 0; // optimized_paths を書き換えるたびに増やす (プレビューの作り直しの判定)
     bool data_available = false;
     cv::Mat view_img;
     std::string analysis;
 
     bool beam_search = false;
+    bool write_binary = false; // optimized_path.lppb に書き出す
+    LatestJobRunner jobs;
 
     mutable std::mutex mtx;
 };
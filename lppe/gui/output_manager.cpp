@@ -12,140 +12,6 @@ static int positive_modulo(int i, int n) {
     return (i % n + n) % n;
 }
 
-/*
-new x = ax + by + c
-new y = dx + ey + f
-Apply linear transform to vector data
-don't change cv::Mat data
-*/
-static void applyLinearTransformVectorData(const VectorData& in, VectorData& out, double a, double b, double c, double d, double e, double f) {
-    // ignore width and height
-    out.width = 0;
-    out.height = 0;
-
-    out.polylines.clear();
-    for(const auto& [color, lines] : in.polylines) {
-        for(const auto& line : lines) {
-            std::vector<cv::Point2f> new_line;
-            for(const auto& pt : line) {
-                float new_x = static_cast<float>(a * pt.x + b * pt.y + c);
-                float new_y = static_cast<float>(d * pt.x + e * pt.y + f);
-                new_line.emplace_back(new_x, new_y);
-            }
-            out.polylines[color].push_back(new_line);
-        }
-    }
-
-    out.contours.clear();
-    for(const auto& [color, lines] : in.contours) {
-        for(const auto& line : lines) {
-            std::vector<cv::Point2f> new_line;
-            for(const auto& pt : line) {
-                float new_x = static_cast<float>(a * pt.x + b * pt.y + c);
-                float new_y = static_cast<float>(d * pt.x + e * pt.y + f);
-                new_line.emplace_back(new_x, new_y);
-            }
-            out.contours[color].push_back(new_line);
-        }
-    }
-
-    out.hatch_lines.clear();
-    for(const auto& [color, lines] : in.hatch_lines) {
-        for(const auto& line : lines) {
-            std::vector<cv::Point2f> new_line;
-            for(const auto& pt : line) {
-                float new_x = static_cast<float>(a * pt.x + b * pt.y + c);
-                float new_y = static_cast<float>(d * pt.x + e * pt.y + f);
-                new_line.emplace_back(new_x, new_y);
-            }
-            out.hatch_lines[color].push_back(new_line);
-        }
-    }
-
-    out.color_names = in.color_names;
-    out.color_values = in.color_values;
-}
-
-static void mergeVectorData(const VectorData& src0, const VectorData& src1, VectorData& dst) {
-    dst.width = 0;
-    dst.height = 0;
-
-    dst.polylines = src0.polylines;
-    for(const auto& [color, lines] : src1.polylines) {
-        for(const auto& line : lines) {
-            dst.polylines[color].push_back(line);
-        }
-    }
-
-    dst.contours = src0.contours;
-    for(const auto& [color, lines] : src1.contours) {
-        for(const auto& line : lines) {
-            dst.contours[color].push_back(line);
-        }
-    }
-
-    dst.hatch_lines = src0.hatch_lines;
-    for(const auto& [color, lines] : src1.hatch_lines) {
-        for(const auto& line : lines) {
-            dst.hatch_lines[color].push_back(line);
-        }
-    }
-
-    dst.color_names = src0.color_names;
-    for(const auto& [color, name] : src1.color_names) {
-        if(dst.color_names.count(color) == 0) {
-            dst.color_names[color] = name;
-        }
-    }
-
-    dst.color_values = src0.color_values;
-    for(const auto& [color, value] : src1.color_values) {
-        if(dst.color_values.count(color) == 0) {
-            dst.color_values[color] = value;
-        }
-    }
-}
-
-static void getRectVectorData(const VectorData& data, double& min_x, double& min_y, double& max_x, double& max_y) {
-    std::vector<double> xs, ys;
-    for(const auto& [color, lines] : data.polylines) {
-        for(const auto& line : lines) {
-            for(const auto& pt : line) {
-                xs.push_back(pt.x);
-                ys.push_back(pt.y);
-            }
-        }
-    }
-    for(const auto& [color, lines] : data.contours) {
-        for(const auto& line : lines) {
-            for(const auto& pt : line) {
-                xs.push_back(pt.x);
-                ys.push_back(pt.y);
-            }
-        }
-    }
-    for(const auto& [color, lines] : data.hatch_lines) {
-        for(const auto& line : lines) { 
-            for(const auto& pt : line) {
-                xs.push_back(pt.x);
-                ys.push_back(pt.y);
-            }
-        }
-    }
-
-    if(xs.empty() || ys.empty()){
-        min_x = min_y = max_x = max_y = 0;
-        return;
-    }
-
-    auto [min_x_it, max_x_it] = std::minmax_element(xs.begin(), xs.end());
-    auto [min_y_it, max_y_it] = std::minmax_element(ys.begin(), ys.end());
-    min_x = *min_x_it;
-    max_x = *max_x_it;
-    min_y = *min_y_it;
-    max_y = *max_y_it;
-}
-
 int sumMapSizes(const std::map<int, std::vector<std::vector<cv::Point2f>>>& m) {
     int sum = 0;
     for (const auto& [key, vec] : m) {
@@ -155,11 +21,10 @@ int sumMapSizes(const std::map<int, std::vector<std::vector<cv::Point2f>>>& m) {
 }
 
 void OutputManager::drawGui(const VectorData& vector_data, GLuint *button_textures) {
-    ImGui::BeginDisabled(isCalculatingViewImage());
+    // 計算中に押した場合は、古い計算を取り消してやり直す
     if(ImGui::Button("Reload View")){
         startCalculation(vector_data);
     }
-    ImGui::EndDisabled();
     if(isCalculatingViewImage()){
         ImGui::SameLine();
         ImGui::Text("Calculating...");
@@ -167,21 +32,21 @@ void OutputManager::drawGui(const VectorData& vector_data, GLuint *button_textur
 
     if(ImGui::Button("Reset to Default")){
         paper_size = "A4";
-        paper_width = 210;
-        paper_height = 297;
-        paper_margin = 10;
-        direction = 0;
-        allow_center_drift = true;
-        size_percent = 100;
+        layout.paper_width = 210;
+        layout.paper_height = 297;
+        layout.paper_margin = 10;
+        layout.direction = 0;
+        layout.allow_center_drift = true;
+        layout.size_percent = 100;
     }
 
     ImGui::Dummy(ImVec2(0, 5));
 
-    if(ImGui::Checkbox("Double", &double_mode)){}
+    if(ImGui::Checkbox("Double", &layout.double_mode)){}
     ImGui::SameLine();
     ImGui::Dummy(ImVec2(10, 0));
     ImGui::SameLine();
-    if(ImGui::Checkbox("Add Border", &add_border)){}
+    if(ImGui::Checkbox("Add Border", &layout.add_border)){}
 
     ImGui::Dummy(ImVec2(0, 5));
 
@@ -190,8 +55,8 @@ void OutputManager::drawGui(const VectorData& vector_data, GLuint *button_textur
     if(ImGui::BeginCombo("Paper Size", "A4")){
         if(ImGui::Selectable("A4")){
             paper_size = "A4";
-            paper_width = 210;
-            paper_height = 297;
+            layout.paper_width = 210;
+            layout.paper_height = 297;
         }
         if(ImGui::Selectable("custom")){
             paper_size = "custom";
@@ -199,33 +64,33 @@ void OutputManager::drawGui(const VectorData& vector_data, GLuint *button_textur
         ImGui::EndCombo();
     }
     if(paper_size == "custom"){
-        ImGui::InputInt("Width (mm)", &paper_width);
-        if(paper_width <= 0) paper_width = 1;
-        if(paper_width > 1000) paper_width = 1000;
-        ImGui::InputInt("Height (mm)", &paper_height);
-        if(paper_height <= 0) paper_height = 1;
-        if(paper_height > 1000) paper_height = 1000;
+        ImGui::InputInt("Width (mm)", &layout.paper_width);
+        if(layout.paper_width <= 0) layout.paper_width = 1;
+        if(layout.paper_width > 1000) layout.paper_width = 1000;
+        ImGui::InputInt("Height (mm)", &layout.paper_height);
+        if(layout.paper_height <= 0) layout.paper_height = 1;
+        if(layout.paper_height > 1000) layout.paper_height = 1000;
     }
 
     ImGui::Dummy(ImVec2(0, 5));
 
-    ImGui::InputInt("Margin (mm)", &paper_margin);
-    if(paper_margin < 0) paper_margin = 0;
-    int max_margin = (paper_width < paper_height ? paper_width : paper_height) / 2;
+    ImGui::InputInt("Margin (mm)", &layout.paper_margin);
+    if(layout.paper_margin < 0) layout.paper_margin = 0;
+    int max_margin = (layout.paper_width < layout.paper_height ? layout.paper_width : layout.paper_height) / 2;
     max_margin = max_margin > 100 ? 100 : max_margin;
-    if(paper_margin > max_margin) paper_margin = max_margin;
+    if(layout.paper_margin > max_margin) layout.paper_margin = max_margin;
 
-    ImGui::InputInt("Direction", &direction);
-    direction = positive_modulo(direction, 360);
+    ImGui::InputInt("Direction", &layout.direction);
+    layout.direction = positive_modulo(layout.direction, 360);
 
     ImGui::PopItemWidth();
 
-    ImGui::Checkbox("Allow Center Drift", &allow_center_drift);
+    ImGui::Checkbox("Allow Center Drift", &layout.allow_center_drift);
 
     ImGui::PushItemWidth(150);
-    ImGui::InputInt("Size (%)", &size_percent);
-    if(size_percent < 1) size_percent = 1;
-    if(size_percent > 100) size_percent = 100;
+    ImGui::InputInt("Size (%)", &layout.size_percent);
+    if(layout.size_percent < 1) layout.size_percent = 1;
+    if(layout.size_percent > 100) layout.size_percent = 100;
     ImGui::PopItemWidth();
 
     ImGui::Separator();
@@ -241,175 +106,93 @@ void OutputManager::drawGui(const VectorData& vector_data, GLuint *button_textur
 void OutputManager::startCalculation(const VectorData& vector_data) {
     std::lock_guard<std::mutex> lock(mtx);
 
-    if(isCalculating) {
-        std::cerr << "OutputManager::startCalculation: Already calculating." << std::endl;
-        return; // Already calculating
-    }
     isCalculating = true;
 
     // Copy inputs
-    vector_data_copy = vector_data;
-
-    std::thread([this]() {
-        cv::Mat new_view_img;
-        VectorData new_output_data;
+    auto vector_data_copy = std::make_shared<const VectorData>(vector_data);
+    LayoutSettings layout_copy = layout;
 
-        std::cout << "OutputManager: Rendering view image..." << std::endl;
-        renderViewImage(vector_data_copy, new_output_data, new_view_img);
-        std::cout << "OutputManager: View image rendered." << std::endl;
+    jobs.start([this, vector_data_copy, layout_copy](const CancelToken& token) {
+        std::cout << "OutputManager: Laying out..." << std::endl;
+        auto new_layout = std::make_shared<InstancedLayout>();
+        if(layoutInstances(*vector_data_copy, layout_copy, *new_layout)){
+            // 枠線は1回だけ描くものとして shared に足す (プレビューには描かない)
+            addLayoutBorder(layout_copy, new_layout->shared);
+        }else{
+            std::cerr << "OutputManager: Layout failed." << std::endl;
+            new_layout.reset();
+        }
+        std::cout << "OutputManager: Layout done." << std::endl;
 
         {
             std::lock_guard<std::mutex> lock(mtx);
-            view_img = new_view_img;
-            output_data = new_output_data;
+            if(token.isCancelled()) return;
+            output_layout = new_layout;
+            output_layout_version++;
+            view_layout = layout_copy;
+            view_img = cv::Mat(); // プレビューは表示するときに描く
             isCalculating = false;
         }
-    }).detach();
-}
-
-void OutputManager::renderViewImage(const VectorData& vector_data, VectorData& output_data, cv::Mat& img) {
-    if(vector_data.width <= 0 || vector_data.height <= 0){
-        std::cerr << "OutputManager::renderViewImage: Invalid vector data size." << std::endl;
-        img = cv::Mat();
-        return;
-    }
-
-    if(paper_width <= 2 * paper_margin || paper_height <= 2 * paper_margin){
-        std::cerr << "OutputManager::renderViewImage: Invalid paper size or margin." << std::endl;
-        img = cv::Mat();
-        return;
-    }
-
-    int drawable_width = paper_width - 2 * paper_margin;
-    int drawable_height = paper_height - 2 * paper_margin;
-
-    // move center to origin
-    VectorData moved_data;
-    applyLinearTransformVectorData(vector_data, moved_data, 1, 0, -vector_data.width * 0.5, 0, 1, -vector_data.height * 0.5);
-
-    // rotate vector data
-    VectorData rotated_data;
-    double rad = direction * CV_PI / 180.0;
-    double a = std::cos(rad);
-    double b = -std::sin(rad);
-    double d = std::sin(rad);
-    double e = std::cos(rad);
-    applyLinearTransformVectorData(moved_data, rotated_data, a, b, 0, d, e, 0);
-
-    // get bounding box
-    double min_x, min_y, max_x, max_y;
-    getRectVectorData(rotated_data, min_x, min_y, max_x, max_y);
-
-    VectorData paper_fit_data;
-    // scale to fit paper
-    if(allow_center_drift){
-        double scale = (std::min)(
-            static_cast<double>(drawable_width) / (max_x - min_x),
-            static_cast<double>(drawable_height) / (max_y - min_y)
-        );
-        double center_x = (min_x + max_x) * 0.5;
-        double center_y = (min_y + max_y) * 0.5;
-        applyLinearTransformVectorData(rotated_data, paper_fit_data, scale, 0, -center_x * scale, 0, scale, -center_y * scale);
-    }else{
-        double scale = (std::min)(
-            static_cast<double>(drawable_width * 0.5) / (std::max)(max_x, -min_x),
-            static_cast<double>(drawable_height * 0.5) / (std::max)(max_y, -min_y)
-        );
-        applyLinearTransformVectorData(rotated_data, paper_fit_data, scale, 0, 0, 0, scale, 0);
-    }
-
-    double final_scale = static_cast<double>(size_percent) / 100.0;
-    if(double_mode){
-        // rotate 90 degrees and sqrt(1/2) scale
-        VectorData rotated_90_data;
-        applyLinearTransformVectorData(paper_fit_data, rotated_90_data, 0, -std::sqrt(0.5) * final_scale, 0, std::sqrt(0.5) * final_scale, 0, 0);
-        VectorData upper_half_data, lower_half_data;
-        applyLinearTransformVectorData(rotated_90_data, upper_half_data, 1, 0, 0, 0, 1, -drawable_height * 0.25);
-        applyLinearTransformVectorData(rotated_90_data, lower_half_data, 1, 0, 0, 0, 1, drawable_height * 0.25);
-        // merge
-        mergeVectorData(upper_half_data, lower_half_data, paper_fit_data);
-
-        final_scale = 1.0;
-    }
-
-    VectorData final_data;
-    applyLinearTransformVectorData(paper_fit_data, final_data, final_scale, 0, paper_width * 0.5, 0, final_scale, paper_height * 0.5);
-    final_data.width = paper_width;
-    final_data.height = paper_height;
-
-    cv::Mat view_map, view_map_with_points, view_map_with_hatch, view_random_colored;
-    const int N = 5; // 0.2mm per pixel
-    visualize(final_data, view_map, view_map_with_points, view_map_with_hatch, view_random_colored, N);
-
-    img = view_map_with_hatch;
-
-    // draw border
-    if(size_percent < 100){
-        cv::rectangle(img,
-            cv::Point((paper_width * 0.5 - (paper_width * 0.5 - paper_margin) * final_scale) * N,
-                      (paper_height * 0.5 - (paper_height * 0.5 - paper_margin) * final_scale) * N),
-            cv::Point((paper_width * 0.5 + (paper_width * 0.5 - paper_margin) * final_scale) * N - 1,
-                      (paper_height * 0.5 + (paper_height * 0.5 - paper_margin) * final_scale) * N - 1),
-            cv::Scalar(255,0,0), 1, cv::LINE_AA
-        );
-    }
-    cv::rectangle(img,
-        cv::Point(paper_margin * N, paper_margin * N),
-        cv::Point((paper_width - paper_margin) * N - 1, (paper_height - paper_margin) * N - 1),
-        cv::Scalar(0,0,255), 1, cv::LINE_AA
-    );
-    if(double_mode){
-        cv::line(img,
-            cv::Point(paper_margin * N, paper_height * 0.5 * N),
-            cv::Point((paper_width - paper_margin) * N - 1, paper_height * 0.5 * N),
-            cv::Scalar(0,0,255), 1, cv::LINE_AA
-        );
-    }
-
-    if(add_border){
-        int border_color = -1;
-        for(const auto& [color, name] : vector_data.color_names) {
-            border_color = color;
-            if(name == "black") {
-                break;
-            }
-        }
-        if(!final_data.contours.count(border_color)){
-            final_data.contours[border_color] = {};
-        }
-        if(!final_data.polylines.count(border_color)){
-            final_data.polylines[border_color] = {};
-        }
-        final_data.contours.at(border_color).push_back({
-            cv::Point2f(paper_margin, paper_margin),
-            cv::Point2f(paper_width - paper_margin, paper_margin),
-            cv::Point2f(paper_width - paper_margin, paper_height - paper_margin),
-            cv::Point2f(paper_margin, paper_height - paper_margin)
-        });
-        if(double_mode){
-            final_data.polylines.at(border_color).push_back({
-                cv::Point2f(paper_margin, paper_height * 0.5),
-                cv::Point2f(paper_width - paper_margin, paper_height * 0.5)
-            });
-        }
-    }
-
-    output_data = final_data;
+    });
 }
 
-cv::Mat OutputManager::getViewImage() const {
+cv::Mat OutputManager::getViewImage(int max_width, int max_height) const {
     std::lock_guard<std::mutex> lock(mtx);
-    if(isCalculating || view_img.empty()){
+    if(isCalculating || !output_layout){
         return cv::Mat();
     }
+    const double scale = fitVectorViewScale(output_layout->base, max_width, max_height, OUTPUT_VIEW_MAX_SCALE);
+    if(view_img.empty() || scale != view_img_scale){
+        // 画像にするときだけ全部の場所に置いたものを作る
+        VectorData placed;
+        flattenInstances(*output_layout, placed, false);
+        view_img = renderVectorView(placed, VectorView::Hatch, scale);
+        drawLayoutGuides(view_img, view_layout, scale);
+        view_img_scale = scale;
+    }
     return view_img;
 }
 
-bool OutputManager::getOutputData(VectorData& out_data) const {
+ImVec2 OutputManager::drawPreview(VectorPreview& preview, int max_width, int max_height) const {
+    std::shared_ptr<const InstancedLayout> data;
+    uint64_t version = 0;
+    LayoutSettings settings;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(isCalculating || !output_layout){
+            return ImVec2(0, 0);
+        }
+        data = output_layout;
+        version = output_layout_version;
+        settings = view_layout;
+    }
+    const ImVec2 size = preview.draw(*data, version, VectorView::Hatch, max_width, max_height);
+
+    // drawLayoutGuides と同じ線を画面座標で
+    const PreviewViewport& vp = preview.getViewport();
+    auto to_screen = [&vp](double x, double y) {
+        return ImVec2(static_cast<float>(vp.origin_x + (x - vp.pan_x) * vp.zoom), static_cast<float>(vp.origin_y + (y - vp.pan_y) * vp.zoom));
+    };
+    const double w = settings.paper_width, h = settings.paper_height, m = settings.paper_margin;
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    draw_list->PushClipRect(ImVec2(vp.origin_x, vp.origin_y), ImVec2(vp.origin_x + vp.width, vp.origin_y + vp.height), true);
+    if(settings.size_percent < 100 && !settings.double_mode){
+        const double s = settings.size_percent / 100.0;
+        draw_list->AddRect(to_screen(w * 0.5 - (w * 0.5 - m) * s, h * 0.5 - (h * 0.5 - m) * s),
+            to_screen(w * 0.5 + (w * 0.5 - m) * s, h * 0.5 + (h * 0.5 - m) * s), IM_COL32(0, 0, 255, 255));
+    }
+    draw_list->AddRect(to_screen(m, m), to_screen(w - m, h - m), IM_COL32(255, 0, 0, 255));
+    if(settings.double_mode){
+        draw_list->AddLine(to_screen(m, h * 0.5), to_screen(w - m, h * 0.5), IM_COL32(255, 0, 0, 255));
+    }
+    draw_list->PopClipRect();
+    return size;
+}
+
+std::shared_ptr<const InstancedLayout> OutputManager::getOutputLayout() const {
     std::lock_guard<std::mutex> lock(mtx);
-    if(isCalculating || output_data.width <= 0 || output_data.height <= 0){
-        return false;
+    if(isCalculating){
+        return nullptr;
     }
-    out_data = output_data;
-    return true;
+    return output_layout;
 }
@@ -4,10 +4,16 @@
 #include <vector>
 #include <mutex>
 #include <thread>
+#include <memory>
 
 #include <opencv4/opencv2/core/mat.hpp>
 
 #include "vector_converters.hpp"
+#include "vector_preview.hpp"
+#include "core/layout.hpp"
+#include "job/job.hpp"
+
+#define OUTPUT_VIEW_MAX_SCALE (5.0) // プレビューの最大倍率 (1mm = 5px)
 
 class OutputManager {
     public:
@@ -15,29 +21,28 @@ class OutputManager {
         ~OutputManager() = default;
 
         void drawGui(const VectorData& vector_data, GLuint *button_textures);
-        cv::Mat getViewImage() const;
+        // 用紙のプレビューを max_width x max_height に収まる大きさで描く (前と同じ大きさなら描き直さない)
+        cv::Mat getViewImage(int max_width, int max_height) const;
+        // 画像にせずに ImDrawList へ直接描く (余白の線も重ねる)。データがなければ (0, 0) を返す
+        ImVec2 drawPreview(VectorPreview& preview, int max_width, int max_height) const;
         bool isCalculatingViewImage() const {
             std::lock_guard<std::mutex> lock(mtx);
             return isCalculating;
         }
-        bool getOutputData(VectorData& out_data) const;
-    private:
+        // 配置の結果 (枠線は shared に入っている)。計算中や失敗したときは nullptr
+        std::shared_ptr<const InstancedLayout> getOutputLayout() const;
         void startCalculation(const VectorData& vector_data);
-        void renderViewImage(const VectorData& vector_data, VectorData& output_data, cv::Mat& img);
+    private:
 
-        bool double_mode = false;
-        bool add_border = false;
         std::string paper_size = "A4";
-        int paper_width = 210; // mm
-        int paper_height = 297; // mm
-        int paper_margin = 20; // mm
-        int direction = 0; // 0-359
-        bool allow_center_drift = true;
-        int size_percent = 100; // 1-100
-
-        cv::Mat view_img;
-        VectorData vector_data_copy;
-        VectorData output_data;
+        LayoutSettings layout;
+
+        std::shared_ptr<const InstancedLayout> output_layout;
+        uint64_t output_layout_version = 0; // output_layout を置き換えるたびに増やす (プレビューの作り直しの判定)
+        LayoutSettings view_layout; // output_layout を作ったときの設定
+        mutable cv::Mat view_img;
+        mutable double view_img_scale = 0;
+        LatestJobRunner jobs;
         bool isCalculating = false;
 
         mutable std::mutex mtx;
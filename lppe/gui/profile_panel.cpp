@@ -0,0 +1,81 @@
+#include "profile_panel.hpp"
+
+#include <algorithm>
+
+// ImGui
+#include "imgui.h"
+
+#include "cross/cross.hpp"
+
+void ProfilePanel::drawGui() {
+    TraceRecorder& recorder = TraceRecorder::instance();
+
+    bool recording = recorder.isEnabled();
+    if(ImGui::Checkbox("Record", &recording)){
+        recorder.setEnabled(recording);
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Clear")){
+        recorder.clear();
+        export_message.clear();
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Export Chrome Trace")){
+        const std::string filename = getExecutableDir() + "/trace.json";
+        export_message = recorder.writeChromeTrace(filename) ? "Saved: " + filename : "Failed to write " + filename;
+    }
+    if(ImGui::IsItemHovered()){
+        ImGui::SetTooltip("Open the file in chrome://tracing or ui.perfetto.dev");
+    }
+    if(!export_message.empty()){
+        ImGui::TextUnformatted(export_message.c_str());
+    }
+    ImGui::Text("Events: %zu", recorder.getEventCount());
+
+    const auto stats = recorder.getStageStats();
+    if(stats.empty()){
+        ImGui::Text("No stages recorded yet. Run the pipeline to see the breakdown.");
+        return;
+    }
+    // 段は入れ子になる (vectorize の中に thinning など) ので、割合は一番長い段に対するもの
+    double longest_ms = 0;
+    for(const auto& s : stats) {
+        longest_ms = (std::max)(longest_ms, s.total_ms);
+    }
+
+    const ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY;
+    if(ImGui::BeginTable("profile_table", 7, flags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 24))){
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Last (ms)");
+        ImGui::TableSetupColumn("Total (ms)");
+        ImGui::TableSetupColumn("Max (ms)");
+        ImGui::TableSetupColumn("Share", ImGuiTableColumnFlags_WidthFixed, 100.0f);
+        ImGui::TableSetupColumn("Last Counts");
+        ImGui::TableHeadersRow();
+        for(const auto& s : stats) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(s.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", s.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", s.last_ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", s.total_ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", s.max_ms);
+            ImGui::TableNextColumn();
+            ImGui::ProgressBar(longest_ms > 0 ? static_cast<float>(s.total_ms / longest_ms) : 0.0f, ImVec2(-FLT_MIN, 0), "");
+            ImGui::TableNextColumn();
+            std::string counts;
+            for(const auto& [key, value] : s.last_counters) {
+                if(!counts.empty()) counts += ", ";
+                counts += key + ": " + std::to_string(static_cast<long long>(value));
+            }
+            ImGui::TextUnformatted(counts.c_str());
+        }
+        ImGui::EndTable();
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+#include "trace/trace.hpp"
+
+// 各段の処理時間と処理量の内訳 (trace/trace で記録したもの)
+class ProfilePanel {
+public:
+    void drawGui();
+private:
+    std::string export_message;
+};
@@ -1,13 +1,6 @@
 #include "shell_manager.hpp"
 
-static bool is_integer(const std::string& s) {
-    if (s.empty()) return false;
-    const char* begin = s.data();
-    const char* end   = s.data() + s.size();
-    int value;
-    auto result = std::from_chars(begin, end, value);
-    return result.ec == std::errc() && result.ptr == end;
-}
+#include "core/pipeline.hpp"
 
 bool ShellManager::drawGui() {
     static char buffer[1024 * 16];
@@ -60,25 +53,7 @@ void ShellManager::runAllCommands() {
             continue;
         }
         if(args[0] == "hatch"){
-            if(args.size() <= 2){
-                continue;
-            }
-            hatchLineSettings[args[1]] = HatchLineSetting();
-            auto key = args[1];
-            for(size_t i=2; i<args.size(); ++i){
-                std::cout << "Arg: " << args[i] << std::endl;
-                std::string value = args[i];
-                if(value == "/" || value == "-" || value == "\\" || value == "|" || value == "+" || value == "x"){
-                    hatchLineSettings[key].mode = value;
-                }else if(is_integer(value)){
-                    int spacing = std::stoi(value);
-                    if(spacing >= 1 && spacing <= 1000){
-                        hatchLineSettings[key].spacing = spacing;
-                    }
-                }else if(value.size() > 0){
-                    hatchLineSettings[key].substitute_color = value;
-                }
-            }
+            parseHatchCommand(args, hatchLineSettings);
         }
     }
 }
@@ -2,6 +2,7 @@
 
 #include "gui.hpp"
 #include "img/colormap_generator.hpp"
+#include "core/converters.hpp"
 
 class EmptyConverter : public VectorConverter {
     public:
@@ -12,6 +13,7 @@ class EmptyConverter : public VectorConverter {
         void apply(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode, VectorData& outData) override;
         bool drawGui() override;
         std::string getConverterName() const { return "Empty"; }
+        void addFingerprint(CacheKey& key) const override;
 };
 
 class EdgeConverter : public VectorConverter {
@@ -23,9 +25,9 @@ class EdgeConverter : public VectorConverter {
         void apply(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode, VectorData& outData) override;
         bool drawGui() override;
         std::string getConverterName() const { return "Edge"; }
+        void addFingerprint(CacheKey& key) const override;
     private:
-        int min_size = 1;
-        int opening_radius = 0;
+        EdgeConverterParams params;
 };
 
 class FillConverter : public VectorConverter {
@@ -38,17 +40,9 @@ class FillConverter : public VectorConverter {
         void apply(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode, VectorData& outData) override;
         bool drawGui() override;
         std::string getConverterName() const { return "Fill"; }
+        void addFingerprint(CacheKey& key) const override;
     private:
-        bool outline_mode = false;
-        std::string canny_mode = "";
-        int low_threshold = 100;
-        int high_threshold = 200;
-        std::string color_edges = "";
-        std::string back_outline = "";
-        int closing_radius = 0;
-        int erosion_radius = 0;
-        int min_size = 1;
-        int opening_radius = 0;
+        FillConverterParams params;
 };
 
 class LineAndFillConverter : public VectorConverter {
@@ -60,11 +54,9 @@ class LineAndFillConverter : public VectorConverter {
         void apply(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode, VectorData& outData) override;
         bool drawGui() override;
         std::string getConverterName() const { return "Line and Fill"; }
+        void addFingerprint(CacheKey& key) const override;
     private:
-        bool outline_mode = false;
-        int radius = 7;
-        int min_size = 1;
-        int opening_radius = 0;
+        LineAndFillConverterParams params;
 };
 
 class OutlineConverter : public VectorConverter {
@@ -76,7 +68,7 @@ class OutlineConverter : public VectorConverter {
         void apply(const cv::Mat& original, const ColorMap& colorMap, const cv::Mat& modeMap, const int mode, VectorData& outData) override;
         bool drawGui() override;
         std::string getConverterName() const { return "Outline"; }
+        void addFingerprint(CacheKey& key) const override;
     private:
-        int min_size = 1;
-        int opening_radius = 0;
+        OutlineConverterParams params;
 };
@@ -0,0 +1,141 @@
+#include "vector_preview.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define PREVIEW_MIN_ZOOM_FACTOR (0.25f)
+#define PREVIEW_MAX_ZOOM_FACTOR (64.0f)
+#define PREVIEW_WHEEL_STEP (1.2f)
+// ImDrawIdx が16bitなので、1回の AddPolyline の頂点 (アンチエイリアスで点の数の数倍) が 65536 を超えないように分ける
+#define PREVIEW_MAX_POLYLINE_POINTS (8192)
+
+void VectorPreview::resetView() {
+    zoom_factor = 1.0f;
+    center_x = data_width * 0.5f;
+    center_y = data_height * 0.5f;
+}
+
+void VectorPreview::beginCanvas(float width, float height, int max_width, int max_height) {
+    if(width != data_width || height != data_height){
+        data_width = width;
+        data_height = height;
+        resetView();
+    }
+
+    // 全体が収まる大きさ (drawMat と同じく、縦横比を保って max に収める)
+    const float fit = (std::min)(max_width / (std::max)(width, 1.0f), max_height / (std::max)(height, 1.0f));
+    const ImVec2 size((std::max)(1.0f, width * fit), (std::max)(1.0f, height * fit));
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("##vector_preview", size);
+
+    float zoom = fit * zoom_factor;
+    if(ImGui::IsItemHovered()){
+        const ImGuiIO& io = ImGui::GetIO();
+        if(ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)){
+            resetView();
+            zoom = fit;
+        }else if(io.MouseWheel != 0.0f){
+            // カーソルの下の点が動かないように拡大縮小する
+            const float mouse_x = center_x + (io.MousePos.x - origin.x - size.x * 0.5f) / zoom;
+            const float mouse_y = center_y + (io.MousePos.y - origin.y - size.y * 0.5f) / zoom;
+            zoom_factor = std::clamp(zoom_factor * std::pow(PREVIEW_WHEEL_STEP, io.MouseWheel), PREVIEW_MIN_ZOOM_FACTOR, PREVIEW_MAX_ZOOM_FACTOR);
+            const float new_zoom = fit * zoom_factor;
+            center_x = mouse_x - (io.MousePos.x - origin.x - size.x * 0.5f) / new_zoom;
+            center_y = mouse_y - (io.MousePos.y - origin.y - size.y * 0.5f) / new_zoom;
+            zoom = new_zoom;
+        }
+    }
+    if(ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left, 0.0f)){
+        const ImVec2 delta = ImGui::GetIO().MouseDelta;
+        center_x -= delta.x / zoom;
+        center_y -= delta.y / zoom;
+    }
+
+    viewport.origin_x = origin.x;
+    viewport.origin_y = origin.y;
+    viewport.width = size.x;
+    viewport.height = size.y;
+    viewport.zoom = zoom;
+    viewport.pan_x = center_x - size.x * 0.5f / zoom;
+    viewport.pan_y = center_y - size.y * 0.5f / zoom;
+}
+
+void VectorPreview::emit() const {
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    const ImVec2 p0(viewport.origin_x, viewport.origin_y);
+    const ImVec2 p1(viewport.origin_x + viewport.width, viewport.origin_y + viewport.height);
+    draw_list->PushClipRect(p0, p1, true);
+    draw_list->AddRectFilled(p0, p1, IM_COL32(255, 255, 255, 255));
+    // cv::Point2f と ImVec2 はどちらも float 2つの並び
+    const ImVec2* points = reinterpret_cast<const ImVec2*>(geometry.points.data());
+    for(const auto& stroke : geometry.strokes){
+        if(stroke.count <= PREVIEW_MAX_POLYLINE_POINTS){
+            draw_list->AddPolyline(points + stroke.first, static_cast<int>(stroke.count), stroke.color,
+                stroke.closed ? ImDrawFlags_Closed : ImDrawFlags_None, 1.0f);
+            continue;
+        }
+        // 長い線は1点ずつ重ねて区切り、閉じる線分は最後に足す
+        uint32_t start = 0;
+        while(start + 1 < stroke.count){
+            const uint32_t count = (std::min)(static_cast<uint32_t>(PREVIEW_MAX_POLYLINE_POINTS), stroke.count - start);
+            draw_list->AddPolyline(points + stroke.first + start, static_cast<int>(count), stroke.color, ImDrawFlags_None, 1.0f);
+            start += count - 1;
+        }
+        if(stroke.closed){
+            draw_list->AddLine(points[stroke.first + stroke.count - 1], points[stroke.first], stroke.color, 1.0f);
+        }
+    }
+    const float radius = std::clamp(viewport.zoom, 1.5f, 4.0f);
+    for(const auto& marker : geometry.markers){
+        draw_list->AddCircleFilled(ImVec2(marker.pos.x, marker.pos.y), radius, marker.color);
+    }
+    draw_list->PopClipRect();
+}
+
+bool VectorPreview::dataChanged(const void* source, uint64_t version) const {
+    return !built || source != built_source || version != built_version;
+}
+
+bool VectorPreview::needsRebuild(const void* source, uint64_t version) {
+    if(!dataChanged(source, version) && viewport == built_viewport && style == built_style){
+        return false;
+    }
+    built = true;
+    built_source = source;
+    built_version = version;
+    built_viewport = viewport;
+    built_style = style;
+    return true;
+}
+
+ImVec2 VectorPreview::draw(const VectorData& data, uint64_t version, VectorView view, int max_width, int max_height) {
+    beginCanvas(static_cast<float>(data.width), static_cast<float>(data.height), max_width, max_height);
+    style.view = view;
+    if(needsRebuild(&data, version)){
+        buildPreviewGeometry(data, viewport, style, geometry);
+    }
+    emit();
+    return ImVec2(viewport.width, viewport.height);
+}
+
+ImVec2 VectorPreview::draw(const InstancedLayout& layout, uint64_t version, VectorView view, int max_width, int max_height) {
+    beginCanvas(static_cast<float>(layout.width), static_cast<float>(layout.height), max_width, max_height);
+    style.view = view;
+    if(needsRebuild(&layout, version)){
+        buildPreviewGeometry(layout, viewport, style, geometry);
+    }
+    emit();
+    return ImVec2(viewport.width, viewport.height);
+}
+
+ImVec2 VectorPreview::draw(const draw_path& path, uint64_t version, float width, float height, int max_width, int max_height) {
+    beginCanvas(width, height, max_width, max_height);
+    if(dataChanged(&path, version)){
+        computeDrawPathBounds(path, path_bounds);
+    }
+    if(needsRebuild(&path, version)){
+        buildPreviewGeometry(path, path_bounds, viewport, style, geometry);
+    }
+    emit();
+    return ImVec2(viewport.width, viewport.height);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "imgui.h"
+
+#include "core/preview_geometry.hpp"
+
+// VectorData / draw_path を cv::Mat に描かずに ImDrawList へ直接描くプレビュー
+// ホイールで拡大縮小、ドラッグで移動、ダブルクリックで全体表示に戻す
+// 線の形 (PreviewGeometry) は、データの版・表示範囲・表示方法のどれかが変わったときだけ作り直す
+class VectorPreview {
+public:
+    // max_width x max_height の中に描き、使った大きさを返す
+    // version はデータを置き換えるたびに変わる番号 (同じなら前に作った形を使う)
+    ImVec2 draw(const VectorData& data, uint64_t version, VectorView view, int max_width, int max_height);
+    // base を置く場所ごとに描く (shared は描かない)
+    ImVec2 draw(const InstancedLayout& layout, uint64_t version, VectorView view, int max_width, int max_height);
+    ImVec2 draw(const draw_path& path, uint64_t version, float data_width, float data_height, int max_width, int max_height);
+    void resetView();
+    // 最後に描いたときの表示範囲 (重ねて描くもの用)
+    const PreviewViewport& getViewport() const { return viewport; }
+
+private:
+    // 表示領域を確保してマウス操作を反映し、今の表示範囲を返す
+    void beginCanvas(float data_width, float data_height, int max_width, int max_height);
+    bool dataChanged(const void* source, uint64_t version) const;
+    // 前に作ったときから何か変わっていれば true を返し、今の状態を覚える
+    bool needsRebuild(const void* source, uint64_t version);
+    void emit() const;
+
+    float zoom_factor = 1.0f; // 1 = 全体が収まる倍率
+    float center_x = 0, center_y = 0; // 表示領域の真ん中に来るデータ座標
+    float data_width = 0, data_height = 0; // 大きさが変わったら全体表示に戻す
+    PreviewViewport viewport;
+    PreviewStyle style;
+    PreviewGeometry geometry; // 作り直すときも確保したメモリは使い回す
+    DrawPathBounds path_bounds; // draw_path の各パスの範囲 (データが変わったときだけ作る)
+
+    // geometry を作ったときの状態
+    bool built = false;
+    const void* built_source = nullptr;
+    uint64_t built_version = 0;
+    PreviewViewport built_viewport;
+    PreviewStyle built_style;
+};
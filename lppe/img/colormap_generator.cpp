@@ -1,10 +1,19 @@
 #include "colormap_generator.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <cfloat>
+#include <cmath>
+#include <array>
+#include <cstdint>
 
 #include <opencv4/opencv2/core/mat.hpp>
+#include <opencv4/opencv2/core/hal/intrin.hpp>
 #include <opencv4/opencv2/imgproc.hpp>
 
+#include "trace/trace.hpp"
+
 bool hex2BGR(const std::string& hex, cv::Scalar& dst) {
     std::string s = hex;
 
@@ -51,6 +60,8 @@ cv::Scalar BGR2Lab(const cv::Scalar& bgr) {
 }
 
 void generateBinaryColorMap(const cv::Mat& src, int threshold, ColorMap& colorMap, cv::Mat& viewMap) {
+    ScopedTrace trace("colormap/binary");
+    trace.count("pixels", static_cast<double>(src.total()));
     if (src.empty() || src.channels() != 3) {
         std::cerr << "Input image is empty or not a 3-channel BGR image." << std::endl;
         return;
@@ -75,237 +86,395 @@ void generateBinaryColorMap(const cv::Mat& src, int threshold, ColorMap& colorMa
     cv::cvtColor(binary, viewMap, cv::COLOR_GRAY2BGR);
 }
 
-void generateMultiColorMap(const cv::Mat& src, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap) {
-    if (src.empty() || src.channels() != 3) {
-        std::cerr << "Input image is empty or not a 3-channel BGR image." << std::endl;
+
+#define UNCLASSIFIED_INDEX (255)
+
+/*
+パレット量子化の共通カーネル
+変換(BGR -> Lab)・無彩色判定・パレットの最近傍探索・indexMap / viewMap / 各色マスクへの書き込みを
+1画素ずつまとめて行い、画像全体を1回だけ走査する
+*/
+struct QuantizePalette {
+    std::vector<cv::Vec3f> lab;          // 有彩色パレット (Lab)
+    std::vector<cv::Vec3b> bgr;          // 出力インデックスごとの表示色 (無彩色 + 有彩色)
+    int achro_offset = 0;                // 無彩色の数 = 有彩色インデックスのオフセット
+    float achro_sensitivity = 0.0f;      // 双円錐型のSがこれ未満なら無彩色
+    std::vector<float> achro_thresholds; // 無彩色の明度しきい値 (Lab L, 昇順)
+    const PaletteLUT* lut = nullptr;     // 有彩色のLUT (nullptrならLab変換して探索)
+};
+
+// 1行分のLabに対してパレットの最近傍インデックスを求める
+// パレットはループの外でSIMDレジスタにブロードキャストし、画素方向にベクトル化する
+static void nearestPaletteRow(const float* lab, int cols, const std::vector<cv::Vec3f>& palette, uchar offset, uchar* dst) {
+    const int K = static_cast<int>(palette.size());
+    if (K == 0) {
+        std::fill(dst, dst + cols, (uchar)UNCLASSIFIED_INDEX);
         return;
     }
-    if (colors.size() < 2) {
-        std::cerr << "At least two colors are required to generate a multi-color map." << std::endl;
-        return;
+
+    int x = 0;
+#if CV_SIMD
+    const int VL = cv::VTraits<cv::v_float32>::vlanes();
+    std::vector<cv::v_float32> pl, pa, pb, pi;
+    pl.reserve(K); pa.reserve(K); pb.reserve(K); pi.reserve(K);
+    for (int k = 0; k < K; ++k) {
+        pl.push_back(cv::vx_setall_f32(palette[k][0]));
+        pa.push_back(cv::vx_setall_f32(palette[k][1]));
+        pb.push_back(cv::vx_setall_f32(palette[k][2]));
+        pi.push_back(cv::vx_setall_f32(static_cast<float>(k)));
+    }
+    float best_buf[cv::VTraits<cv::v_float32>::max_nlanes];
+    for (; x <= cols - VL; x += VL) {
+        cv::v_float32 L, A, B;
+        cv::v_load_deinterleave(lab + 3 * x, L, A, B);
+
+        cv::v_float32 best_d = cv::vx_setall_f32(FLT_MAX);
+        cv::v_float32 best_i = cv::vx_setzero_f32();
+        for (int k = 0; k < K; ++k) {
+            cv::v_float32 dl = cv::v_sub(L, pl[k]);
+            cv::v_float32 da = cv::v_sub(A, pa[k]);
+            cv::v_float32 db = cv::v_sub(B, pb[k]);
+            cv::v_float32 d = cv::v_muladd(dl, dl, cv::v_muladd(da, da, cv::v_mul(db, db)));
+            // 同距離の場合は先の色を優先 (従来の dist < minDist と同じ)
+            cv::v_float32 closer = cv::v_lt(d, best_d);
+            best_d = cv::v_select(closer, d, best_d);
+            best_i = cv::v_select(closer, pi[k], best_i);
+        }
+        cv::v_store(best_buf, best_i);
+        for (int j = 0; j < VL; ++j) {
+            dst[x + j] = static_cast<uchar>(offset + static_cast<int>(best_buf[j]));
+        }
+    }
+#endif
+    for (; x < cols; ++x) {
+        const float* p = lab + 3 * x;
+        float best_d = FLT_MAX;
+        int best_i = 0;
+        for (int k = 0; k < K; ++k) {
+            float dl = p[0] - palette[k][0];
+            float da = p[1] - palette[k][1];
+            float db = p[2] - palette[k][2];
+            float d = dl * dl + da * da + db * db;
+            if (d < best_d) {
+                best_d = d;
+                best_i = k;
+            }
+        }
+        dst[x] = static_cast<uchar>(offset + best_i);
     }
+}
 
-    // 正規化
-    cv::Mat floatMat;
-    src.convertTo(floatMat, CV_32FC3, 1.0 / 255.0);
+// 無彩色の画素をしきい値で分類し、indexを上書きする
+// 双円錐型のS = S_hls * (1 - |2L - 1|) は (max - min) に等しいので、HLS変換は不要
+static void classifyAchroRow(const uchar* bgr, const float* lab, int cols, const QuantizePalette& palette, uchar* dst) {
+    const float sensitivity = palette.achro_sensitivity * 255.0f;
+    const int last = palette.achro_offset - 1;
+    for (int x = 0; x < cols; ++x) {
+        const uchar b = bgr[3 * x], g = bgr[3 * x + 1], r = bgr[3 * x + 2];
+        const int chroma = (std::max)({b, g, r}) - (std::min)({b, g, r});
+        if (chroma >= sensitivity) continue;
+
+        const float L = lab[3 * x];
+        int k = 0;
+        while (k < last && L >= palette.achro_thresholds[k]) ++k;
+        dst[x] = static_cast<uchar>(k);
+    }
+}
 
-    // Lab 変換
-    cv::Mat labMat;
-    cv::cvtColor(floatMat, labMat, cv::COLOR_BGR2Lab);
-    CV_Assert(labMat.type() == CV_32FC3);
+/*
+LUT使用時の明度判定
+Lab L は相対輝度Yの単調増加関数なので、しきい値をYに変換しておけば
+画素ごとには チャンネル別の表3つを足して比較するだけで済む
+*/
+static float srgbToLinear(float c) {
+    return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static const std::array<std::array<float, 256>, 3>& luminanceTables() {
+    // BGRの順
+    static const std::array<std::array<float, 256>, 3> tables = [] {
+        std::array<std::array<float, 256>, 3> t{};
+        const float weights[3] = {0.072169f, 0.715160f, 0.212671f};
+        for (int v = 0; v < 256; ++v) {
+            float lin = srgbToLinear(v / 255.0f);
+            for (int c = 0; c < 3; ++c) t[c][v] = weights[c] * lin;
+        }
+        return t;
+    }();
+    return tables;
+}
 
-    // HLS 変換
-    cv::Mat hlsMat;
-    cv::cvtColor(floatMat, hlsMat, cv::COLOR_BGR2HLS);
-    CV_Assert(hlsMat.type() == CV_32FC3);
+static float labLToLuminance(float L) {
+    float f = (L + 16.0f) / 116.0f;
+    return (L > 8.0f) ? f * f * f : L / 903.3f;
+}
 
-    // colors4print の準備
-    std::vector<std::string> colorNames;
-    std::vector<cv::Scalar> colorValuesBGR;
-    std::vector<cv::Scalar> colorValuesLab;
+static void classifyAchroRowLUT(const uchar* bgr, int cols, const QuantizePalette& palette,
+    const std::vector<float>& thresholds_y, uchar* dst) {
+    const auto& tables = luminanceTables();
+    const float sensitivity = palette.achro_sensitivity * 255.0f;
+    const int last = palette.achro_offset - 1;
+    for (int x = 0; x < cols; ++x) {
+        const uchar b = bgr[3 * x], g = bgr[3 * x + 1], r = bgr[3 * x + 2];
+        const int chroma = (std::max)({b, g, r}) - (std::min)({b, g, r});
+        if (chroma >= sensitivity) continue;
+
+        const float Y = tables[0][b] + tables[1][g] + tables[2][r];
+        int k = 0;
+        while (k < last && Y >= thresholds_y[k]) ++k;
+        dst[x] = static_cast<uchar>(k);
+    }
+}
+
+static void lookupPaletteRow(const uchar* bgr, int cols, const QuantizePalette& palette, uchar* dst) {
+    if (palette.lab.empty()) {
+        std::fill(dst, dst + cols, (uchar)UNCLASSIFIED_INDEX);
+        return;
+    }
+    const uchar* table = palette.lut->table.data();
+    const uchar offset = static_cast<uchar>(palette.achro_offset);
+    for (int x = 0; x < cols; ++x) {
+        const uint32_t key = (uint32_t(bgr[3 * x]) << 16) | (uint32_t(bgr[3 * x + 1]) << 8) | bgr[3 * x + 2];
+        dst[x] = static_cast<uchar>(offset + table[key]);
+    }
+}
+
+bool PaletteLUT::matches(const Colors& colors) const {
+    if (hexes.size() != colors.size()) return false;
+    for (size_t i = 0; i < colors.size(); ++i) {
+        if (hexes[i] != colors[i].second) return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const PaletteLUT> buildPaletteLUT(const Colors& colors) {
+    auto lut = std::make_shared<PaletteLUT>();
+    std::vector<cv::Vec3f> palette;
     for (const auto& [name, hex] : colors) {
         cv::Scalar bgrColor;
         hex2BGR(hex, bgrColor);
         cv::Scalar labColor = BGR2Lab(bgrColor);
-        colorNames.push_back(name);
-        colorValuesBGR.push_back(bgrColor);
-        colorValuesLab.push_back(labColor);
+        lut->hexes.push_back(hex);
+        palette.emplace_back((float)labColor[0], (float)labColor[1], (float)labColor[2]);
+    }
+    if (palette.empty() || palette.size() >= UNCLASSIFIED_INDEX) {
+        return lut;
     }
 
-    // 出力マップ準備
-    cv::Mat indexMap(src.size(), CV_8UC1, cv::Scalar(255)); // 255 = 未分類
-    cv::Mat minDist(src.size(), CV_32F, cv::Scalar(FLT_MAX));
-    //cv::Mat achroMask; // achroの時のみ使用
+    lut->table.resize(size_t(1) << 24);
+    // b ごとに 256x256 (g, r) の面を作り、まとめてLab変換して探索する
+    cv::parallel_for_(cv::Range(0, 256), [&](const cv::Range& range) {
+        cv::Mat plane(256, 256, CV_8UC3);
+        cv::Mat floatPlane, labPlane;
+        for (int b = range.start; b < range.end; ++b) {
+            for (int g = 0; g < 256; ++g) {
+                cv::Vec3b* row = plane.ptr<cv::Vec3b>(g);
+                for (int r = 0; r < 256; ++r) {
+                    row[r] = cv::Vec3b((uchar)b, (uchar)g, (uchar)r);
+                }
+            }
+            plane.convertTo(floatPlane, CV_32FC3, 1.0 / 255.0);
+            cv::cvtColor(floatPlane, labPlane, cv::COLOR_BGR2Lab);
+            for (int g = 0; g < 256; ++g) {
+                uchar* dst = lut->table.data() + ((size_t(b) << 16) | (size_t(g) << 8));
+                nearestPaletteRow(labPlane.ptr<float>(g), 256, palette, 0, dst);
+            }
+        }
+    });
+    return lut;
+}
+
+static void quantizeToPalette(const cv::Mat& src, const QuantizePalette& palette,
+    cv::Mat& indexMap, cv::Mat& viewMap, std::vector<cv::Mat>& masks, std::vector<int>& counts) {
+    CV_Assert(src.type() == CV_8UC3);
+
+    const int colors = static_cast<int>(palette.bgr.size());
+    CV_Assert(colors > 0 && colors < UNCLASSIFIED_INDEX);
 
-    cv::Mat dist(labMat.size(), CV_32F);
+    indexMap.create(src.size(), CV_8UC1);
+    viewMap.create(src.size(), CV_8UC3);
+    masks.assign(colors, cv::Mat());
+    for (auto& mask : masks) {
+        mask = cv::Mat::zeros(src.size(), CV_8UC1);
+    }
+    counts.assign(colors, 0);
 
-    for (size_t i = 0; i < colorValuesLab.size(); ++i) {
+    const cv::Vec3b white(255, 255, 255);
+    std::mutex counts_mtx;
 
-        cv::Vec3f c((float)colorValuesLab[i][0],
-                    (float)colorValuesLab[i][1],
-                    (float)colorValuesLab[i][2]);
+    std::vector<float> thresholds_y;
+    for (float t : palette.achro_thresholds) {
+        thresholds_y.push_back(labLToLuminance(t));
+    }
 
-        cv::parallel_for_(cv::Range(0, labMat.rows), [&](const cv::Range& range) {
-            for (int y = range.start; y < range.end; y++) {
-                const cv::Vec3f* src = labMat.ptr<cv::Vec3f>(y);
-                float* dptr = dist.ptr<float>(y);
-                for (int x = 0; x < labMat.cols; x++) {
-                    cv::Vec3f v = src[x] - c;
-                    dptr[x] = v.dot(v);
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        const int cols = src.cols;
+        cv::Mat floatRow(1, cols, CV_32FC3);
+        cv::Mat labRow(1, cols, CV_32FC3);
+        std::vector<int> local_counts(colors, 0);
+        std::vector<uchar*> mask_rows(colors);
+
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* srow = src.ptr<uchar>(y);
+            uchar* idx = indexMap.ptr<uchar>(y);
+            if (palette.lut) {
+                lookupPaletteRow(srow, cols, palette, idx);
+                if (palette.achro_offset > 0) {
+                    classifyAchroRowLUT(srow, cols, palette, thresholds_y, idx);
+                }
+            } else {
+                src.row(y).convertTo(floatRow, CV_32FC3, 1.0 / 255.0);
+                cv::cvtColor(floatRow, labRow, cv::COLOR_BGR2Lab);
+                const float* lab = labRow.ptr<float>(0);
+
+                nearestPaletteRow(lab, cols, palette.lab, static_cast<uchar>(palette.achro_offset), idx);
+                if (palette.achro_offset > 0) {
+                    classifyAchroRow(srow, lab, cols, palette, idx);
+                }
+            }
+
+            cv::Vec3b* view = viewMap.ptr<cv::Vec3b>(y);
+            for (int i = 0; i < colors; ++i) {
+                mask_rows[i] = masks[i].ptr<uchar>(y);
+            }
+            for (int x = 0; x < cols; ++x) {
+                const uchar i = idx[x];
+                if (i == UNCLASSIFIED_INDEX) {
+                    // 有彩色が無い場合の有彩色画素はどの色にも属さない
+                    view[x] = white;
+                    idx[x] = 0;
+                    continue;
                 }
+                view[x] = palette.bgr[i];
+                mask_rows[i][x] = 255;
+                ++local_counts[i];
             }
-        });
+        }
+
+        std::lock_guard<std::mutex> lock(counts_mtx);
+        for (int i = 0; i < colors; ++i) {
+            counts[i] += local_counts[i];
+        }
+    });
+}
+
+static void appendChromaticColors(const Colors& colors, QuantizePalette& palette,
+    std::vector<std::string>& colorNames, std::vector<cv::Scalar>& colorValuesBGR) {
+    for (const auto& [name, hex] : colors) {
+        cv::Scalar bgrColor;
+        hex2BGR(hex, bgrColor);
+        cv::Scalar labColor = BGR2Lab(bgrColor);
+        colorNames.push_back(name);
+        colorValuesBGR.push_back(bgrColor);
+        palette.lab.emplace_back((float)labColor[0], (float)labColor[1], (float)labColor[2]);
+        palette.bgr.emplace_back((uchar)bgrColor[0], (uchar)bgrColor[1], (uchar)bgrColor[2]);
+    }
+}
+
+void generateMultiColorMap(const cv::Mat& src, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap,
+    const PaletteLUT* lut) {
+    ScopedTrace trace("colormap/multi");
+    trace.count("pixels", static_cast<double>(src.total()));
+    if (src.empty() || src.channels() != 3) {
+        std::cerr << "Input image is empty or not a 3-channel BGR image." << std::endl;
+        return;
+    }
+    if (colors.size() < 2) {
+        std::cerr << "At least two colors are required to generate a multi-color map." << std::endl;
+        return;
+    }
 
-        cv::Mat mask = dist < minDist;
-        dist.copyTo(minDist, mask);
-        indexMap.setTo((uchar)i, mask);
+    // colors4print の準備
+    QuantizePalette palette;
+    std::vector<std::string> colorNames;
+    std::vector<cv::Scalar> colorValuesBGR;
+    appendChromaticColors(colors, palette, colorNames, colorValuesBGR);
+    if (lut && lut->matches(colors) && !lut->table.empty()) {
+        palette.lut = lut;
     }
 
-    viewMap = cv::Mat::zeros(src.size(), CV_8UC3);
-    viewMap.setTo(cv::Scalar(255, 255, 255));
+    cv::Mat indexMap;
+    std::vector<cv::Mat> masks;
+    std::vector<int> counts;
+    quantizeToPalette(src, palette, indexMap, viewMap, masks, counts);
 
     colorMap.colorMap = indexMap;
     colorMap.MapOfColor.clear();
     colorMap.MapOfColorName.clear();
 
     for (size_t i = 0; i < colorValuesBGR.size(); ++i) {
-        cv::Mat mask = (indexMap == (uchar)i);
-        if(cv::countNonZero(mask) > 0) {
-            viewMap.setTo(colorValuesBGR[i], mask);
-            colorMap.MapOfColor[i] = mask;
+        if(counts[i] > 0) {
+            colorMap.MapOfColor[i] = masks[i];
             colorMap.MapOfColorName[i] = colorNames[i];
         }
     }
 }
 
 void generateAchroColorMap(const cv::Mat& src, float achro_sensitivity, std::vector<float>& achro_thresholds,
-    Colors& achro_colors, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap) {
+    Colors& achro_colors, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap, const PaletteLUT* lut) {
+    ScopedTrace trace("colormap/achro");
+    trace.count("pixels", static_cast<double>(src.total()));
 
     if (src.empty() || src.channels() != 3) {
         std::cerr << "Input image is empty or not a 3-channel BGR image." << std::endl;
         return;
     }
-    if (achro_colors.size() < 2) {
-        std::cerr << "At least two achromatic colors are required." << std::endl;
+    if (achro_colors.empty()) {
+        // 無彩色が無ければ、有彩色だけの色分けと同じ
+        generateMultiColorMap(src, colors, colorMap, viewMap, lut);
         return;
     }
 
-    // 正規化
-    cv::Mat floatMat;
-    src.convertTo(floatMat, CV_32FC3, 1.0 / 255.0);
-
-    // Lab 変換
-    cv::Mat labMat;
-    cv::cvtColor(floatMat, labMat, cv::COLOR_BGR2Lab);
-    CV_Assert(labMat.type() == CV_32FC3);
-
-    // HLS 変換
-    cv::Mat hlsMat;
-    cv::cvtColor(floatMat, hlsMat, cv::COLOR_BGR2HLS);
-    CV_Assert(hlsMat.type() == CV_32FC3);
+    const int achro_offset = static_cast<int>(achro_colors.size());
+    if (achro_offset > 4) {
+        std::cerr << "achro_colors: at most 4 achromatic colors are supported (got " << achro_offset << ")." << std::endl;
+        return;
+    }
+    if (achro_thresholds.size() < static_cast<size_t>(achro_offset - 1)) {
+        std::cerr << "achro_thresholds: " << (achro_offset - 1) << " thresholds are required for "
+            << achro_offset << " achromatic colors (got " << achro_thresholds.size() << ")." << std::endl;
+        return;
+    }
 
-    // colors4print の準備
-    std::vector<std::string> colorNames;
-    std::vector<cv::Scalar> colorValuesBGR;
-    std::vector<cv::Scalar> colorValuesLab;
-    for (const auto& [name, hex] : colors) {
+    // 黒・灰・白 + colors4print の準備
+    QuantizePalette palette;
+    palette.achro_offset = achro_offset;
+    palette.achro_sensitivity = achro_sensitivity;
+    palette.achro_thresholds.assign(achro_thresholds.begin(), achro_thresholds.begin() + (achro_offset - 1));
+    std::vector<cv::Scalar> achroValuesBGR;
+    for (const auto& [name, hex] : achro_colors) {
         cv::Scalar bgrColor;
         hex2BGR(hex, bgrColor);
-        cv::Scalar labColor = BGR2Lab(bgrColor);
-        colorNames.push_back(name);
-        colorValuesBGR.push_back(bgrColor);
-        colorValuesLab.push_back(labColor);
+        achroValuesBGR.push_back(bgrColor);
+        palette.bgr.emplace_back((uchar)bgrColor[0], (uchar)bgrColor[1], (uchar)bgrColor[2]);
     }
-
-    // 出力マップ準備
-    cv::Mat indexMap(src.size(), CV_8UC1, cv::Scalar(255)); // 255 = 未分類
-    cv::Mat minDist(src.size(), CV_32F, cv::Scalar(FLT_MAX));
-    cv::Mat achroMask;
-
-    // 無彩色検出
-    cv::Mat L_hls, S_cyl, L_lab;
-    cv::extractChannel(hlsMat, L_hls, 1); // 0:H, 1:L, 2:S
-    cv::extractChannel(hlsMat, S_cyl, 2);
-    cv::extractChannel(labMat, L_lab, 0);
-
-    // 双円錐型のS
-    cv::Mat S_double = S_cyl.mul(1.0f - cv::abs(L_hls * 2.0f - 1.0f));
-
-    // 無彩色マスク
-    achroMask = (S_double < achro_sensitivity);
-
-    int achro_offset = achro_colors.size();
-
-    // 黒・灰・白分類
-    if(achro_offset == 2) {
-        cv::Mat blackMask = achroMask & (L_lab < achro_thresholds[0]);
-        cv::Mat whiteMask = achroMask & (L_lab >= achro_thresholds[0]);
-        indexMap.setTo((uchar)0, blackMask);
-        indexMap.setTo((uchar)1, whiteMask);
-        colorMap.MapOfColor[0] = blackMask;
-        colorMap.MapOfColorName[0] = achro_colors[0].first;
-        colorMap.MapOfColor[1] = whiteMask;
-        colorMap.MapOfColorName[1] = achro_colors[1].first;
-    } else if(achro_offset == 3) {
-        cv::Mat blackMask = achroMask & (L_lab < achro_thresholds[0]);
-        cv::Mat grayMask = achroMask & (L_lab >= achro_thresholds[0]) & (L_lab < achro_thresholds[1]);
-        cv::Mat whiteMask = achroMask & (L_lab >= achro_thresholds[1]);
-        indexMap.setTo((uchar)0, blackMask);
-        indexMap.setTo((uchar)1, grayMask);
-        indexMap.setTo((uchar)2, whiteMask);
-        colorMap.MapOfColor[0] = blackMask;
-        colorMap.MapOfColorName[0] = achro_colors[0].first;
-        colorMap.MapOfColor[1] = grayMask;
-        colorMap.MapOfColorName[1] = achro_colors[1].first;
-        colorMap.MapOfColor[2] = whiteMask;
-        colorMap.MapOfColorName[2] = achro_colors[2].first;
-    } else if(achro_offset == 4) {
-        cv::Mat blackMask = achroMask & (L_lab < achro_thresholds[0]);
-        cv::Mat darkGrayMask = achroMask & (L_lab >= achro_thresholds[0]) & (L_lab < achro_thresholds[1]);
-        cv::Mat lightGrayMask = achroMask & (L_lab >= achro_thresholds[1]) & (L_lab < achro_thresholds[2]);
-        cv::Mat whiteMask = achroMask & (L_lab >= achro_thresholds[2]);
-        indexMap.setTo((uchar)0, blackMask);
-        indexMap.setTo((uchar)1, darkGrayMask);
-        indexMap.setTo((uchar)2, lightGrayMask);
-        indexMap.setTo((uchar)3, whiteMask);
-        colorMap.MapOfColor[0] = blackMask;
-        colorMap.MapOfColorName[0] = achro_colors[0].first;
-        colorMap.MapOfColor[1] = darkGrayMask;
-        colorMap.MapOfColorName[1] = achro_colors[1].first;
-        colorMap.MapOfColor[2] = lightGrayMask;
-        colorMap.MapOfColorName[2] = achro_colors[2].first;
-        colorMap.MapOfColor[3] = whiteMask;
-        colorMap.MapOfColorName[3] = achro_colors[3].first;
-    } else {
-        std::cerr << "Unsupported number of achromatic colors: " << achro_offset << std::endl;
-        return;
+    std::vector<std::string> colorNames;
+    std::vector<cv::Scalar> colorValuesBGR;
+    appendChromaticColors(colors, palette, colorNames, colorValuesBGR);
+    // 有彩色が無い場合は探索自体が不要なので、空のLUTも受け付ける
+    if (lut && lut->matches(colors) && (!lut->table.empty() || colors.empty())) {
+        palette.lut = lut;
     }
 
-    cv::Mat dist(labMat.size(), CV_32F);
-
-    for (size_t i = 0; i < colorValuesLab.size(); ++i) {
-        cv::Vec3f c((float)colorValuesLab[i][0],
-                    (float)colorValuesLab[i][1],
-                    (float)colorValuesLab[i][2]);
-
-        cv::parallel_for_(cv::Range(0, labMat.rows), [&](const cv::Range& range) {
-            for (int y = range.start; y < range.end; y++) {
-                const cv::Vec3f* src = labMat.ptr<cv::Vec3f>(y);
-                float* dptr = dist.ptr<float>(y);
-                for (int x = 0; x < labMat.cols; x++) {
-                    cv::Vec3f v = src[x] - c;
-                    dptr[x] = v.dot(v);
-                }
-            }
-        });
-
-        cv::Mat mask = dist < minDist;
-        mask &= ~achroMask;
-        dist.copyTo(minDist, mask);
-        indexMap.setTo((uchar)(i + achro_offset), mask);
-    }
+    cv::Mat indexMap;
+    std::vector<cv::Mat> masks;
+    std::vector<int> counts;
+    quantizeToPalette(src, palette, indexMap, viewMap, masks, counts);
 
-    viewMap = cv::Mat::zeros(src.size(), CV_8UC3);
-    viewMap.setTo(cv::Scalar(255, 255, 255));
+    colorMap.colorMap = indexMap;
+    colorMap.MapOfColor.clear();
+    colorMap.MapOfColorName.clear();
+    colorMap.MapOfColorValueBGR.clear();
 
-    for(size_t i = 0; i < achro_offset; ++i) {
-        cv::Scalar bgrColor;
-        hex2BGR(achro_colors[i].second, bgrColor);
-        viewMap.setTo(bgrColor, colorMap.MapOfColor[i]);
-        colorMap.MapOfColorValueBGR[i] = bgrColor;
+    for(int i = 0; i < achro_offset; ++i) {
+        colorMap.MapOfColor[i] = masks[i];
+        colorMap.MapOfColorName[i] = achro_colors[i].first;
+        colorMap.MapOfColorValueBGR[i] = achroValuesBGR[i];
     }
 
     for(size_t i = 0; i < colorValuesBGR.size(); ++i) {
-        cv::Mat mask = (indexMap == (uchar)(i + achro_offset));
-        viewMap.setTo(colorValuesBGR[i], mask);
-        colorMap.MapOfColor[i + achro_offset] = mask;
+        colorMap.MapOfColor[i + achro_offset] = masks[i + achro_offset];
         colorMap.MapOfColorName[i + achro_offset] = colorNames[i];
         colorMap.MapOfColorValueBGR[i + achro_offset] = colorValuesBGR[i];
     }
-
-    // set ColorMap.colorMap
-    colorMap.colorMap = cv::Mat::zeros(src.size(), CV_8UC1);
-    for(const auto& [id, mask] : colorMap.MapOfColor) {
-        colorMap.colorMap.setTo((uchar)id, mask);
-    }
 }
@@ -2,6 +2,8 @@
 
 #include <map>
 #include <vector>
+#include <memory>
+#include <string>
 
 #include <opencv4/opencv2/core/mat.hpp>
 
@@ -30,8 +32,25 @@ struct ColorMap {
 
 using Colors = std::vector<std::pair<std::string, std::string>>; // first: name, second: hex color code
 
+/*
+有彩色パレットの3次元LUT
+BGR(24bit)ごとに最も近いパレットのインデックスを保持する (2^24エントリ, 16MB)
+パレットが同じなら使い回せるので、スライダー操作のたびにLab変換をやり直さなくてよい
+*/
+struct PaletteLUT {
+    std::vector<std::string> hexes; // LUTを作ったときのパレット
+    std::vector<uchar> table;       // index = (b << 16) | (g << 8) | r
+
+    bool matches(const Colors& colors) const;
+};
+
+std::shared_ptr<const PaletteLUT> buildPaletteLUT(const Colors& colors);
+
 void generateBinaryColorMap(const cv::Mat& src, int threshold, ColorMap& colorMap, cv::Mat& viewMap);
-void generateMultiColorMap(const cv::Mat& src, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap);
+// lut が nullptr でなければ、Lab変換の代わりにLUTを引いて量子化する (Multi と Achro)
+void generateMultiColorMap(const cv::Mat& src, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap,
+    const PaletteLUT* lut = nullptr);
+// achro_colors は0〜4色、achro_thresholds はその数 - 1 個 (0色なら generateMultiColorMap と同じ)
 void generateAchroColorMap(const cv::Mat& src, float achro_sensitivity, std::vector<float>& achro_thresholds,
-    Colors& achro_colors, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap);
+    Colors& achro_colors, Colors& colors, ColorMap& colorMap, cv::Mat& viewMap, const PaletteLUT* lut = nullptr);
 bool convertHexToBGR(const std::string& hex, int &b, int &g, int &r);
@@ -0,0 +1,149 @@
+#include "content_hash.hpp"
+
+#include <cstring>
+
+// xxHash64 の定数
+#define XXH_PRIME64_1 (0x9E3779B185EBCA87ULL)
+#define XXH_PRIME64_2 (0xC2B2AE3D27D4EB4FULL)
+#define XXH_PRIME64_3 (0x165667B19E3779F9ULL)
+#define XXH_PRIME64_4 (0x85EBCA77C2B2AE63ULL)
+#define XXH_PRIME64_5 (0x27D4EB2F165667C5ULL)
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxhMergeRound(uint64_t acc, uint64_t val) {
+    acc ^= xxhRound(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    uint64_t h;
+
+    // 32バイトずつ4本の列で混ぜる (画像全体を回すので速さが要る)
+    if (size >= 32) {
+        const unsigned char* const limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        do {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMergeRound(h, v1);
+        h = xxhMergeRound(h, v2);
+        h = xxhMergeRound(h, v3);
+        h = xxhMergeRound(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += static_cast<uint64_t>(size);
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxhRound(0, read64(p));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    // 最後に全ビットを混ぜる (近い入力でも上位ビットまで変わるように)
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hashString(const std::string& str, uint64_t seed) {
+    return hashBytes(str.data(), str.size(), seed);
+}
+
+uint64_t hashMat(const cv::Mat& mat, uint64_t seed) {
+    uint64_t h = seed;
+    const int header[3] = {mat.rows, mat.cols, mat.type()};
+    h = hashBytes(header, sizeof(header), h);
+    if (mat.empty()) {
+        return h;
+    }
+
+    // 連続かどうかで値が変わらないよう、常に行ごとに混ぜる
+    const size_t row_bytes = mat.cols * mat.elemSize();
+    for (int y = 0; y < mat.rows; ++y) {
+        h = hashBytes(mat.ptr(y), row_bytes, h);
+    }
+    return h;
+}
+
+uint64_t hashCombine(uint64_t seed, uint64_t value) {
+    return hashBytes(&value, sizeof(value), seed);
+}
+
+// ダイジェストの2つ目に使う seed (1つ目は HASH_SEED)
+#define DIGEST_SEED_2 (0x6A09E667F3BCC908ULL)
+
+CacheKey::CacheKey(const std::string& stage, uint32_t version) {
+    add(stage);
+    add(version);
+}
+
+CacheKey& CacheKey::add(const std::string& str) {
+    add(static_cast<uint32_t>(str.size()));
+    bytes.append(str);
+    return *this;
+}
+
+CacheKey& CacheKey::addDigest(const void* data, size_t size) {
+    add(static_cast<uint64_t>(size));
+    add(hashBytes(data, size, HASH_SEED));
+    return add(hashBytes(data, size, DIGEST_SEED_2));
+}
+
+CacheKey& CacheKey::addMat(const cv::Mat& mat) {
+    add(static_cast<int32_t>(mat.rows));
+    add(static_cast<int32_t>(mat.cols));
+    add(static_cast<int32_t>(mat.type()));
+    add(hashMat(mat, HASH_SEED));
+    return add(hashMat(mat, DIGEST_SEED_2));
+}
+
+CacheKey& CacheKey::addKey(const CacheKey& key) {
+    return add(key.bytes);
+}
+
+uint64_t CacheKey::hash() const {
+    return hashString(bytes);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+#include <opencv4/opencv2/core/mat.hpp>
+
+/*
+Content Hash
+キャッシュのキーに使う64bitハッシュ (xxHash64、seed に前の値を渡してつなげる)
+暗号学的な強さは無いので、キーの衝突検出には使わないこと (ディスクキャッシュは中身の入力も比べる)
+*/
+
+constexpr uint64_t HASH_SEED = 0;
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = HASH_SEED);
+uint64_t hashString(const std::string& str, uint64_t seed = HASH_SEED);
+// サイズ・型・画素値から計算する (連続でないMatも可)
+uint64_t hashMat(const cv::Mat& mat, uint64_t seed = HASH_SEED);
+uint64_t hashCombine(uint64_t seed, uint64_t value);
+
+template <typename T>
+uint64_t hashValue(const T& value, uint64_t seed = HASH_SEED) {
+    static_assert(std::is_trivially_copyable_v<T>, "hashValue requires a trivially copyable type");
+    return hashBytes(&value, sizeof(T), seed);
+}
+
+/*
+Cache Key
+キャッシュのキー: 段の名前・アルゴリズムの版・結果に効く設定を、そのまま並べたバイト列
+画像などの大きな入力だけは128bitのダイジェスト (seed の違う2つのハッシュ) を入れる
+同じかどうかはバイト列で比べる。hash() はファイル名やメモリ上の探索に使うだけ
+*/
+class CacheKey {
+    public:
+        CacheKey() = default;
+        // version はその段の出力が変わる変更をしたら上げる
+        CacheKey(const std::string& stage, uint32_t version);
+
+        template <typename T>
+        CacheKey& add(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "CacheKey::add requires a trivially copyable type");
+            static_assert(!std::is_pointer_v<T> && !std::is_array_v<T>, "CacheKey::add takes values, not pointers");
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+            return *this;
+        }
+        CacheKey& add(const std::string& str);
+        CacheKey& addDigest(const void* data, size_t size);
+        // サイズ・型と画素値のダイジェスト
+        CacheKey& addMat(const cv::Mat& mat);
+        // 前の段のキーをそのまま含める
+        CacheKey& addKey(const CacheKey& key);
+
+        uint64_t hash() const;
+        const std::string& data() const { return bytes; }
+        bool operator==(const CacheKey& other) const { return bytes == other.bytes; }
+    private:
+        std::string bytes;
+};
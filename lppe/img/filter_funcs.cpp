@@ -1,11 +1,18 @@
 #include "filter_funcs.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 #include <opencv4/opencv2/core/mat.hpp>
 #include <opencv4/opencv2/imgproc.hpp>
+#include <opencv4/opencv2/ximgproc.hpp>
+
+#include "job/job.hpp"
+#include "trace/trace.hpp"
 
 void convertToGrayScale(const cv::Mat& src, cv::Mat& dst, GrayscaleMode mode){
+    ScopedTrace trace("filter/grayscale");
+    trace.count("pixels", static_cast<double>(src.total()));
     cv::Mat floatMat, labMat, floatGray, gray;
 
     switch (mode){
@@ -26,12 +33,78 @@ void convertToGrayScale(const cv::Mat& src, cv::Mat& dst, GrayscaleMode mode){
     }
 }
 
-void bilateral(const cv::Mat& src, cv::Mat& dst, int diameter, double sigmaColor, double sigmaSpace, int loops) {
-    cv::Mat current = src.clone();
+static void bilateralExact(const cv::Mat& src, cv::Mat& dst, int diameter, double sigmaColor, double sigmaSpace, int loops) {
+    // cv::bilateralFilter はin-place不可なので、2枚のバッファを交互に使う
+    cv::Mat buffers[2];
+    const cv::Mat* current = &src;
     for (int i = 0; i < loops; ++i) {
-        cv::bilateralFilter(current, dst, diameter, sigmaColor, sigmaSpace);
-        if(i < loops - 1){
-            current = dst.clone();
-        }
+        checkCancelled();
+        cv::Mat& next = buffers[i & 1];
+        cv::bilateralFilter(*current, next, diameter, sigmaColor, sigmaSpace);
+        current = &next;
+    }
+    dst = *current;
+}
+
+static void bilateralFast(const cv::Mat& src, cv::Mat& dst, int diameter, double sigmaColor, double sigmaSpace, int loops) {
+    // bilateralFilter は半径 diameter/2 で打ち切られるので、空間方向のσもそれに合わせる
+    const double sigmaSpatial = std::max(0.5, std::min(sigmaSpace, diameter * 0.5));
+    const double sigmaRange = (sigmaColor > 0.0) ? sigmaColor : 1.0;
+
+    cv::Mat buffers[2];
+    const cv::Mat* current = &src;
+    for (int i = 0; i < loops; ++i) {
+        checkCancelled();
+        cv::Mat& next = buffers[i & 1];
+        cv::ximgproc::dtFilter(*current, *current, next, sigmaSpatial, sigmaRange, cv::ximgproc::DTF_RF, 3);
+        current = &next;
+    }
+    dst = *current;
+}
+
+#define BILATERAL_VALIDATION_SIZE (128)
+
+void bilateral(const cv::Mat& src, cv::Mat& dst, int diameter, double sigmaColor, double sigmaSpace, int loops,
+    BilateralMode mode, double max_error) {
+    ScopedTrace trace("filter/bilateral");
+    trace.count("pixels", static_cast<double>(src.total()));
+    if (loops < 1) {
+        dst = src.clone();
+        return;
+    }
+    if (mode == BilateralMode::Exact) {
+        bilateralExact(src, dst, diameter, sigmaColor, sigmaSpace, loops);
+        return;
+    }
+
+    // 検証領域 (中央) と、その外側で Exact の結果に影響する範囲
+    const int margin = loops * (diameter / 2);
+    const int size = BILATERAL_VALIDATION_SIZE;
+    if (src.cols < size + 2 * margin || src.rows < size + 2 * margin) {
+        // 小さい画像では Exact でも十分速い
+        bilateralExact(src, dst, diameter, sigmaColor, sigmaSpace, loops);
+        return;
+    }
+
+    cv::Mat fast;
+    bilateralFast(src, fast, diameter, sigmaColor, sigmaSpace, loops);
+
+    const cv::Rect inner((src.cols - size) / 2, (src.rows - size) / 2, size, size);
+    const cv::Rect outer(inner.x - margin, inner.y - margin, size + 2 * margin, size + 2 * margin);
+    cv::Mat exactCrop;
+    bilateralExact(src(outer), exactCrop, diameter, sigmaColor, sigmaSpace, loops);
+
+    cv::Mat absDiff;
+    cv::absdiff(exactCrop(cv::Rect(margin, margin, size, size)), fast(inner), absDiff);
+    const cv::Scalar diff = cv::mean(absDiff);
+    double error = 0.0;
+    for (int c = 0; c < src.channels(); ++c) error += diff[c];
+    error /= src.channels();
+
+    if (error > max_error) {
+        std::cerr << "bilateral : fast mode error " << error << " exceeds " << max_error << ", falling back to exact" << std::endl;
+        bilateralExact(src, dst, diameter, sigmaColor, sigmaSpace, loops);
+        return;
     }
+    dst = fast;
 }
@@ -7,4 +7,11 @@ enum class GrayscaleMode {
     Default,
 };
 void convertToGrayScale(const cv::Mat& src, cv::Mat& dst, GrayscaleMode mode = GrayscaleMode::Lab);
-void bilateral(const cv::Mat& src, cv::Mat& dst, int diameter, double sigmaColor, double sigmaSpace, int loops);
+
+enum class BilateralMode {
+    Exact, // cv::bilateralFilter を loops 回
+    Fast,  // ドメイン変換フィルタ (1画素あたりO(1)) で近似
+};
+// Fast のとき、中央の一部で Exact と比較し、平均絶対誤差が max_error を超えたら Exact で計算し直す
+void bilateral(const cv::Mat& src, cv::Mat& dst, int diameter, double sigmaColor, double sigmaSpace, int loops,
+    BilateralMode mode = BilateralMode::Exact, double max_error = 2.0);
@@ -0,0 +1,295 @@
+#include "tiling.hpp"
+
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <unordered_map>
+
+#include <opencv4/opencv2/imgproc.hpp>
+
+#include "vector_data.hpp"
+#include "job/job.hpp"
+
+#define MIN_TILE_SIZE (64)
+
+int tileSizeForBudget(const TileSettings& settings, size_t bytes_per_pixel, int halo) {
+    const double budget = static_cast<double>(settings.memory_budget_mb) * 1024.0 * 1024.0;
+    const int outer = static_cast<int>(std::sqrt(budget / (std::max)(bytes_per_pixel, size_t(1))));
+    return (std::max)(MIN_TILE_SIZE, outer - 2 * halo);
+}
+
+TileGrid makeTiles(cv::Size size, int tile_size, int halo) {
+    TileGrid grid;
+    if (size.width <= 0 || size.height <= 0 || tile_size <= 0) {
+        return grid;
+    }
+    const cv::Rect bounds(0, 0, size.width, size.height);
+    grid.rows = (size.height + tile_size - 1) / tile_size;
+    grid.cols = (size.width + tile_size - 1) / tile_size;
+    grid.tiles.reserve(grid.rows * grid.cols);
+    for (int y = 0; y < size.height; y += tile_size) {
+        for (int x = 0; x < size.width; x += tile_size) {
+            Tile tile;
+            tile.inner = cv::Rect(x, y, (std::min)(tile_size, size.width - x), (std::min)(tile_size, size.height - y));
+            tile.outer = cv::Rect(x - halo, y - halo, tile.inner.width + 2 * halo, tile.inner.height + 2 * halo) & bounds;
+            grid.tiles.push_back(tile);
+        }
+    }
+    return grid;
+}
+
+void forEachTile(const cv::Mat& src, cv::Mat& dst, int halo, size_t bytes_per_pixel, const TileSettings& settings,
+    const std::function<void(const cv::Mat& in, cv::Mat& out)>& op) {
+    if (!settings.enabled) {
+        cv::Mat out;
+        op(src, out);
+        out.copyTo(dst);
+        return;
+    }
+
+    // dst と src が同じMatでも、後のタイルの halo を壊さないよう別に確保する
+    cv::Mat result(src.size(), CV_8UC1);
+    const TileGrid grid = makeTiles(src.size(), tileSizeForBudget(settings, bytes_per_pixel, halo), halo);
+    for (const Tile& tile : grid.tiles) {
+        checkCancelled();
+        cv::Mat out;
+        op(src(tile.outer), out);
+        CV_Assert(out.size() == tile.outer.size() && out.type() == CV_8UC1);
+        const cv::Rect local(tile.inner.x - tile.outer.x, tile.inner.y - tile.outer.y, tile.inner.width, tile.inner.height);
+        out(local).copyTo(result(tile.inner));
+    }
+    result.copyTo(dst); // dst が他と共有しているデータなら、その中身を書き換える (cv::morphologyEx と同じ)
+}
+
+void morphologyTiled(const cv::Mat& src, cv::Mat& dst, int op, const cv::Mat& element, const TileSettings& settings) {
+    if (!settings.enabled) {
+        cv::morphologyEx(src, dst, op, element);
+        return;
+    }
+    // erode/dilate は半径分、open/close など2段のものは2倍の範囲を見る
+    const int radius = (std::max)(element.cols, element.rows) / 2;
+    const int halo = (op == cv::MORPH_ERODE || op == cv::MORPH_DILATE) ? radius : 2 * radius;
+    forEachTile(src, dst, halo, 3, settings, [&](const cv::Mat& in, cv::Mat& out) {
+        cv::morphologyEx(in, out, op, element);
+    });
+}
+
+static int findRoot(std::vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+static void unite(std::vector<int>& parent, int a, int b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a != b) parent[(std::max)(a, b)] = (std::min)(a, b);
+}
+
+cv::Mat removeSmallComponentsTiled(const cv::Mat& binaryImage, int minSize, const TileSettings& settings) {
+    if (!settings.enabled) {
+        return removeSmallComponents(binaryImage, minSize);
+    }
+    CV_Assert(binaryImage.type() == CV_8UC1);
+
+    // ラベル(int32) + 入力 + 出力
+    const TileGrid grid = makeTiles(binaryImage.size(), tileSizeForBudget(settings, 6, 0), 0);
+    const int tile_count = static_cast<int>(grid.tiles.size());
+
+    // 1回目: タイルごとにラベル付けし、面積と境目のラベルだけ残す
+    std::vector<int> offsets(tile_count);
+    std::vector<int> parent;
+    std::vector<int64_t> area;
+    std::vector<std::vector<int>> top(tile_count), bottom(tile_count), left(tile_count), right(tile_count);
+
+    cv::Mat labels, stats, centroids;
+    for (int t = 0; t < tile_count; ++t) {
+        checkCancelled();
+        const cv::Rect& inner = grid.tiles[t].inner;
+        const int n = cv::connectedComponentsWithStats(binaryImage(inner), labels, stats, centroids, 8, CV_32S);
+
+        offsets[t] = static_cast<int>(parent.size());
+        for (int i = 1; i < n; ++i) {
+            parent.push_back(static_cast<int>(parent.size()));
+            area.push_back(stats.at<int>(i, cv::CC_STAT_AREA));
+        }
+
+        // 背景は -1、それ以外は全体で通しの番号
+        auto global = [&](int label) { return (label == 0) ? -1 : offsets[t] + label - 1; };
+        top[t].resize(inner.width);
+        bottom[t].resize(inner.width);
+        for (int x = 0; x < inner.width; ++x) {
+            top[t][x] = global(labels.at<int>(0, x));
+            bottom[t][x] = global(labels.at<int>(inner.height - 1, x));
+        }
+        left[t].resize(inner.height);
+        right[t].resize(inner.height);
+        for (int y = 0; y < inner.height; ++y) {
+            left[t][y] = global(labels.at<int>(y, 0));
+            right[t][y] = global(labels.at<int>(y, inner.width - 1));
+        }
+    }
+
+    // 境目をはさんで8近傍で接するラベルをまとめる
+    // 画像全体の幅(高さ)の配列にしてから比べるので、タイルの角で斜めに接する場合も拾える
+    const int W = binaryImage.cols, H = binaryImage.rows;
+    for (int r = 0; r + 1 < grid.rows; ++r) {
+        std::vector<int> upper(W, -1), lower(W, -1);
+        for (int c = 0; c < grid.cols; ++c) {
+            const int a = r * grid.cols + c, b = (r + 1) * grid.cols + c;
+            std::copy(bottom[a].begin(), bottom[a].end(), upper.begin() + grid.tiles[a].inner.x);
+            std::copy(top[b].begin(), top[b].end(), lower.begin() + grid.tiles[b].inner.x);
+        }
+        for (int x = 0; x < W; ++x) {
+            if (upper[x] < 0) continue;
+            for (int dx = -1; dx <= 1; ++dx) {
+                const int nx = x + dx;
+                if (nx >= 0 && nx < W && lower[nx] >= 0) unite(parent, upper[x], lower[nx]);
+            }
+        }
+    }
+    for (int c = 0; c + 1 < grid.cols; ++c) {
+        std::vector<int> lhs(H, -1), rhs(H, -1);
+        for (int r = 0; r < grid.rows; ++r) {
+            const int a = r * grid.cols + c, b = r * grid.cols + c + 1;
+            std::copy(right[a].begin(), right[a].end(), lhs.begin() + grid.tiles[a].inner.y);
+            std::copy(left[b].begin(), left[b].end(), rhs.begin() + grid.tiles[b].inner.y);
+        }
+        for (int y = 0; y < H; ++y) {
+            if (lhs[y] < 0) continue;
+            for (int dy = -1; dy <= 1; ++dy) {
+                const int ny = y + dy;
+                if (ny >= 0 && ny < H && rhs[ny] >= 0) unite(parent, lhs[y], rhs[ny]);
+            }
+        }
+    }
+
+    std::vector<int64_t> root_area(parent.size(), 0);
+    for (size_t i = 0; i < parent.size(); ++i) {
+        root_area[findRoot(parent, static_cast<int>(i))] += area[i];
+    }
+
+    // 2回目: 同じラベル付けをやり直し、小さい成分を消す
+    cv::Mat filtered = binaryImage.clone();
+    for (int t = 0; t < tile_count; ++t) {
+        checkCancelled();
+        const cv::Rect& inner = grid.tiles[t].inner;
+        cv::connectedComponentsWithStats(binaryImage(inner), labels, stats, centroids, 8, CV_32S);
+        for (int y = 0; y < inner.height; ++y) {
+            const int* lblPtr = labels.ptr<int>(y);
+            uchar* dstPtr = filtered.ptr<uchar>(inner.y + y) + inner.x;
+            for (int x = 0; x < inner.width; ++x) {
+                if (lblPtr[x] == 0) continue;
+                if (root_area[findRoot(parent, offsets[t] + lblPtr[x] - 1)] < minSize) {
+                    dstPtr[x] = 0;
+                }
+            }
+        }
+    }
+    return filtered;
+}
+
+void stitchTiledPolylines(std::vector<std::vector<cv::Point2f>>& polylines, std::vector<int>& tile_of, float tolerance) {
+    CV_Assert(polylines.size() == tile_of.size());
+    const int n = static_cast<int>(polylines.size());
+    if (n < 2) return;
+
+    // 端点の番号: 2*i が先頭、2*i+1 が末尾
+    auto endpoint = [&](int e) -> const cv::Point2f& {
+        const auto& pl = polylines[e / 2];
+        return (e % 2 == 0) ? pl.front() : pl.back();
+    };
+
+    const float cell = (std::max)(1.0f, tolerance);
+    auto cellKey = [cell](int cx, int cy) {
+        return (static_cast<int64_t>(cx) << 32) ^ static_cast<uint32_t>(cy);
+    };
+    std::unordered_map<int64_t, std::vector<int>> cells;
+    for (int e = 0; e < 2 * n; ++e) {
+        if (polylines[e / 2].empty()) continue;
+        const cv::Point2f& p = endpoint(e);
+        cells[cellKey((int)std::floor(p.x / cell), (int)std::floor(p.y / cell))].push_back(e);
+    }
+
+    // 別のタイルの最も近い端点と組にする
+    std::vector<int> partner(2 * n, -1);
+    for (int e = 0; e < 2 * n; ++e) {
+        if (partner[e] >= 0 || polylines[e / 2].empty()) continue;
+        const cv::Point2f& p = endpoint(e);
+        const int cx = (int)std::floor(p.x / cell), cy = (int)std::floor(p.y / cell);
+        int best = -1;
+        float best_dist = tolerance;
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                auto it = cells.find(cellKey(cx + dx, cy + dy));
+                if (it == cells.end()) continue;
+                for (int f : it->second) {
+                    if (f / 2 == e / 2 || partner[f] >= 0 || tile_of[f / 2] == tile_of[e / 2]) continue;
+                    const float d = static_cast<float>(cv::norm(endpoint(f) - p));
+                    if (d <= best_dist) {
+                        best_dist = d;
+                        best = f;
+                    }
+                }
+            }
+        }
+        if (best >= 0) {
+            partner[e] = best;
+            partner[best] = e;
+        }
+    }
+
+    // 組になった端点をたどって1本にする
+    std::vector<std::vector<cv::Point2f>> stitched;
+    std::vector<int> stitched_tile;
+    std::vector<bool> used(n, false);
+    for (int i = 0; i < n; ++i) {
+        if (used[i] || polylines[i].empty()) continue;
+
+        // 鎖の先頭を探す (entry: 鎖を前向きにたどるときの入口の端点)
+        int entry = 2 * i;
+        bool cycle = false;
+        for (int steps = 0; steps < n; ++steps) {
+            const int f = partner[entry];
+            if (f < 0) break;
+            const int prev_entry = f ^ 1;
+            if (prev_entry / 2 == i) {
+                cycle = true;
+                break;
+            }
+            entry = prev_entry;
+        }
+        if (cycle) entry = 2 * i;
+
+        std::vector<cv::Point2f> chain;
+        const int first = entry / 2;
+        int current = entry;
+        while (true) {
+            const int p = current / 2;
+            used[p] = true;
+            const auto& pl = polylines[p];
+            if (current % 2 == 0) {
+                chain.insert(chain.end(), pl.begin(), pl.end());
+            } else {
+                chain.insert(chain.end(), pl.rbegin(), pl.rend());
+            }
+            const int f = partner[current ^ 1];
+            if (f < 0) break;
+            if (used[f / 2]) {
+                if (f / 2 == first) chain.push_back(chain.front()); // 一周した
+                break;
+            }
+            current = f;
+        }
+        stitched.push_back(std::move(chain));
+        stitched_tile.push_back(tile_of[first]);
+    }
+
+    polylines = std::move(stitched);
+    tile_of = std::move(stitched_tile);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+#include <opencv4/opencv2/core/mat.hpp>
+
+/*
+Tiling
+大きな画像を、のりしろ(halo)付きのタイルに分けて処理する
+モルフォロジー・小さい成分の除去・細線化の後の処理の一時的なMatをタイルの大きさに抑える
+入力と出力 (色ごとのマスク、細線化の結果) は画像全体の大きさのまま。ハッチと輪郭の抽出はタイルに分けない
+*/
+
+struct TileSettings {
+    bool enabled = false;
+    size_t memory_budget_mb = 256; // 1タイルの処理に使う一時メモリの上限 (画像全体の大きさのMatは含まない)
+};
+
+struct Tile {
+    cv::Rect inner; // このタイルが結果を書き込む範囲 (タイル同士は重ならない)
+    cv::Rect outer; // inner に halo を付けて画像内に収めた範囲 (処理の入力)
+};
+
+struct TileGrid {
+    int rows = 0, cols = 0;
+    std::vector<Tile> tiles; // 行優先
+};
+
+// 1画素あたり bytes_per_pixel の一時メモリを使う処理で、予算に収まる inner の一辺
+int tileSizeForBudget(const TileSettings& settings, size_t bytes_per_pixel, int halo);
+TileGrid makeTiles(cv::Size size, int tile_size, int halo);
+
+// 近傍 halo 以内しか見ない処理 op をタイルごとに実行し、inner の部分を dst に集める
+// op の出力は入力 (outer) と同じ大きさ・CV_8UC1 であること。dst は画像全体の大きさで確保する
+void forEachTile(const cv::Mat& src, cv::Mat& dst, int halo, size_t bytes_per_pixel, const TileSettings& settings,
+    const std::function<void(const cv::Mat& in, cv::Mat& out)>& op);
+
+// タイル単位のモルフォロジー (設定が無効ならそのまま cv::morphologyEx)
+void morphologyTiled(const cv::Mat& src, cv::Mat& dst, int op, const cv::Mat& element, const TileSettings& settings);
+
+// 8近傍の連結成分のうち面積が minSize 未満のものを消す
+// タイルごとにラベル付けし、タイルの境目で繋がる成分は union-find でまとめてから面積を数える
+cv::Mat removeSmallComponentsTiled(const cv::Mat& binaryImage, int minSize, const TileSettings& settings);
+
+// タイルごとに抽出したpolylineを境目でつなぐ
+// tile_of[i] は polylines[i] を抽出したタイルの番号。別のタイルの端点同士が tolerance 以内ならつなぐ
+// 一周してつながったものは、先頭の点を末尾に足して閉じる
+void stitchTiledPolylines(std::vector<std::vector<cv::Point2f>>& polylines, std::vector<int>& tile_of, float tolerance = 1.5f);
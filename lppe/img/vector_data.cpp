@@ -4,14 +4,45 @@
 #include <list>
 #include <set>
 #include <atomic>
+#include <cstring>
 
 #include <opencv4/opencv2/imgproc.hpp>
 #include <opencv4/opencv2/ximgproc.hpp>
 
+#include "job/job.hpp"
+#include "tiling.hpp"
+#include "trace/trace.hpp"
+
+// 線の本数と点の数を trace に書く
+template <typename Point>
+static void traceLineCounts(ScopedTrace& trace, const std::vector<std::vector<Point>>& lines) {
+    size_t points = 0;
+    for(const auto& line : lines) {
+        points += line.size();
+    }
+    trace.count("polylines", static_cast<double>(lines.size()));
+    trace.count("points", static_cast<double>(points));
+}
+
+static void traceLineCounts(ScopedTrace& trace, const VectorData& data) {
+    size_t lines = 0, points = 0;
+    for(const auto* group : {&data.polylines, &data.contours, &data.hatch_lines}) {
+        for(const auto& [color_id, polylines] : *group) {
+            lines += polylines.size();
+            for(const auto& polyline : polylines) {
+                points += polyline.size();
+            }
+        }
+    }
+    trace.count("polylines", static_cast<double>(lines));
+    trace.count("points", static_cast<double>(points));
+}
+
 // gemini
-static
-std::vector<std::vector<cv::Point2f>> generateHatchLines(const cv::Mat& filled, int lineSpacing = 2, int angleDegree = 45) {
+std::vector<std::vector<cv::Point2f>> generateHatchLines(const cv::Mat& filled, int lineSpacing, int angleDegree) {
     CV_Assert(filled.type() == CV_8UC1);
+    ScopedTrace trace("hatch");
+    trace.count("pixels", static_cast<double>(filled.total()));
 
     std::vector<std::vector<cv::Point2f>> hatchLines;
 
@@ -103,6 +134,7 @@ std::vector<std::vector<cv::Point2f>> generateHatchLines(const cv::Mat& filled,
         }
     }
 
+    traceLineCounts(trace, hatchLines);
     return hatchLines;
 }
 
@@ -233,9 +265,10 @@ std::vector<std::vector<cv::Point2f>> polylinesIntToFloat2f(const std::vector<st
     return polylines2f;
 }
 
-static
 std::vector<std::vector<cv::Point>> extractPolylines(const cv::Mat& lines) {
     CV_Assert(lines.type() == CV_8UC1);
+    ScopedTrace trace("extract_polylines");
+    trace.count("pixels", static_cast<double>(lines.total()));
 
     cv::Mat visited = cv::Mat::zeros(lines.size(), CV_8U);
     std::vector<std::vector<cv::Point>> polylines;
@@ -412,12 +445,14 @@ std::vector<std::vector<cv::Point>> extractPolylines(const cv::Mat& lines) {
 
     }
 
+    traceLineCounts(trace, polylines);
     return polylines;
 }
 
-static
 void extractContoursFromFilled(const cv::Mat& filled, std::vector<std::vector<cv::Point>>& polylines, std::vector<std::vector<cv::Point>>& contours) {
     CV_Assert(filled.type() == CV_8UC1);
+    ScopedTrace trace("extract_contours");
+    trace.count("pixels", static_cast<double>(filled.total()));
 
     polylines.clear();
     contours.clear();
@@ -509,6 +544,8 @@ void extractContoursFromFilled(const cv::Mat& filled, std::vector<std::vector<cv
             }
         }
     }
+    trace.count("contours", static_cast<double>(contours.size()));
+    traceLineCounts(trace, polylines);
 }
 
 std::vector<cv::Point2f> removePolylineJitter(const std::vector<cv::Point2f>& polyline, bool closed, double epsilon) {
@@ -718,6 +755,8 @@ static bool thinningStepParallel(const cv::Mat &src, cv::Mat &dst, const std::ve
 void NWGThinningLUTParallel(const cv::Mat &src, cv::Mat &dst)
 {
     CV_Assert(src.type() == CV_8UC1);
+    ScopedTrace trace("thinning");
+    trace.count("pixels", static_cast<double>(src.total()));
 
     cv::Mat img;
     cv::threshold(src, img, 0, 1, cv::THRESH_BINARY | cv::THRESH_OTSU);
@@ -728,6 +767,7 @@ void NWGThinningLUTParallel(const cv::Mat &src, cv::Mat &dst)
 
     bool modified;
     do {
+        checkCancelled();
         modified = false;
 
         // Step A
@@ -747,6 +787,95 @@ void NWGThinningLUTParallel(const cv::Mat &src, cv::Mat &dst)
     img.convertTo(dst, CV_8UC1, 255);
 }
 
+/**
+ * LUTを用いた1ステップの削除処理（img を直接書き換える）
+ * 削除の判定は書き換える前の値で行う。行の元の値は1行ずつ控え、帯の境目の行は始める前に控えておく
+ */
+static bool thinningStepInPlace(cv::Mat &img, const std::vector<uchar> &lut, int bands)
+{
+    const int rows = img.rows - 2;
+    const int cols = img.cols;
+    if (rows <= 0) return false;
+    bands = std::clamp(bands, 1, rows);
+    auto band_start = [&](int b) { return 1 + static_cast<int>(static_cast<int64_t>(rows) * b / bands); };
+
+    // 帯 b の上の行・下の行 (隣の帯が書き換える)
+    cv::Mat edges(bands * 2, cols, CV_8UC1);
+    for (int b = 0; b < bands; ++b) {
+        img.row(band_start(b) - 1).copyTo(edges.row(2 * b));
+        img.row(band_start(b + 1)).copyTo(edges.row(2 * b + 1));
+    }
+
+    std::atomic<bool> modified(false);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range &range) {
+        std::vector<uchar> prev(cols), curr(cols);
+        for (int b = range.start; b < range.end; ++b)
+        {
+            const int end = band_start(b + 1);
+            std::memcpy(prev.data(), edges.ptr<uchar>(2 * b), cols);
+            for (int y = band_start(b); y < end; ++y)
+            {
+                uchar *out = img.ptr<uchar>(y);
+                std::memcpy(curr.data(), out, cols);
+                const uchar *next = (y + 1 == end) ? edges.ptr<uchar>(2 * b + 1) : img.ptr<uchar>(y + 1);
+
+                for (int x = 1; x < cols - 1; ++x) {
+                    if (curr[x] == 0) continue;
+
+                    int code =
+                        (prev[x - 1] << 0) | (prev[x] << 1) | (prev[x + 1] << 2) |
+                        (curr[x - 1] << 3) | (curr[x] << 4) | (curr[x + 1] << 5) |
+                        (next[x - 1] << 6) | (next[x] << 7) | (next[x + 1] << 8);
+
+                    if (lut[code]) {
+                        out[x] = 0;
+                        modified.store(true, std::memory_order_relaxed);
+                    }
+                }
+                std::swap(prev, curr);
+            }
+        }
+    });
+
+    return modified.load(std::memory_order_relaxed);
+}
+
+/**
+ * NWG細線化（img を直接書き換える）
+ * NWGThinningLUTParallel と同じ結果になる。marker の分の画像全体の作業用Matを使わない
+ */
+void NWGThinningInPlace(cv::Mat &img)
+{
+    CV_Assert(img.type() == CV_8UC1);
+    ScopedTrace trace("thinning");
+    trace.count("pixels", static_cast<double>(img.total()));
+
+    cv::threshold(img, img, 0, 1, cv::THRESH_BINARY | cv::THRESH_OTSU);
+
+    static std::vector<uchar> lutA = createNWGLUT(0);
+    static std::vector<uchar> lutB = createNWGLUT(1);
+    const int bands = (std::max)(1, cv::getNumThreads()) * 4;
+
+    bool modified;
+    do {
+        checkCancelled();
+        modified = false;
+
+        // Step A
+        if (thinningStepInPlace(img, lutA, bands)) {
+            modified = true;
+        }
+
+        // Step B
+        if (thinningStepInPlace(img, lutB, bands)) {
+            modified = true;
+        }
+
+    } while (modified);
+
+    img *= 255;
+}
+
 void extractEdgeFromGroupMap(const cv::Mat& gmap, cv::Mat& edges) {
     CV_Assert(gmap.type() == CV_8UC1);
 
@@ -827,99 +956,202 @@ void classifyPixels(const cv::Mat& binary, cv::Mat& lines, cv::Mat& thinned_line
     vis.setTo(cv::Vec3b(0, 255, 0), filled == 255);
 }
 
-void visualize(const VectorData& data, cv::Mat& view_map, cv::Mat& view_map_with_points, cv::Mat& view_map_with_hatch, 
-    cv::Mat& view_random_colored, int N) {
-    view_map = cv::Mat::zeros(data.height * N, data.width * N, CV_8UC3);
-    view_map.setTo(cv::Scalar(255,255,255));
-    view_map_with_points = view_map.clone();
-    view_map_with_hatch = view_map.clone();
-    view_random_colored = view_map.clone();
-
-    const cv::Scalar red(0,0,255);
-    const cv::Scalar green(0,255,0);
-    const cv::Scalar blue(255,0,0);
+#define VISUALIZE_RANDOM_SEED (12345)
+#define VISUALIZE_MARKER_MIN_SCALE (1.0) // 頂点の印を描く最小の倍率 (データ1単位 = 1px)
 
-    for (const auto& [color_id, polylines] : data.polylines) {
-        cv::Scalar color = data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255);
-        for (const auto& polyline : polylines) {
-            if (polyline.size() >= 2) {
-                std::vector<cv::Point> scaled;
-                scaled.reserve(polyline.size());
-                for (const auto& pt : polyline) {
-                    scaled.emplace_back(static_cast<int>(pt.x * N), static_cast<int>(pt.y * N));
-                }
+VectorBounds VectorBounds::of(const std::vector<cv::Point2f>& line) {
+    VectorBounds b;
+    for (const auto& pt : line) {
+        b.add(pt);
+    }
+    return b;
+}
 
-                cv::Scalar rand_col(rand() % 256, rand() % 256, rand() % 256);
+static void updateGroupBounds(const std::map<int, std::vector<std::vector<cv::Point2f>>>& groups,
+    std::map<int, std::vector<VectorBounds>>& line_bounds, std::map<int, VectorBounds>& color_bounds) {
+    line_bounds.clear();
+    for (const auto& [color_id, lines] : groups) {
+        auto& out = line_bounds[color_id];
+        out.reserve(lines.size());
+        VectorBounds& color = color_bounds[color_id];
+        for (const auto& line : lines) {
+            out.push_back(VectorBounds::of(line));
+            color.add(out.back());
+        }
+    }
+}
 
-                cv::polylines(view_map, scaled, false, color, 1, cv::LINE_AA);
-                cv::polylines(view_map_with_points, scaled, false, red, 1, cv::LINE_AA);
-                cv::polylines(view_map_with_hatch, scaled, false, color, 1, cv::LINE_AA);
-                cv::polylines(view_random_colored, scaled, false, rand_col, 1, cv::LINE_AA);
+void updateBounds(VectorData& data) {
+    data.color_bounds.clear();
+    updateGroupBounds(data.polylines, data.polyline_bounds, data.color_bounds);
+    updateGroupBounds(data.contours, data.contour_bounds, data.color_bounds);
+    updateGroupBounds(data.hatch_lines, data.hatch_bounds, data.color_bounds);
+    data.bounds = VectorBounds();
+    for (const auto& [color_id, b] : data.color_bounds) {
+        data.bounds.add(b);
+    }
+}
 
-                cv::circle(view_map_with_points, scaled.front(), 2, blue, -1, cv::LINE_AA);
-                cv::circle(view_map_with_points, scaled.back(), 2, blue, -1, cv::LINE_AA);
-                for (auto it = scaled.begin() + 1; it != scaled.end() - 1; ++it) {
-                    cv::circle(view_map_with_points, *it, 2, green, -1, cv::LINE_AA);
-                }
-            }
-        }
+static bool groupBoundsUpToDate(const std::map<int, std::vector<std::vector<cv::Point2f>>>& groups,
+    const std::map<int, std::vector<VectorBounds>>& line_bounds) {
+    if (groups.size() != line_bounds.size()) return false;
+    for (const auto& [color_id, lines] : groups) {
+        auto it = line_bounds.find(color_id);
+        if (it == line_bounds.end() || it->second.size() != lines.size()) return false;
     }
+    return true;
+}
 
-    for(const auto& [color_id, contours] : data.contours) {
-        for(const auto& contour : contours) {
-            if (contour.size() >= 2) {
-                cv::Scalar color = data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255);
-                std::vector<cv::Point> scaled;
-                scaled.reserve(contour.size());
-                for (const auto& pt : contour) {
-                    scaled.emplace_back(static_cast<int>(pt.x * N), static_cast<int>(pt.y * N));
-                }
+bool boundsUpToDate(const VectorData& data) {
+    return groupBoundsUpToDate(data.polylines, data.polyline_bounds)
+        && groupBoundsUpToDate(data.contours, data.contour_bounds)
+        && groupBoundsUpToDate(data.hatch_lines, data.hatch_bounds);
+}
 
-                cv::Scalar rand_col(rand() % 256, rand() % 256, rand() % 256);
+// 小数点以下の座標を残して描く (cv::polylines の shift)
+#define VISUALIZE_SHIFT (3)
 
-                cv::polylines(view_map, scaled, true, color, 1, cv::LINE_AA);
-                cv::polylines(view_map_with_points, scaled, true, green, 1, cv::LINE_AA);
-                cv::polylines(view_map_with_hatch, scaled, true, color, 1, cv::LINE_AA);
-                cv::polylines(view_random_colored, scaled, true, rand_col, 1, cv::LINE_AA);
+static void toViewPoints(const std::vector<cv::Point2f>& line, double scale, std::vector<cv::Point>& out) {
+    const double s = scale * (1 << VISUALIZE_SHIFT);
+    out.clear();
+    out.reserve(line.size());
+    for (const auto& pt : line) {
+        out.emplace_back(cvRound(pt.x * s), cvRound(pt.y * s));
+    }
+}
+
+// 1色分を白地の layer に描く
+static void renderColorLayer(const VectorData& data, int color_id, VectorView view, double scale, cv::Mat& layer) {
+    const cv::Scalar red(0,0,255);
+    const cv::Scalar green(0,255,0);
+    const cv::Scalar blue(255,0,0);
+    const cv::Scalar color = data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255);
+    const bool points = view == VectorView::Points;
+    // 頂点の印は拡大して見ているときだけ (縮小表示では線が潰れるだけなので描かない)
+    const bool markers = points && scale >= VISUALIZE_MARKER_MIN_SCALE;
+    const int radius = (std::max)(1, cvRound(scale)) << VISUALIZE_SHIFT;
+    // 線ごとの色は毎回同じになるように、色ごとに固定のシードから作る
+    cv::RNG rng(VISUALIZE_RANDOM_SEED + color_id);
+    std::vector<cv::Point> scaled;
+
+    auto draw = [&](const std::vector<cv::Point>& pts, bool closed, const cv::Scalar& col) {
+        cv::polylines(layer, pts, closed, col, 1, cv::LINE_AA, VISUALIZE_SHIFT);
+    };
+    auto mark = [&](const cv::Point& pt, const cv::Scalar& col) {
+        cv::circle(layer, pt, radius, col, -1, cv::LINE_AA, VISUALIZE_SHIFT);
+    };
 
-                for (const auto& pt : scaled) {
-                    cv::circle(view_map_with_points, pt, 2, blue, -1, cv::LINE_AA);
+    if (data.polylines.count(color_id)) {
+        for (const auto& polyline : data.polylines.at(color_id)) {
+            if (polyline.size() < 2) continue;
+            toViewPoints(polyline, scale, scaled);
+            if (view == VectorView::RandomColored) {
+                draw(scaled, false, cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)));
+            } else if (points) {
+                draw(scaled, false, red);
+                if (markers) {
+                    mark(scaled.front(), blue);
+                    mark(scaled.back(), blue);
+                    for (auto it = scaled.begin() + 1; it != scaled.end() - 1; ++it) {
+                        mark(*it, green);
+                    }
                 }
+            } else {
+                draw(scaled, false, color);
             }
         }
     }
 
-    for(const auto& [color_id, hatch_lines] : data.hatch_lines) {
-        for(const auto& line : hatch_lines) {
-            if (line.size() >= 2) {
-                cv::Scalar color = data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255);
-                std::vector<cv::Point> scaled;
-                scaled.reserve(line.size());
-                for (const auto& pt : line) {
-                    scaled.emplace_back(static_cast<int>(pt.x * N), static_cast<int>(pt.y * N));
+    if (data.contours.count(color_id)) {
+        for (const auto& contour : data.contours.at(color_id)) {
+            if (contour.size() < 2) continue;
+            toViewPoints(contour, scale, scaled);
+            if (view == VectorView::RandomColored) {
+                draw(scaled, true, cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)));
+            } else if (points) {
+                draw(scaled, true, green);
+                if (markers) {
+                    for (const auto& pt : scaled) {
+                        mark(pt, blue);
+                    }
                 }
+            } else {
+                draw(scaled, true, color);
+            }
+        }
+    }
 
-                cv::polylines(view_map_with_points, scaled, false, blue, 1, cv::LINE_AA);
-                cv::polylines(view_map_with_hatch, scaled, false, color, 1, cv::LINE_AA);
-
-                cv::circle(view_map_with_points, scaled.front(), 2, red, -1, cv::LINE_AA);
-                cv::circle(view_map_with_points, scaled.back(), 2, red, -1, cv::LINE_AA);
+    // hatch は Points と Hatch の表示だけ
+    if ((points || view == VectorView::Hatch) && data.hatch_lines.count(color_id)) {
+        for (const auto& line : data.hatch_lines.at(color_id)) {
+            if (line.size() < 2) continue;
+            toViewPoints(line, scale, scaled);
+            draw(scaled, false, points ? blue : color);
+            if (markers) {
+                mark(scaled.front(), red);
+                mark(scaled.back(), red);
                 // hatchの中間点はない
             }
         }
     }
+}
 
-    for(const auto& [color_id, mask] : data.filled_masks) {
-        if(mask.empty() || mask.type() != CV_8UC1) {
-            continue;
+cv::Mat renderVectorView(const VectorData& data, VectorView view, double scale) {
+    ScopedTrace trace("visualize");
+    const int cols = (std::max)(1, cvRound(data.width * scale));
+    const int rows = (std::max)(1, cvRound(data.height * scale));
+    trace.count("pixels", static_cast<double>(cols) * rows);
+
+    std::vector<int> color_ids;
+    auto collect = [&](const std::map<int, std::vector<std::vector<cv::Point2f>>>& groups) {
+        for (const auto& [color_id, lines] : groups) {
+            if (!lines.empty()) color_ids.push_back(color_id);
+        }
+    };
+    collect(data.polylines);
+    collect(data.contours);
+    collect(data.hatch_lines);
+    std::sort(color_ids.begin(), color_ids.end());
+    color_ids.erase(std::unique(color_ids.begin(), color_ids.end()), color_ids.end());
+    trace.count("layers", static_cast<double>(color_ids.size()));
+
+    // 色ごとに別の白地に並列に描き、暗い方を取って重ねる (インクを重ねるのと同じで、順番によらない)
+    std::vector<cv::Mat> layers(color_ids.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(color_ids.size())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            layers[i] = cv::Mat(rows, cols, CV_8UC3, cv::Scalar(255,255,255));
+            renderColorLayer(data, color_ids[i], view, scale, layers[i]);
+        }
+    });
+    cv::Mat img;
+    if (layers.empty()) {
+        img = cv::Mat(rows, cols, CV_8UC3, cv::Scalar(255,255,255));
+    } else {
+        img = layers[0];
+        for (size_t i = 1; i < layers.size(); ++i) {
+            cv::min(img, layers[i], img);
         }
-        cv::Mat colorMask;
-        cv::cvtColor(mask, colorMask, cv::COLOR_GRAY2BGR);
-        cv::Scalar color = data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255);
-        cv::Mat resized;
-        cv::resize(mask, resized, view_map.size(), 0, 0, cv::INTER_NEAREST);
-        view_map.setTo(color, resized);
     }
+
+    if (view == VectorView::Color) {
+        for (const auto& [color_id, mask] : data.filled_masks) {
+            if (mask.empty() || mask.type() != CV_8UC1) {
+                continue;
+            }
+            cv::Scalar color = data.color_values.count(color_id) ? data.color_values.at(color_id) : cv::Scalar(255, 255, 255);
+            cv::Mat resized;
+            cv::resize(mask, resized, img.size(), 0, 0, cv::INTER_NEAREST);
+            img.setTo(color, resized);
+        }
+    }
+    return img;
+}
+
+double fitVectorViewScale(const VectorData& data, int max_width, int max_height, double max_scale) {
+    if (data.width <= 0 || data.height <= 0 || max_width <= 0 || max_height <= 0) {
+        return max_scale;
+    }
+    return (std::min)({max_scale, static_cast<double>(max_width) / data.width, static_cast<double>(max_height) / data.height});
 }
 
 // 浮動小数点座標の許容誤差
@@ -1043,6 +1275,8 @@ static bool mergePolylines(std::vector<std::vector<cv::Point2f>>& polylines) {
 // -------------------------------------------------------------
 
 void optimizeVectorData(const VectorData &src, VectorData &dst) {
+    ScopedTrace trace("merge");
+    traceLineCounts(trace, src);
     // データの初期化とコピー
     dst.polylines.clear();
     dst.contours.clear();
@@ -1079,6 +1313,7 @@ void optimizeVectorData(const VectorData &src, VectorData &dst) {
         // ---------------------------------------------
         bool merged_in_pass = true;
         while (merged_in_pass) {
+            checkCancelled();
             merged_in_pass = false;
             std::vector<std::vector<cv::Point2f>> next_polylines;
             std::vector<bool> consumed(current_polylines.size(), false);
@@ -1204,6 +1439,7 @@ struct VwPoint {
     float importance = 0.0f;
     VwPointIterator prev;
     VwPointIterator next;
+    int index = 0; // 元のポリラインでの順番
 };
 
 // V-Wアルゴリズムの最小要素を定義 (面積とイテレータを保持)
@@ -1213,13 +1449,12 @@ struct PointImportance {
     VwPointIterator it; 
     
     // setで使用するための比較演算子
-    // 面積が等しい場合は、イテレータのメモリアドレスでソート (一意性を確保)
+    // 面積が等しい場合は元の順番でソート (一意性を確保し、実行ごとに結果が変わらないように)
     bool operator<(const PointImportance& other) const {
         if (area != other.area) {
             return area < other.area;
         }
-        // ポインタ比較で一意性を確保
-        return &(*it) < &(*other.it); 
+        return it->index < other.it->index;
     }
 };
 
@@ -1239,9 +1474,9 @@ std::vector<cv::Point2f> simplifyPolylineVW(
 
     // 1. ポリラインを双方向リスト (std::list) に変換
     std::list<VwPoint> working_list;
-    for (const auto& p : polyline) {
+    for (size_t i = 0; i < polyline.size(); ++i) {
         // 初期化時にダミーのイテレータで埋める
-        working_list.push_back({p, 0.0f, working_list.end(), working_list.end()});
+        working_list.push_back({polyline[i], 0.0f, working_list.end(), working_list.end(), static_cast<int>(i)});
     }
 
     // 2. 優先度キュー (std::set) を初期化
@@ -1343,6 +1578,8 @@ std::vector<std::vector<cv::Point2f>> simplifyPolylinesVW(
 }
 
 void simplifyVectorData(const VectorData& src, VectorData& dst) {
+    ScopedTrace trace("simplify");
+    traceLineCounts(trace, src);
     for(const auto& [color_id, name] : src.color_names) {
         dst.color_names[color_id] = name;
         dst.color_values[color_id] = src.color_values.at(color_id);
@@ -1411,12 +1648,50 @@ void removeShortPolylines(std::vector<std::vector<cv::Point2f>>& polylines, floa
     );
 }
 
+// edge_mask を細線化してpolylineにする。細線化は画像全体で行い、その後の処理をタイルごとに行って境目でつなぎ直す
+// 細線化は1回の反復で1画素ずつ影響が広がり、細い線でも端から1画素ずつ削れて反復が長く続くので、
+// のりしろ付きのタイルで細線化すると結果が変わることがある
+static std::vector<std::vector<cv::Point2f>> extractEdgePolylinesTiled(const cv::Mat& mask, const TileSettings& tiling) {
+    // 画像全体の作業用Matは細線化の結果の1枚だけ
+    cv::Mat thinned = mask.clone();
+    NWGThinningInPlace(thinned);
+
+    // cleaned・extractPolylines 用のコピー・visited。clean_thinned は3x3しか見ないので、のりしろは1画素
+    const TileGrid grid = makeTiles(mask.size(), tileSizeForBudget(tiling, 3, 1), 1);
+
+    std::vector<std::vector<cv::Point2f>> polylines;
+    std::vector<int> tile_of;
+    cv::Mat cleaned;
+    for(int t = 0; t < (int)grid.tiles.size(); ++t) {
+        checkCancelled();
+        const Tile& tile = grid.tiles[t];
+        clean_thinned(thinned(tile.outer), cleaned);
+
+        // extractPolylines は連続したMatを前提にしているのでコピーする
+        const cv::Rect local(tile.inner.x - tile.outer.x, tile.inner.y - tile.outer.y, tile.inner.width, tile.inner.height);
+        cv::Mat inner = cleaned(local).clone();
+        auto tile_polylines = polylinesIntToFloat2f(extractPolylines(inner));
+        const cv::Point2f offset((float)tile.inner.x, (float)tile.inner.y);
+        for(auto& polyline : tile_polylines) {
+            for(auto& p : polyline) {
+                p += offset;
+            }
+            polylines.push_back(std::move(polyline));
+            tile_of.push_back(t);
+        }
+    }
+    stitchTiledPolylines(polylines, tile_of);
+    return polylines;
+}
+
 void lastConvertToVectorData(
-    VectorData& data, cv::Mat& view_map, cv::Mat& view_map_with_points, cv::Mat& view_map_with_hatch,
-    cv::Mat& view_random_colored,
+    VectorData& data,
     int hatchLineSpacing, int hatchLineAngle, int minSize, float jitterEpsilon, float minPolylineLength,
-    const std::map<std::string, HatchLineSetting>& hatchLineSettings
+    const std::map<std::string, HatchLineSetting>& hatchLineSettings,
+    const TileSettings& tiling
 ) {
+    ScopedTrace trace("vectorize");
+    trace.count("pixels", static_cast<double>(data.width) * data.height);
     for(auto& [color_id, mask] : data.filled_masks) {
         if(mask.empty() || mask.type() != CV_8UC1) {
             continue;
@@ -1459,6 +1734,7 @@ void lastConvertToVectorData(
                 }
             }
         }
+        checkCancelled();
         for(auto angle : angles) {
             std::cout << "Generating hatch lines for color: " << data.color_names.at(color_id) << " with angle: " << angle << " and spacing: " << spacing << std::endl;
             auto hatchLines = generateHatchLines(mask, spacing, angle);
@@ -1472,9 +1748,14 @@ void lastConvertToVectorData(
             continue;
         }
 
-        NWGThinningLUTParallel(mask, thinned);
-        clean_thinned(thinned, cleaned);
-        auto polylines = polylinesIntToFloat2f(extractPolylines(cleaned));
+        std::vector<std::vector<cv::Point2f>> polylines;
+        if(tiling.enabled) {
+            polylines = extractEdgePolylinesTiled(mask, tiling);
+        } else {
+            NWGThinningLUTParallel(mask, thinned);
+            clean_thinned(thinned, cleaned);
+            polylines = polylinesIntToFloat2f(extractPolylines(cleaned));
+        }
         removeShortPolylines(polylines, minPolylineLength);
         auto no_jitter = removePolylinesJitter(polylines, false, jitterEpsilon);
         data.polylines[color_id].reserve(data.polylines[color_id].size() + no_jitter.size());
@@ -1484,6 +1765,7 @@ void lastConvertToVectorData(
         if(mask.empty() || mask.type() != CV_8UC1) {
             continue;
         }
+        checkCancelled();
         std::vector<std::vector<cv::Point>> raw_polylines, raw_contours;
         extractContoursFromFilled(mask, raw_polylines, raw_contours);
         auto polylines = polylinesIntToFloat2f(raw_polylines);
@@ -1515,6 +1797,6 @@ void lastConvertToVectorData(
     VectorData simplified;
     simplifyVectorData(data, simplified);
     data = simplified;
-
-    visualize(data, view_map, view_map_with_points, view_map_with_hatch, view_random_colored, 2);
+    updateBounds(data);
+    traceLineCounts(trace, data);
 }
@@ -2,19 +2,51 @@
 
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
 
 #include <opencv4/opencv2/core.hpp>
 
+#include "tiling.hpp"
+
 struct HatchLineSetting {
     int spacing = -1; // px
     std::string mode = "/"; // [/-\|+x]
     std::string substitute_color = ""; // 代わりに使う色
 };
 
+// 点の範囲 (点がひとつもなければ empty)
+struct VectorBounds {
+    float min_x = FLT_MAX, min_y = FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+
+    bool empty() const { return min_x > max_x; }
+    void add(const cv::Point2f& p) {
+        min_x = (std::min)(min_x, p.x);
+        min_y = (std::min)(min_y, p.y);
+        max_x = (std::max)(max_x, p.x);
+        max_y = (std::max)(max_y, p.y);
+    }
+    void add(const VectorBounds& b) {
+        min_x = (std::min)(min_x, b.min_x);
+        min_y = (std::min)(min_y, b.min_y);
+        max_x = (std::max)(max_x, b.max_x);
+        max_y = (std::max)(max_y, b.max_y);
+    }
+    static VectorBounds of(const std::vector<cv::Point2f>& line);
+};
+
 struct VectorData {
     std::map<int, std::vector<std::vector<cv::Point2f>>> polylines;
     std::map<int, std::vector<std::vector<cv::Point2f>>> contours;
     std::map<int, std::vector<std::vector<cv::Point2f>>> hatch_lines;
+    // 線の範囲のキャッシュ (updateBounds で作る。*_bounds[color][i] は polylines[color][i] などの範囲)
+    // 線を足したり書き換えたりしたら updateBounds を呼び直すこと。数が合わないものは boundsUpToDate で弾く
+    std::map<int, std::vector<VectorBounds>> polyline_bounds;
+    std::map<int, std::vector<VectorBounds>> contour_bounds;
+    std::map<int, std::vector<VectorBounds>> hatch_bounds;
+    std::map<int, VectorBounds> color_bounds; // 色ごと (3種類の線をまとめて)
+    VectorBounds bounds; // 全体
     std::map<int, cv::Mat> filled_masks; // 計算によりhatch_linesに変換される
     std::map<int, cv::Mat> edge_masks; // 計算によりpolylinesに変換される
     std::map<int, cv::Mat> outline_masks; // 枠線を付けたい領域が塗られたcv::Matであり、計算によりcontoursに変換される
@@ -27,6 +59,31 @@ cv::Mat removeSmallComponents(const cv::Mat& binaryImage, int minSize = 3);
 void canny(const cv::Mat& src, cv::Mat& edges, int lowThreshold = 100, int highThreshold = 200);
 void extractEdgeFromGroupMap(const cv::Mat& gmap, cv::Mat& edges);
 void classifyPixels(const cv::Mat& binary, cv::Mat& lines, cv::Mat& thinned_lines, cv::Mat& filled, cv::Mat& vis, int r=7);
-void lastConvertToVectorData(VectorData& data, cv::Mat& view_map, cv::Mat& view_map_with_points, cv::Mat& view_map_with_hatch, cv::Mat& view_random_colored, int hatchLineSpacing, int hatchLineAngle, int minSize, float jitterEpsilon, float minPolylineLength, const std::map<std::string, HatchLineSetting>& hatchLineSettings);
+void lastConvertToVectorData(VectorData& data, int hatchLineSpacing, int hatchLineAngle, int minSize, float jitterEpsilon, float minPolylineLength, const std::map<std::string, HatchLineSetting>& hatchLineSettings, const TileSettings& tiling = TileSettings());
 
-void visualize(const VectorData& data, cv::Mat& view_map, cv::Mat& view_map_with_points, cv::Mat& view_map_with_hatch, cv::Mat& view_random_colored, int N);
+// lastConvertToVectorData の中の個々の処理 (lppe_bench から直接呼ぶ)
+void NWGThinningLUTParallel(const cv::Mat& src, cv::Mat& dst);
+// NWGThinningLUTParallel と同じ結果を img に上書きする (タイル分割のときに使う)
+void NWGThinningInPlace(cv::Mat& img);
+std::vector<std::vector<cv::Point>> extractPolylines(const cv::Mat& lines);
+void extractContoursFromFilled(const cv::Mat& filled, std::vector<std::vector<cv::Point>>& polylines, std::vector<std::vector<cv::Point>>& contours);
+std::vector<std::vector<cv::Point2f>> generateHatchLines(const cv::Mat& filled, int lineSpacing = 2, int angleDegree = 45);
+void optimizeVectorData(const VectorData& src, VectorData& dst);
+
+// 線を1回なめて *_bounds, color_bounds, bounds を作り直す
+void updateBounds(VectorData& data);
+// 範囲のキャッシュが今の線の数と合っているか
+bool boundsUpToDate(const VectorData& data);
+
+// プレビューの種類 (GUI の convert_to_vector_mode 4-7 の順)
+enum class VectorView {
+    Color = 0,        // 線と塗りを元の色で
+    Points = 1,       // 線の種類ごとの色と頂点
+    Hatch = 2,        // hatch も含めて元の色で
+    RandomColored = 3 // 線ごとにランダムな色で
+};
+// 表示する1枚だけを、データの1単位 = scale px で描く (色ごとに並列に描いて重ねる)
+// 頂点の印は拡大して見ているとき (scale >= 1) だけ描く
+cv::Mat renderVectorView(const VectorData& data, VectorView view, double scale);
+// max_width x max_height に収まる倍率 (max_scale より大きくはしない)
+double fitVectorViewScale(const VectorData& data, int max_width, int max_height, double max_scale);
@@ -0,0 +1,43 @@
+#include "job.hpp"
+
+#include <iostream>
+#include <thread>
+
+static thread_local const CancelToken* current_token = nullptr;
+
+void checkCancelled() {
+    if (current_token != nullptr && current_token->isCancelled()) {
+        throw JobCancelled();
+    }
+}
+
+ScopedCancelToken::ScopedCancelToken(const CancelToken& token) : token(token), previous(current_token) {
+    current_token = &this->token;
+}
+
+ScopedCancelToken::~ScopedCancelToken() {
+    current_token = previous;
+}
+
+void LatestJobRunner::start(std::function<void(const CancelToken&)> work) {
+    CancelToken token;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        current.cancel();
+        current = token;
+    }
+
+    std::thread([token, work = std::move(work)]() {
+        ScopedCancelToken scope(token);
+        try {
+            work(token);
+        } catch (const JobCancelled&) {
+            std::cout << "Job cancelled." << std::endl;
+        }
+    }).detach();
+}
+
+void LatestJobRunner::cancel() {
+    std::lock_guard<std::mutex> lock(mtx);
+    current.cancel();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <exception>
+#include <functional>
+
+/*
+Job
+バックグラウンド計算の取り消し (新しいものを優先)
+新しい計算を始めると実行中の計算は取り消され、重い処理の途中にある checkCancelled() で打ち切られる
+*/
+
+class CancelToken {
+    public:
+        CancelToken() : cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+        void cancel() const { cancelled->store(true, std::memory_order_relaxed); }
+        bool isCancelled() const { return cancelled->load(std::memory_order_relaxed); }
+    private:
+        std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+struct JobCancelled : public std::exception {
+    const char* what() const noexcept override { return "job cancelled"; }
+};
+
+// 今のスレッドで実行中のジョブが取り消されていれば JobCancelled を投げる
+// ジョブの外 (トークンが無いスレッド) から呼ばれた場合は何もしない
+// cv::parallel_for_ の中では投げないこと (例外がスレッドをまたげない)
+void checkCancelled();
+
+// このスレッドで checkCancelled() が見るトークンを設定する
+class ScopedCancelToken {
+    public:
+        explicit ScopedCancelToken(const CancelToken& token);
+        ~ScopedCancelToken();
+        ScopedCancelToken(const ScopedCancelToken&) = delete;
+        ScopedCancelToken& operator=(const ScopedCancelToken&) = delete;
+    private:
+        CancelToken token;
+        const CancelToken* previous;
+};
+
+class LatestJobRunner {
+    public:
+        // 実行中のジョブを取り消してから、work を別スレッドで始める
+        // work には自分のトークンが渡されるので、結果を反映する直前に isCancelled() を確認すること
+        // (確認と反映は、start/cancel を呼ぶ側と同じmutexの中で行う)
+        void start(std::function<void(const CancelToken&)> work);
+        void cancel();
+    private:
+        CancelToken current;
+        std::mutex mtx;
+};
@@ -0,0 +1,434 @@
+// lppe_lppb: LPPB 形式 (ev3/printer/lppb.h) のパスファイルを EV3 と同じ読み込み (lppb.c) で読む
+// usage: lppe_lppb <file.lppb> [--text out.txt] [--compare path.txt] [--bench N] [--stream] [--plan]
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+
+#include "lppb.h"
+#include "path_stream.h"
+#include "planner.h"
+
+namespace fs = std::filesystem;
+
+#define MAX_POLYLINE_POINTS (1 << 20)
+
+struct DecodedPath {
+    int color = 0;
+    std::vector<float> xs, ys; // mm
+};
+
+struct DecodedFile {
+    std::vector<std::string> color_names;
+    std::vector<DecodedPath> paths;
+};
+
+static void printUsage() {
+    std::cerr << "usage: lppe_lppb <file.lppb> [--text out.txt] [--compare path.txt] [--bench N] [--stream] [--plan]" << std::endl;
+    std::cerr << "  --text     decode to the optimized_path.txt format" << std::endl;
+    std::cerr << "  --compare  check that a text path file has the same points (within 0.01mm)" << std::endl;
+    std::cerr << "  --bench    time parsing the .lppb and the --compare text file N times each" << std::endl;
+    std::cerr << "  --stream   read both files again through the EV3 ring buffer (path_stream.c) on a loader thread" << std::endl;
+    std::cerr << "  --plan     run the EV3 motion planner (planner.c) over every stroke and check its speed limits" << std::endl;
+}
+
+// reader は大きいので static (EV3 と同じ使い方)
+static lppb_reader_t reader;
+static int32_t x_units[MAX_POLYLINE_POINTS];
+static int32_t y_units[MAX_POLYLINE_POINTS];
+
+static bool readLppb(const std::string& filename, DecodedFile* out, size_t& points) {
+    points = 0;
+    if(lppb_open(&reader, filename.c_str()) != 0){
+        std::cerr << "Failed to open LPPB file: " << filename << std::endl;
+        return false;
+    }
+    if(out){
+        for(int i = 0; i < reader.header.color_n; ++i) {
+            out->color_names.push_back(reader.header.color_names[i]);
+        }
+    }
+    for(int color = 0; color < reader.header.color_n; ++color) {
+        int n = 0;
+        int result;
+        while((result = lppb_read_path(&reader, x_units, y_units, MAX_POLYLINE_POINTS, &n)) == 1) {
+            points += n;
+            if(!out) continue;
+            DecodedPath path;
+            path.color = color;
+            path.xs.resize(n);
+            path.ys.resize(n);
+            for(int i = 0; i < n; ++i) {
+                path.xs[i] = x_units[i] * (1.0f / LPPB_UNITS_PER_MM);
+                path.ys[i] = y_units[i] * (1.0f / LPPB_UNITS_PER_MM);
+            }
+            out->paths.push_back(std::move(path));
+        }
+        if(result < 0){
+            std::cerr << "Broken LPPB file: " << filename << " (color " << color << ")" << std::endl;
+            lppb_close(&reader);
+            return false;
+        }
+    }
+    lppb_close(&reader);
+    return true;
+}
+
+// EV3 の print_file と同じく fgets + sscanf で読む
+static bool readText(const std::string& filename, DecodedFile* out, size_t& points) {
+    points = 0;
+    FILE* fp = std::fopen(filename.c_str(), "r");
+    if(fp == NULL){
+        std::cerr << "Failed to open text file: " << filename << std::endl;
+        return false;
+    }
+    char str[128];
+    int color_n = 0;
+    if(std::fscanf(fp, "%d\n", &color_n) != 1 || color_n < 1 || color_n > LPPB_MAX_COLOR){
+        std::fclose(fp);
+        std::cerr << "Invalid color count in " << filename << std::endl;
+        return false;
+    }
+    for(int i = 0; i < color_n; ++i) {
+        if(!std::fgets(str, sizeof(str), fp)){
+            std::fclose(fp);
+            return false;
+        }
+        str[std::strcspn(str, "\n")] = '\0';
+        if(out) out->color_names.push_back(str);
+    }
+    for(int color = 0; color < color_n; ++color) {
+        bool next_color = false;
+        while(!next_color) {
+            DecodedPath path;
+            path.color = color;
+            while(true) {
+                if(!std::fgets(str, sizeof(str), fp)){
+                    std::fclose(fp);
+                    std::cerr << "Unexpected end of " << filename << std::endl;
+                    return false;
+                }
+                if(std::strcmp(str, "n\n") == 0) break;
+                if(std::strcmp(str, "e\n") == 0){
+                    next_color = true;
+                    break;
+                }
+                float x, y;
+                if(std::sscanf(str, "%f %f", &x, &y) != 2){
+                    std::fclose(fp);
+                    std::cerr << "Invalid point data: " << str << std::endl;
+                    return false;
+                }
+                ++points;
+                if(out){
+                    path.xs.push_back(x);
+                    path.ys.push_back(y);
+                }
+            }
+            if(out) out->paths.push_back(std::move(path));
+        }
+    }
+    std::fclose(fp);
+    return true;
+}
+
+#define STREAM_TEST_CAPACITY (64) // 小さくして、何度も一周させる
+
+static void streamWait() {
+    std::this_thread::yield();
+}
+
+// EV3 の loader_task と draw_stream_polyline と同じ使い方で stream から読む
+static bool readStream(const std::string& filename, bool lppb, DecodedFile& out) {
+    static path_cmd_t cmds[STREAM_TEST_CAPACITY];
+    path_stream_t stream;
+    path_stream_init(&stream, cmds, STREAM_TEST_CAPACITY, streamWait);
+
+    int color_n = 0;
+    FILE* fp = nullptr;
+    if(lppb){
+        if(lppb_open(&reader, filename.c_str()) != 0){
+            std::cerr << "Failed to open LPPB file: " << filename << std::endl;
+            return false;
+        }
+        color_n = reader.header.color_n;
+        for(int i = 0; i < color_n; ++i) {
+            out.color_names.push_back(reader.header.color_names[i]);
+        }
+    }else{
+        fp = std::fopen(filename.c_str(), "r");
+        char str[128];
+        if(fp == NULL || std::fscanf(fp, "%d\n", &color_n) != 1){
+            if(fp) std::fclose(fp);
+            std::cerr << "Failed to open text file: " << filename << std::endl;
+            return false;
+        }
+        for(int i = 0; i < color_n; ++i) {
+            if(!std::fgets(str, sizeof(str), fp)) break;
+            str[std::strcspn(str, "\n")] = '\0';
+            out.color_names.push_back(str);
+        }
+    }
+    std::thread loader([&]() {
+        if(lppb){
+            path_stream_load_lppb(&stream, &reader);
+        }else{
+            path_stream_load_text(&stream, fp, color_n);
+        }
+    });
+
+    bool ok = true;
+    int color = 0;
+    DecodedPath path;
+    while(ok) {
+        path_cmd_t cmd;
+        path_stream_peek(&stream, &cmd);
+        path_stream_pop(&stream);
+        if(cmd.type == PATH_CMD_POINT){
+            path.xs.push_back(cmd.x * (1.0f / LPPB_UNITS_PER_MM));
+            path.ys.push_back(cmd.y * (1.0f / LPPB_UNITS_PER_MM));
+        }else if(cmd.type == PATH_CMD_PATH_END){
+            path.color = color;
+            out.paths.push_back(std::move(path));
+            path = DecodedPath();
+        }else if(cmd.type == PATH_CMD_COLOR_END){
+            ++color;
+        }else{
+            ok = cmd.type == PATH_CMD_FILE_END && color == color_n;
+            break;
+        }
+    }
+    path_stream_cancel(&stream);
+    loader.join();
+    if(!ok){
+        std::cerr << "Stream ended with an error: " << filename << std::endl;
+    }
+    return ok;
+}
+
+#define PLAN_TICK_MS (4) // EV3 の timer_once
+
+// EV3 と同じく4msごとに目標位置を出して、軸ごとの速さが上限を超えないか・最後の点に着くかを調べる
+static bool checkPlan(const DecodedFile& file) {
+    planner_limits_t limits;
+    planner_default_limits(&limits);
+    const float dt = PLAN_TICK_MS * 0.001f;
+    double planned_s = 0, constant_s = 0, max_ratio = 0;
+    size_t segments = 0;
+    planner_t planner;
+    for(const auto& path : file.paths) {
+        if(path.xs.size() < 2) continue;
+        planner_init(&planner, &limits, path.xs[0], path.ys[0]);
+        size_t next = 1;
+        float px = path.xs[0], py = path.ys[0], x, y;
+        while(true) {
+            while(next < path.xs.size() && !planner_is_full(&planner)) {
+                planner_add_point(&planner, path.xs[next], path.ys[next]);
+                ++next;
+            }
+            const bool moving = planner_step(&planner, dt, &x, &y) == 1;
+            planned_s += dt;
+            // 1tick の間の平均の速さ (最高速度に対する比)
+            max_ratio = (std::max)(max_ratio, static_cast<double>(std::fabs(x - px) / dt / limits.max_speed_x));
+            max_ratio = (std::max)(max_ratio, static_cast<double>(std::fabs(y - py) / dt / limits.max_speed_y));
+            px = x;
+            py = y;
+            if(!moving && next >= path.xs.size()) break;
+        }
+        if(std::fabs(x - path.xs.back()) > 1e-3f || std::fabs(y - path.ys.back()) > 1e-3f){
+            std::cerr << "Planner did not reach the end of a stroke." << std::endl;
+            return false;
+        }
+        // 前の動き: 線分ごとに line_time を timer_once で割った回数だけ進む (鋭角で待つ時間は含まない)
+        for(size_t i = 1; i < path.xs.size(); ++i) {
+            const int line_time = static_cast<int>((std::max)(std::fabs(path.xs[i] - path.xs[i - 1]) * 1.0f,
+                std::fabs(path.ys[i] - path.ys[i - 1]) * 0.4f) / 10.0f * 1000.0f);
+            constant_s += (line_time / PLAN_TICK_MS + 1) * PLAN_TICK_MS * 0.001;
+            ++segments;
+        }
+    }
+    std::cout << std::setprecision(1) << "planned pen-down time: " << planned_s << " s (constant-speed segments: "
+        << constant_s << " s without corner settling, " << segments << " segments)" << std::endl;
+    std::cout << std::setprecision(3) << "max axis speed / limit: " << max_ratio << std::endl;
+    if(max_ratio > 1.01){
+        std::cerr << "Planner exceeded an axis speed limit." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool writeText(const std::string& filename, const DecodedFile& file) {
+    std::ofstream ofs(filename);
+    if(!ofs){
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+    ofs << file.color_names.size() << '\n';
+    for(const auto& name : file.color_names) {
+        ofs << name << '\n';
+    }
+    for(int color = 0; color < static_cast<int>(file.color_names.size()); ++color) {
+        bool first = true;
+        for(const auto& path : file.paths) {
+            if(path.color != color) continue;
+            if(!first) ofs << "n\n";
+            first = false;
+            for(size_t i = 0; i < path.xs.size(); ++i) {
+                ofs << path.xs[i] << ' ' << path.ys[i] << '\n';
+            }
+        }
+        ofs << "e\n";
+    }
+    return static_cast<bool>(ofs);
+}
+
+static bool compareFiles(const DecodedFile& a, const DecodedFile& b) {
+    if(a.color_names != b.color_names){
+        std::cerr << "Color names differ." << std::endl;
+        return false;
+    }
+    if(a.paths.size() != b.paths.size()){
+        std::cerr << "Path count differs: " << a.paths.size() << " vs " << b.paths.size() << std::endl;
+        return false;
+    }
+    // 0.01mm に丸めた誤差 + テキストの桁落ち
+    const float tolerance = 0.5f / LPPB_UNITS_PER_MM + 1e-3f;
+    for(size_t i = 0; i < a.paths.size(); ++i) {
+        const auto& p = a.paths[i];
+        const auto& q = b.paths[i];
+        if(p.color != q.color || p.xs.size() != q.xs.size()){
+            std::cerr << "Path " << i << " differs in color or point count." << std::endl;
+            return false;
+        }
+        for(size_t k = 0; k < p.xs.size(); ++k) {
+            if(std::fabs(p.xs[k] - q.xs[k]) > tolerance || std::fabs(p.ys[k] - q.ys[k]) > tolerance){
+                std::cerr << "Path " << i << " point " << k << " differs: (" << p.xs[k] << ", " << p.ys[k]
+                    << ") vs (" << q.xs[k] << ", " << q.ys[k] << ")" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename F>
+static double medianMs(int repeat, F&& run) {
+    std::vector<double> times;
+    for(int i = 0; i < repeat; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2){
+        printUsage();
+        return 1;
+    }
+    const std::string input = argv[1];
+    std::string text_path, compare_path;
+    int bench = 0;
+    bool stream = false;
+    bool plan = false;
+    for(int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if(arg == "--text" && i + 1 < argc){
+            text_path = argv[++i];
+        }else if(arg == "--compare" && i + 1 < argc){
+            compare_path = argv[++i];
+        }else if(arg == "--bench" && i + 1 < argc){
+            bench = std::atoi(argv[++i]);
+        }else if(arg == "--stream"){
+            stream = true;
+        }else if(arg == "--plan"){
+            plan = true;
+        }else{
+            printUsage();
+            return 1;
+        }
+    }
+
+    DecodedFile decoded;
+    size_t points = 0;
+    if(!readLppb(input, &decoded, points)){
+        return 1;
+    }
+    const lppb_header_t& header = reader.header;
+    std::cout << input << ": version " << header.version << ", " << header.color_n << " colors, "
+        << header.path_n << " paths, " << header.point_n << " points, " << fs::file_size(input) << " bytes" << std::endl;
+    std::cout << std::fixed << std::setprecision(2) << "bounds: (" << header.min_x * 0.01 << ", " << header.min_y * 0.01
+        << ") - (" << header.max_x * 0.01 << ", " << header.max_y * 0.01 << ") mm" << std::endl;
+    for(int i = 0; i < header.color_n; ++i) {
+        std::cout << "  " << header.color_names[i] << ": " << header.color_path_n[i] << " paths" << std::endl;
+    }
+    if(points != header.point_n || decoded.paths.size() != header.path_n){
+        std::cerr << "Header counts do not match the data." << std::endl;
+        return 1;
+    }
+
+    if(!text_path.empty()){
+        if(!writeText(text_path, decoded)){
+            return 1;
+        }
+        std::cout << "Decoded to " << text_path << std::endl;
+    }
+
+    if(!compare_path.empty()){
+        DecodedFile text;
+        size_t text_points = 0;
+        if(!readText(compare_path, &text, text_points) || !compareFiles(decoded, text)){
+            std::cerr << "MISMATCH: " << compare_path << std::endl;
+            return 1;
+        }
+        std::cout << "Same paths as " << compare_path << " (" << fs::file_size(compare_path) << " bytes, "
+            << std::setprecision(1) << static_cast<double>(fs::file_size(compare_path)) / fs::file_size(input) << "x larger)" << std::endl;
+    }
+
+    if(stream){
+        DecodedFile streamed;
+        if(!readStream(input, true, streamed) || !compareFiles(decoded, streamed)){
+            std::cerr << "MISMATCH: streamed " << input << std::endl;
+            return 1;
+        }
+        std::cout << "Streamed " << input << ": same paths" << std::endl;
+        if(!compare_path.empty()){
+            // テキストは stream の中で 0.01mm に丸めるので、テキストをそのまま読んだものと比べる
+            DecodedFile text, streamed_text;
+            size_t text_points = 0;
+            if(!readText(compare_path, &text, text_points) ||
+               !readStream(compare_path, false, streamed_text) || !compareFiles(text, streamed_text)){
+                std::cerr << "MISMATCH: streamed " << compare_path << std::endl;
+                return 1;
+            }
+            std::cout << "Streamed " << compare_path << ": same paths" << std::endl;
+        }
+    }
+
+    if(plan && !checkPlan(decoded)){
+        return 1;
+    }
+
+    if(bench > 0){
+        size_t n = 0;
+        const double lppb_ms = medianMs(bench, [&]() { readLppb(input, nullptr, n); });
+        std::cout << std::setprecision(3) << "parse lppb: " << lppb_ms << " ms" << std::endl;
+        if(!compare_path.empty()){
+            const double text_ms = medianMs(bench, [&]() { readText(compare_path, nullptr, n); });
+            std::cout << "parse text: " << text_ms << " ms (" << std::setprecision(1) << text_ms / lppb_ms << "x slower)" << std::endl;
+        }
+    }
+    return 0;
+}
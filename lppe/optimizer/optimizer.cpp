@@ -5,6 +5,23 @@
 #include <cmath>
 #include <algorithm>
 
+#include "job/job.hpp"
+#include "trace/trace.hpp"
+
+static void traceInputCounts(ScopedTrace& trace, const unoptimized_path& input) {
+    size_t lines = 0, points = 0;
+    for(const auto* group : {&input.polylines, &input.contours}) {
+        for(const auto& [color_id, paths] : *group) {
+            lines += paths.size();
+            for(const auto& path : paths) {
+                points += path.size();
+            }
+        }
+    }
+    trace.count("polylines", static_cast<double>(lines));
+    trace.count("points", static_cast<double>(points));
+}
+
 // テストのために、そのままコピーするだけ
 static void no_optimize(const unoptimized_path& input, draw_path& output) {
     output.paths.clear();
@@ -98,6 +115,7 @@ static void greedy_optimize(const unoptimized_path& input, draw_path& output) {
         int paths_remaining = all_elements_for_color.size();
 
         while (paths_remaining > 0) {
+            checkCancelled();
             float min_dist_sq = -1.0f;
             int best_path_index = -1;
             bool reverse_best_path = false; // 最適なパスを反転させるかどうか
@@ -214,6 +232,7 @@ static void beam_search_optimize_fast(const unoptimized_path& input,
         std::vector<BeamNode> beam = {initial};
 
         for (size_t step = 1; step < candidates.size(); ++step) {
+            checkCancelled();
             std::vector<BeamNode> next_beam;
 
             for (const auto& node : beam) {
@@ -236,8 +255,12 @@ static void beam_search_optimize_fast(const unoptimized_path& input,
                 }
 
                 // top_k に制限
+                // 距離が同じときは候補の番号順 (実行ごとに結果が変わらないように)
                 std::sort(dists.begin(), dists.end(),
-                          [](const CandidateInfo& a, const CandidateInfo& b){ return a.dist < b.dist; });
+                          [](const CandidateInfo& a, const CandidateInfo& b){
+                              if (a.dist != b.dist) return a.dist < b.dist;
+                              return a.idx < b.idx;
+                          });
                 int expand_limit = std::min((int)dists.size(), top_k);
 
                 for (int j = 0; j < expand_limit; ++j) {
@@ -255,7 +278,7 @@ static void beam_search_optimize_fast(const unoptimized_path& input,
             }
 
             // ビーム幅制限
-            std::sort(next_beam.begin(), next_beam.end(),
+            std::stable_sort(next_beam.begin(), next_beam.end(),
                       [](const BeamNode& a, const BeamNode& b){ return a.total_length < b.total_length; });
             if ((int)next_beam.size() > beam_width) next_beam.resize(beam_width);
             beam = std::move(next_beam);
@@ -311,6 +334,7 @@ static void greedy_optimize_free_start(const unoptimized_path& input,
 
         // 最初の線を全候補から選択
         for (size_t start_idx = 0; start_idx < candidates.size(); ++start_idx) {
+            checkCancelled();
             std::vector<bool> used(candidates.size(), false);
             std::vector<std::vector<point>> seq;
             seq.push_back(candidates[start_idx]);
@@ -395,6 +419,7 @@ static void greedy_optimize_nlookahead(const unoptimized_path& input,
 
         // 各候補を最初の線として試す
         for (size_t start_idx = 0; start_idx < candidates.size(); ++start_idx) {
+            checkCancelled();
             std::vector<bool> used(candidates.size(), false);
             std::vector<std::vector<point>> seq;
             seq.push_back(candidates[start_idx]);
@@ -444,6 +469,7 @@ static void greedy_optimize_nlookahead(const unoptimized_path& input,
         point current_end = best_seq.front().back();
 
         while (true) {
+            checkCancelled();
             float min_dist = std::numeric_limits<float>::max();
             size_t next_idx = candidates.size();
             bool reverse_flag = false;
@@ -474,6 +500,8 @@ static void greedy_optimize_nlookahead(const unoptimized_path& input,
 }
 
 void Optimizer::optimize_greedy(const unoptimized_path& input, draw_path& output) const{
+    ScopedTrace trace("optimize/greedy");
+    traceInputCounts(trace, input);
     //greedy_optimize(input, output);
     //no_optimize(input, output);
     //beam_search_optimize_fast(input, output, 12, 8);
@@ -482,5 +510,7 @@ void Optimizer::optimize_greedy(const unoptimized_path& input, draw_path& output
 }
 
 void Optimizer::optimize_beam_search(const unoptimized_path& input, draw_path& output) const{
+    ScopedTrace trace("optimize/beam");
+    traceInputCounts(trace, input);
     beam_search_optimize_fast(input, output, 12, 8);
 }
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+/*
+JSON
+trace (Chrome trace_event) と lppe_bench の結果の書き出しで使う
+一番下の trace_module に置いて、どのモジュールからも使えるようにする
+*/
+
+// JSON の文字列の中身 (前後の " は付けない)
+std::string jsonEscape(const std::string& str);
@@ -0,0 +1,150 @@
+#include "trace.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "json.hpp"
+
+#define TRACE_MAX_EVENTS (200000)
+
+TraceRecorder::TraceRecorder() : origin(std::chrono::steady_clock::now()) {}
+
+void TraceRecorder::setEnabled(bool value) {
+    std::lock_guard<std::mutex> lock(mtx);
+    enabled = value;
+}
+
+bool TraceRecorder::isEnabled() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return enabled;
+}
+
+int64_t TraceRecorder::nowMicros() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+uint32_t TraceRecorder::currentThread() {
+    static std::atomic<uint32_t> next_thread{1};
+    thread_local uint32_t thread = next_thread.fetch_add(1);
+    return thread;
+}
+
+void TraceRecorder::record(TraceEvent&& event) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!enabled) return;
+
+    TraceStageStats& s = stats[event.name];
+    if (s.calls == 0) s.name = event.name;
+    const double ms = event.duration_us / 1000.0;
+    s.calls++;
+    s.total_ms += ms;
+    s.last_ms = ms;
+    s.max_ms = (std::max)(s.max_ms, ms);
+    s.last_counters.clear();
+    for (int i = 0; i < event.counter_count; ++i) {
+        s.last_counters[event.counters[i].key] = event.counters[i].value;
+    }
+
+    if (events.size() >= TRACE_MAX_EVENTS) {
+        events.erase(events.begin(), events.begin() + events.size() / 2);
+    }
+    events.push_back(std::move(event));
+}
+
+void TraceRecorder::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    events.clear();
+    stats.clear();
+}
+
+std::vector<TraceStageStats> TraceRecorder::getStageStats() const {
+    std::vector<TraceStageStats> result;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        result.reserve(stats.size());
+        for (const auto& [name, s] : stats) {
+            result.push_back(s);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const TraceStageStats& a, const TraceStageStats& b) {
+        return a.total_ms > b.total_ms;
+    });
+    return result;
+}
+
+size_t TraceRecorder::getEventCount() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return events.size();
+}
+
+static void writeJsonString(std::ofstream& ofs, const std::string& str) {
+    ofs << '"' << jsonEscape(str) << '"';
+}
+
+// Chrome trace_event 形式 (完了イベント "ph":"X" の列)
+bool TraceRecorder::writeChromeTrace(const std::string& filename) const {
+    std::vector<TraceEvent> copy;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        copy = events;
+    }
+    std::ofstream ofs(filename);
+    if (!ofs) {
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (size_t i = 0; i < copy.size(); ++i) {
+        const TraceEvent& e = copy[i];
+        ofs << "{\"name\":";
+        writeJsonString(ofs, e.name);
+        ofs << ",\"cat\":\"lppe\",\"ph\":\"X\",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us
+            << ",\"pid\":1,\"tid\":" << e.thread;
+        if (e.counter_count > 0) {
+            ofs << ",\"args\":{";
+            for (int c = 0; c < e.counter_count; ++c) {
+                if (c > 0) ofs << ",";
+                writeJsonString(ofs, e.counters[c].key);
+                ofs << ":" << e.counters[c].value;
+            }
+            ofs << "}";
+        }
+        ofs << "}" << (i + 1 < copy.size() ? "," : "") << "\n";
+    }
+    ofs << "]}\n";
+    if (!ofs.good()) {
+        std::cerr << "Failed to write trace: " << filename << std::endl;
+        return false;
+    }
+    std::cout << "Trace written to " << filename << " (" << copy.size() << " events)" << std::endl;
+    return true;
+}
+
+ScopedTrace::ScopedTrace(std::string name) : active(TraceRecorder::instance().isEnabled()) {
+    if (!active) return;
+    event.name = std::move(name);
+    event.thread = TraceRecorder::currentThread();
+    event.start_us = TraceRecorder::instance().nowMicros();
+}
+
+ScopedTrace::~ScopedTrace() {
+    if (!active) return;
+    event.duration_us = TraceRecorder::instance().nowMicros() - event.start_us;
+    TraceRecorder::instance().record(std::move(event));
+}
+
+void ScopedTrace::count(const char* key, double value) {
+    if (!active) return;
+    for (int i = 0; i < event.counter_count; ++i) {
+        if (std::strcmp(event.counters[i].key, key) == 0) {
+            event.counters[i].value = value;
+            return;
+        }
+    }
+    if (event.counter_count < TRACE_MAX_COUNTERS) {
+        event.counters[event.counter_count++] = {key, value};
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/*
+Trace
+各段の処理時間と処理量 (画素数・線の数・点の数) を記録する
+
+    void NWGThinningLUTParallel(...) {
+        ScopedTrace trace("thinning");
+        trace.count("pixels", src.total());
+        ...
+    }
+
+スコープを抜けたときに TraceRecorder に1件記録される
+段ごとの集計 (GUIのProfileパネル用) と、Chrome の trace_event 形式での書き出しができる
+(chrome://tracing や https://ui.perfetto.dev で開ける)
+*/
+
+#define TRACE_MAX_COUNTERS (4)
+
+struct TraceCounter {
+    const char* key = nullptr; // 文字列リテラルのみ
+    double value = 0;
+};
+
+struct TraceEvent {
+    std::string name;
+    int64_t start_us = 0; // TraceRecorder を作った時刻から
+    int64_t duration_us = 0;
+    uint32_t thread = 0;  // 記録した順に振ったスレッド番号
+    TraceCounter counters[TRACE_MAX_COUNTERS];
+    int counter_count = 0;
+};
+
+// 段ごとの集計
+struct TraceStageStats {
+    std::string name;
+    size_t calls = 0;
+    double total_ms = 0;
+    double last_ms = 0;
+    double max_ms = 0;
+    std::map<std::string, double> last_counters; // 最後の呼び出しの処理量
+};
+
+class TraceRecorder {
+    public:
+        static TraceRecorder& instance() {
+            static TraceRecorder recorder;
+            return recorder;
+        }
+
+        void setEnabled(bool enabled);
+        bool isEnabled() const;
+        void record(TraceEvent&& event);
+        void clear();
+        std::vector<TraceStageStats> getStageStats() const; // 合計時間の長い順
+        size_t getEventCount() const;
+        bool writeChromeTrace(const std::string& filename) const;
+
+        int64_t nowMicros() const;
+        static uint32_t currentThread();
+
+    private:
+        TraceRecorder();
+        bool enabled = true;
+        std::chrono::steady_clock::time_point origin;
+        std::vector<TraceEvent> events; // 上限を超えたら古い半分を捨てる
+        std::map<std::string, TraceStageStats> stats;
+        mutable std::mutex mtx;
+};
+
+class ScopedTrace {
+    public:
+        explicit ScopedTrace(std::string name);
+        ~ScopedTrace();
+        ScopedTrace(const ScopedTrace&) = delete;
+        ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+        // key は文字列リテラルにすること。同じ key は上書きする
+        void count(const char* key, double value);
+
+    private:
+        bool active;
+        TraceEvent event;
+};